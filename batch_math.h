@@ -0,0 +1,539 @@
+// HARFANG(R) Copyright (C) 2022 NWNC HARFANG. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+#pragma once
+
+// Batch math kernels operating on arrays of hg::Mat4, hg::Vec3, hg::Quaternion and hg::MinMax: transform points by a
+// matrix, multiply matrix pairs, compose TRS into matrices and test bounding boxes against a frustum. Each kernel has a
+// scalar fallback, a 4 wide SSE2 or NEON implementation and an 8 wide AVX2 implementation, GetBatchMath() returns the
+// best one supported by the CPU.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <immintrin.h>
+#define BATCH_MATH_SSE2 1
+#define BATCH_MATH_AVX2 1
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define BATCH_MATH_TARGET_AVX2
+#else
+#define BATCH_MATH_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#endif
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define BATCH_MATH_NEON 1
+#endif
+
+#include <foundation/frustum.h>
+#include <foundation/math.h>
+#include <foundation/matrix3.h>
+#include <foundation/matrix4.h>
+#include <foundation/minmax.h>
+#include <foundation/quaternion.h>
+#include <foundation/vector3.h>
+
+// kernels access the hg types as packed floats, matrices are 3 rows of 4 floats with the translation in the last column
+static_assert(sizeof(hg::Vec3) == 3 * sizeof(float), "hg::Vec3 must be 3 packed floats");
+static_assert(sizeof(hg::Quaternion) == 4 * sizeof(float), "hg::Quaternion must be 4 packed floats");
+static_assert(sizeof(hg::Mat4) == 12 * sizeof(float), "hg::Mat4 must be 3x4 packed floats");
+static_assert(sizeof(hg::MinMax) == 2 * sizeof(hg::Vec3), "hg::MinMax must be 2 packed hg::Vec3");
+
+// Batch math API, output arrays may alias an input array element for element.
+struct BatchMath {
+	// out[i] = m * in[i]
+	void (*transform_points)(const hg::Mat4 &m, const hg::Vec3 *in, hg::Vec3 *out, size_t count);
+	// out[i] = a[i] * b[i]
+	void (*mul_mat4)(const hg::Mat4 *a, const hg::Mat4 *b, hg::Mat4 *out, size_t count);
+	// out[i] = TransformationMat4(pos[i], ToMatrix3(rot[i]), scale[i])
+	void (*compose_trs)(const hg::Vec3 *pos, const hg::Quaternion *rot, const hg::Vec3 *scale, hg::Mat4 *out, size_t count);
+	// visible[i] = TestVisibility(frustum, aabb[i]) != V_Outside
+	void (*test_aabbs)(const hg::Frustum &frustum, const hg::MinMax *aabb, uint8_t *visible, size_t count);
+};
+
+//
+inline void TransformPoint(const hg::Mat4 &m, const hg::Vec3 &p, hg::Vec3 &out) {
+	const float x = p.x, y = p.y, z = p.z;
+	out.x = m.m[0][0] * x + m.m[0][1] * y + m.m[0][2] * z + m.m[0][3];
+	out.y = m.m[1][0] * x + m.m[1][1] * y + m.m[1][2] * z + m.m[1][3];
+	out.z = m.m[2][0] * x + m.m[2][1] * y + m.m[2][2] * z + m.m[2][3];
+}
+
+inline void MulMat4(const hg::Mat4 &a, const hg::Mat4 &b, hg::Mat4 &out) {
+	float r[3][4];
+	for (int i = 0; i < 3; ++i) {
+		for (int j = 0; j < 4; ++j)
+			r[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] + a.m[i][2] * b.m[2][j];
+		r[i][3] += a.m[i][3];
+	}
+	memcpy(out.m, r, sizeof(r));
+}
+
+inline void ComposeTRS(const hg::Vec3 &p, const hg::Quaternion &q, const hg::Vec3 &s, hg::Mat4 &out) {
+	const float x2 = q.x + q.x, y2 = q.y + q.y, z2 = q.z + q.z;
+	const float xx = q.x * x2, yy = q.y * y2, zz = q.z * z2, xy = q.x * y2, xz = q.x * z2, yz = q.y * z2, wx = q.w * x2, wy = q.w * y2, wz = q.w * z2;
+
+	out.m[0][0] = (1.f - (yy + zz)) * s.x, out.m[0][1] = (xy - wz) * s.y, out.m[0][2] = (xz + wy) * s.z, out.m[0][3] = p.x;
+	out.m[1][0] = (xy + wz) * s.x, out.m[1][1] = (1.f - (xx + zz)) * s.y, out.m[1][2] = (yz - wx) * s.z, out.m[1][3] = p.y;
+	out.m[2][0] = (xz - wy) * s.x, out.m[2][1] = (yz + wx) * s.y, out.m[2][2] = (1.f - (xx + yy)) * s.z, out.m[2][3] = p.z;
+}
+
+// Frustum planes point outward, a box is outside when its center is further than its projected extent from any plane.
+inline bool IsAABBVisible(const hg::Frustum &frustum, const hg::MinMax &aabb) {
+	const float cx = (aabb.mn.x + aabb.mx.x) * 0.5f, cy = (aabb.mn.y + aabb.mx.y) * 0.5f, cz = (aabb.mn.z + aabb.mx.z) * 0.5f;
+	const float ex = (aabb.mx.x - aabb.mn.x) * 0.5f, ey = (aabb.mx.y - aabb.mn.y) * 0.5f, ez = (aabb.mx.z - aabb.mn.z) * 0.5f;
+
+	for (const auto &plane : frustum)
+		if (plane.x * cx + plane.y * cy + plane.z * cz + plane.w > std::abs(plane.x) * ex + std::abs(plane.y) * ey + std::abs(plane.z) * ez)
+			return false;
+	return true;
+}
+
+// Scalar fallback.
+inline void TransformPointsScalar(const hg::Mat4 &m, const hg::Vec3 *in, hg::Vec3 *out, size_t count) {
+	for (size_t i = 0; i < count; ++i)
+		TransformPoint(m, in[i], out[i]);
+}
+
+inline void MulMat4Scalar(const hg::Mat4 *a, const hg::Mat4 *b, hg::Mat4 *out, size_t count) {
+	for (size_t i = 0; i < count; ++i)
+		MulMat4(a[i], b[i], out[i]);
+}
+
+inline void ComposeTRSScalar(const hg::Vec3 *pos, const hg::Quaternion *rot, const hg::Vec3 *scale, hg::Mat4 *out, size_t count) {
+	for (size_t i = 0; i < count; ++i)
+		ComposeTRS(pos[i], rot[i], scale[i], out[i]);
+}
+
+inline void TestAABBsScalar(const hg::Frustum &frustum, const hg::MinMax *aabb, uint8_t *visible, size_t count) {
+	for (size_t i = 0; i < count; ++i)
+		visible[i] = IsAABBVisible(frustum, aabb[i]) ? 1 : 0;
+}
+
+// 4 wide primitives.
+#if BATCH_MATH_SSE2
+using F4 = __m128;
+
+inline F4 F4Set1(float v) { return _mm_set1_ps(v); }
+inline F4 F4Set(float x, float y, float z, float w) { return _mm_set_ps(w, z, y, x); }
+inline F4 F4Load(const float *p) { return _mm_loadu_ps(p); }
+inline void F4Store(float *p, F4 v) { _mm_storeu_ps(p, v); }
+inline F4 F4Add(F4 a, F4 b) { return _mm_add_ps(a, b); }
+inline F4 F4Sub(F4 a, F4 b) { return _mm_sub_ps(a, b); }
+inline F4 F4Mul(F4 a, F4 b) { return _mm_mul_ps(a, b); }
+inline F4 F4MulAdd(F4 a, F4 b, F4 c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+inline int F4MaskGt(F4 a, F4 b) { return _mm_movemask_ps(_mm_cmpgt_ps(a, b)); }
+
+template <int i> inline F4 F4Splat(F4 v) { return _mm_shuffle_ps(v, v, _MM_SHUFFLE(i, i, i, i)); }
+
+inline void F4Transpose(F4 &a, F4 &b, F4 &c, F4 &d) { _MM_TRANSPOSE4_PS(a, b, c, d); }
+
+inline void F4Unzip(F4 a, F4 b, F4 &even, F4 &odd) {
+	even = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+	odd = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+}
+
+// 4 packed Vec3 (x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3) to and from x, y and z vectors.
+inline void F4Load3(const float *p, F4 &x, F4 &y, F4 &z) {
+	const F4 a = _mm_loadu_ps(p), b = _mm_loadu_ps(p + 4), c = _mm_loadu_ps(p + 8);
+	x = _mm_shuffle_ps(a, _mm_shuffle_ps(b, c, _MM_SHUFFLE(1, 0, 3, 2)), _MM_SHUFFLE(3, 0, 3, 0));
+	y = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+	z = _mm_shuffle_ps(_mm_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+inline void F4Store3(float *p, F4 x, F4 y, F4 z) {
+	_mm_storeu_ps(p, _mm_shuffle_ps(_mm_shuffle_ps(x, y, _MM_SHUFFLE(1, 0, 1, 0)), _mm_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0)));
+	_mm_storeu_ps(p + 4, _mm_shuffle_ps(_mm_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1)), _mm_shuffle_ps(x, y, _MM_SHUFFLE(2, 2, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0)));
+	_mm_storeu_ps(p + 8, _mm_shuffle_ps(_mm_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2)), _mm_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0)));
+}
+#elif BATCH_MATH_NEON
+using F4 = float32x4_t;
+
+inline F4 F4Set1(float v) { return vdupq_n_f32(v); }
+inline F4 F4Set(float x, float y, float z, float w) {
+	const float v[4] = {x, y, z, w};
+	return vld1q_f32(v);
+}
+inline F4 F4Load(const float *p) { return vld1q_f32(p); }
+inline void F4Store(float *p, F4 v) { vst1q_f32(p, v); }
+inline F4 F4Add(F4 a, F4 b) { return vaddq_f32(a, b); }
+inline F4 F4Sub(F4 a, F4 b) { return vsubq_f32(a, b); }
+inline F4 F4Mul(F4 a, F4 b) { return vmulq_f32(a, b); }
+inline F4 F4MulAdd(F4 a, F4 b, F4 c) { return vmlaq_f32(c, a, b); }
+inline int F4MaskGt(F4 a, F4 b) {
+	static const uint32_t bits[4] = {1, 2, 4, 8};
+	const uint32x4_t m = vandq_u32(vcgtq_f32(a, b), vld1q_u32(bits));
+	return int(vgetq_lane_u32(m, 0) | vgetq_lane_u32(m, 1) | vgetq_lane_u32(m, 2) | vgetq_lane_u32(m, 3));
+}
+
+template <int i> inline F4 F4Splat(F4 v) { return vdupq_n_f32(vgetq_lane_f32(v, i)); }
+
+inline void F4Transpose(F4 &a, F4 &b, F4 &c, F4 &d) {
+	const float32x4x2_t ab = vtrnq_f32(a, b), cd = vtrnq_f32(c, d);
+	a = vcombine_f32(vget_low_f32(ab.val[0]), vget_low_f32(cd.val[0]));
+	b = vcombine_f32(vget_low_f32(ab.val[1]), vget_low_f32(cd.val[1]));
+	c = vcombine_f32(vget_high_f32(ab.val[0]), vget_high_f32(cd.val[0]));
+	d = vcombine_f32(vget_high_f32(ab.val[1]), vget_high_f32(cd.val[1]));
+}
+
+inline void F4Unzip(F4 a, F4 b, F4 &even, F4 &odd) {
+	const float32x4x2_t r = vuzpq_f32(a, b);
+	even = r.val[0];
+	odd = r.val[1];
+}
+
+inline void F4Load3(const float *p, F4 &x, F4 &y, F4 &z) {
+	const float32x4x3_t v = vld3q_f32(p);
+	x = v.val[0], y = v.val[1], z = v.val[2];
+}
+
+inline void F4Store3(float *p, F4 x, F4 y, F4 z) {
+	float32x4x3_t v;
+	v.val[0] = x, v.val[1] = y, v.val[2] = z;
+	vst3q_f32(p, v);
+}
+#endif
+
+// 4 wide kernels, written once over the SSE2 and NEON primitives.
+#if BATCH_MATH_SSE2 || BATCH_MATH_NEON
+inline void TransformPointsSIMD4(const hg::Mat4 &m, const hg::Vec3 *in, hg::Vec3 *out, size_t count) {
+	const F4 m00 = F4Set1(m.m[0][0]), m01 = F4Set1(m.m[0][1]), m02 = F4Set1(m.m[0][2]), m03 = F4Set1(m.m[0][3]);
+	const F4 m10 = F4Set1(m.m[1][0]), m11 = F4Set1(m.m[1][1]), m12 = F4Set1(m.m[1][2]), m13 = F4Set1(m.m[1][3]);
+	const F4 m20 = F4Set1(m.m[2][0]), m21 = F4Set1(m.m[2][1]), m22 = F4Set1(m.m[2][2]), m23 = F4Set1(m.m[2][3]);
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		F4 x, y, z;
+		F4Load3(&in[i].x, x, y, z);
+
+		const F4 ox = F4MulAdd(x, m00, F4MulAdd(y, m01, F4MulAdd(z, m02, m03)));
+		const F4 oy = F4MulAdd(x, m10, F4MulAdd(y, m11, F4MulAdd(z, m12, m13)));
+		const F4 oz = F4MulAdd(x, m20, F4MulAdd(y, m21, F4MulAdd(z, m22, m23)));
+
+		F4Store3(&out[i].x, ox, oy, oz);
+	}
+
+	for (; i < count; ++i)
+		TransformPoint(m, in[i], out[i]);
+}
+
+inline void MulMat4SIMD4(const hg::Mat4 *a, const hg::Mat4 *b, hg::Mat4 *out, size_t count) {
+	const F4 unit_w = F4Set(0.f, 0.f, 0.f, 1.f);
+
+	for (size_t i = 0; i < count; ++i) {
+		const float *pa = &a[i].m[0][0], *pb = &b[i].m[0][0];
+		float *po = &out[i].m[0][0];
+
+		const F4 b0 = F4Load(pb), b1 = F4Load(pb + 4), b2 = F4Load(pb + 8);
+
+		for (int r = 0; r < 3; ++r) {
+			const F4 ar = F4Load(pa + r * 4);
+			F4Store(po + r * 4, F4MulAdd(F4Splat<0>(ar), b0, F4MulAdd(F4Splat<1>(ar), b1, F4MulAdd(F4Splat<2>(ar), b2, F4Mul(F4Splat<3>(ar), unit_w)))));
+		}
+	}
+}
+
+inline void ComposeTRSSIMD4(const hg::Vec3 *pos, const hg::Quaternion *rot, const hg::Vec3 *scale, hg::Mat4 *out, size_t count) {
+	const F4 one = F4Set1(1.f);
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		F4 qx = F4Load(&rot[i].x), qy = F4Load(&rot[i + 1].x), qz = F4Load(&rot[i + 2].x), qw = F4Load(&rot[i + 3].x);
+		F4Transpose(qx, qy, qz, qw);
+
+		F4 px, py, pz, sx, sy, sz;
+		F4Load3(&pos[i].x, px, py, pz);
+		F4Load3(&scale[i].x, sx, sy, sz);
+
+		const F4 x2 = F4Add(qx, qx), y2 = F4Add(qy, qy), z2 = F4Add(qz, qz);
+		const F4 xx = F4Mul(qx, x2), yy = F4Mul(qy, y2), zz = F4Mul(qz, z2), xy = F4Mul(qx, y2), xz = F4Mul(qx, z2), yz = F4Mul(qy, z2);
+		const F4 wx = F4Mul(qw, x2), wy = F4Mul(qw, y2), wz = F4Mul(qw, z2);
+
+		F4 rows[3][4] = {
+			{F4Mul(F4Sub(one, F4Add(yy, zz)), sx), F4Mul(F4Sub(xy, wz), sy), F4Mul(F4Add(xz, wy), sz), px},
+			{F4Mul(F4Add(xy, wz), sx), F4Mul(F4Sub(one, F4Add(xx, zz)), sy), F4Mul(F4Sub(yz, wx), sz), py},
+			{F4Mul(F4Sub(xz, wy), sx), F4Mul(F4Add(yz, wx), sy), F4Mul(F4Sub(one, F4Add(xx, yy)), sz), pz},
+		};
+
+		for (int r = 0; r < 3; ++r) {
+			F4Transpose(rows[r][0], rows[r][1], rows[r][2], rows[r][3]);
+			for (int k = 0; k < 4; ++k)
+				F4Store(&out[i + k].m[r][0], rows[r][k]);
+		}
+	}
+
+	for (; i < count; ++i)
+		ComposeTRS(pos[i], rot[i], scale[i], out[i]);
+}
+
+inline void TestAABBsSIMD4(const hg::Frustum &frustum, const hg::MinMax *aabb, uint8_t *visible, size_t count) {
+	F4 nx[hg::FP_Count], ny[hg::FP_Count], nz[hg::FP_Count], nw[hg::FP_Count], ax[hg::FP_Count], ay[hg::FP_Count], az[hg::FP_Count];
+	for (int p = 0; p < hg::FP_Count; ++p) {
+		nx[p] = F4Set1(frustum[p].x), ny[p] = F4Set1(frustum[p].y), nz[p] = F4Set1(frustum[p].z), nw[p] = F4Set1(frustum[p].w);
+		ax[p] = F4Set1(std::abs(frustum[p].x)), ay[p] = F4Set1(std::abs(frustum[p].y)), az[p] = F4Set1(std::abs(frustum[p].z));
+	}
+
+	const F4 half = F4Set1(0.5f);
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		// boxes are loaded as 8 consecutive Vec3 then split into their min and max corners
+		F4 x01, y01, z01, x23, y23, z23;
+		F4Load3(&aabb[i].mn.x, x01, y01, z01);
+		F4Load3(&aabb[i + 2].mn.x, x23, y23, z23);
+
+		F4 mnx, mny, mnz, mxx, mxy, mxz;
+		F4Unzip(x01, x23, mnx, mxx);
+		F4Unzip(y01, y23, mny, mxy);
+		F4Unzip(z01, z23, mnz, mxz);
+
+		const F4 cx = F4Mul(F4Add(mnx, mxx), half), cy = F4Mul(F4Add(mny, mxy), half), cz = F4Mul(F4Add(mnz, mxz), half);
+		const F4 ex = F4Mul(F4Sub(mxx, mnx), half), ey = F4Mul(F4Sub(mxy, mny), half), ez = F4Mul(F4Sub(mxz, mnz), half);
+
+		int outside = 0;
+		for (int p = 0; p < hg::FP_Count; ++p) {
+			const F4 d = F4MulAdd(cx, nx[p], F4MulAdd(cy, ny[p], F4MulAdd(cz, nz[p], nw[p])));
+			const F4 e = F4MulAdd(ex, ax[p], F4MulAdd(ey, ay[p], F4Mul(ez, az[p])));
+			outside |= F4MaskGt(d, e);
+		}
+
+		for (int k = 0; k < 4; ++k)
+			visible[i + k] = (outside >> k) & 1 ? 0 : 1;
+	}
+
+	for (; i < count; ++i)
+		visible[i] = IsAABBVisible(frustum, aabb[i]) ? 1 : 0;
+}
+#endif
+
+// 8 wide AVX2 kernels. Each 256 bit register holds two independent 128 bit lanes, data is loaded so that the low lane
+// holds elements [i, i+4) and the high lane elements [i+4, i+8), the 4 wide shuffles then apply per lane unchanged.
+#if BATCH_MATH_AVX2
+using F8 = __m256;
+
+BATCH_MATH_TARGET_AVX2 inline F8 F8Load2(const float *lo, const float *hi) { return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(lo)), _mm_loadu_ps(hi), 1); }
+
+BATCH_MATH_TARGET_AVX2 inline void F8Store2(float *lo, float *hi, F8 v) {
+	_mm_storeu_ps(lo, _mm256_castps256_ps128(v));
+	_mm_storeu_ps(hi, _mm256_extractf128_ps(v, 1));
+}
+
+BATCH_MATH_TARGET_AVX2 inline void F8Transpose(F8 &a, F8 &b, F8 &c, F8 &d) {
+	const F8 t0 = _mm256_unpacklo_ps(a, b), t1 = _mm256_unpackhi_ps(a, b), t2 = _mm256_unpacklo_ps(c, d), t3 = _mm256_unpackhi_ps(c, d);
+	a = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0));
+	b = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2));
+	c = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0));
+	d = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2));
+}
+
+// 8 packed Vec3 to and from x, y and z vectors.
+BATCH_MATH_TARGET_AVX2 inline void F8Load3(const float *p, F8 &x, F8 &y, F8 &z) {
+	const F8 a = F8Load2(p, p + 12), b = F8Load2(p + 4, p + 16), c = F8Load2(p + 8, p + 20);
+	x = _mm256_shuffle_ps(a, _mm256_shuffle_ps(b, c, _MM_SHUFFLE(1, 0, 3, 2)), _MM_SHUFFLE(3, 0, 3, 0));
+	y = _mm256_shuffle_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(0, 0, 1, 1)), _mm256_shuffle_ps(b, c, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+	z = _mm256_shuffle_ps(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(1, 1, 2, 2)), _mm256_shuffle_ps(c, c, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+}
+
+BATCH_MATH_TARGET_AVX2 inline void F8Store3(float *p, F8 x, F8 y, F8 z) {
+	F8Store2(p, p + 12, _mm256_shuffle_ps(_mm256_shuffle_ps(x, y, _MM_SHUFFLE(1, 0, 1, 0)), _mm256_shuffle_ps(z, x, _MM_SHUFFLE(1, 1, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0)));
+	F8Store2(p + 4, p + 16, _mm256_shuffle_ps(_mm256_shuffle_ps(y, z, _MM_SHUFFLE(1, 1, 1, 1)), _mm256_shuffle_ps(x, y, _MM_SHUFFLE(2, 2, 2, 2)), _MM_SHUFFLE(2, 0, 2, 0)));
+	F8Store2(p + 8, p + 20, _mm256_shuffle_ps(_mm256_shuffle_ps(z, x, _MM_SHUFFLE(3, 3, 2, 2)), _mm256_shuffle_ps(y, z, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0)));
+}
+
+BATCH_MATH_TARGET_AVX2 inline void TransformPointsAVX2(const hg::Mat4 &m, const hg::Vec3 *in, hg::Vec3 *out, size_t count) {
+	const F8 m00 = _mm256_set1_ps(m.m[0][0]), m01 = _mm256_set1_ps(m.m[0][1]), m02 = _mm256_set1_ps(m.m[0][2]), m03 = _mm256_set1_ps(m.m[0][3]);
+	const F8 m10 = _mm256_set1_ps(m.m[1][0]), m11 = _mm256_set1_ps(m.m[1][1]), m12 = _mm256_set1_ps(m.m[1][2]), m13 = _mm256_set1_ps(m.m[1][3]);
+	const F8 m20 = _mm256_set1_ps(m.m[2][0]), m21 = _mm256_set1_ps(m.m[2][1]), m22 = _mm256_set1_ps(m.m[2][2]), m23 = _mm256_set1_ps(m.m[2][3]);
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		F8 x, y, z;
+		F8Load3(&in[i].x, x, y, z);
+
+		const F8 ox = _mm256_fmadd_ps(x, m00, _mm256_fmadd_ps(y, m01, _mm256_fmadd_ps(z, m02, m03)));
+		const F8 oy = _mm256_fmadd_ps(x, m10, _mm256_fmadd_ps(y, m11, _mm256_fmadd_ps(z, m12, m13)));
+		const F8 oz = _mm256_fmadd_ps(x, m20, _mm256_fmadd_ps(y, m21, _mm256_fmadd_ps(z, m22, m23)));
+
+		F8Store3(&out[i].x, ox, oy, oz);
+	}
+
+	for (; i < count; ++i)
+		TransformPoint(m, in[i], out[i]);
+}
+
+// Two matrix products per iteration, one per lane.
+BATCH_MATH_TARGET_AVX2 inline void MulMat4AVX2(const hg::Mat4 *a, const hg::Mat4 *b, hg::Mat4 *out, size_t count) {
+	const F8 unit_w = _mm256_set_ps(1.f, 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f);
+
+	size_t i = 0;
+	for (; i + 2 <= count; i += 2) {
+		const float *pa0 = &a[i].m[0][0], *pa1 = &a[i + 1].m[0][0], *pb0 = &b[i].m[0][0], *pb1 = &b[i + 1].m[0][0];
+		float *po0 = &out[i].m[0][0], *po1 = &out[i + 1].m[0][0];
+
+		const F8 b0 = F8Load2(pb0, pb1), b1 = F8Load2(pb0 + 4, pb1 + 4), b2 = F8Load2(pb0 + 8, pb1 + 8);
+
+		for (int r = 0; r < 3; ++r) {
+			const F8 ar = F8Load2(pa0 + r * 4, pa1 + r * 4);
+			const F8 c = _mm256_fmadd_ps(_mm256_permute_ps(ar, 0x00), b0,
+				_mm256_fmadd_ps(_mm256_permute_ps(ar, 0x55), b1, _mm256_fmadd_ps(_mm256_permute_ps(ar, 0xaa), b2, _mm256_mul_ps(_mm256_permute_ps(ar, 0xff), unit_w))));
+			F8Store2(po0 + r * 4, po1 + r * 4, c);
+		}
+	}
+
+	for (; i < count; ++i)
+		MulMat4(a[i], b[i], out[i]);
+}
+
+BATCH_MATH_TARGET_AVX2 inline void ComposeTRSAVX2(const hg::Vec3 *pos, const hg::Quaternion *rot, const hg::Vec3 *scale, hg::Mat4 *out, size_t count) {
+	const F8 one = _mm256_set1_ps(1.f);
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		F8 qx = F8Load2(&rot[i].x, &rot[i + 4].x), qy = F8Load2(&rot[i + 1].x, &rot[i + 5].x), qz = F8Load2(&rot[i + 2].x, &rot[i + 6].x), qw = F8Load2(&rot[i + 3].x, &rot[i + 7].x);
+		F8Transpose(qx, qy, qz, qw);
+
+		F8 px, py, pz, sx, sy, sz;
+		F8Load3(&pos[i].x, px, py, pz);
+		F8Load3(&scale[i].x, sx, sy, sz);
+
+		const F8 x2 = _mm256_add_ps(qx, qx), y2 = _mm256_add_ps(qy, qy), z2 = _mm256_add_ps(qz, qz);
+		const F8 xx = _mm256_mul_ps(qx, x2), yy = _mm256_mul_ps(qy, y2), zz = _mm256_mul_ps(qz, z2);
+		const F8 xy = _mm256_mul_ps(qx, y2), xz = _mm256_mul_ps(qx, z2), yz = _mm256_mul_ps(qy, z2);
+		const F8 wx = _mm256_mul_ps(qw, x2), wy = _mm256_mul_ps(qw, y2), wz = _mm256_mul_ps(qw, z2);
+
+		F8 rows[3][4] = {
+			{_mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(yy, zz)), sx), _mm256_mul_ps(_mm256_sub_ps(xy, wz), sy), _mm256_mul_ps(_mm256_add_ps(xz, wy), sz), px},
+			{_mm256_mul_ps(_mm256_add_ps(xy, wz), sx), _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, zz)), sy), _mm256_mul_ps(_mm256_sub_ps(yz, wx), sz), py},
+			{_mm256_mul_ps(_mm256_sub_ps(xz, wy), sx), _mm256_mul_ps(_mm256_add_ps(yz, wx), sy), _mm256_mul_ps(_mm256_sub_ps(one, _mm256_add_ps(xx, yy)), sz), pz},
+		};
+
+		for (int r = 0; r < 3; ++r) {
+			F8Transpose(rows[r][0], rows[r][1], rows[r][2], rows[r][3]);
+			for (int k = 0; k < 4; ++k)
+				F8Store2(&out[i + k].m[r][0], &out[i + k + 4].m[r][0], rows[r][k]);
+		}
+	}
+
+	for (; i < count; ++i)
+		ComposeTRS(pos[i], rot[i], scale[i], out[i]);
+}
+
+BATCH_MATH_TARGET_AVX2 inline void TestAABBsAVX2(const hg::Frustum &frustum, const hg::MinMax *aabb, uint8_t *visible, size_t count) {
+	F8 nx[hg::FP_Count], ny[hg::FP_Count], nz[hg::FP_Count], nw[hg::FP_Count], ax[hg::FP_Count], ay[hg::FP_Count], az[hg::FP_Count];
+	for (int p = 0; p < hg::FP_Count; ++p) {
+		nx[p] = _mm256_set1_ps(frustum[p].x), ny[p] = _mm256_set1_ps(frustum[p].y), nz[p] = _mm256_set1_ps(frustum[p].z), nw[p] = _mm256_set1_ps(frustum[p].w);
+		ax[p] = _mm256_set1_ps(std::abs(frustum[p].x)), ay[p] = _mm256_set1_ps(std::abs(frustum[p].y)), az[p] = _mm256_set1_ps(std::abs(frustum[p].z));
+	}
+
+	const F8 half = _mm256_set1_ps(0.5f);
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		// lanes hold boxes [i, i+2) [i+2, i+4) then [i+4, i+6) [i+6, i+8), unzipping them yields the box order
+		// i, i+1, i+4, i+5 | i+2, i+3, i+6, i+7 which is restored on the result mask
+		F8 xa, ya, za, xb, yb, zb;
+		F8Load3(&aabb[i].mn.x, xa, ya, za);
+		F8Load3(&aabb[i + 4].mn.x, xb, yb, zb);
+
+		const F8 mnx = _mm256_shuffle_ps(xa, xb, _MM_SHUFFLE(2, 0, 2, 0)), mxx = _mm256_shuffle_ps(xa, xb, _MM_SHUFFLE(3, 1, 3, 1));
+		const F8 mny = _mm256_shuffle_ps(ya, yb, _MM_SHUFFLE(2, 0, 2, 0)), mxy = _mm256_shuffle_ps(ya, yb, _MM_SHUFFLE(3, 1, 3, 1));
+		const F8 mnz = _mm256_shuffle_ps(za, zb, _MM_SHUFFLE(2, 0, 2, 0)), mxz = _mm256_shuffle_ps(za, zb, _MM_SHUFFLE(3, 1, 3, 1));
+
+		const F8 cx = _mm256_mul_ps(_mm256_add_ps(mnx, mxx), half), cy = _mm256_mul_ps(_mm256_add_ps(mny, mxy), half), cz = _mm256_mul_ps(_mm256_add_ps(mnz, mxz), half);
+		const F8 ex = _mm256_mul_ps(_mm256_sub_ps(mxx, mnx), half), ey = _mm256_mul_ps(_mm256_sub_ps(mxy, mny), half), ez = _mm256_mul_ps(_mm256_sub_ps(mxz, mnz), half);
+
+		F8 outside = _mm256_setzero_ps();
+		for (int p = 0; p < hg::FP_Count; ++p) {
+			const F8 d = _mm256_fmadd_ps(cx, nx[p], _mm256_fmadd_ps(cy, ny[p], _mm256_fmadd_ps(cz, nz[p], nw[p])));
+			const F8 e = _mm256_fmadd_ps(ex, ax[p], _mm256_fmadd_ps(ey, ay[p], _mm256_mul_ps(ez, az[p])));
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(d, e, _CMP_GT_OQ));
+		}
+
+		int mask = _mm256_movemask_ps(outside);
+		mask = (mask & 0xc3) | ((mask & 0x0c) << 2) | ((mask & 0x30) >> 2);
+
+		for (int k = 0; k < 8; ++k)
+			visible[i + k] = (mask >> k) & 1 ? 0 : 1;
+	}
+
+	for (; i < count; ++i)
+		visible[i] = IsAABBVisible(frustum, aabb[i]) ? 1 : 0;
+}
+
+inline bool IsAVX2Supported() {
+#if defined(_MSC_VER) && !defined(__clang__)
+	int info[4];
+	__cpuid(info, 1);
+	const bool fma = (info[2] & (1 << 12)) != 0, osxsave = (info[2] & (1 << 27)) != 0;
+	if (!fma || !osxsave || (_xgetbv(0) & 6) != 6) // the OS must save the YMM registers
+		return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+#endif
+}
+#endif
+
+//
+enum BatchMathISA { BMI_Scalar, BMI_SIMD4, BMI_AVX2, BMI_Count };
+
+inline const char *GetBatchMathISAName(BatchMathISA isa) {
+	switch (isa) {
+		case BMI_SIMD4:
+#if BATCH_MATH_NEON
+			return "NEON";
+#else
+			return "SSE2";
+#endif
+		case BMI_AVX2:
+			return "AVX2";
+		default:
+			return "scalar";
+	}
+}
+
+inline bool IsBatchMathISASupported(BatchMathISA isa) {
+	switch (isa) {
+		case BMI_Scalar:
+			return true;
+		case BMI_SIMD4:
+#if BATCH_MATH_SSE2 || BATCH_MATH_NEON
+			return true;
+#else
+			return false;
+#endif
+		case BMI_AVX2:
+#if BATCH_MATH_AVX2
+			return IsAVX2Supported();
+#else
+			return false;
+#endif
+		default:
+			return false;
+	}
+}
+
+inline BatchMath GetBatchMath(BatchMathISA isa) {
+#if BATCH_MATH_AVX2
+	if (isa == BMI_AVX2)
+		return {TransformPointsAVX2, MulMat4AVX2, ComposeTRSAVX2, TestAABBsAVX2};
+#endif
+#if BATCH_MATH_SSE2 || BATCH_MATH_NEON
+	if (isa == BMI_SIMD4)
+		return {TransformPointsSIMD4, MulMat4SIMD4, ComposeTRSSIMD4, TestAABBsSIMD4};
+#endif
+	return {TransformPointsScalar, MulMat4Scalar, ComposeTRSScalar, TestAABBsScalar};
+}
+
+// Best supported implementation.
+inline BatchMath GetBatchMath() {
+	for (int isa = BMI_Count - 1; isa > BMI_Scalar; --isa)
+		if (IsBatchMathISASupported(BatchMathISA(isa)))
+			return GetBatchMath(BatchMathISA(isa));
+	return GetBatchMath(BMI_Scalar);
+}
@@ -0,0 +1,139 @@
+# HARFANG(R) Copyright (C) 2022 NWNC HARFANG. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+# Incremental compilation of a resource package (a top-level folder of the resources tree).
+#
+# The content of every input is hashed and recorded in a per package manifest, the package is only compiled again when
+# the hashes, the graphic API, the toolchain or assetc itself changed. Compiled packages are stored in an optional
+# shared cache directory, keyed by content hash, so that several build trees can reuse them.
+#
+# Packages referencing assets of other packages (eg. scenes using core/shader/pbr.hps) list them as dependencies: only
+# the referenced assets and their sources are staged alongside the package so that assetc resolves the references, they
+# are part of the package hash and their compiled outputs are discarded, each package only publishes its own folder.
+#
+# Usage: cmake -DASSETC=<assetc executable> -DAPI=<graphic API> -DTOOLCHAIN=<toolchain dir> -DPACKAGE=<package name>
+#              -DINPUT_DIR=<resources dir> -DOUTPUT_DIR=<compiled resources dir> -DSTAGING_DIR=<work dir>
+#              -DMANIFEST=<manifest file> [-DDEPENDENCIES=<comma separated package names>] [-DCACHE_DIR=<shared cache dir>]
+#              -P compile_resource_package.cmake
+
+cmake_minimum_required(VERSION 3.13)
+
+foreach(var ASSETC API TOOLCHAIN PACKAGE INPUT_DIR OUTPUT_DIR STAGING_DIR MANIFEST)
+	if(NOT DEFINED ${var})
+		message(FATAL_ERROR "compile_resource_package: ${var} is not defined")
+	endif()
+endforeach()
+
+include(${CMAKE_CURRENT_LIST_DIR}/resource_references.cmake)
+
+string(REPLACE "," ";" dependencies "${DEPENDENCIES}")
+
+# hash every input of the package and the dependency assets it references
+file(GLOB_RECURSE inputs LIST_DIRECTORIES false RELATIVE ${INPUT_DIR} ${INPUT_DIR}/${PACKAGE}/*)
+
+set(dependency_inputs)
+foreach(dependency ${dependencies})
+	collect_resource_references(${INPUT_DIR} ${PACKAGE} ${dependency} references)
+	resolve_resource_references(${INPUT_DIR} "${references}" referenced_inputs)
+	list(APPEND dependency_inputs ${referenced_inputs})
+endforeach()
+
+list(APPEND inputs ${dependency_inputs})
+list(SORT inputs)
+
+set(asset_hashes "")
+foreach(input ${inputs})
+	file(SHA256 ${INPUT_DIR}/${input} hash)
+	string(APPEND asset_hashes "${hash} ${input}\n")
+endforeach()
+
+file(SHA256 ${ASSETC} assetc_hash)
+string(SHA256 package_hash "${asset_hashes}${API}\n${TOOLCHAIN}\n${assetc_hash}\n")
+
+# up to date?
+set(previous_hashes "")
+if(EXISTS ${MANIFEST})
+	file(STRINGS ${MANIFEST} previous_package_hash LIMIT_COUNT 1 REGEX "^package ")
+	if(previous_package_hash STREQUAL "package ${package_hash}" AND EXISTS ${OUTPUT_DIR}/${PACKAGE})
+		message(STATUS "${PACKAGE}: up to date")
+		file(TOUCH ${MANIFEST})
+		return()
+	endif()
+	file(STRINGS ${MANIFEST} previous_hashes REGEX "^[0-9a-f]+ ")
+endif()
+
+# report the assets that changed since the last compilation
+string(REPLACE "\n" ";" current_hashes "${asset_hashes}")
+list(REMOVE_ITEM current_hashes "")
+
+set(changed_count 0)
+foreach(entry ${current_hashes})
+	list(FIND previous_hashes "${entry}" found)
+	if(found EQUAL -1)
+		if(previous_hashes)
+			string(REGEX REPLACE "^[0-9a-f]+ " "" changed "${entry}")
+			message(STATUS "${PACKAGE}: ${changed} changed")
+		endif()
+		math(EXPR changed_count "${changed_count} + 1")
+	endif()
+endforeach()
+
+# fetch from the shared cache or compile
+set(cached_dir "")
+if(CACHE_DIR)
+	set(cached_dir ${CACHE_DIR}/${PACKAGE}-${package_hash})
+endif()
+
+if(cached_dir AND EXISTS ${cached_dir}/.complete)
+	message(STATUS "${PACKAGE}: ${changed_count} asset(s) changed, using shared cache ${cached_dir}")
+	set(compiled_dir ${cached_dir})
+else()
+	message(STATUS "${PACKAGE}: ${changed_count} asset(s) changed, compiling")
+
+	# assetc compiles a whole tree, stage the package and the referenced dependency assets under their own path so that
+	# references are unchanged
+	file(REMOVE_RECURSE ${STAGING_DIR})
+	file(MAKE_DIRECTORY ${STAGING_DIR}/in ${STAGING_DIR}/out)
+	file(COPY ${INPUT_DIR}/${PACKAGE} DESTINATION ${STAGING_DIR}/in)
+	foreach(input ${dependency_inputs})
+		get_filename_component(input_dir ${input} DIRECTORY)
+		file(COPY ${INPUT_DIR}/${input} DESTINATION ${STAGING_DIR}/in/${input_dir})
+	endforeach()
+
+	get_filename_component(assetc_dir ${ASSETC} DIRECTORY)
+	execute_process(
+		COMMAND ${ASSETC} ${STAGING_DIR}/in ${STAGING_DIR}/out -api ${API} -t ${TOOLCHAIN}
+		WORKING_DIRECTORY ${assetc_dir}
+		RESULT_VARIABLE result
+	)
+	if(NOT result EQUAL 0)
+		message(FATAL_ERROR "${PACKAGE}: assetc failed (${result})")
+	endif()
+
+	# dependencies are published by their own package
+	foreach(dependency ${dependencies})
+		file(REMOVE_RECURSE ${STAGING_DIR}/out/${dependency})
+	endforeach()
+
+	set(compiled_dir ${STAGING_DIR}/out)
+
+	# publish to the shared cache, the rename is atomic so concurrent build trees never see a partial entry
+	if(cached_dir)
+		string(RANDOM LENGTH 8 suffix)
+		set(cache_tmp ${CACHE_DIR}/.tmp-${PACKAGE}-${suffix})
+		file(COPY ${compiled_dir}/ DESTINATION ${cache_tmp})
+		file(TOUCH ${cache_tmp}/.complete)
+		execute_process(COMMAND ${CMAKE_COMMAND} -E rename ${cache_tmp} ${cached_dir} RESULT_VARIABLE rename_result OUTPUT_QUIET ERROR_QUIET)
+		if(NOT rename_result EQUAL 0)
+			file(REMOVE_RECURSE ${cache_tmp}) # another build tree published it first
+		endif()
+	endif()
+endif()
+
+# replace the package outputs
+file(REMOVE_RECURSE ${OUTPUT_DIR}/${PACKAGE})
+file(GLOB compiled_entries LIST_DIRECTORIES true ${compiled_dir}/*)
+file(COPY ${compiled_entries} DESTINATION ${OUTPUT_DIR})
+file(REMOVE ${OUTPUT_DIR}/.complete)
+
+file(WRITE ${MANIFEST} "package ${package_hash}\n${asset_hashes}")
+file(REMOVE_RECURSE ${STAGING_DIR})
@@ -0,0 +1,56 @@
+# HARFANG(R) Copyright (C) 2022 NWNC HARFANG. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+# References from a resource package to the assets of another package (eg. a scene material using core/shader/pbr.hps).
+# Shared by CMakeLists.txt, to order the package compilations, and by compile_resource_package.cmake, to stage the
+# referenced assets.
+
+# binary assets, never scanned for references
+set(resource_binary_extensions .geo .png .jpg .jpeg .tga .dds .hdr .exr .ttf .otf .wav .ogg .bin)
+
+# List the assets of DEPENDENCY referenced by the text files of PACKAGE (paths relative to INPUT_DIR, as written in the
+# package, eg. core/pbr/probe.hdr.radiance).
+function(collect_resource_references INPUT_DIR PACKAGE DEPENDENCY OUT_VAR)
+	file(GLOB_RECURSE files LIST_DIRECTORIES false ${INPUT_DIR}/${PACKAGE}/*)
+
+	set(references)
+	foreach(file ${files})
+		string(REGEX MATCH "\\.[^./]*$" ext "${file}")
+		string(TOLOWER "${ext}" ext)
+		if(ext IN_LIST resource_binary_extensions)
+			continue()
+		endif()
+
+		file(STRINGS ${file} lines REGEX "\"${DEPENDENCY}/")
+		foreach(line ${lines})
+			string(REGEX MATCHALL "\"${DEPENDENCY}/[^\"]+\"" matches "${line}")
+			foreach(match ${matches})
+				string(REPLACE "\"" "" match "${match}")
+				list(APPEND references ${match})
+			endforeach()
+		endforeach()
+	endforeach()
+
+	list(REMOVE_DUPLICATES references)
+	list(SORT references)
+	set(${OUT_VAR} ${references} PARENT_SCOPE)
+endfunction()
+
+# Source files needed to compile the referenced assets: every file of the referenced folder whose name starts with the
+# asset stem (probe.hdr and its .meta for core/pbr/probe.hdr.radiance, pbr.hps, pbr_vs.sc, pbr_fs.sc and pbr_varying.def
+# for core/shader/pbr.hps) and the shader headers of that folder.
+function(resolve_resource_references INPUT_DIR REFERENCES OUT_VAR)
+	set(inputs)
+	foreach(reference ${REFERENCES})
+		get_filename_component(dir ${reference} DIRECTORY)
+		get_filename_component(name ${reference} NAME)
+		string(REGEX REPLACE "\\..*$" "" stem "${name}")
+
+		file(GLOB stem_inputs LIST_DIRECTORIES false RELATIVE ${INPUT_DIR} ${INPUT_DIR}/${dir}/${stem}.* ${INPUT_DIR}/${dir}/${stem}_*)
+		file(GLOB header_inputs LIST_DIRECTORIES false RELATIVE ${INPUT_DIR} ${INPUT_DIR}/${dir}/*.sh)
+		list(APPEND inputs ${stem_inputs} ${header_inputs})
+	endforeach()
+
+	list(REMOVE_DUPLICATES inputs)
+	list(SORT inputs)
+	set(${OUT_VAR} ${inputs} PARENT_SCOPE)
+endfunction()
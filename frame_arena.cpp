@@ -0,0 +1,353 @@
+// HARFANG(R) Copyright (C) 2022 NWNC HARFANG. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+// Frame arena: transient per-frame containers are carved out of a linear allocator reset after bgfx::frame, render
+// containers owned by the engine API (uniform sets, vertices, strings) are allocated once and updated in place.
+// A global operator new counter reports the heap allocations left in the render loop.
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <foundation/clock.h>
+#include <foundation/format.h>
+#include <foundation/log.h>
+#include <foundation/math.h>
+#include <foundation/projection.h>
+
+#include <platform/input_system.h>
+#include <platform/window_system.h>
+
+#include <engine/assets.h>
+#include <engine/font.h>
+#include <engine/forward_pipeline.h>
+#include <engine/render_pipeline.h>
+#include <engine/scene.h>
+#include <engine/scene_forward_pipeline.h>
+
+// heap allocation counter
+static std::atomic<size_t> heap_alloc_count{0};
+
+void *operator new(size_t size) {
+	++heap_alloc_count;
+	if (void *p = std::malloc(size ? size : 1))
+		return p;
+	throw std::bad_alloc();
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+void operator delete[](void *p, size_t) noexcept { std::free(p); }
+
+// Linear allocator reset once per frame. Allocations that do not fit are served from the heap for the current frame
+// and the arena grows to the high water mark on the next reset, so overflow is not a steady state.
+class FrameArena {
+public:
+	explicit FrameArena(size_t capacity) : buffer(static_cast<uint8_t *>(std::malloc(capacity))), capacity(capacity) {
+		if (!buffer)
+			throw std::bad_alloc();
+	}
+	~FrameArena() {
+		ReleaseOverflow();
+		std::free(buffer);
+	}
+
+	FrameArena(const FrameArena &) = delete;
+	FrameArena &operator=(const FrameArena &) = delete;
+
+	void *Allocate(size_t size, size_t align) {
+		const size_t offset = (head + align - 1) & ~(align - 1);
+
+		if (offset + size <= capacity) {
+			head = offset + size;
+			high_water = std::max(high_water, head);
+			return buffer + offset;
+		}
+
+		// overflow, chain a heap block to release on reset. Overflow bytes add up over the frame so that the arena grows
+		// enough to hold all of them on the next reset.
+		overflow_bytes += size + align;
+		high_water = std::max(high_water, head + overflow_bytes);
+
+		auto block = static_cast<OverflowBlock *>(std::malloc(sizeof(OverflowBlock) + size + align));
+		if (!block)
+			throw std::bad_alloc();
+
+		block->next = overflow;
+		overflow = block;
+		++overflow_count;
+
+		const uintptr_t data = (reinterpret_cast<uintptr_t>(block + 1) + align - 1) & ~uintptr_t(align - 1);
+		return reinterpret_cast<void *>(data);
+	}
+
+	template <typename T> T *Allocate(size_t count) { return static_cast<T *>(Allocate(sizeof(T) * count, alignof(T))); }
+
+	// Format into the arena, the returned string lives until the next reset.
+	const char *Format(const char *fmt, ...) {
+		va_list args;
+
+		va_start(args, fmt);
+		const int len = vsnprintf(nullptr, 0, fmt, args);
+		va_end(args);
+
+		char *out = Allocate<char>(len + 1);
+
+		va_start(args, fmt);
+		vsnprintf(out, len + 1, fmt, args);
+		va_end(args);
+		return out;
+	}
+
+	void Reset() {
+		ReleaseOverflow();
+
+		if (high_water > capacity) {
+			const size_t new_capacity = high_water + high_water / 2;
+			auto new_buffer = static_cast<uint8_t *>(std::malloc(new_capacity));
+			if (!new_buffer)
+				throw std::bad_alloc();
+
+			std::free(buffer);
+			buffer = new_buffer;
+			capacity = new_capacity;
+		}
+
+		last_frame_usage = head + overflow_bytes;
+		head = overflow_bytes = 0;
+	}
+
+	size_t GetCapacity() const { return capacity; }
+	size_t GetLastFrameUsage() const { return last_frame_usage; }
+	size_t GetOverflowCount() const { return overflow_count; }
+
+private:
+	struct OverflowBlock {
+		OverflowBlock *next;
+	};
+
+	void ReleaseOverflow() {
+		while (overflow) {
+			OverflowBlock *next = overflow->next;
+			std::free(overflow);
+			overflow = next;
+		}
+	}
+
+	uint8_t *buffer;
+	size_t capacity, head = 0, high_water = 0, last_frame_usage = 0, overflow_count = 0;
+	size_t overflow_bytes = 0; // during the current frame
+	OverflowBlock *overflow = nullptr;
+};
+
+// Standard allocator adapter so that std containers can live in the frame arena, deallocation is a no-op.
+template <typename T> struct ArenaAllocator {
+	using value_type = T;
+
+	FrameArena *arena;
+
+	explicit ArenaAllocator(FrameArena &arena) : arena(&arena) {}
+	template <typename U> ArenaAllocator(const ArenaAllocator<U> &o) : arena(o.arena) {}
+
+	T *allocate(size_t n) { return arena->Allocate<T>(n); }
+	void deallocate(T *, size_t) {}
+
+	template <typename U> bool operator==(const ArenaAllocator<U> &o) const { return arena == o.arena; }
+	template <typename U> bool operator!=(const ArenaAllocator<U> &o) const { return arena != o.arena; }
+};
+
+template <typename T> using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+// Persistent text for the engine DrawText API, assigning keeps the reserved capacity so no allocation takes place.
+struct TextSlot {
+	std::string text;
+
+	TextSlot() { text.reserve(256); }
+
+	const std::string &Set(const char *s) {
+		text.assign(s);
+		return text;
+	}
+};
+
+struct LabelEntry {
+	hg::NodeRef ref;
+	float distance;
+};
+
+// Build the cursor circle in a persistent vertex buffer and submit it once.
+static void DrawCircle(bgfx::ViewId view_id, hg::Vertices &vtx, const hg::Vec2 &center, float radius, const hg::Color &color, bgfx::ProgramHandle prg, const hg::RenderState &state) {
+	const int segment_count = 32;
+	const float step = hg::TwoPi / segment_count;
+
+	vtx.Clear();
+
+	hg::Vec3 p0(center.x + radius, center.y, 0.f);
+	for (int i = 1; i <= segment_count; ++i) {
+		const hg::Vec3 p1(radius * std::cos(i * step) + center.x, radius * std::sin(i * step) + center.y, 0.f);
+		vtx.Begin(2 * (i - 1)).SetPos(p0).SetColor0(color).End();
+		vtx.Begin(2 * (i - 1) + 1).SetPos(p1).SetColor0(color).End();
+		p0 = p1;
+	}
+
+	hg::DrawLines(view_id, vtx, prg, state);
+}
+
+int main() {
+	hg::InputInit();
+	hg::WindowSystemInit();
+
+	int res_x = 1280, res_y = 720;
+
+	hg::Window *window = hg::RenderInit("Harfang - Frame Arena", res_x, res_y, BGFX_RESET_VSYNC | BGFX_RESET_MSAA_X4);
+	if (!window) {
+		hg::error("failed to create window.");
+		return EXIT_FAILURE;
+	}
+
+	// access compiled resources
+	hg::AddAssetsFolder("resources_compiled");
+
+	// create forward pipeline and resources.
+	hg::ForwardPipeline pipeline = hg::CreateForwardPipeline();
+	hg::PipelineResources res = hg::PipelineResources();
+
+	// load scene
+	hg::Scene scene;
+	hg::LoadSceneContext load_ctx;
+	hg::LoadSceneFromAssets("materials/materials.scn", scene, res, hg::GetForwardPipelineInfo(), load_ctx);
+
+	hg::Node camera = scene.GetCurrentCamera();
+
+	// text and 2D resources, the uniform sets are built once and updated in place
+	hg::Font font = hg::LoadFontFromAssets("font/default.ttf", 16);
+	bgfx::ProgramHandle font_program = hg::LoadProgramFromAssets("core/shader/font");
+	hg::RenderState text_render_state = hg::ComputeRenderState(hg::BM_Alpha, hg::DT_Always, hg::FC_Disabled);
+
+	std::vector<hg::UniformSetValue> text_uniform_values = {hg::MakeUniformSetValue("u_color", hg::Vec4(1.f, 1.f, 0.5f))};
+	const std::vector<hg::UniformSetTexture> no_textures;
+
+	bgfx::VertexLayout vtx_layout = hg::VertexLayoutPosFloatColorFloat();
+	bgfx::ProgramHandle draw2D_program = hg::LoadProgramFromAssets("shaders/pos_rgb");
+	hg::RenderState draw2D_render_state = hg::ComputeRenderState(hg::BM_Alpha, hg::DT_Less, hg::FC_Disabled);
+
+	hg::Vertices circle_vtx(vtx_layout, 64);
+
+	const std::vector<hg::Node> nodes = scene.GetNodes();
+
+	TextSlot stats_text, help_text, label_texts[32];
+	help_text.Set("Space: toggle frame arena / naive per-frame allocations");
+
+	// the arena starts small on purpose, it grows to the high water mark over the first frames
+	FrameArena arena(1024);
+	bool use_arena = true;
+
+	size_t app_allocs = 0, frame_allocs = 0;
+	float angle = 0.f;
+
+	hg::Keyboard keyboard;
+	hg::Mouse mouse;
+
+	while (!keyboard.Down(hg::K_Escape) && hg::IsWindowOpen(window)) {
+		const size_t frame_alloc_start = heap_alloc_count;
+
+		hg::time_ns dt = hg::tick_clock();
+
+		keyboard.Update();
+		mouse.Update();
+
+		if (keyboard.Pressed(hg::K_Space))
+			use_arena = !use_arena;
+
+		angle += hg::time_to_sec_f(dt) * 0.25f;
+		camera.GetTransform().SetWorld(hg::Mat4LookAt(hg::Vec3(hg::Sin(angle) * 8.f, 3.f, hg::Cos(angle) * 8.f), hg::Vec3::Zero));
+
+		scene.Update(dt);
+
+		bgfx::ViewId view_id = 0;
+		hg::SceneForwardPipelinePassViewId views;
+		hg::SubmitSceneToPipeline(view_id, scene, hg::iRect(0, 0, res_x, res_y), true, pipeline, res, views);
+
+		// application render code, this is where the allocation count should drop to zero
+		const size_t app_alloc_start = heap_alloc_count;
+
+		hg::SetView2D(view_id, 0, 0, res_x, res_y, -1, 1, BGFX_CLEAR_DEPTH, hg::Color::Black, 1, 0);
+
+		const hg::Vec3 cam_pos = camera.GetTransform().GetPos();
+		const hg::Vec2 mouse_pos(float(mouse.X()), float(res_y - mouse.Y()));
+
+		if (use_arena) {
+			// labels sorted by distance in a transient arena vector
+			ArenaVector<LabelEntry> labels{ArenaAllocator<LabelEntry>(arena)};
+			labels.reserve(nodes.size());
+
+			for (const auto &node : nodes)
+				if (node.HasObject())
+					labels.push_back({node.ref, hg::Dist(node.GetTransform().GetPos(), cam_pos)});
+
+			std::sort(labels.begin(), labels.end(), [](const LabelEntry &a, const LabelEntry &b) { return a.distance < b.distance; });
+
+			for (size_t i = 0; i < labels.size() && i < 32; ++i) {
+				const char *label = arena.Format("%.2f m", labels[i].distance);
+				hg::DrawText(view_id, font, label_texts[i].Set(label), font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20.f, 20.f + float(i) * 20.f, 0), hg::DTHA_Left,
+					hg::DTVA_Top, text_uniform_values, no_textures, text_render_state);
+			}
+
+			DrawCircle(view_id, circle_vtx, mouse_pos, 20.f, hg::Color::White, draw2D_program, draw2D_render_state);
+
+			const char *stats = arena.Format("Frame arena: %d heap allocations in application code, %d in the whole frame - arena %d/%d bytes, %d overflows", int(app_allocs),
+				int(frame_allocs), int(arena.GetLastFrameUsage()), int(arena.GetCapacity()), int(arena.GetOverflowCount()));
+			hg::DrawText(view_id, font, stats_text.Set(stats), font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20, res_y - 40, 0), hg::DTHA_Left, hg::DTVA_Bottom,
+				text_uniform_values, no_textures, text_render_state);
+		} else {
+			// the same work with per-frame heap containers
+			std::vector<LabelEntry> labels;
+
+			for (const auto &node : nodes)
+				if (node.HasObject())
+					labels.push_back({node.ref, hg::Dist(node.GetTransform().GetPos(), cam_pos)});
+
+			std::sort(labels.begin(), labels.end(), [](const LabelEntry &a, const LabelEntry &b) { return a.distance < b.distance; });
+
+			std::vector<hg::UniformSetValue> values = {hg::MakeUniformSetValue("u_color", hg::Vec4(1.f, 1.f, 0.5f))};
+
+			for (size_t i = 0; i < labels.size() && i < 32; ++i)
+				hg::DrawText(view_id, font, hg::format("%1 m").arg(labels[i].distance), font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20.f, 20.f + float(i) * 20.f, 0),
+					hg::DTHA_Left, hg::DTVA_Top, values, {}, text_render_state);
+
+			hg::Vertices vtx(vtx_layout, 64);
+			DrawCircle(view_id, vtx, mouse_pos, 20.f, hg::Color::White, draw2D_program, draw2D_render_state);
+
+			hg::DrawText(view_id, font, hg::format("Naive: %1 heap allocations in application code, %2 in the whole frame").arg(app_allocs).arg(frame_allocs), font_program, "u_tex", 0,
+				hg::Mat4::Identity, hg::Vec3(20, res_y - 40, 0), hg::DTHA_Left, hg::DTVA_Bottom, values, {}, text_render_state);
+		}
+
+		hg::DrawText(view_id, font, help_text.text, font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20, res_y - 64, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values,
+			no_textures, text_render_state);
+
+		app_allocs = heap_alloc_count - app_alloc_start;
+
+		// end of frame, transient data is released
+		bgfx::frame();
+		arena.Reset();
+
+		hg::UpdateWindow(window);
+
+		frame_allocs = heap_alloc_count - frame_alloc_start;
+	}
+
+	hg::RenderShutdown();
+	hg::DestroyWindow(window);
+
+	hg::WindowSystemShutdown();
+	hg::InputShutdown();
+
+	return EXIT_SUCCESS;
+}
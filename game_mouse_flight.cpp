@@ -1,8 +1,19 @@
 // HARFANG(R) Copyright (C) 2021 Emmanuel Julien, NWNC HARFANG. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+// Pass -record <file> to record the session input, -replay <file> to play it back as a reproducible benchmark.
+// The world is streamed in cells around the camera, hold space to fly faster.
+#include <algorithm>
+#include <array>
 #include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
 
 #include <foundation/log.h>
 #include <foundation/clock.h>
+#include <foundation/format.h>
+#include <foundation/rand.h>
 #include <foundation/math.h>
 #include <foundation/projection.h>
 #include <foundation/matrix3.h>
@@ -16,14 +27,259 @@
 #include <engine/forward_pipeline.h>
 #include <engine/create_geometry.h>
 #include <engine/assets.h>
+#include <engine/font.h>
+#include "input_session.h"
+
+// World partition streamed around the camera. The world is a list of scene placements bucketed into a grid of square
+// cells, the cells entering the load radius are instantiated nearest first under a per frame time budget while their
+// textures and models go through the pipeline resources load queues, uploaded under a budget of their own. Cells are
+// unloaded past a larger radius so that flying along a cell border does not load and unload it over and over. Time
+// budgets depend on the machine load, a replay uses a placement count instead so that it streams the same cells on the
+// same frames from run to run.
+class WorldStreamer {
+public:
+	struct Placement {
+		std::string path; // scene asset
+		hg::Mat4 world;
+	};
+
+	struct Settings {
+		float cell_size = 240.f;
+		float load_radius = 480.f, unload_radius = 720.f;
+		hg::time_ns instantiate_budget = hg::time_from_ms(2); // at least one placement is instantiated per update
+		hg::time_ns upload_budget = hg::time_from_ms(4);
+
+		int instantiate_count = 0; // when not zero, placements instantiated per update instead of the time budget
+		bool upload_all = false; // drain the load queues on every update instead of the time budget
+	};
+
+	struct Stats {
+		int cell_count = 0, resident_cells = 0, loading_cells = 0, resident_placements = 0;
+		int loaded_cells = 0, unloaded_cells = 0; // during the last update
+		size_t uploaded_resources = 0; // during the last update
+		hg::time_ns instantiate_time = 0, upload_time = 0, unload_time = 0;
+	};
+
+	void Build(const std::vector<Placement> &placements_, const Settings &settings_) {
+		settings = settings_;
+		placements = placements_;
+
+		cells.clear();
+		grid.clear();
+		active.clear();
+		queue.clear();
+		stats = {};
+
+		if (placements.empty())
+			return;
+
+		// grid covering the placement origins, only the cells holding placements are stored
+		float min_x = placements[0].world.m[0][3], min_z = placements[0].world.m[2][3], max_x = min_x, max_z = min_z;
+		for (const auto &p : placements) {
+			min_x = std::min(min_x, p.world.m[0][3]), max_x = std::max(max_x, p.world.m[0][3]);
+			min_z = std::min(min_z, p.world.m[2][3]), max_z = std::max(max_z, p.world.m[2][3]);
+		}
+
+		origin_x = std::floor(min_x / settings.cell_size) * settings.cell_size;
+		origin_z = std::floor(min_z / settings.cell_size) * settings.cell_size;
+		grid_w = int((max_x - origin_x) / settings.cell_size) + 1;
+		grid_h = int((max_z - origin_z) / settings.cell_size) + 1;
+		grid.assign(size_t(grid_w) * grid_h, -1);
+
+		for (uint32_t i = 0; i < placements.size(); ++i) {
+			const int x = std::min(int((placements[i].world.m[0][3] - origin_x) / settings.cell_size), grid_w - 1);
+			const int z = std::min(int((placements[i].world.m[2][3] - origin_z) / settings.cell_size), grid_h - 1);
+
+			int &idx = grid[size_t(z) * grid_w + x];
+			if (idx < 0) {
+				idx = int(cells.size());
+				cells.emplace_back();
+				cells.back().x = x;
+				cells.back().z = z;
+			}
+			cells[idx].placements.push_back(i);
+		}
+
+		stats.cell_count = int(cells.size());
+	}
+
+	void Update(hg::Scene &scene, hg::PipelineResources &res, const hg::Vec3 &pos) {
+		stats.loaded_cells = stats.unloaded_cells = 0;
+
+		// unload the cells past the unload radius, partially instantiated cells included
+		hg::time_ns t = hg::time_now();
+
+		for (size_t i = 0; i < active.size();) {
+			Cell &cell = cells[active[i]];
+			cell.distance = CellDistance(cell, pos);
+
+			if (cell.distance > settings.unload_radius) {
+				UnloadCell(scene, cell);
+				active[i] = active.back();
+				active.pop_back();
+				++stats.unloaded_cells;
+			} else {
+				++i;
+			}
+		}
+
+		if (stats.unloaded_cells) {
+			queue.erase(std::remove_if(queue.begin(), queue.end(), [this](int idx) { return cells[idx].state == CS_Unloaded; }), queue.end());
+			scene.GarbageCollect();
+		}
+
+		stats.unload_time = hg::time_now() - t;
+
+		// queue the cells entering the load radius, only the grid rectangle around the camera is scanned
+		const int r = int(std::ceil(settings.load_radius / settings.cell_size));
+		const int cx = int(std::floor((pos.x - origin_x) / settings.cell_size)), cz = int(std::floor((pos.z - origin_z) / settings.cell_size));
+
+		for (int z = std::max(cz - r, 0); z <= std::min(cz + r, grid_h - 1); ++z)
+			for (int x = std::max(cx - r, 0); x <= std::min(cx + r, grid_w - 1); ++x) {
+				const int idx = grid[size_t(z) * grid_w + x];
+				if (idx < 0 || cells[idx].state != CS_Unloaded)
+					continue;
+
+				Cell &cell = cells[idx];
+				cell.distance = CellDistance(cell, pos);
+
+				if (cell.distance <= settings.load_radius) {
+					cell.state = CS_Queued;
+					active.push_back(idx);
+					queue.push_back(idx);
+				}
+			}
+
+		// instantiate the nearest cells first, one placement at a time until the budget is spent
+		std::sort(queue.begin(), queue.end(), [this](int a, int b) { return cells[a].distance < cells[b].distance; });
+
+		t = hg::time_now();
+		size_t done = 0;
+		int count = 0;
+
+		for (; done < queue.size(); ++count) {
+			if (settings.instantiate_count ? count == settings.instantiate_count : count && hg::time_now() - t >= settings.instantiate_budget)
+				break;
+
+			Cell &cell = cells[queue[done]];
+			const Placement &placement = placements[cell.placements[cell.nodes.size()]];
+
+			bool success;
+			hg::Node node = hg::CreateInstanceFromAssets(scene, placement.world, placement.path, res, hg::GetForwardPipelineInfo(), success,
+				hg::LSSF_AllNodeFeatures | hg::LSSF_QueueTextureLoads | hg::LSSF_QueueModelLoads);
+			if (!success)
+				hg::warn(hg::format("failed to instantiate '%1'").arg(placement.path));
+
+			// the world lighting belongs to the streaming scene
+			if (node.HasInstance())
+				for (auto ref : node.GetInstanceSceneView().nodes) {
+					hg::Node instance_node = scene.GetNode(ref);
+					if (instance_node.HasLight())
+						instance_node.Disable();
+				}
+
+			cell.nodes.push_back(node.ref);
+			++stats.resident_placements;
+
+			if (cell.nodes.size() == cell.placements.size()) {
+				cell.state = CS_Resident;
+				++stats.loaded_cells;
+				++done;
+			}
+		}
+
+		queue.erase(queue.begin(), queue.begin() + done);
+		stats.instantiate_time = hg::time_now() - t;
+
+		// upload the queued textures and models
+		t = hg::time_now();
+		stats.uploaded_resources = hg::ProcessLoadQueues(res, settings.upload_all ? std::numeric_limits<hg::time_ns>::max() : settings.upload_budget, true);
+		stats.upload_time = hg::time_now() - t;
+
+		stats.loading_cells = int(queue.size());
+		stats.resident_cells = int(active.size() - queue.size());
+	}
 
-void draw_circle(bgfx::ViewId &view_id, const hg::Vec2 &center, float radius, const hg::Color &color, bgfx::ProgramHandle draw2D_program, hg::RenderState& draw2D_render_state, bgfx::VertexLayout &vtx_layout) {
+	void UnloadAll(hg::Scene &scene) {
+		for (auto idx : active)
+			UnloadCell(scene, cells[idx]);
+
+		active.clear();
+		queue.clear();
+		scene.GarbageCollect();
+
+		stats.resident_cells = stats.loading_cells = 0;
+	}
+
+	const Stats &GetStats() const { return stats; }
+
+private:
+	enum CellState { CS_Unloaded, CS_Queued, CS_Resident };
+
+	struct Cell {
+		int x = 0, z = 0;
+		std::vector<uint32_t> placements;
+		std::vector<hg::NodeRef> nodes; // instantiated placements, in order
+		CellState state = CS_Unloaded;
+		float distance = 0.f;
+	};
+
+	// distance from a position to the cell footprint on the XZ plane
+	float CellDistance(const Cell &cell, const hg::Vec3 &pos) const {
+		const float x = origin_x + cell.x * settings.cell_size, z = origin_z + cell.z * settings.cell_size;
+		const float dx = std::max(std::max(x - pos.x, pos.x - (x + settings.cell_size)), 0.f);
+		const float dz = std::max(std::max(z - pos.z, pos.z - (z + settings.cell_size)), 0.f);
+		return std::sqrt(dx * dx + dz * dz);
+	}
+
+	void UnloadCell(hg::Scene &scene, Cell &cell) {
+		for (auto ref : cell.nodes) {
+			hg::Node node = scene.GetNode(ref);
+			node.DestroyInstance();
+			scene.DestroyNode(ref);
+		}
+
+		stats.resident_placements -= int(cell.nodes.size());
+		cell.nodes.clear();
+		cell.state = CS_Unloaded;
+	}
+
+	Settings settings;
+	std::vector<Placement> placements;
+
+	std::vector<Cell> cells;
+	std::vector<int> grid; // cell index or -1 for every grid coordinate
+	float origin_x = 0.f, origin_z = 0.f;
+	int grid_w = 0, grid_h = 0;
+
+	std::vector<int> active; // queued and resident cells
+	std::vector<int> queue; // cells waiting to be fully instantiated
+
+	Stats stats;
+};
+
+// Tile the playground over the world, every tile is rotated by a multiple of 90° chosen from its coordinates.
+std::vector<WorldStreamer::Placement> make_world_layout(int tile_count, float tile_spacing) {
+	std::vector<WorldStreamer::Placement> placements;
+	placements.reserve(size_t(tile_count) * tile_count);
+
+	for (int j = -tile_count / 2; j < tile_count - tile_count / 2; ++j)
+		for (int i = -tile_count / 2; i < tile_count - tile_count / 2; ++i) {
+			const uint32_t hash = (uint32_t(i) * 73856093u) ^ (uint32_t(j) * 19349663u);
+			const float yaw = float((hash >> 4) & 3) * hg::HalfPi;
+			placements.push_back({"playground/playground.scn", hg::TransformationMat4(hg::Vec3(i * tile_spacing, 0.f, j * tile_spacing), hg::Vec3(0.f, yaw, 0.f))});
+		}
+
+	return placements;
+}
+
+void draw_circle(bgfx::ViewId &view_id, hg::Vertices &vtx, const hg::Vec2 &center, float radius, const hg::Color &color, bgfx::ProgramHandle draw2D_program, hg::RenderState& draw2D_render_state) {
 	int segment_count = 32;
 	float step = hg::TwoPi / segment_count;
 	hg::Vec3 p0 = hg::Vec3(center.x + radius, center.y, 0.f);
 	hg::Vec3 p1 = hg::Vec3::Zero;
 
-	hg::Vertices vtx(vtx_layout, segment_count * 2 + 2);
+	vtx.Clear(); // the vertices are reused from frame to frame, clearing keeps their storage
 
 	for (int i = 0; i <= segment_count; i++) {
 		p1.x = radius * cos(i * step) + center.x; 
@@ -32,9 +288,9 @@ void draw_circle(bgfx::ViewId &view_id, const hg::Vec2 &center, float radius, co
 		vtx.Begin(2 * i).SetPos(p0).SetColor0(color).End();
 		vtx.Begin(2 * i + 1).SetPos(p1).SetColor0(color).End();
 		p0 = p1;
-
-		hg::DrawLines(view_id, vtx, draw2D_program, draw2D_render_state);
 	}
+
+	hg::DrawLines(view_id, vtx, draw2D_program, draw2D_render_state);
 }
 
 void update_plane(hg::Node &plane_node, float mouse_x_normd, float mouse_y_normd, float setting_plane_speed, float setting_plane_mouse_sensitivity) {
@@ -65,15 +321,31 @@ void update_chase_camera(hg::Node& camera_node, const hg::Vec3& target_pos, floa
 	camera_transform.SetRot(hg::ToEuler(hg::Mat3LookAt(camera_to_target)));
 }
 
-int main() {
+int main(int narg, const char **args) {
+	// record or replay the session input
+	InputSession::Mode session_mode = InputSession::IS_Live;
+	const char *session_path = nullptr;
+
+	for (int i = 1; i + 1 < narg; ++i)
+		if (!strcmp(args[i], "-record") || !strcmp(args[i], "-replay")) {
+			session_mode = !strcmp(args[i], "-record") ? InputSession::IS_Record : InputSession::IS_Replay;
+			session_path = args[++i];
+		}
+
+	InputSession session;
+	if (!session.Open(session_mode, session_path, uint32_t(hg::time_now()))) {
+		hg::error(hg::format("failed to open input session '%1'").arg(session_path));
+		return EXIT_FAILURE;
+	}
+
 	// Initialize input and window system.
 	hg::InputInit();
 	hg::WindowSystemInit();
 
 	int res_x = 1280, res_y = 720;
 
-	// create window.
-	hg::Window* window = hg::RenderInit("Harfang - Mouse Flight", res_x, res_y, BGFX_RESET_VSYNC | BGFX_RESET_MSAA_X8);
+	// create window, a replay runs without vertical synchronization to measure the actual frame cost.
+	hg::Window* window = hg::RenderInit("Harfang - Mouse Flight", res_x, res_y, (session_mode == InputSession::IS_Replay ? 0 : BGFX_RESET_VSYNC) | BGFX_RESET_MSAA_X8);
 	if (!window) {
 		hg::error("failed to create window.");
 		return EXIT_FAILURE;
@@ -92,6 +364,8 @@ int main() {
 	bgfx::ProgramHandle draw2D_program = hg::LoadProgramFromAssets("shaders/pos_rgb");
 	hg::RenderState draw2D_render_state = hg::ComputeRenderState(hg::BM_Alpha, hg::DT_Less, hg::FC_Disabled);
 
+	hg::Vertices cursor_vtx(vtx_layout, 66);
+
 	// gameplay settings
 	hg::Vec3 setting_camera_chase_offset = hg::Vec3(0, 0.2f, 0);
 	float setting_camera_chase_distance = 1;
@@ -99,10 +373,36 @@ int main() {
 	float setting_plane_speed = 0.05f;
 	float setting_plane_mouse_sensitivity = 0.5f;
 
-	// setup game world
+	// text overlay
+	hg::Font font = hg::LoadFontFromAssets("font/default.ttf", 16);
+	bgfx::ProgramHandle font_program = hg::LoadProgramFromAssets("core/shader/font");
+
+	hg::RenderState text_render_state = hg::ComputeRenderState(hg::BM_Alpha, hg::DT_Always, hg::FC_Disabled);
+	std::vector<hg::UniformSetValue> text_uniform_values = {hg::MakeUniformSetValue("u_color", hg::Vec4(1.f, 1.f, 1.f, 1.f))};
+
+	// setup game world, the environment and lighting of the playground scene are shared by the whole world: load it and
+	// only keep its lights, its geometry is streamed with the world cells
 	hg::Scene scene;
 	hg::LoadSceneContext load_ctx;
-	hg::LoadSceneFromAssets("playground/playground.scn", scene, res, hg::GetForwardPipelineInfo(), load_ctx);
+	if (!hg::LoadSceneFromAssets("playground/playground.scn", scene, res, hg::GetForwardPipelineInfo(), load_ctx)) {
+		hg::error("failed to load the playground scene.");
+		return EXIT_FAILURE;
+	}
+
+	for (auto ref : load_ctx.view.nodes)
+		if (!scene.GetNode(ref).HasLight())
+			scene.DestroyNode(ref);
+	scene.GarbageCollect();
+
+	// the world is far too large to be loaded up front, it is streamed in cells around the camera
+	WorldStreamer::Settings world_settings;
+	if (session_mode == InputSession::IS_Replay) {
+		world_settings.instantiate_count = 4;
+		world_settings.upload_all = true;
+	}
+
+	WorldStreamer world;
+	world.Build(make_world_layout(48, 120.f), world_settings);
 
 	bool success = true;
 	hg::Node plane_node = hg::CreateInstanceFromAssets(scene, hg::TranslationMat4(hg::Vec3(0, 4, 0)), "paper_plane/paper_plane.scn", res, hg::GetForwardPipelineInfo(), success);
@@ -110,29 +410,42 @@ int main() {
 
 	scene.SetCurrentCamera(camera_node);
 
-	hg::Keyboard keyboard;
-	hg::Mouse mouse;
+	FrameTimeReport frame_time_report;
+	hg::time_ns frame_start = hg::time_now();
+
+	// overlay texts, only formatted when the values they show change, the frame costs at most four times per second
+	std::string cells_text, memory_text, cost_text;
+	std::array<int, 5> cells_values;
+	std::array<int64_t, 4> memory_values;
+	cells_values.fill(-1);
+	memory_values.fill(-1);
+	hg::time_ns cost_text_time = -hg::time_from_ms(250);
 
 	// game loop
-	while(!keyboard.Down(hg::K_Escape)) {
-		hg::time_ns dt = hg::tick_clock();  // tick clock, retrieve elapsed clock since last call
+	for (;;) {
+		// update mouse/keyboard devices and tick clock, when replaying both come from the recorded session. Escape and the
+		// window closing are read live so that a replay can be aborted.
+		if (!session.Update(hg::tick_clock()) || hg::ReadKeyboard().key[hg::K_Escape] || !hg::IsWindowOpen(window))
+			break;
 
-		// update mouse/keyboard devices
-		keyboard.Update();
-		mouse.Update();
+		hg::time_ns dt = session.GetDt();
 
 		// compute ratio corrected normalized mouse position
-		int mouse_x = mouse.X();
-		int mouse_y = mouse.Y();
+		int mouse_x = session.GetMouse().x;
+		int mouse_y = session.GetMouse().y;
 
 		hg::Vec2 aspect_ratio = hg::ComputeAspectRatioX(float(res_x), float(res_y));
 		float mouse_x_normd = (mouse_x / float(res_x) - 0.5f) * aspect_ratio.x;
 		float mouse_y_normd = (mouse_y / float(res_y) - 0.5f) * aspect_ratio.y;
 
-		// update gameplay elements (plane & camera)
-		update_plane(plane_node, mouse_x_normd, mouse_y_normd, setting_plane_speed, setting_plane_mouse_sensitivity);
+		// update gameplay elements (plane & camera), hold space to fly faster
+		const float plane_speed = session.KeyDown(hg::K_Space) ? setting_plane_speed * 20.f : setting_plane_speed;
+		update_plane(plane_node, mouse_x_normd, mouse_y_normd, plane_speed, setting_plane_mouse_sensitivity);
 		update_chase_camera(camera_node, plane_node.GetTransform().GetWorld() * setting_camera_chase_offset, setting_camera_chase_distance);
 
+		// stream the world cells around the camera
+		world.Update(scene, res, camera_node.GetTransform().GetPos());
+
 		// update scene and submit it to render pipeline
 		scene.Update(dt);
 
@@ -142,13 +455,68 @@ int main() {
 
 		// draw 2D GUI
 		hg::SetView2D(view_id, 0, 0, res_x, res_y, -1, 1, BGFX_CLEAR_DEPTH, hg::Color::Black, 1, 0, true);
-		draw_circle(view_id, hg::Vec2(float(mouse_x), float(mouse_y)), 20.f, hg::Color::White, draw2D_program, draw2D_render_state, vtx_layout); // display mouse cursor
+		draw_circle(view_id, cursor_vtx, hg::Vec2(float(mouse_x), float(mouse_y)), 20.f, hg::Color::White, draw2D_program, draw2D_render_state); // display mouse cursor
+
+		// streaming report
+		const WorldStreamer::Stats &world_stats = world.GetStats();
+		const bgfx::Stats *render_stats = bgfx::getStats();
+
+		const std::array<int, 5> cells = {
+			{world_stats.resident_cells, world_stats.loading_cells, world_stats.cell_count, world_stats.resident_placements, int(scene.GetAllNodeCount())}};
+		if (cells != cells_values) {
+			cells_values = cells;
+			cells_text = hg::format("Cells: %1 resident, %2 loading (%3 in world) - %4 placements, %5 nodes")
+							 .arg(cells[0])
+							 .arg(cells[1])
+							 .arg(cells[2])
+							 .arg(cells[3])
+							 .arg(cells[4]);
+		}
+
+		const std::array<int64_t, 4> memory = {
+			{render_stats->numTextures, render_stats->textureMemoryUsed, render_stats->numVertexBuffers, render_stats->numIndexBuffers}};
+		if (memory != memory_values) {
+			memory_values = memory;
+			memory_text = hg::format("GPU: %1 textures (%2 MB), %3 vertex buffers, %4 index buffers")
+							  .arg(int(memory[0]))
+							  .arg(float(memory[1]) / (1024.f * 1024.f))
+							  .arg(int(memory[2]))
+							  .arg(int(memory[3]));
+		}
+
+		if (hg::time_now() - cost_text_time >= hg::time_from_ms(250)) {
+			cost_text = hg::format("Frame cost: instantiate %1 ms, upload %2 ms (%3 resources), unload %4 ms")
+							.arg(hg::time_to_ms_f(world_stats.instantiate_time))
+							.arg(hg::time_to_ms_f(world_stats.upload_time))
+							.arg(int(world_stats.uploaded_resources))
+							.arg(hg::time_to_ms_f(world_stats.unload_time));
+			cost_text_time = hg::time_now();
+		}
+
+		++view_id;
+		hg::SetView2D(view_id, 0, 0, res_x, res_y, -1, 1, 0, hg::Color::Black, 1, 0);
+		hg::DrawText(view_id, font, cells_text, font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(10, res_y - 20, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+		hg::DrawText(view_id, font, memory_text, font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(10, res_y - 40, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+		hg::DrawText(view_id, font, cost_text, font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(10, res_y - 60, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
 
 		// end of frame
 		bgfx::frame();
 		hg::UpdateWindow(window);
+
+		const hg::time_ns now = hg::time_now();
+		if (session_mode == InputSession::IS_Replay)
+			frame_time_report.frame_times.push_back(now - frame_start);
+		frame_start = now;
 	}
 
+	world.UnloadAll(scene);
+
+	session.Close();
+	if (session_mode == InputSession::IS_Replay)
+		hg::log(hg::format("replay of '%1' (seed %2): %3").arg(session_path).arg(session.GetSeed()).arg(frame_time_report.Format()));
+	else if (session_mode == InputSession::IS_Record)
+		hg::log(hg::format("recorded session to '%1', %2 bytes").arg(session_path).arg(int(session.GetStreamSize())));
+
 	hg::RenderShutdown();
 	hg::DestroyWindow(window);
 
@@ -0,0 +1,243 @@
+// HARFANG(R) Copyright (C) 2022 NWNC HARFANG. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+// Mouse flight with timestamped input sampling: the mouse is sampled several times per frame, the newest sample is
+// read just before the plane and camera are updated (late sampling) and the input to submit latency is measured.
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include <foundation/clock.h>
+#include <foundation/format.h>
+#include <foundation/log.h>
+#include <foundation/math.h>
+#include <foundation/matrix3.h>
+#include <foundation/projection.h>
+
+#include <platform/input_system.h>
+#include <platform/window_system.h>
+
+#include <engine/assets.h>
+#include <engine/font.h>
+#include <engine/forward_pipeline.h>
+#include <engine/render_pipeline.h>
+#include <engine/scene.h>
+#include <engine/scene_forward_pipeline.h>
+
+struct InputSample {
+	hg::time_ns t;
+	int x, y;
+};
+
+// Ring buffer of timestamped mouse samples. The platform layer only allows reading the mouse from the thread pumping
+// the window events, so sampling points are spread over the frame on that thread.
+class InputTimeline {
+public:
+	void Sample() {
+		const hg::MouseState state = hg::ReadMouse();
+
+		InputSample &s = samples[head % capacity];
+		s.t = hg::time_now();
+		s.x = state.x;
+		s.y = state.y;
+
+		if (head > 0 && (s.x != samples[(head - 1) % capacity].x || s.y != samples[(head - 1) % capacity].y) && first_change == InvalidIndex)
+			first_change = head;
+		++head;
+	}
+
+	// All samples taken since the previous call, oldest first.
+	size_t ConsumeSinceLastFrame(std::vector<InputSample> &out) {
+		out.clear();
+		for (size_t i = std::max(consumed, head > capacity ? head - capacity : 0); i < head; ++i)
+			out.push_back(samples[i % capacity]);
+		consumed = head;
+		return out.size();
+	}
+
+	const InputSample &Newest() const { return samples[(head - 1) % capacity]; }
+
+	// Timestamp of the first sample that moved since the last reset, 0 if the mouse did not move.
+	hg::time_ns GetFirstChangeTime() const { return first_change == InvalidIndex ? 0 : samples[first_change % capacity].t; }
+	void ResetChange() { first_change = InvalidIndex; }
+
+private:
+	static const size_t capacity = 256, InvalidIndex = ~size_t(0);
+
+	InputSample samples[capacity] = {};
+	size_t head = 0, consumed = 0, first_change = InvalidIndex;
+};
+
+// Rolling latency statistics over the last frames.
+struct LatencyStats {
+	static const int window = 120;
+
+	float values[window] = {};
+	int count = 0;
+
+	void Push(hg::time_ns latency) { values[count++ % window] = hg::time_to_ms_f(latency); }
+
+	float Average() const {
+		const int n = std::min(count, window);
+		float sum = 0.f;
+		for (int i = 0; i < n; ++i)
+			sum += values[i];
+		return n ? sum / n : 0.f;
+	}
+
+	float Max() const { return count ? *std::max_element(values, values + std::min(count, window)) : 0.f; }
+};
+
+static void UpdatePlane(hg::Node &plane_node, float mouse_x_normd, float mouse_y_normd, float speed, float mouse_sensitivity) {
+	hg::Transform plane_transform = plane_node.GetTransform();
+
+	hg::Vec3 plane_pos = plane_transform.GetPos();
+	plane_pos = plane_pos + hg::Normalize(hg::GetZ(plane_transform.GetWorld())) * speed;
+	plane_pos.y = hg::Clamp(plane_pos.y, 0.1f, 50.f); // floor / ceiling
+
+	hg::Vec3 plane_rot = plane_transform.GetRot();
+	hg::Vec3 next_plane_rot = plane_rot;
+	next_plane_rot.x = hg::Clamp(next_plane_rot.x + mouse_y_normd * -0.03f, -0.75f, 0.75f);
+	next_plane_rot.y = next_plane_rot.y + mouse_x_normd * 0.03f;
+	next_plane_rot.z = hg::Clamp(mouse_x_normd * -0.75f, -1.2f, 1.2f);
+
+	plane_rot = plane_rot + (next_plane_rot - plane_rot) * mouse_sensitivity;
+
+	plane_transform.SetPos(plane_pos);
+	plane_transform.SetRot(plane_rot);
+}
+
+static void UpdateChaseCamera(hg::Node &camera_node, const hg::Vec3 &target_pos, float distance) {
+	hg::Transform camera_transform = camera_node.GetTransform();
+	hg::Vec3 camera_to_target = hg::Normalize(target_pos - camera_transform.GetPos());
+
+	camera_transform.SetPos(target_pos - camera_to_target * distance);
+	camera_transform.SetRot(hg::ToEuler(hg::Mat3LookAt(camera_to_target)));
+}
+
+// Stand-in for the game simulation running between the start of the frame and the render submission.
+static void SimulateWork(hg::time_ns duration) {
+	const hg::time_ns end = hg::time_now() + duration;
+	while (hg::time_now() < end)
+		;
+}
+
+int main() {
+	hg::InputInit();
+	hg::WindowSystemInit();
+
+	int res_x = 1280, res_y = 720;
+
+	hg::Window *window = hg::RenderInit("Harfang - Mouse Latency", res_x, res_y, BGFX_RESET_VSYNC | BGFX_RESET_MSAA_X8);
+	if (!window) {
+		hg::error("failed to create window.");
+		return EXIT_FAILURE;
+	}
+
+	// create forward pipeline and resources.
+	hg::PipelineResources res = hg::PipelineResources();
+	hg::ForwardPipeline pipeline = hg::CreateForwardPipeline();
+
+	// access compiled resources
+	hg::AddAssetsFolder("resources_compiled");
+
+	// text rendering
+	hg::Font font = hg::LoadFontFromAssets("font/default.ttf", 16);
+	bgfx::ProgramHandle font_program = hg::LoadProgramFromAssets("core/shader/font");
+
+	std::vector<hg::UniformSetValue> text_uniform_values = {hg::MakeUniformSetValue("u_color", hg::Vec4(1.f, 1.f, 0.5f))};
+	hg::RenderState text_render_state = hg::ComputeRenderState(hg::BM_Alpha, hg::DT_Always, hg::FC_Disabled);
+
+	// setup game world
+	hg::Scene scene;
+	hg::LoadSceneContext load_ctx;
+	hg::LoadSceneFromAssets("playground/playground.scn", scene, res, hg::GetForwardPipelineInfo(), load_ctx);
+
+	bool success = true;
+	hg::Node plane_node = hg::CreateInstanceFromAssets(scene, hg::TranslationMat4(hg::Vec3(0, 4, 0)), "paper_plane/paper_plane.scn", res, hg::GetForwardPipelineInfo(), success);
+	hg::Node camera_node = hg::CreateCamera(scene, hg::TranslationMat4(hg::Vec3(0, 4, -5)), 0.01f, 1000);
+
+	scene.SetCurrentCamera(camera_node);
+
+	InputTimeline input;
+	std::vector<InputSample> frame_samples;
+	LatencyStats sample_to_submit, change_to_submit;
+
+	bool late_sampling = true;
+	hg::time_ns work = hg::time_from_ms(4);
+
+	hg::Keyboard keyboard;
+
+	while (!keyboard.Down(hg::K_Escape) && hg::IsWindowOpen(window)) {
+		hg::time_ns dt = hg::tick_clock();
+
+		keyboard.Update();
+		input.Sample(); // early sample, start of the frame
+
+		if (keyboard.Pressed(hg::K_L))
+			late_sampling = !late_sampling;
+		if (keyboard.Pressed(hg::K_Add))
+			work = work + hg::time_from_ms(1);
+		if (keyboard.Pressed(hg::K_Sub))
+			work = std::max(work - hg::time_from_ms(1), hg::time_ns(0));
+
+		const InputSample early = input.Newest();
+
+		SimulateWork(work);
+
+		input.Sample(); // late sample, just before the input is used
+		const InputSample used = late_sampling ? input.Newest() : early;
+
+		// update gameplay elements (plane & camera)
+		const hg::Vec2 aspect_ratio = hg::ComputeAspectRatioX(float(res_x), float(res_y));
+		const float mouse_x_normd = (used.x / float(res_x) - 0.5f) * aspect_ratio.x;
+		const float mouse_y_normd = (used.y / float(res_y) - 0.5f) * aspect_ratio.y;
+
+		UpdatePlane(plane_node, mouse_x_normd, mouse_y_normd, 0.05f, 0.5f);
+		UpdateChaseCamera(camera_node, plane_node.GetTransform().GetWorld() * hg::Vec3(0, 0.2f, 0), 1.f);
+
+		scene.Update(dt);
+
+		bgfx::ViewId view_id = 0;
+		hg::SceneForwardPipelinePassViewId views;
+		hg::SubmitSceneToPipeline(view_id, scene, hg::iRect(0, 0, res_x, res_y), true, pipeline, res, views);
+
+		// latency report
+		const size_t sample_count = input.ConsumeSinceLastFrame(frame_samples);
+
+		hg::SetView2D(view_id, 0, 0, res_x, res_y, -1, 1, BGFX_CLEAR_DEPTH, hg::Color::Black, 1, 0);
+
+		const std::string stats = hg::format("%1 sampling - input to submit avg %2 ms, max %3 ms - mouse move to submit avg %4 ms, max %5 ms - %6 samples/frame")
+									  .arg(late_sampling ? "Late" : "Early")
+									  .arg(sample_to_submit.Average())
+									  .arg(sample_to_submit.Max())
+									  .arg(change_to_submit.Average())
+									  .arg(change_to_submit.Max())
+									  .arg(sample_count);
+		hg::DrawText(view_id, font, stats, font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20, res_y - 40, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+		hg::DrawText(view_id, font, hg::format("L: toggle late sampling - +/-: simulated work (%1 ms)").arg(hg::time_to_ms(work)), font_program, "u_tex", 0, hg::Mat4::Identity,
+			hg::Vec3(20, res_y - 64, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+
+		// measure from the input timestamps to the frame submission
+		const hg::time_ns submit_t = hg::time_now();
+
+		sample_to_submit.Push(submit_t - used.t);
+		if (const hg::time_ns change_t = input.GetFirstChangeTime())
+			change_to_submit.Push(submit_t - change_t);
+		input.ResetChange();
+
+		bgfx::frame();
+		hg::UpdateWindow(window);
+
+		input.Sample(); // the frame call blocks on vsync, catch the input that came in meanwhile
+	}
+
+	hg::RenderShutdown();
+	hg::DestroyWindow(window);
+
+	hg::WindowSystemShutdown();
+	hg::InputShutdown();
+
+	return EXIT_SUCCESS;
+}
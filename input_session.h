@@ -0,0 +1,246 @@
+// HARFANG(R) Copyright (C) 2022 NWNC HARFANG. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <foundation/clock.h>
+#include <foundation/format.h>
+#include <foundation/rand.h>
+
+#include <platform/input_system.h>
+
+// Record or replay the keyboard and mouse states and the frame delta times of a session. The recording also holds the
+// seed of the random number generator, replaying it feeds the exact same inputs, delta times and random streams.
+// Frames are delta encoded: the delta time, the keys that changed state and the mouse fields that changed. A recording
+// is flushed to its file every second or so, a crash only loses the last frames.
+class InputSession {
+public:
+	enum Mode { IS_Live, IS_Record, IS_Replay };
+
+	~InputSession() { Close(); }
+
+	// Start a session, the seed is ignored when replaying as the recorded seed is used instead.
+	bool Open(Mode mode_, const char *path, uint32_t seed_) {
+		mode = mode_;
+		seed = seed_;
+		stream.clear();
+		cursor = 0;
+		flushed_size = 0;
+		unflushed_frames = 0;
+
+		if (mode == IS_Replay) {
+			FILE *file = fopen(path, "rb");
+			if (!file)
+				return false;
+
+			long size = -1;
+			if (fseek(file, 0, SEEK_END) == 0)
+				size = ftell(file);
+
+			bool ok = size >= 0 && fseek(file, 0, SEEK_SET) == 0;
+			if (ok) {
+				stream.resize(size_t(size));
+				ok = fread(stream.data(), 1, stream.size(), file) == stream.size();
+			}
+			fclose(file);
+
+			uint32_t header[3];
+			if (!ok || stream.size() < sizeof(header))
+				return false;
+			memcpy(header, stream.data(), sizeof(header));
+			if (header[0] != magic || header[1] != version)
+				return false;
+
+			seed = header[2];
+			cursor = sizeof(header);
+		} else if (mode == IS_Record) {
+			out = fopen(path, "wb");
+			if (!out)
+				return false;
+
+			const uint32_t header[3] = {magic, version, seed};
+			fwrite(header, sizeof(header), 1, out);
+		}
+
+		hg::Seed(seed);
+		return true;
+	}
+
+	void Close() {
+		if (out) {
+			Flush();
+			fclose(out);
+			out = nullptr;
+		}
+	}
+
+	// Advance to the next frame, returns false once a replay is over.
+	bool Update(hg::time_ns live_dt) {
+		old_keyboard = keyboard;
+
+		if (mode == IS_Replay) {
+			if (cursor >= stream.size())
+				return false;
+
+			dt = hg::time_ns(ReadVarint());
+			for (uint64_t count = ReadVarint(); count > 0; --count) {
+				const uint64_t key = ReadVarint();
+				if (key < hg::K_Last)
+					keyboard.key[key] = !keyboard.key[key];
+			}
+
+			const uint64_t fields = ReadVarint();
+			if (fields & MF_Pos) {
+				mouse.x += DecodeZigZag(ReadVarint());
+				mouse.y += DecodeZigZag(ReadVarint());
+			}
+			if (fields & MF_Button)
+				for (int i = 0; i < 8; ++i)
+					mouse.button[i] = (fields >> (8 + i)) & 1;
+			if (fields & MF_Wheel) {
+				mouse.wheel = DecodeZigZag(ReadVarint());
+				mouse.hwheel = DecodeZigZag(ReadVarint());
+			} else {
+				mouse.wheel = mouse.hwheel = 0;
+			}
+			return cursor <= stream.size();
+		}
+
+		const hg::KeyboardState new_keyboard = hg::ReadKeyboard();
+		const hg::MouseState new_mouse = hg::ReadMouse();
+
+		if (mode == IS_Record) {
+			WriteVarint(uint64_t(live_dt));
+
+			changed_keys.clear();
+			for (int i = 0; i < hg::K_Last; ++i)
+				if (new_keyboard.key[i] != keyboard.key[i])
+					changed_keys.push_back(i);
+
+			WriteVarint(changed_keys.size());
+			for (int key : changed_keys)
+				WriteVarint(uint64_t(key));
+
+			uint64_t fields = 0;
+			if (new_mouse.x != mouse.x || new_mouse.y != mouse.y)
+				fields |= MF_Pos;
+			for (int i = 0; i < 8; ++i) {
+				if (new_mouse.button[i] != mouse.button[i])
+					fields |= MF_Button;
+				fields |= uint64_t(new_mouse.button[i]) << (8 + i);
+			}
+			if (new_mouse.wheel != 0 || new_mouse.hwheel != 0)
+				fields |= MF_Wheel;
+
+			WriteVarint((fields & MF_Button) ? fields : (fields & 0xff));
+			if (fields & MF_Pos) {
+				WriteVarint(EncodeZigZag(new_mouse.x - mouse.x));
+				WriteVarint(EncodeZigZag(new_mouse.y - mouse.y));
+			}
+			if (fields & MF_Wheel) {
+				WriteVarint(EncodeZigZag(new_mouse.wheel));
+				WriteVarint(EncodeZigZag(new_mouse.hwheel));
+			}
+
+			if (++unflushed_frames >= flush_frame_count)
+				Flush();
+		}
+
+		dt = live_dt;
+		keyboard = new_keyboard;
+		mouse = new_mouse;
+		return true;
+	}
+
+	Mode GetMode() const { return mode; }
+	uint32_t GetSeed() const { return seed; }
+	size_t GetStreamSize() const { return flushed_size + stream.size(); }
+
+	hg::time_ns GetDt() const { return dt; }
+	bool KeyDown(hg::Key key) const { return keyboard.key[key]; }
+	bool KeyPressed(hg::Key key) const { return keyboard.key[key] && !old_keyboard.key[key]; }
+	const hg::MouseState &GetMouse() const { return mouse; }
+
+private:
+	enum MouseField { MF_Pos = 1, MF_Button = 2, MF_Wheel = 4 }; // button states are stored in bits 8 to 15
+
+	static const uint32_t magic = 0x52495348; // 'HSIR'
+	static const uint32_t version = 1;
+
+	static const int flush_frame_count = 60;
+
+	static uint64_t EncodeZigZag(int v) { return v < 0 ? (uint64_t(-int64_t(v)) << 1) - 1 : uint64_t(v) << 1; }
+	static int DecodeZigZag(uint64_t v) { return (v & 1) ? -int(int64_t(v >> 1) + 1) : int(v >> 1); }
+
+	// Append the recorded frames to the file, the stream only holds the frames recorded since the last flush.
+	void Flush() {
+		fwrite(stream.data(), 1, stream.size(), out);
+		fflush(out);
+
+		flushed_size += stream.size();
+		stream.clear();
+		unflushed_frames = 0;
+	}
+
+	void WriteVarint(uint64_t v) {
+		for (; v >= 0x80; v >>= 7)
+			stream.push_back(uint8_t(v | 0x80));
+		stream.push_back(uint8_t(v));
+	}
+
+	uint64_t ReadVarint() {
+		uint64_t v = 0;
+		for (int shift = 0; cursor < stream.size() && shift < 64; shift += 7) {
+			const uint8_t b = stream[cursor++];
+			v |= uint64_t(b & 0x7f) << shift;
+			if (!(b & 0x80))
+				return v;
+		}
+		cursor = stream.size() + 1; // truncated stream
+		return 0;
+	}
+
+	Mode mode = IS_Live;
+	uint32_t seed = 0;
+
+	std::vector<uint8_t> stream;
+	size_t cursor = 0;
+	FILE *out = nullptr;
+	size_t flushed_size = 0;
+	int unflushed_frames = 0;
+
+	std::vector<int> changed_keys;
+
+	hg::time_ns dt = 0;
+	hg::KeyboardState keyboard{}, old_keyboard{};
+	hg::MouseState mouse{};
+};
+
+// Frame time statistics of a replayed session, reported once the replay is over.
+struct FrameTimeReport {
+	std::vector<hg::time_ns> frame_times;
+
+	std::string Format() {
+		if (frame_times.empty())
+			return "no frame replayed";
+
+		std::sort(frame_times.begin(), frame_times.end());
+
+		hg::time_ns total = 0;
+		for (auto t : frame_times)
+			total += t;
+
+		return hg::format("%1 frames, average %2 ms, median %3 ms, 99th percentile %4 ms, worst %5 ms")
+			.arg(int(frame_times.size()))
+			.arg(hg::time_to_ms_f(total / hg::time_ns(frame_times.size())))
+			.arg(hg::time_to_ms_f(frame_times[frame_times.size() / 2]))
+			.arg(hg::time_to_ms_f(frame_times[frame_times.size() * 99 / 100]))
+			.arg(hg::time_to_ms_f(frame_times.back()));
+	}
+};
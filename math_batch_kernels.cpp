@@ -0,0 +1,157 @@
+// HARFANG(R) Copyright (C) 2022 NWNC HARFANG. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+// Microbenchmark of the batch math kernels of batch_math.h: every kernel runs against the equivalent loop of scalar hg
+// calls and their results are validated.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <foundation/clock.h>
+#include <foundation/format.h>
+#include <foundation/log.h>
+#include <foundation/projection.h>
+#include <foundation/rand.h>
+
+#include "batch_math.h"
+
+// Microbenchmark.
+template <typename Fn> static hg::time_ns BestOf(int runs, Fn fn) {
+	hg::time_ns best = 0;
+	for (int i = 0; i < runs; ++i) {
+		const hg::time_ns start = hg::time_now();
+		fn();
+		const hg::time_ns elapsed = hg::time_now() - start;
+		if (i == 0 || elapsed < best)
+			best = elapsed;
+	}
+	return best;
+}
+
+// Largest error relative to the reference magnitude, absolute below 1.
+static float MaxError(const float *ref, const float *out, size_t count) {
+	float err = 0.f;
+	for (size_t i = 0; i < count; ++i)
+		err = std::max(err, std::abs(ref[i] - out[i]) / std::max(std::abs(ref[i]), 1.f));
+	return err;
+}
+
+static std::string FormatResult(const char *kernel, const char *path, hg::time_ns elapsed, hg::time_ns reference, size_t count, const std::string &check) {
+	return hg::format("%1 %2: %3 ns/element, x%4 %5")
+		.arg(kernel)
+		.arg(path)
+		.arg(float(elapsed) / float(count), 2)
+		.arg(float(reference) / float(std::max<hg::time_ns>(elapsed, 1)), 2)
+		.arg(check);
+}
+
+int main(int narg, const char **args) {
+	const size_t count = 1 << 16;
+	const int runs = 50;
+
+	// inputs
+	hg::Seed(0);
+
+	std::vector<hg::Vec3> points(count), positions(count), scales(count);
+	std::vector<hg::Quaternion> rotations(count);
+	std::vector<hg::Mat4> mat_a(count), mat_b(count);
+	std::vector<hg::MinMax> aabbs(count);
+
+	for (size_t i = 0; i < count; ++i) {
+		points[i] = hg::Vec3(hg::FRRand(-100.f, 100.f), hg::FRRand(-100.f, 100.f), hg::FRRand(-100.f, 100.f));
+		positions[i] = hg::Vec3(hg::FRRand(-100.f, 100.f), hg::FRRand(-100.f, 100.f), hg::FRRand(-100.f, 100.f));
+		scales[i] = hg::Vec3(hg::FRRand(0.5f, 2.f), hg::FRRand(0.5f, 2.f), hg::FRRand(0.5f, 2.f));
+		rotations[i] = hg::QuaternionFromEuler(hg::Vec3(hg::FRRand(-hg::Pi, hg::Pi), hg::FRRand(-hg::Pi, hg::Pi), hg::FRRand(-hg::Pi, hg::Pi)));
+		mat_a[i] = hg::TransformationMat4(positions[i], hg::Vec3(hg::FRand(), hg::FRand(), hg::FRand()), scales[i]);
+		mat_b[i] = hg::TransformationMat4(points[i], hg::Vec3(hg::FRand(), hg::FRand(), hg::FRand()));
+
+		const hg::Vec3 size(hg::FRRand(0.1f, 4.f), hg::FRRand(0.1f, 4.f), hg::FRRand(0.1f, 4.f));
+		aabbs[i] = hg::MinMax(positions[i] - size, positions[i] + size);
+	}
+
+	const hg::Mat4 transform = hg::TransformationMat4(hg::Vec3(1.f, 2.f, 3.f), hg::Deg3(30.f, 45.f, 60.f), hg::Vec3(1.f, 2.f, 0.5f));
+
+	const hg::Mat44 proj = hg::ComputePerspectiveProjectionMatrix(0.1f, 150.f, hg::FovToZoomFactor(hg::Deg(60.f)), hg::ComputeAspectRatioX(16.f, 9.f));
+	const hg::Frustum frustum = hg::MakeFrustum(proj, hg::Mat4LookAt(hg::Vec3(0.f, 0.f, -50.f), hg::Vec3::Zero));
+
+	// scalar hg reference
+	std::vector<hg::Vec3> ref_points(count), out_points(count);
+	std::vector<hg::Mat4> ref_mats(count), out_mats(count), ref_trs(count), out_trs(count);
+	std::vector<uint8_t> ref_visible(count), out_visible(count);
+
+	const hg::time_ns ref_points_t = BestOf(runs, [&]() {
+		for (size_t i = 0; i < count; ++i)
+			ref_points[i] = transform * points[i];
+	});
+	const hg::time_ns ref_mats_t = BestOf(runs, [&]() {
+		for (size_t i = 0; i < count; ++i)
+			ref_mats[i] = mat_a[i] * mat_b[i];
+	});
+	const hg::time_ns ref_trs_t = BestOf(runs, [&]() {
+		for (size_t i = 0; i < count; ++i)
+			ref_trs[i] = hg::TransformationMat4(positions[i], hg::ToMatrix3(rotations[i]), scales[i]);
+	});
+	const hg::time_ns ref_visible_t = BestOf(runs, [&]() {
+		for (size_t i = 0; i < count; ++i)
+			ref_visible[i] = hg::TestVisibility(frustum, aabbs[i]) != hg::V_Outside ? 1 : 0;
+	});
+
+	hg::log(hg::format("%1 elements, best of %2 runs, speedups relative to the scalar hg calls").arg(int(count)).arg(runs));
+	hg::log(FormatResult("TransformPoints", "hg", ref_points_t, ref_points_t, count, ""));
+	hg::log(FormatResult("MulMat4", "hg", ref_mats_t, ref_mats_t, count, ""));
+	hg::log(FormatResult("ComposeTRS", "hg", ref_trs_t, ref_trs_t, count, ""));
+	hg::log(FormatResult("TestAABBs", "hg", ref_visible_t, ref_visible_t, count, ""));
+
+	bool all_valid = true;
+
+	for (int isa = 0; isa < BMI_Count; ++isa) {
+		if (!IsBatchMathISASupported(BatchMathISA(isa))) {
+			hg::log(hg::format("%1: not supported").arg(GetBatchMathISAName(BatchMathISA(isa))));
+			continue;
+		}
+
+		const BatchMath math = GetBatchMath(BatchMathISA(isa));
+		const char *name = GetBatchMathISAName(BatchMathISA(isa));
+
+		const hg::time_ns points_t = BestOf(runs, [&]() { math.transform_points(transform, points.data(), out_points.data(), count); });
+		const hg::time_ns mats_t = BestOf(runs, [&]() { math.mul_mat4(mat_a.data(), mat_b.data(), out_mats.data(), count); });
+		const hg::time_ns trs_t = BestOf(runs, [&]() { math.compose_trs(positions.data(), rotations.data(), scales.data(), out_trs.data(), count); });
+		const hg::time_ns visible_t = BestOf(runs, [&]() { math.test_aabbs(frustum, aabbs.data(), out_visible.data(), count); });
+
+		// validate against the reference, fused multiply-add and operation order account for small differences and may
+		// flip the result of boxes exactly touching a plane
+		const float points_err = MaxError(&ref_points[0].x, &out_points[0].x, count * 3);
+		const float mats_err = MaxError(&ref_mats[0].m[0][0], &out_mats[0].m[0][0], count * 12);
+		const float trs_err = MaxError(&ref_trs[0].m[0][0], &out_trs[0].m[0][0], count * 12);
+
+		size_t visible_mismatch = 0;
+		for (size_t i = 0; i < count; ++i)
+			if (ref_visible[i] != out_visible[i])
+				++visible_mismatch;
+
+		const bool valid = points_err < 1e-5f && mats_err < 1e-5f && trs_err < 1e-5f && visible_mismatch <= count / 10000;
+		all_valid = all_valid && valid;
+
+		hg::log(FormatResult("TransformPoints", name, points_t, ref_points_t, count, hg::format("(max error %1)").arg(points_err, 6)));
+		hg::log(FormatResult("MulMat4", name, mats_t, ref_mats_t, count, hg::format("(max error %1)").arg(mats_err, 6)));
+		hg::log(FormatResult("ComposeTRS", name, trs_t, ref_trs_t, count, hg::format("(max error %1)").arg(trs_err, 6)));
+		hg::log(FormatResult("TestAABBs", name, visible_t, ref_visible_t, count, hg::format("(%1 mismatches)").arg(int(visible_mismatch))));
+	}
+
+	// the kernels are in place safe element for element
+	std::vector<hg::Mat4> in_place = mat_a;
+	GetBatchMath().mul_mat4(in_place.data(), mat_b.data(), in_place.data(), count);
+	if (MaxError(&ref_mats[0].m[0][0], &in_place[0].m[0][0], count * 12) >= 1e-5f)
+		all_valid = false;
+
+	if (!all_valid) {
+		hg::error("batch math kernels do not match the scalar hg reference");
+		return EXIT_FAILURE;
+	}
+
+	hg::log("all batch math kernels match the scalar hg reference");
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,599 @@
+// HARFANG(R) Copyright (C) 2022 NWNC HARFANG. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+// Optimize model geometry for the post-transform vertex cache, overdraw and vertex fetch then quantize its attributes to 16 bits.
+// The pass runs on meshes built at creation time and on imported .geo files, usage: model_optimize [source geometry folder]
+// The source geometries default to the car engine of the source tree resources, they are not installed.
+
+#include <foundation/clock.h>
+#include <foundation/dir.h>
+#include <foundation/format.h>
+#include <foundation/log.h>
+#include <foundation/math.h>
+#include <foundation/minmax.h>
+#include <foundation/projection.h>
+
+#include <platform/input_system.h>
+#include <platform/window_system.h>
+
+#include <engine/assets.h>
+#include <engine/create_geometry.h>
+#include <engine/font.h>
+#include <engine/forward_pipeline.h>
+#include <engine/geometry.h>
+#include <engine/render_pipeline.h>
+#include <engine/scene.h>
+#include <engine/scene_forward_pipeline.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "source_resources.h"
+
+// CPU side triangle mesh, indices are a triangle list.
+struct Mesh {
+	std::vector<hg::Vec3> pos;
+	std::vector<hg::Vec3> normal;
+	std::vector<hg::Vec2> uv; // optional
+	std::vector<uint32_t> idx;
+};
+
+// Average cache miss ratio: number of vertex shader invocations per triangle for a FIFO post-transform cache.
+static float ComputeACMR(const std::vector<uint32_t> &idx, size_t vtx_count, uint32_t cache_size = 16) {
+	if (idx.empty())
+		return 0.f;
+
+	std::vector<uint32_t> stamp(vtx_count, 0);
+	uint32_t time = cache_size + 1, misses = 0;
+
+	for (uint32_t v : idx)
+		if (time - stamp[v] > cache_size) {
+			stamp[v] = time++;
+			++misses;
+		}
+
+	return float(misses) / float(idx.size() / 3);
+}
+
+// Tom Forsyth's linear-speed vertex cache optimization.
+static const int forsyth_cache_size = 32;
+
+static float ForsythVertexScore(int cache_pos, uint32_t live_tri_count) {
+	if (live_tri_count == 0)
+		return -1.f; // no triangle left to emit using this vertex
+
+	float score = 0.f;
+	if (cache_pos >= 0)
+		score = cache_pos < 3 ? 0.75f : powf(1.f - float(cache_pos - 3) / float(forsyth_cache_size - 3), 1.5f);
+
+	return score + 2.f / sqrtf(float(live_tri_count));
+}
+
+static void OptimizeVertexCache(std::vector<uint32_t> &idx, size_t vtx_count) {
+	// degenerate triangles draw nothing and would be listed twice in the live triangles of their repeated vertex
+	size_t kept = 0;
+	for (size_t t = 0; t < idx.size() / 3; ++t) {
+		const uint32_t a = idx[t * 3], b = idx[t * 3 + 1], c = idx[t * 3 + 2];
+		if (a != b && b != c && c != a) {
+			idx[kept++] = a;
+			idx[kept++] = b;
+			idx[kept++] = c;
+		}
+	}
+	idx.resize(kept);
+
+	if (idx.empty())
+		return;
+
+	const size_t tri_count = idx.size() / 3;
+
+	// vertex to triangle adjacency
+	std::vector<uint32_t> tri_offset(vtx_count + 1, 0);
+	for (uint32_t v : idx)
+		++tri_offset[v + 1];
+	for (size_t v = 0; v < vtx_count; ++v)
+		tri_offset[v + 1] += tri_offset[v];
+
+	std::vector<uint32_t> tris(idx.size()), fill(tri_offset.begin(), tri_offset.end() - 1);
+	for (size_t t = 0; t < tri_count; ++t)
+		for (int k = 0; k < 3; ++k)
+			tris[fill[idx[t * 3 + k]]++] = uint32_t(t);
+
+	std::vector<uint32_t> live(vtx_count);
+	std::vector<int> cache_pos(vtx_count, -1);
+	std::vector<float> vtx_score(vtx_count);
+
+	for (size_t v = 0; v < vtx_count; ++v) {
+		live[v] = tri_offset[v + 1] - tri_offset[v];
+		vtx_score[v] = ForsythVertexScore(-1, live[v]);
+	}
+
+	std::vector<float> tri_score(tri_count);
+	std::vector<bool> emitted(tri_count, false);
+
+	for (size_t t = 0; t < tri_count; ++t)
+		tri_score[t] = vtx_score[idx[t * 3]] + vtx_score[idx[t * 3 + 1]] + vtx_score[idx[t * 3 + 2]];
+
+	std::vector<uint32_t> out, cache, next_cache;
+	out.reserve(idx.size());
+	cache.reserve(forsyth_cache_size + 3);
+	next_cache.reserve(forsyth_cache_size + 3);
+
+	size_t best = size_t(std::max_element(tri_score.begin(), tri_score.end()) - tri_score.begin()), scan = 0;
+
+	while (out.size() < idx.size()) {
+		if (best == size_t(-1)) { // no candidate in cache, resume from the first triangle not yet emitted
+			while (emitted[scan])
+				++scan;
+			best = scan;
+		}
+
+		emitted[best] = true;
+
+		next_cache.clear();
+		for (int k = 0; k < 3; ++k) {
+			const uint32_t v = idx[best * 3 + k];
+			out.push_back(v);
+			next_cache.push_back(v);
+
+			// remove the emitted triangle from the vertex live triangle list
+			uint32_t *v_tris = &tris[tri_offset[v]];
+			std::swap(*std::find(v_tris, v_tris + live[v], uint32_t(best)), v_tris[live[v] - 1]);
+			--live[v];
+		}
+
+		for (uint32_t v : cache)
+			if (v != next_cache[0] && v != next_cache[1] && v != next_cache[2])
+				next_cache.push_back(v);
+
+		// update scores of vertices entering, moving in or leaving the cache
+		for (size_t i = 0; i < next_cache.size(); ++i) {
+			const uint32_t v = next_cache[i];
+			cache_pos[v] = i < forsyth_cache_size ? int(i) : -1;
+			vtx_score[v] = ForsythVertexScore(cache_pos[v], live[v]);
+		}
+
+		best = size_t(-1);
+		float best_score = -1.f;
+
+		for (uint32_t v : next_cache)
+			for (uint32_t i = 0; i < live[v]; ++i) {
+				const uint32_t t = tris[tri_offset[v] + i];
+				tri_score[t] = vtx_score[idx[t * 3]] + vtx_score[idx[t * 3 + 1]] + vtx_score[idx[t * 3 + 2]];
+				if (tri_score[t] > best_score) {
+					best_score = tri_score[t];
+					best = t;
+				}
+			}
+
+		if (next_cache.size() > forsyth_cache_size)
+			next_cache.resize(forsyth_cache_size);
+		std::swap(cache, next_cache);
+	}
+
+	idx = std::move(out);
+}
+
+// Check the vertex cache optimization on a strip holding degenerate triangles, they must be dropped and every other
+// triangle emitted once with its winding preserved. Run with: model_optimize -check
+static bool CheckOptimizeVertexCache() {
+	std::vector<uint32_t> idx = {0, 1, 2, 2, 1, 3, 3, 3, 4, 2, 3, 4, 4, 4, 4, 4, 3, 5, 5, 6, 5, 5, 6, 7};
+	std::vector<std::array<uint32_t, 3>> expected = {{{0, 1, 2}}, {{2, 1, 3}}, {{2, 3, 4}}, {{4, 3, 5}}, {{5, 6, 7}}};
+
+	OptimizeVertexCache(idx, 8);
+
+	if (idx.size() != expected.size() * 3)
+		return false;
+
+	std::vector<std::array<uint32_t, 3>> tris;
+	for (size_t t = 0; t < idx.size() / 3; ++t)
+		tris.push_back({{idx[t * 3], idx[t * 3 + 1], idx[t * 3 + 2]}});
+
+	std::sort(tris.begin(), tris.end());
+	std::sort(expected.begin(), expected.end());
+	return tris == expected;
+}
+
+// Sort clusters of cache-optimized triangles so that those facing away from the mesh center, most likely to occlude
+// the rest of the mesh, are drawn first.
+static void OptimizeOverdraw(std::vector<uint32_t> &idx, const std::vector<hg::Vec3> &pos, size_t cluster_tri_count = 128) {
+	const size_t tri_count = idx.size() / 3;
+
+	hg::Vec3 center = hg::Vec3::Zero;
+	for (const auto &p : pos)
+		center += p;
+	center = center / float(std::max<size_t>(pos.size(), 1));
+
+	struct Cluster {
+		size_t first_tri, tri_count;
+		float sort_key;
+	};
+
+	std::vector<Cluster> clusters;
+	for (size_t first = 0; first < tri_count; first += cluster_tri_count) {
+		Cluster cluster = {first, std::min(cluster_tri_count, tri_count - first), 0.f};
+
+		hg::Vec3 c = hg::Vec3::Zero, n = hg::Vec3::Zero;
+		for (size_t t = first; t < first + cluster.tri_count; ++t) {
+			const hg::Vec3 &a = pos[idx[t * 3]], &b = pos[idx[t * 3 + 1]], &d = pos[idx[t * 3 + 2]];
+			c += a + b + d;
+			n += hg::Cross(b - a, d - a); // area weighted
+		}
+
+		c = c / float(cluster.tri_count * 3);
+		cluster.sort_key = hg::Dot(c - center, hg::Len(n) > 0.f ? hg::Normalize(n) : n);
+		clusters.push_back(cluster);
+	}
+
+	std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster &a, const Cluster &b) { return a.sort_key > b.sort_key; });
+
+	std::vector<uint32_t> out;
+	out.reserve(idx.size());
+	for (const auto &cluster : clusters)
+		out.insert(out.end(), idx.begin() + cluster.first_tri * 3, idx.begin() + (cluster.first_tri + cluster.tri_count) * 3);
+
+	idx = std::move(out);
+}
+
+// Renumber vertices in the order they are first referenced by the index buffer, unreferenced vertices are dropped.
+static void OptimizeVertexFetch(Mesh &mesh) {
+	std::vector<uint32_t> remap(mesh.pos.size(), ~0u);
+	uint32_t next = 0;
+
+	for (uint32_t &v : mesh.idx) {
+		if (remap[v] == ~0u)
+			remap[v] = next++;
+		v = remap[v];
+	}
+
+	Mesh out;
+	out.pos.resize(next);
+	out.normal.resize(next);
+	if (!mesh.uv.empty())
+		out.uv.resize(next);
+
+	for (size_t v = 0; v < remap.size(); ++v)
+		if (remap[v] != ~0u) {
+			out.pos[remap[v]] = mesh.pos[v];
+			out.normal[remap[v]] = mesh.normal[v];
+			if (!mesh.uv.empty())
+				out.uv[remap[v]] = mesh.uv[v];
+		}
+
+	out.idx = std::move(mesh.idx);
+	mesh = std::move(out);
+}
+
+static void OptimizeMesh(Mesh &mesh) {
+	OptimizeVertexCache(mesh.idx, mesh.pos.size());
+	OptimizeOverdraw(mesh.idx, mesh.pos);
+	OptimizeVertexFetch(mesh);
+}
+
+// Vertex layouts before and after quantization.
+static bgfx::VertexLayout MakeFloatLayout(bool has_uv) {
+	bgfx::VertexLayout layout;
+	layout.begin().add(bgfx::Attrib::Position, 3, bgfx::AttribType::Float).add(bgfx::Attrib::Normal, 4, bgfx::AttribType::Uint8, true, true);
+	if (has_uv)
+		layout.add(bgfx::Attrib::TexCoord0, 2, bgfx::AttribType::Float);
+	layout.end();
+	return layout;
+}
+
+static bgfx::VertexLayout MakeQuantizedLayout(bool has_uv, bool quantize_uv) {
+	bgfx::VertexLayout layout;
+	layout.begin().add(bgfx::Attrib::Position, 4, bgfx::AttribType::Int16, true).add(bgfx::Attrib::Normal, 4, bgfx::AttribType::Uint8, true, true);
+	if (has_uv)
+		layout.add(bgfx::Attrib::TexCoord0, 2, quantize_uv ? bgfx::AttribType::Int16 : bgfx::AttribType::Float, quantize_uv);
+	layout.end();
+	return layout;
+}
+
+static size_t ComputeMeshSize(const Mesh &mesh, const bgfx::VertexLayout &layout) {
+	const size_t index_size = mesh.pos.size() > 65535 ? 4 : 2;
+	return mesh.pos.size() * layout.getStride() + mesh.idx.size() * index_size;
+}
+
+// Quantization maps positions to [-1;1] using a uniform scale so that normals are not skewed by the dequantization
+// matrix. Texture coordinates are stored as normalized 16 bit integers when in the [-1;1] range, as floats otherwise.
+static bool CanQuantizeUV(const Mesh &mesh) {
+	for (const auto &uv : mesh.uv)
+		if (uv.x < -1.f || uv.x > 1.f || uv.y < -1.f || uv.y > 1.f)
+			return false;
+	return true;
+}
+
+static hg::Model MakeModel(const Mesh &mesh, bool quantize, hg::Mat4 &dequantize) {
+	const bool has_uv = !mesh.uv.empty();
+	const bgfx::VertexLayout layout = quantize ? MakeQuantizedLayout(has_uv, CanQuantizeUV(mesh)) : MakeFloatLayout(has_uv);
+
+	hg::MinMax minmax(mesh.pos.empty() ? hg::Vec3::Zero : mesh.pos[0], mesh.pos.empty() ? hg::Vec3::Zero : mesh.pos[0]);
+	for (const auto &p : mesh.pos)
+		minmax.mn = hg::Min(minmax.mn, p), minmax.mx = hg::Max(minmax.mx, p);
+
+	const hg::Vec3 offset = (minmax.mn + minmax.mx) * 0.5f;
+	const hg::Vec3 half_size = (minmax.mx - minmax.mn) * 0.5f;
+	const float scale = std::max(std::max(half_size.x, half_size.y), std::max(half_size.z, 1e-6f));
+
+	dequantize = quantize ? hg::TransformationMat4(offset, hg::Vec3::Zero, hg::Vec3(scale, scale, scale)) : hg::Mat4::Identity;
+
+	const bgfx::Memory *vtx_mem = bgfx::alloc(uint32_t(mesh.pos.size() * layout.getStride()));
+	for (uint32_t i = 0; i < uint32_t(mesh.pos.size()); ++i) {
+		const hg::Vec3 p = quantize ? (mesh.pos[i] - offset) / scale : mesh.pos[i];
+		const float pos[4] = {p.x, p.y, p.z, 1.f};
+		bgfx::vertexPack(pos, false, bgfx::Attrib::Position, layout, vtx_mem->data, i);
+
+		const float normal[4] = {mesh.normal[i].x, mesh.normal[i].y, mesh.normal[i].z, 0.f};
+		bgfx::vertexPack(normal, true, bgfx::Attrib::Normal, layout, vtx_mem->data, i);
+
+		if (has_uv) {
+			const float uv[4] = {mesh.uv[i].x, mesh.uv[i].y, 0.f, 0.f};
+			bgfx::vertexPack(uv, false, bgfx::Attrib::TexCoord0, layout, vtx_mem->data, i);
+		}
+	}
+
+	const bgfx::Memory *idx_mem;
+	uint16_t idx_flags = BGFX_BUFFER_NONE;
+
+	if (mesh.pos.size() > 65535) {
+		idx_mem = bgfx::copy(mesh.idx.data(), uint32_t(mesh.idx.size() * sizeof(uint32_t)));
+		idx_flags = BGFX_BUFFER_INDEX32;
+	} else {
+		idx_mem = bgfx::alloc(uint32_t(mesh.idx.size() * sizeof(uint16_t)));
+		for (size_t i = 0; i < mesh.idx.size(); ++i)
+			reinterpret_cast<uint16_t *>(idx_mem->data)[i] = uint16_t(mesh.idx[i]);
+	}
+
+	hg::DisplayList list;
+	list.vertex_buffer = bgfx::createVertexBuffer(vtx_mem, layout);
+	list.index_buffer = bgfx::createIndexBuffer(idx_mem, idx_flags);
+
+	hg::Model mdl;
+	mdl.lists.push_back(list);
+	mdl.bounds.push_back(quantize ? hg::MinMax(hg::Vec3(-1.f, -1.f, -1.f), hg::Vec3(1.f, 1.f, 1.f)) : minmax);
+	mdl.mats.push_back(0);
+	return mdl;
+}
+
+// Same sphere topology as CreateSphereModel but kept on the CPU so that it can go through the optimization pass.
+static Mesh CreateSphereMesh(float radius, int subdiv_x, int subdiv_y) {
+	Mesh mesh;
+
+	for (int j = 0; j <= subdiv_x; ++j) {
+		const float t = hg::Pi * float(j) / float(subdiv_x);
+		for (int i = 0; i <= subdiv_y; ++i) {
+			const float s = hg::TwoPi * float(i) / float(subdiv_y);
+			const hg::Vec3 n(sinf(t) * cosf(s), cosf(t), sinf(t) * sinf(s));
+
+			mesh.pos.push_back(n * radius);
+			mesh.normal.push_back(n);
+			mesh.uv.push_back(hg::Vec2(float(i) / float(subdiv_y), float(j) / float(subdiv_x)));
+		}
+	}
+
+	for (int j = 0; j < subdiv_x; ++j)
+		for (int i = 0; i < subdiv_y; ++i) {
+			const uint32_t a = j * (subdiv_y + 1) + i, b = a + subdiv_y + 1;
+			mesh.idx.insert(mesh.idx.end(), {a, b, a + 1, a + 1, b, b + 1});
+		}
+
+	return mesh;
+}
+
+// Triangulate an imported geometry and weld identical vertices, vertices keep the geometry order as an importer would.
+static Mesh MeshFromGeometry(const hg::Geometry &geo) {
+	Mesh mesh;
+
+	size_t corner_count = 0;
+	for (const auto &pol : geo.pol)
+		corner_count += pol.vtx_count;
+
+	std::vector<hg::Vec3> computed_normals;
+	const std::vector<hg::Vec3> &normals = GetCornerNormals(geo, computed_normals);
+
+	const bool has_uv = geo.uv[0].size() >= corner_count;
+	std::map<std::array<uint32_t, 6>, uint32_t> welded;
+	std::vector<std::array<uint32_t, 6>> corners;
+
+	auto float_bits = [](float v) {
+		uint32_t bits;
+		memcpy(&bits, &v, sizeof(bits));
+		return bits;
+	};
+
+	size_t corner = 0;
+	for (const auto &pol : geo.pol) {
+		std::vector<std::array<uint32_t, 6>> pol_corners;
+		for (int i = 0; i < pol.vtx_count; ++i, ++corner) {
+			const hg::Vec3 &n = normals[corner];
+			const hg::Vec2 uv = has_uv ? geo.uv[0][corner] : hg::Vec2::Zero;
+			pol_corners.push_back({uint32_t(geo.binding[corner]), float_bits(n.x), float_bits(n.y), float_bits(n.z), float_bits(uv.x), float_bits(uv.y)});
+		}
+
+		for (int i = 1; i + 1 < pol.vtx_count; ++i) // fan triangulation
+			corners.insert(corners.end(), {pol_corners[0], pol_corners[i], pol_corners[i + 1]});
+	}
+
+	for (const auto &key : corners)
+		welded.emplace(key, 0);
+
+	for (auto &i : welded) {
+		const auto &key = i.first;
+		i.second = uint32_t(mesh.pos.size());
+
+		float n[3], uv[2];
+		memcpy(n, &key[1], sizeof(n));
+		memcpy(uv, &key[4], sizeof(uv));
+
+		mesh.pos.push_back(geo.vtx[key[0]]);
+		mesh.normal.push_back(hg::Vec3(n[0], n[1], n[2]));
+		if (has_uv)
+			mesh.uv.push_back(hg::Vec2(uv[0], uv[1]));
+	}
+
+	for (const auto &key : corners)
+		mesh.idx.push_back(welded[key]);
+
+	return mesh;
+}
+
+struct OptimizationReport {
+	size_t triangle_count{}, mesh_count{};
+	size_t size_before{}, size_after{};
+	float vs_invocations_before{}, vs_invocations_after{}; // estimated from the cache miss ratio
+};
+
+static void OptimizeAndReport(Mesh &mesh, OptimizationReport &report) {
+	const bool has_uv = !mesh.uv.empty();
+
+	report.size_before += ComputeMeshSize(mesh, MakeFloatLayout(has_uv));
+	report.vs_invocations_before += ComputeACMR(mesh.idx, mesh.pos.size()) * float(mesh.idx.size() / 3);
+
+	OptimizeMesh(mesh);
+
+	report.size_after += ComputeMeshSize(mesh, MakeQuantizedLayout(has_uv, CanQuantizeUV(mesh)));
+	report.vs_invocations_after += ComputeACMR(mesh.idx, mesh.pos.size()) * float(mesh.idx.size() / 3);
+	report.triangle_count += mesh.idx.size() / 3;
+	++report.mesh_count;
+}
+
+static std::string FormatReport(const char *name, const OptimizationReport &report) {
+	return hg::format("%1: %2 meshes, %3 triangles, memory %4 KB -> %5 KB, VS invocations %6 -> %7")
+		.arg(name)
+		.arg(report.mesh_count)
+		.arg(report.triangle_count)
+		.arg(report.size_before / 1024)
+		.arg(report.size_after / 1024)
+		.arg(int(report.vs_invocations_before))
+		.arg(int(report.vs_invocations_after));
+}
+
+int main(int narg, const char **args) {
+	if (narg > 1 && !strcmp(args[1], "-check")) {
+		if (!CheckOptimizeVertexCache()) {
+			hg::error("vertex cache optimization check failed.");
+			return EXIT_FAILURE;
+		}
+		hg::log("vertex cache optimization check passed.");
+		return EXIT_SUCCESS;
+	}
+
+	const std::string geo_folder = narg > 1 ? args[1] : HG_RESOURCES_SOURCE_DIR "/car_engine";
+	if (!hg::IsDir(geo_folder.c_str())) {
+		hg::error(hg::format("source geometry folder '%1' not found, usage: model_optimize [source geometry folder]").arg(geo_folder));
+		return EXIT_FAILURE;
+	}
+
+	// create window.
+	hg::InputInit();
+	hg::WindowSystemInit();
+
+	int res_x = 1280, res_y = 720;
+
+	hg::Window *win = hg::RenderInit("Harfang - Model Optimization", res_x, res_y, BGFX_RESET_VSYNC | BGFX_RESET_MSAA_X4);
+	if (!win) {
+		hg::error("failed to create window.");
+		return EXIT_FAILURE;
+	}
+
+	// access compiled resources
+	hg::AddAssetsFolder("resources_compiled");
+
+	// create forward pipeline and resources.
+	hg::ForwardPipeline pipeline = hg::CreateForwardPipeline();
+	hg::PipelineResources res = hg::PipelineResources();
+
+	// optimize the source geometries found in the geometry folder, as an importer would.
+	OptimizationReport geo_report;
+
+	for (const auto &entry : hg::ListDir(geo_folder.c_str(), hg::DE_File)) {
+		if (entry.name.size() < 4 || entry.name.compare(entry.name.size() - 4, 4, ".geo") != 0)
+			continue;
+
+		const hg::Geometry geo = hg::LoadGeometryFromFile((geo_folder + "/" + entry.name).c_str());
+		if (geo.pol.empty())
+			continue;
+
+		Mesh mesh = MeshFromGeometry(geo);
+		OptimizeAndReport(mesh, geo_report);
+	}
+
+	const std::string geo_report_text = FormatReport(geo_folder.c_str(), geo_report);
+	hg::log(geo_report_text.c_str());
+
+	// optimize a model at creation time, the reference model is created with the stock layout.
+	OptimizationReport sphere_report;
+
+	Mesh sphere_mesh = CreateSphereMesh(0.5f, 48, 96);
+	OptimizeAndReport(sphere_mesh, sphere_report);
+
+	const std::string sphere_report_text = FormatReport("sphere", sphere_report);
+	hg::log(sphere_report_text.c_str());
+
+	hg::Mat4 sphere_dequantize;
+	hg::ModelRef sphere_opt_ref = res.models.Add("sphere_optimized", MakeModel(sphere_mesh, true, sphere_dequantize));
+	hg::ModelRef sphere_ref = res.models.Add("sphere", hg::CreateSphereModel(hg::VertexLayoutPosFloatNormUInt8(), 0.5f, 48, 96));
+	hg::ModelRef ground_ref = res.models.Add("ground", hg::CreateCubeModel(hg::VertexLayoutPosFloatNormUInt8(), 20.f, 0.01f, 20.f));
+
+	// create materials
+	hg::PipelineProgramRef prg = hg::LoadPipelineProgramRefFromAssets("core/shader/default.hps", res, hg::GetForwardPipelineInfo());
+
+	hg::Material sphere_mat = hg::CreateMaterial(prg, "uDiffuseColor", hg::Vec4(1.f, 0.5f, 0.1f), "uSpecularColor", hg::Vec4::One);
+	hg::Material ground_mat = hg::CreateMaterial(prg, "uDiffuseColor", hg::Vec4(0.5f, 0.5f, 0.5f), "uSpecularColor", hg::Vec4(0.1f, 0.1f, 0.1f));
+
+	// setup scene, reference spheres on the left, optimized and quantized spheres on the right
+	hg::Scene scene;
+	scene.canvas.color = hg::Color(0.1f, 0.1f, 0.1f);
+	scene.environment.ambient = hg::Color(0.1f, 0.1f, 0.1f);
+
+	hg::Node camera = hg::CreateCamera(scene, hg::Mat4LookAt(hg::Vec3(0.f, 4.f, -8.f), hg::Vec3(0.f, 0.5f, 0.f)), 0.01f, 100.f);
+	scene.SetCurrentCamera(camera);
+
+	hg::CreateLinearLight(scene, hg::TransformationMat4(hg::Vec3::Zero, hg::Deg3(30.f, 30.f, 0.f)), hg::Color::White, hg::Color::White, 10, hg::LST_Map, 0.002f, hg::Vec4(8.f, 16.f, 32.f, 64.f));
+	hg::CreateObject(scene, hg::Mat4::Identity, ground_ref, {ground_mat});
+
+	for (int j = 0; j < 4; ++j)
+		for (int i = 0; i < 4; ++i) {
+			const hg::Vec3 pos(-4.5f + i * 1.2f, 0.5f, -2.f + j * 1.2f);
+			hg::CreateObject(scene, hg::TranslationMat4(pos), sphere_ref, {sphere_mat});
+			hg::CreateObject(scene, hg::TranslationMat4(pos + hg::Vec3(5.4f, 0.f, 0.f)) * sphere_dequantize, sphere_opt_ref, {sphere_mat}); // dequantization is folded into the node matrix
+		}
+
+	// text overlay
+	hg::Font font = hg::LoadFontFromAssets("font/default.ttf", 16);
+	bgfx::ProgramHandle font_program = hg::LoadProgramFromAssets("core/shader/font");
+
+	hg::RenderState text_render_state = hg::ComputeRenderState(hg::BM_Alpha, hg::DT_Always, hg::FC_Disabled);
+	std::vector<hg::UniformSetValue> text_uniform_values = {hg::MakeUniformSetValue("u_color", hg::Vec4(1.f, 1.f, .5f, 1.f))};
+
+	// main loop
+	hg::Keyboard keyboard;
+	while (!keyboard.Pressed(hg::K_Escape) && hg::IsWindowOpen(win)) {
+		hg::time_ns dt = hg::tick_clock();  // tick clock, retrieve elapsed clock since last call
+
+		keyboard.Update();
+
+		scene.Update(dt);
+
+		bgfx::ViewId view_id = 0;
+		hg::SceneForwardPipelinePassViewId views;
+		hg::SubmitSceneToPipeline(view_id, scene, hg::iRect(0, 0, res_x, res_y), true, pipeline, res, views);
+
+		hg::SetView2D(view_id, 0, 0, res_x, res_y, -1, 1, BGFX_CLEAR_DEPTH, hg::Color::Black, 1, 0);
+		hg::DrawText(view_id, font, sphere_report_text, font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20, res_y - 40, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+		hg::DrawText(view_id, font, geo_report_text, font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20, res_y - 64, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+
+		bgfx::frame();
+		hg::UpdateWindow(win);
+	}
+
+	hg::RenderShutdown();
+	hg::DestroyWindow(win);
+
+	return EXIT_SUCCESS;
+}
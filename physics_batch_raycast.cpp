@@ -0,0 +1,531 @@
+// HARFANG(R) Copyright (C) 2022 NWNC HARFANG. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+// Batched raycasts and sphere sweeps: the physics bodies are copied once per frame to a read-only snapshot binned in a
+// uniform grid, query batches are then split across worker threads which write to caller provided result buffers.
+// A rays per second against thread count benchmark is logged at startup and results are checked against the physics.
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <foundation/clock.h>
+#include <foundation/format.h>
+#include <foundation/log.h>
+#include <foundation/math.h>
+#include <foundation/matrix4.h>
+#include <foundation/projection.h>
+#include <foundation/rand.h>
+
+#include <platform/input_system.h>
+#include <platform/window_system.h>
+
+#include <engine/assets.h>
+#include <engine/create_geometry.h>
+#include <engine/font.h>
+#include <engine/forward_pipeline.h>
+#include <engine/scene.h>
+#include <engine/scene_bullet3_physics.h>
+#include <engine/scene_forward_pipeline.h>
+#include <engine/scene_systems.h>
+
+#include "worker_pool.h"
+
+//
+enum QueryShapeType : uint8_t { QST_Sphere, QST_Box };
+
+struct QueryShape {
+	QueryShapeType type;
+	hg::NodeRef node;
+	hg::Vec3 center, axis[3], half_extents; // half_extents.x is the radius of a sphere
+};
+
+struct QueryRay {
+	hg::Vec3 origin, direction; // direction is normalized
+	float max_t;
+	float radius; // 0 for a raycast, sphere sweep otherwise
+};
+
+struct QueryHit {
+	float t;
+	uint32_t shape; // index in the snapshot, NoHit if nothing was hit
+	hg::Vec3 normal;
+
+	static const uint32_t NoHit = ~0u;
+};
+
+// Read-only copy of the physics shapes binned in a uniform grid. Shapes are binned with their bounds inflated by the
+// largest sweep radius supported.
+class QuerySnapshot {
+public:
+	float max_sweep_radius = 0.5f;
+
+	void Clear() { shapes.clear(); }
+
+	void AddSphere(hg::NodeRef node, const hg::Vec3 &center, float radius) { shapes.push_back({QST_Sphere, node, center, {hg::Vec3::Right, hg::Vec3::Up, hg::Vec3::Front}, hg::Vec3(radius, radius, radius)}); }
+
+	void AddBox(hg::NodeRef node, const hg::Mat4 &world, const hg::Vec3 &size) {
+		const hg::Vec3 scale = hg::GetScale(world);
+		shapes.push_back({QST_Box, node, hg::GetT(world), {hg::Normalize(hg::GetX(world)), hg::Normalize(hg::GetY(world)), hg::Normalize(hg::GetZ(world))}, size * scale * 0.5f});
+	}
+
+	void Build(float cell_size) {
+		// shape bounds
+		bounds_mn = hg::Vec3(std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max());
+		bounds_mx = -bounds_mn;
+
+		shape_mn.resize(shapes.size());
+		shape_mx.resize(shapes.size());
+
+		for (size_t i = 0; i < shapes.size(); ++i) {
+			const QueryShape &s = shapes[i];
+
+			hg::Vec3 extent = s.half_extents;
+			if (s.type == QST_Box)
+				extent = hg::Abs(s.axis[0] * s.half_extents.x) + hg::Abs(s.axis[1] * s.half_extents.y) + hg::Abs(s.axis[2] * s.half_extents.z);
+			extent = extent + hg::Vec3::One * max_sweep_radius;
+
+			shape_mn[i] = s.center - extent;
+			shape_mx[i] = s.center + extent;
+			bounds_mn = hg::Min(bounds_mn, shape_mn[i]);
+			bounds_mx = hg::Max(bounds_mx, shape_mx[i]);
+		}
+
+		// grid resolution, at most 64 cells per axis
+		const hg::Vec3 size = bounds_mx - bounds_mn;
+		cell = hg::Vec3(std::max(cell_size, size.x / 64.f), std::max(cell_size, size.y / 64.f), std::max(cell_size, size.z / 64.f));
+		for (int a = 0; a < 3; ++a)
+			res[a] = std::max(1, int(std::ceil((&size.x)[a] / (&cell.x)[a])));
+
+		// count then fill the compact cell lists
+		cell_offset.assign(size_t(res[0]) * res[1] * res[2] + 1, 0);
+
+		for (int pass = 0; pass < 2; ++pass) {
+			if (pass == 1) {
+				for (size_t i = 1; i < cell_offset.size(); ++i)
+					cell_offset[i] += cell_offset[i - 1];
+				cell_shapes.resize(cell_offset.back());
+				cell_fill.assign(cell_offset.begin(), cell_offset.end() - 1);
+			}
+
+			for (uint32_t i = 0; i < uint32_t(shapes.size()); ++i) {
+				int c0[3], c1[3];
+				CellCoords(shape_mn[i], c0);
+				CellCoords(shape_mx[i], c1);
+
+				for (int z = c0[2]; z <= c1[2]; ++z)
+					for (int y = c0[1]; y <= c1[1]; ++y)
+						for (int x = c0[0]; x <= c1[0]; ++x) {
+							const size_t c = CellIndex(x, y, z);
+							if (pass == 0)
+								++cell_offset[c + 1];
+							else
+								cell_shapes[cell_fill[c]++] = i;
+						}
+			}
+		}
+	}
+
+	// Closest hit along the ray, walking the grid cells front to back (Amanatides & Woo).
+	QueryHit Query(const QueryRay &ray) const {
+		QueryHit hit = {ray.max_t, QueryHit::NoHit, hg::Vec3::Zero};
+
+		float t_enter, t_exit;
+		if (shapes.empty() || !IntersectAABB(ray.origin, ray.direction, bounds_mn, bounds_mx, t_enter, t_exit) || t_enter > ray.max_t)
+			return hit;
+
+		const hg::Vec3 p = ray.origin + ray.direction * (t_enter + 1e-4f);
+
+		int c[3], step[3];
+		float t_next[3], t_delta[3];
+		CellCoords(p, c);
+
+		for (int a = 0; a < 3; ++a) {
+			const float d = (&ray.direction.x)[a], o = (&ray.origin.x)[a];
+			const float mn = (&bounds_mn.x)[a], size = (&cell.x)[a];
+
+			if (d > 0.f) {
+				step[a] = 1;
+				t_next[a] = (mn + (c[a] + 1) * size - o) / d;
+				t_delta[a] = size / d;
+			} else if (d < 0.f) {
+				step[a] = -1;
+				t_next[a] = (mn + c[a] * size - o) / d;
+				t_delta[a] = -size / d;
+			} else {
+				step[a] = 0;
+				t_next[a] = t_delta[a] = std::numeric_limits<float>::max();
+			}
+		}
+
+		for (;;) {
+			const size_t ci = CellIndex(c[0], c[1], c[2]);
+			for (uint32_t n = cell_offset[ci]; n < cell_offset[ci + 1]; ++n) {
+				const uint32_t i = cell_shapes[n];
+
+				float t;
+				hg::Vec3 normal;
+				if (IntersectShape(shapes[i], ray, t, normal) && t < hit.t)
+					hit = {t, i, normal};
+			}
+
+			// a hit closer than the cell exit cannot be beaten by the following cells
+			const int a = t_next[0] < t_next[1] ? (t_next[0] < t_next[2] ? 0 : 2) : (t_next[1] < t_next[2] ? 1 : 2);
+			if (hit.shape != QueryHit::NoHit && hit.t <= t_next[a])
+				break;
+			if (t_next[a] > ray.max_t || t_next[a] > t_exit)
+				break;
+
+			c[a] += step[a];
+			if (c[a] < 0 || c[a] >= res[a])
+				break;
+			t_next[a] += t_delta[a];
+		}
+
+		return hit;
+	}
+
+	// Run a batch of queries on the worker pool, results are written to hits[i] for rays[i].
+	void QueryBatch(WorkerPool &pool, const QueryRay *rays, QueryHit *hits, size_t count) const {
+		pool.Run(count, 256, [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i)
+				hits[i] = Query(rays[i]);
+		});
+	}
+
+	const QueryShape &GetShape(uint32_t i) const { return shapes[i]; }
+	size_t GetShapeCount() const { return shapes.size(); }
+
+private:
+	static bool IntersectAABB(const hg::Vec3 &o, const hg::Vec3 &d, const hg::Vec3 &mn, const hg::Vec3 &mx, float &t_enter, float &t_exit) {
+		t_enter = 0.f;
+		t_exit = std::numeric_limits<float>::max();
+
+		for (int a = 0; a < 3; ++a) {
+			const float da = (&d.x)[a], oa = (&o.x)[a];
+			if (std::abs(da) < 1e-12f) {
+				if (oa < (&mn.x)[a] || oa > (&mx.x)[a])
+					return false;
+				continue;
+			}
+
+			float t0 = ((&mn.x)[a] - oa) / da, t1 = ((&mx.x)[a] - oa) / da;
+			if (t0 > t1)
+				std::swap(t0, t1);
+
+			t_enter = std::max(t_enter, t0);
+			t_exit = std::min(t_exit, t1);
+			if (t_enter > t_exit)
+				return false;
+		}
+		return true;
+	}
+
+	// Sweeps inflate the shape by the sweep radius, box corners are not rounded so box sweeps are conservative.
+	static bool IntersectShape(const QueryShape &s, const QueryRay &ray, float &t, hg::Vec3 &normal) {
+		if (s.type == QST_Sphere) {
+			const float r = s.half_extents.x + ray.radius;
+			const hg::Vec3 oc = ray.origin - s.center;
+
+			const float b = hg::Dot(oc, ray.direction), c = hg::Dot(oc, oc) - r * r;
+			const float disc = b * b - c;
+			if (disc < 0.f)
+				return false;
+
+			const float sq = std::sqrt(disc);
+			if (-b + sq < 0.f)
+				return false; // behind the ray origin
+
+			t = std::max(-b - sq, 0.f); // 0 if starting inside
+			normal = hg::Normalize(ray.origin + ray.direction * t - s.center);
+			return true;
+		}
+
+		// box, in its local frame
+		const hg::Vec3 oc = ray.origin - s.center;
+		const hg::Vec3 o(hg::Dot(oc, s.axis[0]), hg::Dot(oc, s.axis[1]), hg::Dot(oc, s.axis[2]));
+		const hg::Vec3 d(hg::Dot(ray.direction, s.axis[0]), hg::Dot(ray.direction, s.axis[1]), hg::Dot(ray.direction, s.axis[2]));
+		const hg::Vec3 e = s.half_extents + hg::Vec3::One * ray.radius;
+
+		float t_enter, t_exit;
+		if (!IntersectAABB(o, d, -e, e, t_enter, t_exit))
+			return false;
+
+		t = t_enter;
+
+		// the face hit is the one along which the local hit point is the furthest out
+		const hg::Vec3 p = o + d * t;
+		const hg::Vec3 q(std::abs(p.x) / e.x, std::abs(p.y) / e.y, std::abs(p.z) / e.z);
+		const int a = q.x > q.y ? (q.x > q.z ? 0 : 2) : (q.y > q.z ? 1 : 2);
+		normal = s.axis[a] * ((&p.x)[a] < 0.f ? -1.f : 1.f);
+		return true;
+	}
+
+	void CellCoords(const hg::Vec3 &p, int c[3]) const {
+		for (int a = 0; a < 3; ++a)
+			c[a] = hg::Clamp(int(((&p.x)[a] - (&bounds_mn.x)[a]) / (&cell.x)[a]), 0, res[a] - 1);
+	}
+
+	size_t CellIndex(int x, int y, int z) const { return (size_t(z) * res[1] + y) * res[0] + x; }
+
+	std::vector<QueryShape> shapes;
+	std::vector<hg::Vec3> shape_mn, shape_mx;
+
+	hg::Vec3 bounds_mn, bounds_mx, cell;
+	int res[3] = {1, 1, 1};
+
+	std::vector<uint32_t> cell_offset, cell_shapes, cell_fill;
+};
+
+//
+struct SnapshotBody {
+	hg::NodeRef node;
+	QueryShapeType type;
+	hg::Vec3 size; // box size or sphere radius in x
+};
+
+static void BuildSnapshot(const hg::Scene &scene, const std::vector<SnapshotBody> &bodies, QuerySnapshot &snapshot) {
+	snapshot.Clear();
+	for (const auto &body : bodies) {
+		const hg::Mat4 world = scene.GetNodeWorldMatrix(body.node);
+		if (body.type == QST_Sphere)
+			snapshot.AddSphere(body.node, hg::GetT(world), body.size.x);
+		else
+			snapshot.AddBox(body.node, world, body.size);
+	}
+	snapshot.Build(2.f);
+}
+
+static void MakeSensorRays(const hg::Vec3 &origin, float angle, std::vector<QueryRay> &rays, float radius) {
+	const size_t count = rays.size();
+	for (size_t i = 0; i < count; ++i) {
+		// spiral over the lower hemisphere
+		const float k = (float(i) + 0.5f) / float(count);
+		const float phi = float(i) * 2.39996323f + angle, cos_theta = -k;
+		const float sin_theta = std::sqrt(1.f - cos_theta * cos_theta);
+
+		rays[i] = {origin, hg::Vec3(std::cos(phi) * sin_theta, cos_theta, std::sin(phi) * sin_theta), 100.f, radius};
+	}
+}
+
+// Rays per second against thread count, and agreement with the physics raycasts.
+static void BenchmarkBatchQueries(const hg::Scene &scene, const hg::SceneBullet3Physics &physics, const QuerySnapshot &snapshot) {
+	std::vector<QueryRay> rays(200000);
+	std::vector<QueryHit> hits(rays.size());
+	MakeSensorRays(hg::Vec3(0.f, 15.f, 0.f), 0.f, rays, 0.f);
+
+	const int max_threads = std::max(1, int(std::thread::hardware_concurrency()));
+
+	std::vector<int> thread_counts;
+	for (int n = 1; n < max_threads; n *= 2)
+		thread_counts.push_back(n);
+	thread_counts.push_back(max_threads);
+
+	for (int thread_count : thread_counts) {
+		WorkerPool pool(thread_count);
+		snapshot.QueryBatch(pool, rays.data(), hits.data(), rays.size()); // warm up
+
+		const hg::time_ns t0 = hg::time_now();
+		for (int n = 0; n < 4; ++n)
+			snapshot.QueryBatch(pool, rays.data(), hits.data(), rays.size());
+		const hg::time_ns elapsed = hg::time_now() - t0;
+
+		hg::log(hg::format("Batch raycast: %1 threads, %2 Mrays/s").arg(thread_count).arg(float(rays.size() * 4) / hg::time_to_sec_f(elapsed) / 1e6f));
+	}
+
+	// check a subset against the physics raycasts
+	int agree = 0, checked = 0;
+	for (size_t i = 0; i < rays.size(); i += 200, ++checked) {
+		const QueryRay &ray = rays[i];
+		const hg::RaycastOut out = physics.RaycastFirstHit(scene, ray.origin, ray.origin + ray.direction * ray.max_t);
+
+		const bool physics_hit = scene.IsValidNodeRef(out.node), batch_hit = hits[i].shape != QueryHit::NoHit;
+		if (physics_hit != batch_hit)
+			continue;
+		if (!batch_hit || hg::Dist(out.P, ray.origin + ray.direction * hits[i].t) < 0.05f)
+			++agree;
+	}
+
+	hg::log(hg::format("Batch raycast: %1/%2 rays agree with the physics raycasts").arg(agree).arg(checked));
+}
+
+int main(int narg, const char **args) {
+	// Create window
+	const int width = 1280, height = 720;
+
+	hg::InputInit();
+	hg::WindowSystemInit();
+
+	hg::Window *window = hg::NewWindow(width, height);
+	if (!hg::RenderInit(window)) {
+		return EXIT_FAILURE;
+	}
+	bgfx::reset(width, height, BGFX_RESET_VSYNC | BGFX_RESET_MSAA_X8);
+
+	// Create vertex layout for cubes and spheres (position and normal).
+	bgfx::VertexLayout vs_decl;
+	vs_decl.begin().add(bgfx::Attrib::Position, 3, bgfx::AttribType::Float).add(bgfx::Attrib::Normal, 3, bgfx::AttribType::Uint8, true, true).end();
+
+	hg::PipelineResources resources;
+
+	hg::ModelRef sphere_ref = resources.models.Add("sphere", hg::CreateSphereModel(vs_decl, 0.5f, 12, 24));
+	hg::ModelRef cube_ref = resources.models.Add("cube", hg::CreateCubeModel(vs_decl, 1.f, 1.f, 1.f));
+
+	hg::AddAssetsFolder("resources_compiled");
+
+	hg::PipelineProgramRef prg = hg::LoadPipelineProgramRefFromAssets("core/shader/default.hps", resources, hg::GetForwardPipelineInfo());
+
+	hg::Material ground_mat = hg::CreateMaterial(prg, "uDiffuseColor", hg::Vec4(0.5f, 0.5f, 0.5f), "uSpecularColor", hg::Vec4(0.1f, 0.1f, 0.1f));
+	hg::Material objects_mat = hg::CreateMaterial(prg, "uDiffuseColor", hg::Vec4(0.5f, 0.5f, 0.5f), "uSpecularColor", hg::Vec4::One);
+
+	// Scene, light and camera.
+	hg::Scene scene;
+	scene.canvas.color = hg::ColorI(22, 56, 76);
+
+	hg::Node camera = hg::CreateCamera(scene, hg::TransformationMat4(hg::Vec3(0, 20.f, -30.f), hg::Deg3(30.f, 0.f, 0.f)), 0.01f, 5000.f);
+	hg::CreateLinearLight(scene, hg::TransformationMat4(hg::Vec3::Zero, hg::Deg3(30, 59, 0)), hg::Color(1, 0.8f, 0.7f), hg::Color(1, 0.8f, 0.7f), 10, hg::LST_Map, 0.002f, hg::Vec4(50, 100, 200, 400));
+	scene.SetCurrentCamera(camera);
+
+	// Board and objects, their shapes are recorded for the query snapshot.
+	std::vector<SnapshotBody> bodies;
+
+	auto add_static_box = [&](const hg::Vec3 &size, const hg::Vec3 &pos, const char *name) {
+		hg::ModelRef mdl_ref = resources.models.Add(name, hg::CreateCubeModel(vs_decl, size.x, size.y, size.z));
+		hg::Node n = hg::CreatePhysicCube(scene, size, hg::TranslationMat4(pos), mdl_ref, {ground_mat}, 0.f);
+		n.GetRigidBody().SetType(hg::RBT_Static);
+		bodies.push_back({n.ref, QST_Box, size});
+	};
+
+	add_static_box(hg::Vec3(30.f, 1.f, 30.f), hg::Vec3(0.f, -.5f, 0.f), "ground");
+	add_static_box(hg::Vec3(1.f, 11.f, 32.f), hg::Vec3(-15.5f, -.5f, 0.f), "wall_l");
+	add_static_box(hg::Vec3(1.f, 11.f, 32.f), hg::Vec3(15.5f, -.5f, 0.f), "wall_r");
+	add_static_box(hg::Vec3(32.f, 11.f, 1.f), hg::Vec3(0.f, -.5f, -15.5f), "wall_b");
+	add_static_box(hg::Vec3(32.f, 11.f, 1.f), hg::Vec3(0.f, -.5f, 15.5f), "wall_t");
+
+	const size_t board_body_count = bodies.size();
+
+	for (int i = 0; i < 512; ++i) {
+		const hg::Mat4 mtx = hg::TranslationMat4(hg::RandomVec3(hg::Vec3(-12.f, 2.f, -12.f), hg::Vec3(12.f, 30.f, 12.f)));
+		if (i % 2) {
+			hg::Node node = hg::CreatePhysicCube(scene, hg::Vec3::One, mtx, cube_ref, {objects_mat});
+			bodies.push_back({node.ref, QST_Box, hg::Vec3::One});
+		} else {
+			hg::Node node = hg::CreatePhysicSphere(scene, 0.5f, mtx, sphere_ref, {objects_mat});
+			bodies.push_back({node.ref, QST_Sphere, hg::Vec3(0.5f, 0.5f, 0.5f)});
+		}
+	}
+
+	hg::SceneClocks clocks;
+	hg::SceneBullet3Physics physics;
+	physics.SceneCreatePhysicsFromFile(scene);
+
+	// let the objects settle then benchmark the batch queries
+	for (int i = 0; i < 180; ++i)
+		hg::SceneUpdateSystems(scene, clocks, hg::time_from_ms(16), physics, hg::time_from_ms(16), 1);
+
+	QuerySnapshot snapshot;
+	BuildSnapshot(scene, bodies, snapshot);
+	BenchmarkBatchQueries(scene, physics, snapshot);
+
+	// Text display.
+	hg::Font font = hg::LoadFontFromAssets("font/default.ttf", 16);
+	bgfx::ProgramHandle font_program = hg::LoadProgramFromAssets("core/shader/font");
+
+	hg::RenderState text_render_state = hg::ComputeRenderState(hg::BM_Alpha, hg::DT_Always, hg::FC_Disabled);
+	std::vector<hg::UniformSetValue> text_uniform_values = {hg::MakeUniformSetValue("u_color", hg::Vec4(1.f, 1.f, .5f, 1.f))};
+
+	// Query rays display.
+	bgfx::VertexLayout line_layout = hg::VertexLayoutPosFloatColorFloat();
+	bgfx::ProgramHandle line_program = hg::LoadProgramFromAssets("shaders/pos_rgb");
+	hg::RenderState line_render_state = hg::ComputeRenderState(hg::BM_Opaque, hg::DT_Less, hg::FC_Disabled);
+
+	const size_t displayed_rays = 512;
+	hg::Vertices line_vtx(line_layout, displayed_rays * 2);
+
+	hg::ForwardPipeline pipeline = hg::CreateForwardPipeline();
+	hg::iRect viewport = hg::MakeRectFromWidthHeight(0, 0, width, height);
+
+	WorkerPool pool(std::max(1, int(std::thread::hardware_concurrency())));
+
+	size_t ray_count = 32768;
+	bool sweep = false;
+
+	std::vector<QueryRay> rays;
+	std::vector<QueryHit> hits;
+
+	hg::Keyboard keyboard;
+
+	hg::reset_clock();
+	while (!keyboard.Pressed(hg::K_Escape) && hg::IsWindowOpen(window)) {
+		keyboard.Update();
+
+		if (keyboard.Pressed(hg::K_Add))
+			ray_count = std::min<size_t>(ray_count * 2, 1 << 20);
+		if (keyboard.Pressed(hg::K_Sub))
+			ray_count = std::max<size_t>(ray_count / 2, displayed_rays);
+		if (keyboard.Pressed(hg::K_Space))
+			sweep = !sweep;
+
+		if (keyboard.Pressed(hg::K_S)) // drop the objects again
+			for (size_t i = board_body_count; i < bodies.size(); ++i)
+				physics.NodeTeleport(bodies[i].node, hg::TranslationMat4(hg::RandomVec3(hg::Vec3(-12.f, 2.f, -12.f), hg::Vec3(12.f, 30.f, 12.f))));
+
+		const hg::time_ns dt = hg::tick_clock();
+		hg::SceneUpdateSystems(scene, clocks, dt, physics, hg::time_from_ms(16), 3);
+
+		// snapshot and batch queries
+		const hg::time_ns snapshot_start = hg::time_now();
+		BuildSnapshot(scene, bodies, snapshot);
+		const hg::time_ns snapshot_time = hg::time_now() - snapshot_start;
+
+		rays.resize(ray_count);
+		hits.resize(ray_count);
+		MakeSensorRays(hg::Vec3(0.f, 15.f, 0.f), hg::time_to_sec_f(hg::get_clock()) * 0.2f, rays, sweep ? 0.25f : 0.f);
+
+		const hg::time_ns query_start = hg::time_now();
+		snapshot.QueryBatch(pool, rays.data(), hits.data(), ray_count);
+		const hg::time_ns query_time = hg::time_now() - query_start;
+
+		// Display scene and a subset of the queries.
+		bgfx::ViewId view_id = 0;
+		hg::SceneForwardPipelinePassViewId views;
+		hg::SubmitSceneToPipeline(view_id, scene, viewport, 1.f, pipeline, resources, views);
+
+		line_vtx.Clear();
+		for (size_t i = 0; i < displayed_rays; ++i) {
+			const size_t r = i * ray_count / displayed_rays;
+			const bool hit = hits[r].shape != QueryHit::NoHit;
+
+			line_vtx.Begin(2 * i).SetPos(rays[r].origin).SetColor0(hit ? hg::Color::Green : hg::Color::Red).End();
+			line_vtx.Begin(2 * i + 1).SetPos(rays[r].origin + rays[r].direction * (hit ? hits[r].t : 5.f)).SetColor0(hit ? hg::Color::Green : hg::Color::Red).End();
+		}
+
+		hg::SetViewPerspective(view_id, 0, 0, width, height, camera.GetTransform().GetWorld(), 0.01f, 5000.f, hg::FovToZoomFactor(camera.GetCamera().GetFov()), 0);
+		hg::DrawLines(view_id, line_vtx, line_program, line_render_state);
+		++view_id;
+
+		hg::SetView2D(view_id, 0, 0, width, height, -1, 1, BGFX_CLEAR_DEPTH, hg::Color::Black, 1, 0);
+
+		const std::string stats = hg::format("%1 %2 against %3 shapes on %4 threads: %5 ms (%6 Mrays/s) - snapshot %7 ms")
+									  .arg(ray_count)
+									  .arg(sweep ? "sphere sweeps" : "raycasts")
+									  .arg(snapshot.GetShapeCount())
+									  .arg(pool.GetThreadCount())
+									  .arg(hg::time_to_ms_f(query_time))
+									  .arg(float(ray_count) / std::max(hg::time_to_sec_f(query_time), 1e-6f) / 1e6f)
+									  .arg(hg::time_to_ms_f(snapshot_time));
+		hg::DrawText(view_id, font, stats, font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20, height - 40, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+		hg::DrawText(view_id, font, "+/-: Ray count - Space: Toggle sphere sweeps - S: Drop the objects again", font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20, height - 64, 0),
+			hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+
+		bgfx::frame();
+		hg::UpdateWindow(window);
+	}
+
+	hg::RenderShutdown();
+	hg::InputShutdown();
+	hg::DestroyWindow(window);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,337 @@
+// HARFANG(R) Copyright (C) 2022 NWNC HARFANG. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+// Collision event stream: the contacts collected after each physics update are turned into a contiguous structure of
+// arrays of begin/persist/end events, filtered by collision layer masks, without per-node tracking.
+
+#include <algorithm>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <vector>
+
+#include <foundation/clock.h>
+#include <foundation/format.h>
+#include <foundation/log.h>
+#include <foundation/projection.h>
+#include <foundation/rand.h>
+
+#include <platform/input_system.h>
+#include <platform/window_system.h>
+
+#include <engine/assets.h>
+#include <engine/create_geometry.h>
+#include <engine/font.h>
+#include <engine/forward_pipeline.h>
+#include <engine/scene.h>
+#include <engine/scene_bullet3_physics.h>
+#include <engine/scene_forward_pipeline.h>
+#include <engine/scene_systems.h>
+
+enum CollisionEventType : uint8_t { CET_Begin, CET_Persist, CET_End };
+
+// Events of a physics update stored as parallel arrays, the storage is kept from one update to the next.
+struct CollisionEventStream {
+	std::vector<uint8_t> type;
+	std::vector<hg::NodeRef> node_a, node_b;
+	std::vector<hg::Vec3> point, normal;
+	std::vector<float> depth; // penetration depth, the contacts collected from the physics do not carry the impulse
+
+	size_t size() const { return type.size(); }
+
+	void reserve(size_t count) {
+		type.reserve(count);
+		node_a.reserve(count);
+		node_b.reserve(count);
+		point.reserve(count);
+		normal.reserve(count);
+		depth.reserve(count);
+	}
+
+	void clear() {
+		type.clear();
+		node_a.clear();
+		node_b.clear();
+		point.clear();
+		normal.clear();
+		depth.clear();
+	}
+
+	void push_back(CollisionEventType t, hg::NodeRef a, hg::NodeRef b, const hg::Vec3 &p, const hg::Vec3 &n, float d) {
+		type.push_back(t);
+		node_a.push_back(a);
+		node_b.push_back(b);
+		point.push_back(p);
+		normal.push_back(n);
+		depth.push_back(d);
+	}
+};
+
+// Collision layers: two nodes report events if the layer of each one is in the mask of the other.
+enum CollisionLayer : uint32_t {
+	CL_Static = 1 << 0,
+	CL_Cube = 1 << 1,
+	CL_Sphere = 1 << 2,
+	CL_All = ~0u,
+};
+
+// Builds the event stream by diffing the contact pairs of the current update against the previous one.
+class CollisionEventBuilder {
+public:
+	void Reserve(size_t pair_count) {
+		prev.reserve(pair_count);
+		curr.reserve(pair_count);
+	}
+
+	void SetLayer(hg::NodeRef ref, uint32_t layer, uint32_t mask) {
+		if (ref.idx >= layers.size()) {
+			layers.resize(ref.idx + 1, CL_All);
+			masks.resize(ref.idx + 1, CL_All);
+		}
+		layers[ref.idx] = layer;
+		masks[ref.idx] = mask;
+	}
+
+	void Build(const hg::NodePairContacts &contacts, CollisionEventStream &out) {
+		out.clear();
+		curr.clear();
+
+		// one entry per filtered pair, keeping its deepest contact
+		for (const auto &i : contacts)
+			for (const auto &j : i.second) {
+				if (j.second.empty() || !Accept(i.first, j.first))
+					continue;
+
+				const auto deepest = std::min_element(j.second.begin(), j.second.end(), [](const hg::Contact &a, const hg::Contact &b) { return a.d < b.d; });
+
+				const bool swap = j.first.idx < i.first.idx;
+				const hg::NodeRef a = swap ? j.first : i.first, b = swap ? i.first : j.first;
+				curr.push_back({(uint64_t(a.idx) << 32) | b.idx, a, b, deepest->P, swap ? -deepest->N : deepest->N, deepest->d});
+			}
+
+		std::sort(curr.begin(), curr.end(), [](const PairEntry &a, const PairEntry &b) { return a.key < b.key; });
+		curr.erase(std::unique(curr.begin(), curr.end(), [](const PairEntry &a, const PairEntry &b) { return a.key == b.key; }), curr.end()); // (a, b) and (b, a)
+
+		// merge walk of the sorted pair lists
+		size_t p = 0, c = 0;
+		while (p < prev.size() || c < curr.size()) {
+			if (c == curr.size() || (p < prev.size() && prev[p].key < curr[c].key)) {
+				Emit(out, CET_End, prev[p++]);
+			} else if (p == prev.size() || curr[c].key < prev[p].key) {
+				Emit(out, CET_Begin, curr[c++]);
+			} else {
+				Emit(out, CET_Persist, curr[c++]);
+				++p;
+			}
+		}
+
+		std::swap(prev, curr);
+	}
+
+private:
+	struct PairEntry {
+		uint64_t key;
+		hg::NodeRef a, b;
+		hg::Vec3 P, N;
+		float d;
+	};
+
+	bool Accept(hg::NodeRef a, hg::NodeRef b) const {
+		const uint32_t layer_a = a.idx < layers.size() ? layers[a.idx] : CL_All, mask_a = a.idx < masks.size() ? masks[a.idx] : CL_All;
+		const uint32_t layer_b = b.idx < layers.size() ? layers[b.idx] : CL_All, mask_b = b.idx < masks.size() ? masks[b.idx] : CL_All;
+		return (layer_a & mask_b) && (layer_b & mask_a);
+	}
+
+	static void Emit(CollisionEventStream &out, CollisionEventType type, const PairEntry &e) { out.push_back(type, e.a, e.b, e.P, e.N, e.d); }
+
+	std::vector<uint32_t> layers, masks;
+	std::vector<PairEntry> prev, curr;
+};
+
+// Empties the contact lists but keeps the pair entries and the storage of their lists, so the pairs still touching on the
+// next update are collected without allocating. The pairs left empty are skipped by the event builder.
+static void ClearContacts(hg::NodePairContacts &contacts) {
+	for (auto &i : contacts)
+		for (auto &j : i.second)
+			j.second.clear();
+}
+
+int main(int narg, const char **args) {
+	// Create window
+	const int width = 1280, height = 720;
+
+	hg::InputInit();
+	hg::WindowSystemInit();
+
+	hg::Window *window = hg::NewWindow(width, height);
+	if (!hg::RenderInit(window)) {
+		return EXIT_FAILURE;
+	}
+	bgfx::reset(width, height, BGFX_RESET_VSYNC | BGFX_RESET_MSAA_X8);
+
+	// Create vertex layout for cubes and spheres (position and normal).
+	bgfx::VertexLayout vs_decl;
+	vs_decl.begin().add(bgfx::Attrib::Position, 3, bgfx::AttribType::Float).add(bgfx::Attrib::Normal, 3, bgfx::AttribType::Uint8, true, true).end();
+
+	hg::PipelineResources resources;
+
+	hg::ModelRef sphere_ref = resources.models.Add("sphere", hg::CreateSphereModel(vs_decl, 0.5f, 12, 24));
+	hg::ModelRef cube_ref = resources.models.Add("cube", hg::CreateCubeModel(vs_decl, 1.f, 1.f, 1.f));
+
+	hg::AddAssetsFolder("resources_compiled");
+
+	hg::PipelineProgramRef prg = hg::LoadPipelineProgramRefFromAssets("core/shader/default.hps", resources, hg::GetForwardPipelineInfo());
+
+	hg::Material ground_mat = hg::CreateMaterial(prg, "uDiffuseColor", hg::Vec4(0.5f, 0.5f, 0.5f), "uSpecularColor", hg::Vec4(0.1f, 0.1f, 0.1f));
+	hg::Material cube_mat = hg::CreateMaterial(prg, "uDiffuseColor", hg::Vec4(0.8f, 0.4f, 0.2f), "uSpecularColor", hg::Vec4::One);
+	hg::Material sphere_mat = hg::CreateMaterial(prg, "uDiffuseColor", hg::Vec4(0.2f, 0.4f, 0.8f), "uSpecularColor", hg::Vec4::One);
+
+	// Scene, light and camera.
+	hg::Scene scene;
+	scene.canvas.color = hg::ColorI(22, 56, 76);
+
+	hg::Node camera = hg::CreateCamera(scene, hg::TransformationMat4(hg::Vec3(0, 20.f, -30.f), hg::Deg3(30.f, 0.f, 0.f)), 0.01f, 5000.f);
+	hg::CreateLinearLight(scene, hg::TransformationMat4(hg::Vec3::Zero, hg::Deg3(30, 59, 0)), hg::Color(1, 0.8f, 0.7f), hg::Color(1, 0.8f, 0.7f), 10, hg::LST_Map, 0.002f, hg::Vec4(50, 100, 200, 400));
+	scene.SetCurrentCamera(camera);
+
+	// Event storage sized for a full board, it only grows past this during the update that first exceeds it.
+	const size_t max_pairs = 4096;
+
+	CollisionEventBuilder event_builder;
+	event_builder.Reserve(max_pairs);
+	CollisionEventStream events;
+	events.reserve(max_pairs * 2); // pairs ending while as many begin
+
+	// Board: ground and walls are on the static layer.
+	auto add_static_box = [&](const hg::Vec3 &size, const hg::Vec3 &pos, const char *name) {
+		hg::ModelRef mdl_ref = resources.models.Add(name, hg::CreateCubeModel(vs_decl, size.x, size.y, size.z));
+		hg::Node n = hg::CreatePhysicCube(scene, size, hg::TranslationMat4(pos), mdl_ref, {ground_mat}, 0.f);
+		n.GetRigidBody().SetType(hg::RBT_Static);
+		event_builder.SetLayer(n.ref, CL_Static, CL_All);
+	};
+
+	add_static_box(hg::Vec3(30.f, 1.f, 30.f), hg::Vec3(0.f, -.5f, 0.f), "ground");
+	add_static_box(hg::Vec3(1.f, 11.f, 32.f), hg::Vec3(-15.5f, -.5f, 0.f), "wall_l");
+	add_static_box(hg::Vec3(1.f, 11.f, 32.f), hg::Vec3(15.5f, -.5f, 0.f), "wall_r");
+	add_static_box(hg::Vec3(32.f, 11.f, 1.f), hg::Vec3(0.f, -.5f, -15.5f), "wall_b");
+	add_static_box(hg::Vec3(32.f, 11.f, 1.f), hg::Vec3(0.f, -.5f, 15.5f), "wall_t");
+
+	hg::SceneClocks clocks;
+	hg::SceneBullet3Physics physics;
+	physics.SceneCreatePhysicsFromFile(scene);
+
+	// Text display.
+	hg::Font font = hg::LoadFontFromAssets("font/default.ttf", 16);
+	bgfx::ProgramHandle font_program = hg::LoadProgramFromAssets("core/shader/font");
+
+	hg::RenderState text_render_state = hg::ComputeRenderState(hg::BM_Alpha, hg::DT_Always, hg::FC_Disabled);
+	std::vector<hg::UniformSetValue> text_uniform_values = {hg::MakeUniformSetValue("u_color", hg::Vec4(1.f, 1.f, .5f, 1.f))};
+
+	hg::ForwardPipeline pipeline = hg::CreateForwardPipeline();
+	hg::iRect viewport = hg::MakeRectFromWidthHeight(0, 0, width, height);
+
+	// Layer filters, the object masks are reassigned when the filter changes.
+	struct LayerFilter {
+		const char *name;
+		uint32_t cube_mask, sphere_mask;
+	};
+
+	const LayerFilter filters[] = {
+		{"all pairs", CL_All, CL_All},
+		{"objects against objects", CL_Cube | CL_Sphere, CL_Cube | CL_Sphere},
+		{"cubes against spheres", CL_Sphere, CL_Cube},
+		{"objects against the board", CL_Static, CL_Static},
+	};
+	int filter_idx = 0;
+
+	std::list<hg::NodeRef> cube_refs, sphere_refs;
+
+	auto apply_filter = [&]() {
+		for (auto ref : cube_refs)
+			event_builder.SetLayer(ref, CL_Cube, filters[filter_idx].cube_mask);
+		for (auto ref : sphere_refs)
+			event_builder.SetLayer(ref, CL_Sphere, filters[filter_idx].sphere_mask);
+	};
+
+	hg::NodePairContacts contacts;
+	size_t counts[3] = {}, max_events = 0;
+	hg::time_ns build_time = 0;
+
+	hg::Keyboard keyboard;
+
+	hg::reset_clock();
+	while (!keyboard.Pressed(hg::K_Escape) && hg::IsWindowOpen(window)) {
+		keyboard.Update();
+
+		if (keyboard.Down(hg::K_S)) {
+			for (int i = 0; i < 8; ++i) {
+				const hg::Mat4 mtx = hg::TranslationMat4(hg::RandomVec3(hg::Vec3(-10.f, 18.f, -10.f), hg::Vec3(10.f, 18.f, 10.f)));
+
+				if (hg::Rand() % 2) {
+					hg::Node node = hg::CreatePhysicCube(scene, hg::Vec3::One, mtx, cube_ref, {cube_mat});
+					physics.NodeCreatePhysicsFromFile(node);
+					cube_refs.push_back(node.ref);
+				} else {
+					hg::Node node = hg::CreatePhysicSphere(scene, 0.5f, mtx, sphere_ref, {sphere_mat});
+					physics.NodeCreatePhysicsFromFile(node);
+					sphere_refs.push_back(node.ref);
+				}
+			}
+			apply_filter();
+		}
+
+		if (keyboard.Pressed(hg::K_F)) {
+			filter_idx = (filter_idx + 1) % 4;
+			apply_filter();
+		}
+
+		// Update physics then turn the collected contacts into the event stream.
+		hg::SceneUpdateSystems(scene, clocks, hg::tick_clock(), physics, hg::time_from_ms(16), 3);
+
+		ClearContacts(contacts);
+		physics.CollectCollisionEvents(scene, contacts);
+
+		const hg::time_ns build_start = hg::time_now();
+		event_builder.Build(contacts, events);
+		build_time = hg::time_now() - build_start;
+
+		// Consume the stream in a single pass.
+		counts[CET_Begin] = counts[CET_Persist] = counts[CET_End] = 0;
+		float deepest = 0.f;
+
+		for (size_t i = 0; i < events.size(); ++i) {
+			++counts[events.type[i]];
+			if (events.type[i] != CET_End)
+				deepest = std::min(deepest, events.depth[i]);
+		}
+
+		max_events = std::max(max_events, events.size());
+
+		// Display scene.
+		bgfx::ViewId view_id = 0;
+		hg::SceneForwardPipelinePassViewId views;
+		hg::SubmitSceneToPipeline(view_id, scene, viewport, 1.f, pipeline, resources, views);
+
+		hg::SetView2D(view_id, 0, 0, width, height, -1, 1, BGFX_CLEAR_DEPTH, hg::Color::Black, 1, 0);
+
+		const std::string stats = hg::format("%1 objects - filter: %2 - events: %3 begin, %4 persist, %5 end (peak %6) - deepest contact %7 - build %8 ms")
+									  .arg(cube_refs.size() + sphere_refs.size())
+									  .arg(filters[filter_idx].name)
+									  .arg(counts[CET_Begin])
+									  .arg(counts[CET_Persist])
+									  .arg(counts[CET_End])
+									  .arg(max_events)
+									  .arg(deepest)
+									  .arg(hg::time_to_ms_f(build_time));
+		hg::DrawText(view_id, font, stats, font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20, height - 40, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+		hg::DrawText(view_id, font, "S: Add objects - F: Cycle layer filter", font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20, height - 64, 0), hg::DTHA_Left, hg::DTVA_Bottom,
+			text_uniform_values, {}, text_render_state);
+
+		bgfx::frame();
+		hg::UpdateWindow(window);
+	}
+
+	hg::RenderShutdown();
+	hg::InputShutdown();
+	hg::DestroyWindow(window);
+	return EXIT_SUCCESS;
+}
@@ -17,9 +17,32 @@
 #include <engine/create_geometry.h>
 #include <engine/forward_pipeline.h>
 
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <list>
+#include <string>
+#include <vector>
+#include "input_session.h"
 
+// Pass -record <file> to record the session input, -replay <file> to play it back as a reproducible benchmark.
 int main(int narg, const char **args) {
+	// Record or replay the session input.
+	InputSession::Mode session_mode = InputSession::IS_Live;
+	const char *session_path = nullptr;
+
+	for (int i = 1; i + 1 < narg; ++i)
+		if (!strcmp(args[i], "-record") || !strcmp(args[i], "-replay")) {
+			session_mode = !strcmp(args[i], "-record") ? InputSession::IS_Record : InputSession::IS_Replay;
+			session_path = args[++i];
+		}
+
+	InputSession session;
+	if (!session.Open(session_mode, session_path, uint32_t(hg::time_now()))) {
+		hg::error(hg::format("failed to open input session '%1'").arg(session_path));
+		return EXIT_FAILURE;
+	}
+
 	// Create window
 	const int width = 1920, height = 1090;
 
@@ -30,7 +53,8 @@ int main(int narg, const char **args) {
 	if (!hg::RenderInit(window)) {
 		return EXIT_FAILURE;
 	}
-	bgfx::reset(width, height, BGFX_RESET_VSYNC | BGFX_RESET_MSAA_X8);
+	// A replay runs without vertical synchronization to measure the actual frame cost.
+	bgfx::reset(width, height, (session_mode == InputSession::IS_Replay ? 0 : BGFX_RESET_VSYNC) | BGFX_RESET_MSAA_X8);
 
 	// Create vertex layout for cubes and spheres (position and normal).
 	bgfx::VertexLayout vs_decl;
@@ -116,15 +140,22 @@ int main(int narg, const char **args) {
 	// This list will hold the node reference of the objects we will create.
 	std::list<hg::NodeRef> node_refs;
 
+	size_t object_count = 0;
+	std::string object_count_text = "0 Object";
+
+	FrameTimeReport frame_time_report;
+
 	hg::reset_clock();
+	hg::time_ns frame_start = hg::time_now();
+
 	while(1) {
-		// Fetch keyboard key states.
-		hg::KeyboardState state = hg::ReadKeyboard();
-		if (state.key[hg::K_Escape]) {
+		// Fetch keyboard key states and tick clock, when replaying both come from the recorded session. Escape and the
+		// window closing are read live so that a replay can be aborted.
+		if (!session.Update(hg::tick_clock()) || hg::ReadKeyboard().key[hg::K_Escape] || !hg::IsWindowOpen(window)) {
 			break;
 		}
 
-		if (state.key[hg::K_S]) {
+		if (session.KeyDown(hg::K_S)) {
 			// Add 8 new objects onto the scene.
 			for (int i = 0; i < 8; ++i) {
 				hg::SetMaterialValue(objects_mat, "uDiffuseColor", hg::Vec4(hg::FRand(), hg::FRand(), hg::FRand(), 1.f));
@@ -143,7 +174,7 @@ int main(int narg, const char **args) {
 			}
 			hg::log(hg::format("%1 nodes").arg(scene.GetNodes().size()));
 
-		} else if (state.key[hg::K_D]) {
+		} else if (session.KeyDown(hg::K_D)) {
 			// Delete the first 8 objects added to the scene.
 			for (int i = 0; i < 8; ++i)
 				if (!node_refs.empty()) {
@@ -158,7 +189,13 @@ int main(int narg, const char **args) {
 		} 
 
 		// Update physics.
-		hg::SceneUpdateSystems(scene, clocks, hg::tick_clock(), physics, hg::time_from_ms(16), 3);
+		hg::SceneUpdateSystems(scene, clocks, session.GetDt(), physics, hg::time_from_ms(16), 3);
+
+		// Only format the object count text when it changes.
+		if (node_refs.size() != object_count) {
+			object_count = node_refs.size();
+			object_count_text = hg::format("%1 Object").arg(object_count);
+		}
 
 		// Display scene.
 		bgfx::ViewId view_id = 0;
@@ -168,13 +205,24 @@ int main(int narg, const char **args) {
 		// Prints key usage and the number of active objects in a text overlay.
 		hg::SetView2D(view_id, 0, 0, width, height, -1, 1, BGFX_CLEAR_DEPTH, hg::Color::Black, 1, 0);
 		hg::DrawText(view_id, font, "S: Add object - D : Destruct object", font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(460, height - 60, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
-		hg::DrawText(view_id, font, hg::format("%1 Object").arg(node_refs.size()), font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(width - 200, height - 60, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+		hg::DrawText(view_id, font, object_count_text, font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(width - 200, height - 60, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
 
 		bgfx::frame();
 
 		hg::UpdateWindow(window);
+
+		const hg::time_ns now = hg::time_now();
+		if (session_mode == InputSession::IS_Replay)
+			frame_time_report.frame_times.push_back(now - frame_start);
+		frame_start = now;
 	}
 
+	session.Close();
+	if (session_mode == InputSession::IS_Replay)
+		hg::log(hg::format("replay of '%1' (seed %2): %3").arg(session_path).arg(session.GetSeed()).arg(frame_time_report.Format()));
+	else if (session_mode == InputSession::IS_Record)
+		hg::log(hg::format("recorded session to '%1', %2 bytes").arg(session_path).arg(int(session.GetStreamSize())));
+
 	hg::RenderShutdown();
 	hg::InputShutdown();
 	hg::DestroyWindow(window);
@@ -0,0 +1,281 @@
+// HARFANG(R) Copyright (C) 2022 NWNC HARFANG. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+// Body sleeping control and per-update physics statistics: objects piling up in the box are released to the physics
+// sleeping once their velocities stay under configurable thresholds, the cost of each update is reported on screen.
+
+#include <algorithm>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <foundation/clock.h>
+#include <foundation/format.h>
+#include <foundation/log.h>
+#include <foundation/projection.h>
+#include <foundation/rand.h>
+
+#include <platform/input_system.h>
+#include <platform/window_system.h>
+
+#include <engine/assets.h>
+#include <engine/create_geometry.h>
+#include <engine/font.h>
+#include <engine/forward_pipeline.h>
+#include <engine/scene.h>
+#include <engine/scene_bullet3_physics.h>
+#include <engine/scene_forward_pipeline.h>
+#include <engine/scene_systems.h>
+
+// Bullet sleeping thresholds (btRigidBody defaults), the physics wrapper does not expose them.
+static const float physics_linear_sleeping_threshold = 0.8f; // m/s
+static const float physics_angular_sleeping_threshold = 1.f; // rad/s
+
+// The thresholds decide when a body is released to the physics, Bullet then sleeps it once its velocities stay under
+// its own thresholds. They can only be stricter than the Bullet ones, a looser threshold would release bodies that
+// Bullet keeps awake.
+struct SleepSettings {
+	float linear_threshold = 0.2f; // m/s, at most physics_linear_sleeping_threshold
+	float angular_threshold = 0.3f; // rad/s, at most physics_angular_sleeping_threshold
+	float time_to_sleep = 0.5f; // s
+};
+
+// Bodies are created with deactivation disabled so that the physics never puts them to sleep on its own. Once a body
+// velocities stayed below the thresholds long enough its deactivation is enabled again, releasing it to the physics.
+class BodySleepTracker {
+public:
+	void Add(const hg::SceneBullet3Physics &physics, hg::NodeRef ref) {
+		physics.NodeSetDeactivation(ref, false);
+		bodies[ref.idx] = {ref, 0.f, false};
+	}
+
+	void Update(const hg::SceneBullet3Physics &physics, const SleepSettings &settings, float dt) {
+		sleeping_count = released_count = 0;
+
+		for (auto &i : bodies) {
+			Body &body = i.second;
+
+			const bool at_rest = hg::Len(physics.NodeGetLinearVelocity(body.ref)) < settings.linear_threshold &&
+								 hg::Len(physics.NodeGetAngularVelocity(body.ref)) < settings.angular_threshold;
+
+			if (!at_rest) {
+				if (body.sleeping) // woken by a collision
+					physics.NodeSetDeactivation(body.ref, false);
+				body.rest_time = 0.f;
+				body.sleeping = false;
+				continue;
+			}
+
+			body.rest_time += dt;
+			if (!body.sleeping && body.rest_time >= settings.time_to_sleep) {
+				physics.NodeSetLinearVelocity(body.ref, hg::Vec3::Zero);
+				physics.NodeSetAngularVelocity(body.ref, hg::Vec3::Zero);
+				physics.NodeSetDeactivation(body.ref, true);
+				body.sleeping = true;
+			}
+
+			if (body.sleeping)
+				++released_count;
+			if (physics.NodeIsSleeping(body.ref)) // the physics may take a few steps to actually sleep a released body
+				++sleeping_count;
+		}
+	}
+
+	// Keep every body awake, used when the thresholds change.
+	void WakeAll(const hg::SceneBullet3Physics &physics) {
+		for (auto &i : bodies) {
+			physics.NodeSetDeactivation(i.second.ref, false);
+			physics.NodeWake(i.second.ref);
+			i.second.rest_time = 0.f;
+			i.second.sleeping = false;
+		}
+	}
+
+	size_t GetBodyCount() const { return bodies.size(); }
+	size_t GetSleepingCount() const { return sleeping_count; } // bodies the physics reports as sleeping
+	size_t GetReleasedCount() const { return released_count; } // bodies whose deactivation was enabled by the tracker
+
+private:
+	struct Body {
+		hg::NodeRef ref;
+		float rest_time;
+		bool sleeping;
+	};
+
+	std::unordered_map<uint32_t, Body> bodies;
+	size_t sleeping_count = 0, released_count = 0;
+};
+
+// Per-update statistics.
+struct PhysicsUpdateStats {
+	size_t pairs = 0, contacts = 0;
+	hg::time_ns update_time = 0, peak_update_time = 0;
+
+	void Update(const hg::NodePairContacts &node_pair_contacts, hg::time_ns time) {
+		pairs = contacts = 0;
+		for (const auto &i : node_pair_contacts)
+			for (const auto &j : i.second)
+				if (i.first.idx < j.first.idx) { // each pair is reported as (a, b) and (b, a)
+					++pairs;
+					contacts += j.second.size();
+				}
+
+		update_time = time;
+		peak_update_time = std::max(peak_update_time, time);
+	}
+};
+
+int main(int narg, const char **args) {
+	// Create window
+	const int width = 1280, height = 720;
+
+	hg::InputInit();
+	hg::WindowSystemInit();
+
+	hg::Window *window = hg::NewWindow(width, height);
+	if (!hg::RenderInit(window)) {
+		return EXIT_FAILURE;
+	}
+	bgfx::reset(width, height, BGFX_RESET_VSYNC | BGFX_RESET_MSAA_X8);
+
+	// Create vertex layout for cubes and spheres (position and normal).
+	bgfx::VertexLayout vs_decl;
+	vs_decl.begin().add(bgfx::Attrib::Position, 3, bgfx::AttribType::Float).add(bgfx::Attrib::Normal, 3, bgfx::AttribType::Uint8, true, true).end();
+
+	hg::PipelineResources resources;
+
+	hg::ModelRef sphere_ref = resources.models.Add("sphere", hg::CreateSphereModel(vs_decl, 0.5f, 12, 24));
+	hg::ModelRef cube_ref = resources.models.Add("cube", hg::CreateCubeModel(vs_decl, 1.f, 1.f, 1.f));
+
+	hg::AddAssetsFolder("resources_compiled");
+
+	hg::PipelineProgramRef prg = hg::LoadPipelineProgramRefFromAssets("core/shader/default.hps", resources, hg::GetForwardPipelineInfo());
+
+	hg::Material ground_mat = hg::CreateMaterial(prg, "uDiffuseColor", hg::Vec4(0.5f, 0.5f, 0.5f), "uSpecularColor", hg::Vec4(0.1f, 0.1f, 0.1f));
+	hg::Material objects_mat = hg::CreateMaterial(prg, "uDiffuseColor", hg::Vec4(0.5f, 0.5f, 0.5f), "uSpecularColor", hg::Vec4::One);
+
+	// Scene, light and camera.
+	hg::Scene scene;
+	scene.canvas.color = hg::ColorI(22, 56, 76);
+
+	hg::Node camera = hg::CreateCamera(scene, hg::TransformationMat4(hg::Vec3(0, 20.f, -30.f), hg::Deg3(30.f, 0.f, 0.f)), 0.01f, 5000.f);
+	hg::CreateLinearLight(scene, hg::TransformationMat4(hg::Vec3::Zero, hg::Deg3(30, 59, 0)), hg::Color(1, 0.8f, 0.7f), hg::Color(1, 0.8f, 0.7f), 10, hg::LST_Map, 0.002f, hg::Vec4(50, 100, 200, 400));
+	scene.SetCurrentCamera(camera);
+
+	// Board.
+	auto add_static_box = [&](const hg::Vec3 &size, const hg::Vec3 &pos, const char *name) {
+		hg::ModelRef mdl_ref = resources.models.Add(name, hg::CreateCubeModel(vs_decl, size.x, size.y, size.z));
+		hg::Node n = hg::CreatePhysicCube(scene, size, hg::TranslationMat4(pos), mdl_ref, {ground_mat}, 0.f);
+		n.GetRigidBody().SetType(hg::RBT_Static);
+	};
+
+	add_static_box(hg::Vec3(30.f, 1.f, 30.f), hg::Vec3(0.f, -.5f, 0.f), "ground");
+	add_static_box(hg::Vec3(1.f, 11.f, 32.f), hg::Vec3(-15.5f, -.5f, 0.f), "wall_l");
+	add_static_box(hg::Vec3(1.f, 11.f, 32.f), hg::Vec3(15.5f, -.5f, 0.f), "wall_r");
+	add_static_box(hg::Vec3(32.f, 11.f, 1.f), hg::Vec3(0.f, -.5f, -15.5f), "wall_b");
+	add_static_box(hg::Vec3(32.f, 11.f, 1.f), hg::Vec3(0.f, -.5f, 15.5f), "wall_t");
+
+	hg::SceneClocks clocks;
+	hg::SceneBullet3Physics physics;
+	physics.SceneCreatePhysicsFromFile(scene);
+
+	// Text display.
+	hg::Font font = hg::LoadFontFromAssets("font/default.ttf", 16);
+	bgfx::ProgramHandle font_program = hg::LoadProgramFromAssets("core/shader/font");
+
+	hg::RenderState text_render_state = hg::ComputeRenderState(hg::BM_Alpha, hg::DT_Always, hg::FC_Disabled);
+	std::vector<hg::UniformSetValue> text_uniform_values = {hg::MakeUniformSetValue("u_color", hg::Vec4(1.f, 1.f, .5f, 1.f))};
+
+	hg::ForwardPipeline pipeline = hg::CreateForwardPipeline();
+	hg::iRect viewport = hg::MakeRectFromWidthHeight(0, 0, width, height);
+
+	// Sleeping and stepping settings.
+	SleepSettings sleep_settings;
+	BodySleepTracker sleep_tracker;
+
+	const int step_rates[] = {60, 120, 240};
+	int step_rate_idx = 0, max_steps = 3;
+
+	hg::NodePairContacts contacts;
+	PhysicsUpdateStats stats;
+
+	hg::Keyboard keyboard;
+
+	hg::reset_clock();
+	while (!keyboard.Pressed(hg::K_Escape) && hg::IsWindowOpen(window)) {
+		keyboard.Update();
+
+		if (keyboard.Down(hg::K_S))
+			for (int i = 0; i < 8; ++i) {
+				const hg::Mat4 mtx = hg::TranslationMat4(hg::RandomVec3(hg::Vec3(-10.f, 18.f, -10.f), hg::Vec3(10.f, 18.f, 10.f)));
+				hg::Node node = hg::Rand() % 2 ? hg::CreatePhysicCube(scene, hg::Vec3::One, mtx, cube_ref, {objects_mat}) : hg::CreatePhysicSphere(scene, 0.5f, mtx, sphere_ref, {objects_mat});
+				physics.NodeCreatePhysicsFromFile(node);
+				sleep_tracker.Add(physics, node.ref);
+			}
+
+		if (keyboard.Pressed(hg::K_T))
+			step_rate_idx = (step_rate_idx + 1) % 3;
+		if (keyboard.Pressed(hg::K_M))
+			max_steps = max_steps % 8 + 1;
+
+		if (keyboard.Pressed(hg::K_Add) || keyboard.Pressed(hg::K_Sub)) {
+			const float k = keyboard.Pressed(hg::K_Add) ? 1.25f : 0.8f;
+			sleep_settings.linear_threshold = std::min(sleep_settings.linear_threshold * k, physics_linear_sleeping_threshold);
+			sleep_settings.angular_threshold = std::min(sleep_settings.angular_threshold * k, physics_angular_sleeping_threshold);
+			sleep_tracker.WakeAll(physics);
+		}
+
+		if (keyboard.Pressed(hg::K_W))
+			sleep_tracker.WakeAll(physics);
+
+		// Update physics and gather the update statistics.
+		const hg::time_ns dt = hg::tick_clock();
+
+		const hg::time_ns update_start = hg::time_now();
+		hg::SceneUpdateSystems(scene, clocks, dt, physics, hg::time_from_sec_f(1.f / step_rates[step_rate_idx]), max_steps);
+		const hg::time_ns update_time = hg::time_now() - update_start;
+
+		sleep_tracker.Update(physics, sleep_settings, hg::time_to_sec_f(dt));
+
+		contacts.clear();
+		physics.CollectCollisionEvents(scene, contacts);
+		stats.Update(contacts, update_time);
+
+		// Display scene.
+		bgfx::ViewId view_id = 0;
+		hg::SceneForwardPipelinePassViewId views;
+		hg::SubmitSceneToPipeline(view_id, scene, viewport, 1.f, pipeline, resources, views);
+
+		hg::SetView2D(view_id, 0, 0, width, height, -1, 1, BGFX_CLEAR_DEPTH, hg::Color::Black, 1, 0);
+
+		const std::string body_stats = hg::format("Bodies: %1 active, %2 sleeping, %3 released to sleep - contact pairs: %4, contacts: %5 - update %6 ms (peak %7 ms)")
+										   .arg(sleep_tracker.GetBodyCount() - sleep_tracker.GetSleepingCount())
+										   .arg(sleep_tracker.GetSleepingCount())
+										   .arg(sleep_tracker.GetReleasedCount())
+										   .arg(stats.pairs)
+										   .arg(stats.contacts)
+										   .arg(hg::time_to_ms_f(stats.update_time))
+										   .arg(hg::time_to_ms_f(stats.peak_update_time));
+		const std::string settings = hg::format("Release to sleep below %1 m/s and %2 rad/s for %3 s (physics sleeps below %4 m/s and %5 rad/s) - step %6 Hz, up to %7 steps per update")
+										 .arg(sleep_settings.linear_threshold)
+										 .arg(sleep_settings.angular_threshold)
+										 .arg(sleep_settings.time_to_sleep)
+										 .arg(physics_linear_sleeping_threshold)
+										 .arg(physics_angular_sleeping_threshold)
+										 .arg(step_rates[step_rate_idx])
+										 .arg(max_steps);
+
+		hg::DrawText(view_id, font, body_stats, font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20, height - 40, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+		hg::DrawText(view_id, font, settings, font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20, height - 64, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+		hg::DrawText(view_id, font, "S: Add objects - W: Wake all - +/-: Release thresholds - T: Step rate - M: Max steps", font_program, "u_tex", 0, hg::Mat4::Identity,
+			hg::Vec3(20, height - 88, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+
+		bgfx::frame();
+		hg::UpdateWindow(window);
+	}
+
+	hg::RenderShutdown();
+	hg::InputShutdown();
+	hg::DestroyWindow(window);
+	return EXIT_SUCCESS;
+}
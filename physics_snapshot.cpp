@@ -0,0 +1,348 @@
+// HARFANG(R) Copyright (C) 2022 NWNC HARFANG. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+// Binary simulation snapshot: the state of every physics object (world matrix, linear and angular velocity) is
+// gathered into contiguous arrays and stored as a compact binary blob that can be restored in place to roll back the
+// simulation, or written to disk. Objects are identified by a stable id and their shape kind, node references are
+// never persisted.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <foundation/clock.h>
+#include <foundation/format.h>
+#include <foundation/log.h>
+#include <foundation/projection.h>
+#include <foundation/rand.h>
+
+#include <platform/input_system.h>
+#include <platform/window_system.h>
+
+#include <engine/assets.h>
+#include <engine/create_geometry.h>
+#include <engine/font.h>
+#include <engine/forward_pipeline.h>
+#include <engine/scene.h>
+#include <engine/scene_bullet3_physics.h>
+#include <engine/scene_forward_pipeline.h>
+#include <engine/scene_systems.h>
+
+enum ObjectKind : uint8_t { OK_Cube, OK_Sphere };
+
+// Simulation objects, one entry per dynamic body.
+struct SimulationObjects {
+	std::vector<hg::NodeRef> refs;
+	std::vector<uint32_t> ids; // stable identity, unlike node references it is meaningful in a snapshot
+	std::vector<uint8_t> kinds;
+	uint32_t next_id = 0;
+};
+
+// Snapshot blob layout: header followed by one packed array per field.
+struct SnapshotHeader {
+	uint32_t magic = 0x4e534748; // 'HGSN'
+	uint32_t version = 2;
+	uint32_t count = 0;
+	uint32_t reserved = 0;
+};
+
+struct SimulationSnapshot {
+	std::vector<uint8_t> blob;
+	bool from_file = false; // ids of another run do not match the live objects, every body is created again
+};
+
+template <typename T> static void WriteArray(std::vector<uint8_t> &blob, size_t &offset, const T *data, size_t count) {
+	memcpy(blob.data() + offset, data, sizeof(T) * count);
+	offset += sizeof(T) * count;
+}
+
+// Arrays are packed without padding, elements are read with memcpy.
+template <typename T> static T ReadElement(const std::vector<uint8_t> &blob, size_t offset, size_t i) {
+	T v;
+	memcpy(&v, blob.data() + offset + sizeof(T) * i, sizeof(T));
+	return v;
+}
+
+static size_t GetSnapshotSize(size_t count) {
+	return sizeof(SnapshotHeader) + count * (sizeof(uint32_t) + sizeof(uint8_t) + sizeof(hg::Mat4) + 2 * sizeof(hg::Vec3));
+}
+
+// The ids and kinds are already contiguous and copied in bulk, the per-node state is gathered straight into the blob.
+static void SaveSnapshot(const hg::Scene &scene, const hg::SceneBullet3Physics &physics, const SimulationObjects &objects, SimulationSnapshot &snapshot) {
+	const size_t count = objects.refs.size();
+
+	SnapshotHeader header;
+	header.count = uint32_t(count);
+
+	snapshot.blob.resize(GetSnapshotSize(count));
+	snapshot.from_file = false;
+
+	size_t offset = 0;
+	WriteArray(snapshot.blob, offset, &header, 1);
+	WriteArray(snapshot.blob, offset, objects.ids.data(), count);
+	WriteArray(snapshot.blob, offset, objects.kinds.data(), count);
+
+	size_t world_offset = offset, linear_offset = offset + count * sizeof(hg::Mat4), angular_offset = linear_offset + count * sizeof(hg::Vec3);
+
+	for (size_t i = 0; i < count; ++i) {
+		const hg::Mat4 world = scene.GetNodeWorldMatrix(objects.refs[i]);
+		const hg::Vec3 linear = physics.NodeGetLinearVelocity(objects.refs[i]), angular = physics.NodeGetAngularVelocity(objects.refs[i]);
+
+		WriteArray(snapshot.blob, world_offset, &world, 1);
+		WriteArray(snapshot.blob, linear_offset, &linear, 1);
+		WriteArray(snapshot.blob, angular_offset, &angular, 1);
+	}
+}
+
+// Restore in place. Live objects whose id and kind match a snapshot entry are reset, the other live objects are
+// destroyed and the missing entries are created again using the create callback.
+template <typename CreateObject>
+static bool RestoreSnapshot(hg::Scene &scene, hg::SceneBullet3Physics &physics, SimulationObjects &objects, const SimulationSnapshot &snapshot, CreateObject create_object) {
+	if (snapshot.blob.size() < sizeof(SnapshotHeader))
+		return false;
+
+	const SnapshotHeader header = ReadElement<SnapshotHeader>(snapshot.blob, 0, 0);
+	if (header.magic != SnapshotHeader().magic || header.version != SnapshotHeader().version || snapshot.blob.size() != GetSnapshotSize(header.count))
+		return false;
+
+	const size_t count = header.count;
+
+	const size_t ids_offset = sizeof(SnapshotHeader), kinds_offset = ids_offset + count * sizeof(uint32_t), world_offset = kinds_offset + count;
+	const size_t linear_offset = world_offset + count * sizeof(hg::Mat4), angular_offset = linear_offset + count * sizeof(hg::Vec3);
+
+	std::vector<uint32_t> ids(count);
+	std::vector<uint8_t> kinds(count);
+
+	memcpy(ids.data(), snapshot.blob.data() + ids_offset, count * sizeof(uint32_t));
+	memcpy(kinds.data(), snapshot.blob.data() + kinds_offset, count);
+
+	if (std::any_of(kinds.begin(), kinds.end(), [](uint8_t kind) { return kind > OK_Sphere; }))
+		return false;
+
+	// match the live objects by id and kind
+	std::unordered_map<uint32_t, size_t> live;
+	if (!snapshot.from_file)
+		for (size_t j = 0; j < objects.ids.size(); ++j)
+			live[objects.ids[j]] = j;
+
+	std::vector<hg::NodeRef> refs(count, hg::InvalidNodeRef);
+	std::vector<bool> kept(objects.refs.size(), false);
+
+	for (size_t i = 0; i < count; ++i) {
+		const auto j = live.find(ids[i]);
+		if (j == live.end())
+			continue;
+
+		if (objects.kinds[j->second] == kinds[i] && scene.IsValidNodeRef(objects.refs[j->second])) {
+			refs[i] = objects.refs[j->second];
+			kept[j->second] = true;
+		}
+		live.erase(j); // an id is matched once
+	}
+
+	// destroy the live objects absent from the snapshot
+	for (size_t j = 0; j < objects.refs.size(); ++j)
+		if (!kept[j])
+			scene.DestroyNode(objects.refs[j]);
+
+	scene.GarbageCollect();
+	physics.GarbageCollect(scene);
+
+	for (size_t i = 0; i < count; ++i) {
+		const hg::Mat4 world = ReadElement<hg::Mat4>(snapshot.blob, world_offset, i);
+
+		hg::NodeRef &ref = refs[i];
+		if (!scene.IsValidNodeRef(ref))
+			ref = create_object(ObjectKind(kinds[i]), world);
+
+		scene.GetNode(ref).GetTransform().SetWorld(world);
+		physics.NodeResetWorld(ref, world);
+		physics.NodeSetLinearVelocity(ref, ReadElement<hg::Vec3>(snapshot.blob, linear_offset, i));
+		physics.NodeSetAngularVelocity(ref, ReadElement<hg::Vec3>(snapshot.blob, angular_offset, i));
+		physics.NodeWake(ref);
+
+		objects.next_id = std::max(objects.next_id, ids[i] + 1);
+	}
+
+	objects.refs = std::move(refs);
+	objects.ids = std::move(ids);
+	objects.kinds = std::move(kinds);
+	return true;
+}
+
+static bool WriteSnapshotToFile(const SimulationSnapshot &snapshot, const char *path) {
+	FILE *file = fopen(path, "wb");
+	if (!file)
+		return false;
+	const bool ok = fwrite(snapshot.blob.data(), 1, snapshot.blob.size(), file) == snapshot.blob.size();
+	fclose(file);
+	return ok;
+}
+
+static bool ReadSnapshotFromFile(SimulationSnapshot &snapshot, const char *path) {
+	FILE *file = fopen(path, "rb");
+	if (!file)
+		return false;
+
+	long size = -1;
+	if (fseek(file, 0, SEEK_END) == 0)
+		size = ftell(file);
+
+	bool ok = size >= 0 && fseek(file, 0, SEEK_SET) == 0;
+	if (ok) {
+		snapshot.blob.resize(size_t(size));
+		ok = fread(snapshot.blob.data(), 1, snapshot.blob.size(), file) == snapshot.blob.size();
+	}
+
+	fclose(file);
+
+	if (!ok)
+		snapshot.blob.clear();
+	snapshot.from_file = true;
+	return ok;
+}
+
+int main(int narg, const char **args) {
+	// Create window
+	const int width = 1280, height = 720;
+
+	hg::InputInit();
+	hg::WindowSystemInit();
+
+	hg::Window *window = hg::NewWindow(width, height);
+	if (!hg::RenderInit(window)) {
+		return EXIT_FAILURE;
+	}
+	bgfx::reset(width, height, BGFX_RESET_VSYNC | BGFX_RESET_MSAA_X8);
+
+	// Create vertex layout for cubes and spheres (position and normal).
+	bgfx::VertexLayout vs_decl;
+	vs_decl.begin().add(bgfx::Attrib::Position, 3, bgfx::AttribType::Float).add(bgfx::Attrib::Normal, 3, bgfx::AttribType::Uint8, true, true).end();
+
+	hg::PipelineResources resources;
+
+	hg::ModelRef sphere_ref = resources.models.Add("sphere", hg::CreateSphereModel(vs_decl, 0.5f, 12, 24));
+	hg::ModelRef cube_ref = resources.models.Add("cube", hg::CreateCubeModel(vs_decl, 1.f, 1.f, 1.f));
+
+	hg::AddAssetsFolder("resources_compiled");
+
+	hg::PipelineProgramRef prg = hg::LoadPipelineProgramRefFromAssets("core/shader/default.hps", resources, hg::GetForwardPipelineInfo());
+
+	hg::Material ground_mat = hg::CreateMaterial(prg, "uDiffuseColor", hg::Vec4(0.5f, 0.5f, 0.5f), "uSpecularColor", hg::Vec4(0.1f, 0.1f, 0.1f));
+	hg::Material objects_mat = hg::CreateMaterial(prg, "uDiffuseColor", hg::Vec4(0.5f, 0.5f, 0.5f), "uSpecularColor", hg::Vec4::One);
+
+	// Scene, light and camera.
+	hg::Scene scene;
+	scene.canvas.color = hg::ColorI(22, 56, 76);
+
+	hg::Node camera = hg::CreateCamera(scene, hg::TransformationMat4(hg::Vec3(0, 20.f, -30.f), hg::Deg3(30.f, 0.f, 0.f)), 0.01f, 5000.f);
+	hg::CreateLinearLight(scene, hg::TransformationMat4(hg::Vec3::Zero, hg::Deg3(30, 59, 0)), hg::Color(1, 0.8f, 0.7f), hg::Color(1, 0.8f, 0.7f), 10, hg::LST_Map, 0.002f, hg::Vec4(50, 100, 200, 400));
+	scene.SetCurrentCamera(camera);
+
+	// Board.
+	auto add_static_box = [&](const hg::Vec3 &size, const hg::Vec3 &pos, const char *name) {
+		hg::ModelRef mdl_ref = resources.models.Add(name, hg::CreateCubeModel(vs_decl, size.x, size.y, size.z));
+		hg::Node n = hg::CreatePhysicCube(scene, size, hg::TranslationMat4(pos), mdl_ref, {ground_mat}, 0.f);
+		n.GetRigidBody().SetType(hg::RBT_Static);
+	};
+
+	add_static_box(hg::Vec3(30.f, 1.f, 30.f), hg::Vec3(0.f, -.5f, 0.f), "ground");
+	add_static_box(hg::Vec3(1.f, 11.f, 32.f), hg::Vec3(-15.5f, -.5f, 0.f), "wall_l");
+	add_static_box(hg::Vec3(1.f, 11.f, 32.f), hg::Vec3(15.5f, -.5f, 0.f), "wall_r");
+	add_static_box(hg::Vec3(32.f, 11.f, 1.f), hg::Vec3(0.f, -.5f, -15.5f), "wall_b");
+	add_static_box(hg::Vec3(32.f, 11.f, 1.f), hg::Vec3(0.f, -.5f, 15.5f), "wall_t");
+
+	hg::SceneClocks clocks;
+	hg::SceneBullet3Physics physics;
+	physics.SceneCreatePhysicsFromFile(scene);
+
+	SimulationObjects objects;
+
+	auto create_object = [&](ObjectKind kind, const hg::Mat4 &mtx) -> hg::NodeRef {
+		hg::Node node = kind == OK_Cube ? hg::CreatePhysicCube(scene, hg::Vec3::One, mtx, cube_ref, {objects_mat}) : hg::CreatePhysicSphere(scene, 0.5f, mtx, sphere_ref, {objects_mat});
+		physics.NodeCreatePhysicsFromFile(node);
+		return node.ref;
+	};
+
+	// Text display.
+	hg::Font font = hg::LoadFontFromAssets("font/default.ttf", 16);
+	bgfx::ProgramHandle font_program = hg::LoadProgramFromAssets("core/shader/font");
+
+	hg::RenderState text_render_state = hg::ComputeRenderState(hg::BM_Alpha, hg::DT_Always, hg::FC_Disabled);
+	std::vector<hg::UniformSetValue> text_uniform_values = {hg::MakeUniformSetValue("u_color", hg::Vec4(1.f, 1.f, .5f, 1.f))};
+
+	hg::ForwardPipeline pipeline = hg::CreateForwardPipeline();
+	hg::iRect viewport = hg::MakeRectFromWidthHeight(0, 0, width, height);
+
+	SimulationSnapshot snapshot;
+	std::string status = "No snapshot";
+
+	hg::Keyboard keyboard;
+
+	hg::reset_clock();
+	while (!keyboard.Pressed(hg::K_Escape) && hg::IsWindowOpen(window)) {
+		keyboard.Update();
+
+		if (keyboard.Down(hg::K_S))
+			for (int i = 0; i < 8; ++i) {
+				const ObjectKind kind = hg::Rand() % 2 ? OK_Cube : OK_Sphere;
+				objects.refs.push_back(create_object(kind, hg::TranslationMat4(hg::RandomVec3(hg::Vec3(-10.f, 18.f, -10.f), hg::Vec3(10.f, 18.f, 10.f)))));
+				objects.ids.push_back(objects.next_id++);
+				objects.kinds.push_back(kind);
+			}
+
+		if (keyboard.Pressed(hg::K_D))
+			for (int i = 0; i < 8 && !objects.refs.empty(); ++i) {
+				scene.DestroyNode(objects.refs.back());
+				objects.refs.pop_back();
+				objects.ids.pop_back();
+				objects.kinds.pop_back();
+			}
+
+		if (keyboard.Pressed(hg::K_C)) {
+			const hg::time_ns t = hg::time_now();
+			SaveSnapshot(scene, physics, objects, snapshot);
+			status = hg::format("Saved %1 objects, %2 KB in %3 ms").arg(objects.refs.size()).arg(snapshot.blob.size() / 1024).arg(hg::time_to_ms_f(hg::time_now() - t));
+		}
+
+		if (keyboard.Pressed(hg::K_R)) {
+			const hg::time_ns t = hg::time_now();
+			if (RestoreSnapshot(scene, physics, objects, snapshot, create_object))
+				status = hg::format("Restored %1 objects in %2 ms").arg(objects.refs.size()).arg(hg::time_to_ms_f(hg::time_now() - t));
+			else
+				status = "Invalid snapshot";
+		}
+
+		if (keyboard.Pressed(hg::K_W))
+			status = WriteSnapshotToFile(snapshot, "snapshot.bin") ? "Snapshot written to snapshot.bin" : "Failed to write snapshot.bin";
+		if (keyboard.Pressed(hg::K_L))
+			status = ReadSnapshotFromFile(snapshot, "snapshot.bin") ? "Snapshot read from snapshot.bin, press R to restore" : "Failed to read snapshot.bin";
+
+		scene.GarbageCollect();
+		physics.GarbageCollect(scene);
+
+		hg::SceneUpdateSystems(scene, clocks, hg::tick_clock(), physics, hg::time_from_ms(16), 3);
+
+		// Display scene.
+		bgfx::ViewId view_id = 0;
+		hg::SceneForwardPipelinePassViewId views;
+		hg::SubmitSceneToPipeline(view_id, scene, viewport, 1.f, pipeline, resources, views);
+
+		hg::SetView2D(view_id, 0, 0, width, height, -1, 1, BGFX_CLEAR_DEPTH, hg::Color::Black, 1, 0);
+		hg::DrawText(view_id, font, hg::format("%1 objects - %2").arg(objects.refs.size()).arg(status), font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20, height - 40, 0),
+			hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+		hg::DrawText(view_id, font, "S: Add objects - D: Destroy objects - C: Checkpoint - R: Restore - W/L: Write/Load snapshot.bin", font_program, "u_tex", 0, hg::Mat4::Identity,
+			hg::Vec3(20, height - 64, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+
+		bgfx::frame();
+		hg::UpdateWindow(window);
+	}
+
+	hg::RenderShutdown();
+	hg::InputShutdown();
+	hg::DestroyWindow(window);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,280 @@
+// HARFANG(R) Copyright (C) 2022 NWNC HARFANG. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+// Pipelined rendering: the main thread owns the window and runs the bgfx render thread while the scene is updated and
+// submitted from a game thread, so the simulation of frame N+1 overlaps the rendering of frame N.
+// Run with -single to compare with the usual single threaded loop and with -latency <n> to set the maximum number of
+// frames the renderer may queue (1 to 3, defaults to the driver setting). A frame pacing report is displayed in all modes.
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <foundation/clock.h>
+#include <foundation/format.h>
+#include <foundation/log.h>
+#include <foundation/math.h>
+
+#include <platform/input_system.h>
+#include <platform/window_system.h>
+
+#include <engine/assets.h>
+#include <engine/font.h>
+#include <engine/forward_pipeline.h>
+#include <engine/render_pipeline.h>
+#include <engine/scene.h>
+#include <engine/scene_forward_pipeline.h>
+
+// Frame pacing statistics over a rolling window. The first frames are skipped, they include the scene load and the
+// shader and texture uploads and would otherwise count as missed vsyncs.
+struct FramePacing {
+	static const int window = 240, warm_up = 30;
+
+	float frame_ms[window] = {};
+	bool missed[window] = {};
+	int frame = 0, count = 0, missed_vsync = 0;
+	float vsync_ms = 1000.f / 60.f;
+
+	float cpu_ms = 0.f, gpu_ms = 0.f, wait_render_ms = 0.f, wait_submit_ms = 0.f;
+
+	void Update(hg::time_ns dt, const bgfx::Stats &stats) {
+		if (frame++ < warm_up)
+			return;
+
+		const float ms = hg::time_to_ms_f(dt);
+		const int i = count++ % window;
+
+		// missed_vsync is the number of missed vsyncs in the window
+		if (missed[i])
+			--missed_vsync;
+
+		frame_ms[i] = ms;
+		missed[i] = ms > vsync_ms * 1.5f;
+
+		if (missed[i])
+			++missed_vsync;
+
+		// per frame split of the API thread (submit) and render thread waits
+		const double cpu_freq = double(stats.cpuTimerFreq), gpu_freq = double(stats.gpuTimerFreq);
+
+		cpu_ms = float(double(stats.cpuTimeEnd - stats.cpuTimeBegin) * 1000.0 / cpu_freq);
+		gpu_ms = gpu_freq > 0 ? float(double(stats.gpuTimeEnd - stats.gpuTimeBegin) * 1000.0 / gpu_freq) : 0.f;
+		wait_render_ms = float(double(stats.waitRender) * 1000.0 / cpu_freq);
+		wait_submit_ms = float(double(stats.waitSubmit) * 1000.0 / cpu_freq);
+	}
+
+	int Size() const { return std::min(count, window); }
+
+	float Mean() const {
+		const int n = Size();
+		float sum = 0.f;
+		for (int i = 0; i < n; ++i)
+			sum += frame_ms[i];
+		return n ? sum / n : 0.f;
+	}
+
+	float StdDev() const {
+		const int n = Size();
+		const float mean = Mean();
+		float sum = 0.f;
+		for (int i = 0; i < n; ++i)
+			sum += (frame_ms[i] - mean) * (frame_ms[i] - mean);
+		return n ? std::sqrt(sum / n) : 0.f;
+	}
+
+	// missed vsyncs in percent of the frames in the window
+	float MissedVSyncRate() const {
+		const int n = Size();
+		return n ? float(missed_vsync) * 100.f / float(n) : 0.f;
+	}
+};
+
+// State shared between the main (window and render) thread and the game thread.
+struct SharedState {
+	std::atomic<bool> quit{false};
+	std::atomic<int> work_ms{4};
+};
+
+// Stand-in for the game simulation.
+static void SimulateWork(hg::time_ns duration) {
+	const hg::time_ns end = hg::time_now() + duration;
+	while (hg::time_now() < end)
+		;
+}
+
+// Keyboard controls, read on the thread pumping the window events.
+static void UpdateControls(hg::Window *window, hg::Keyboard &keyboard, SharedState &shared) {
+	keyboard.Update();
+
+	if (keyboard.Pressed(hg::K_Add))
+		++shared.work_ms;
+	if (keyboard.Pressed(hg::K_Sub))
+		shared.work_ms = std::max(shared.work_ms - 1, 0);
+
+	if (!hg::IsWindowOpen(window) || keyboard.Pressed(hg::K_Escape))
+		shared.quit = true;
+}
+
+// Same as hg::RenderInit but with a maximum frame latency, the number of frames the driver may queue ahead of the display
+// (0 keeps the driver setting). It can only be set when initializing bgfx.
+static bool RenderInit(hg::Window *window, int res_x, int res_y, uint32_t reset_flags, int max_frame_latency) {
+	bgfx::PlatformData pd;
+	pd.nwh = hg::GetWindowHandle(window);
+#if __linux__
+	pd.ndt = hg::GetDisplay();
+#endif
+	bgfx::setPlatformData(pd);
+
+	bgfx::Init init;
+	init.platformData = pd;
+	init.resolution.width = res_x;
+	init.resolution.height = res_y;
+	init.resolution.reset = reset_flags;
+	init.resolution.maxFrameLatency = uint8_t(max_frame_latency);
+	return bgfx::init(init);
+}
+
+// Scene update and render submission, runs on the game thread in pipelined mode. Returns false if the renderer could
+// not be initialized.
+static bool GameLoop(hg::Window *window, int res_x, int res_y, SharedState &shared, bool pipelined, int max_frame_latency) {
+	if (!RenderInit(window, res_x, res_y, BGFX_RESET_VSYNC | BGFX_RESET_MSAA_X4, max_frame_latency))
+		return false;
+
+	// access compiled resources
+	hg::AddAssetsFolder("resources_compiled");
+
+	// create forward pipeline and resources.
+	hg::ForwardPipeline pipeline = hg::CreateForwardPipeline();
+	hg::PipelineResources res = hg::PipelineResources();
+
+	// load scene
+	hg::Scene scene;
+	hg::LoadSceneContext load_ctx;
+	hg::LoadSceneFromAssets("materials/materials.scn", scene, res, hg::GetForwardPipelineInfo(), load_ctx);
+
+	hg::Node camera = scene.GetCurrentCamera();
+
+	// text rendering
+	hg::Font font = hg::LoadFontFromAssets("font/default.ttf", 16);
+	bgfx::ProgramHandle font_program = hg::LoadProgramFromAssets("core/shader/font");
+
+	std::vector<hg::UniformSetValue> text_uniform_values = {hg::MakeUniformSetValue("u_color", hg::Vec4(1.f, 1.f, 0.5f))};
+	hg::RenderState text_render_state = hg::ComputeRenderState(hg::BM_Alpha, hg::DT_Always, hg::FC_Disabled);
+
+	FramePacing pacing;
+	float angle = 0.f;
+
+	hg::Keyboard keyboard;
+
+	hg::reset_clock();
+
+	while (!shared.quit) {
+		hg::time_ns dt = hg::tick_clock();
+
+		pacing.Update(dt, *bgfx::getStats());
+
+		SimulateWork(hg::time_from_ms(shared.work_ms));
+
+		angle += hg::time_to_sec_f(dt) * 0.25f;
+		camera.GetTransform().SetWorld(hg::Mat4LookAt(hg::Vec3(hg::Sin(angle) * 8.f, 3.f, hg::Cos(angle) * 8.f), hg::Vec3::Zero));
+
+		scene.Update(dt);
+
+		bgfx::ViewId view_id = 0;
+		hg::SceneForwardPipelinePassViewId views;
+		hg::SubmitSceneToPipeline(view_id, scene, hg::iRect(0, 0, res_x, res_y), true, pipeline, res, views);
+
+		// frame pacing report
+		hg::SetView2D(view_id, 0, 0, res_x, res_y, -1, 1, BGFX_CLEAR_DEPTH, hg::Color::Black, 1, 0);
+
+		const std::string report = hg::format("%1 - frame %2 ms (std dev %3 ms), %4% missed vsyncs over %5 frames - submit %6 ms, GPU %7 ms, wait render %8 ms, wait submit %9 ms")
+									   .arg(pipelined ? "Pipelined render thread" : "Single thread")
+									   .arg(pacing.Mean())
+									   .arg(pacing.StdDev())
+									   .arg(pacing.MissedVSyncRate())
+									   .arg(pacing.Size())
+									   .arg(pacing.cpu_ms)
+									   .arg(pacing.gpu_ms)
+									   .arg(pacing.wait_render_ms)
+									   .arg(pacing.wait_submit_ms);
+		hg::DrawText(view_id, font, report, font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20, res_y - 40, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+		hg::DrawText(view_id, font, hg::format("+/-: simulated game work (%1 ms), max frame latency %2").arg(int(shared.work_ms)).arg(max_frame_latency ? std::to_string(max_frame_latency) : std::string("driver default")), font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20, res_y - 64, 0),
+			hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+
+		// in pipelined mode this hands the frame over to the render thread and returns as soon as it picked it up
+		bgfx::frame();
+
+		if (!pipelined) {
+			hg::UpdateWindow(window);
+			UpdateControls(window, keyboard, shared);
+		}
+	}
+
+	hg::RenderShutdown();
+	return true;
+}
+
+int main(int narg, const char **args) {
+	bool pipelined = true;
+	int max_frame_latency = 0;
+
+	for (int i = 1; i < narg; ++i)
+		if (strcmp(args[i], "-single") == 0)
+			pipelined = false;
+		else if (strcmp(args[i], "-latency") == 0 && i + 1 < narg)
+			max_frame_latency = std::min(std::max(atoi(args[++i]), 1), 3);
+
+	hg::InputInit();
+	hg::WindowSystemInit();
+
+	const int res_x = 1280, res_y = 720;
+
+	hg::Window *window = hg::NewWindow("Harfang - Render Thread", res_x, res_y);
+	if (!window) {
+		hg::error("failed to create window.");
+		return EXIT_FAILURE;
+	}
+
+	SharedState shared;
+	std::atomic<bool> success{true};
+
+	if (pipelined) {
+		// calling renderFrame before the renderer is initialized makes this thread the render thread, bgfx then
+		// allows the game thread to run at most one frame ahead of it
+		bgfx::renderFrame();
+
+		std::thread game_thread([&]() { success = GameLoop(window, res_x, res_y, shared, true, max_frame_latency); });
+
+		hg::Keyboard keyboard;
+
+		// render until the game thread shuts the renderer down, the window events are pumped on this thread
+		for (;;) {
+			const bgfx::RenderFrame::Enum state = bgfx::renderFrame(100);
+			if (state == bgfx::RenderFrame::Exiting)
+				break;
+			if (state == bgfx::RenderFrame::NoContext && !success)
+				break; // renderer initialization failed on the game thread
+
+			hg::UpdateWindow(window);
+			UpdateControls(window, keyboard, shared);
+		}
+
+		game_thread.join();
+	} else {
+		success = GameLoop(window, res_x, res_y, shared, false, max_frame_latency);
+	}
+
+	if (!success)
+		hg::error("failed to initialize the renderer.");
+
+	hg::DestroyWindow(window);
+
+	hg::WindowSystemShutdown();
+	hg::InputShutdown();
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,31 @@
+$input vWorldPos, vNormal
+
+#include <bgfx_shader.sh>
+
+#define MAX_LIGHTS 8
+
+uniform vec4 u_color; // diffuse color
+uniform vec4 u_ambient;
+
+// light set of the draw, unused slots have a black color
+uniform vec4 u_light_pos[MAX_LIGHTS]; // xyz: world position, w: 1 / radius
+uniform vec4 u_light_dir[MAX_LIGHTS]; // xyz: spot direction, w: cosine of the outer angle (-2 for point lights)
+uniform vec4 u_light_color[MAX_LIGHTS]; // rgb: diffuse color, w: cosine of the inner angle (-1 for point lights)
+
+void main() {
+	vec3 normal = normalize(vNormal);
+	vec3 light = u_ambient.rgb;
+
+	for (int i = 0; i < MAX_LIGHTS; ++i) {
+		vec3 L = u_light_pos[i].xyz - vWorldPos;
+		float d = length(L);
+		L /= max(d, 0.0001);
+
+		float attenuation = max(1.0 - d * u_light_pos[i].w, 0.0);
+		float cone = clamp((dot(-L, u_light_dir[i].xyz) - u_light_dir[i].w) / (u_light_color[i].w - u_light_dir[i].w), 0.0, 1.0);
+
+		light += u_light_color[i].rgb * max(dot(normal, L), 0.0) * attenuation * attenuation * cone;
+	}
+
+	gl_FragColor = vec4(u_color.rgb * light, 1.0);
+}
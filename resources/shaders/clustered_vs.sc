@@ -0,0 +1,10 @@
+$input a_position, a_normal
+$output vWorldPos, vNormal
+
+#include <bgfx_shader.sh>
+
+void main() {
+	vWorldPos = mul(u_model[0], vec4(a_position, 1.0)).xyz;
+	vNormal = mul(u_model[0], vec4(a_normal * 2.0 - 1.0, 0.0)).xyz;
+	gl_Position = mul(u_modelViewProj, vec4(a_position, 1.0));
+}
@@ -0,0 +1,14 @@
+$input a_position, a_normal, i_data0, i_data1
+$output vNormal
+
+#include <bgfx_shader.sh>
+
+// i_data0: world position and uniform scale, i_data1: rotation quaternion
+vec3 rotate(vec4 q, vec3 v) {
+	return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
+void main() {
+	vNormal = rotate(i_data1, a_normal * 2.0 - 1.0);
+	gl_Position = mul(u_viewProj, vec4(rotate(i_data1, a_position * i_data0.w) + i_data0.xyz, 1.0));
+}
@@ -40,6 +40,9 @@ int main() {
 	hg::ForwardPipelineAAA pipeline_aaa = hg::CreateForwardPipelineAAAFromAssets("core", pipeline_aaa_config, bgfx::BackbufferRatio::Equal, bgfx::BackbufferRatio::Equal);
 	pipeline_aaa_config.sample_count = 1;
 
+	// resolve the animated node once, the transform stays valid for the lifetime of the node
+	hg::Transform trs = scene.GetNode("engine_master").GetTransform();
+
 	// main loop
 	int frame = 0;
 
@@ -50,7 +53,6 @@ int main() {
 		// update keyboard devices
 		keyboard.Update();
 		
-		hg::Transform trs = scene.GetNode("engine_master").GetTransform();
 		trs.SetRot(trs.GetRot() + hg::Vec3(0, hg::Deg(15.f) * hg::time_to_sec_f(dt), 0));
 
 		bgfx::ViewId view_id = 0;
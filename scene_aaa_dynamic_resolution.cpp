@@ -0,0 +1,195 @@
+// HARFANG(R) Copyright (C) 2022 NWNC HARFANG. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+// Toyota 2JZ - GTE Engine model by Serhii Denysenko(CGTrader: serhiidenysenko8256)
+// URL : https://www.cgtrader.com/3d-models/vehicle/part/toyota-2jz-gte-engine-2932b715-2f42-4ecd-93ce-df9507c67ce8
+
+// Dynamic resolution for the AAA pipeline: the scene is rendered to a sub-rectangle of a full resolution frame buffer
+// whose size follows a frame time target, then upscaled to the back buffer. Render targets are never reallocated.
+
+#include <algorithm>
+#include <vector>
+
+#include <foundation/clock.h>
+#include <foundation/format.h>
+#include <foundation/log.h>
+#include <foundation/math.h>
+
+#include <platform/input_system.h>
+#include <platform/window_system.h>
+
+#include <engine/assets.h>
+#include <engine/dear_imgui.h>
+#include <engine/render_pipeline.h>
+#include <engine/scene.h>
+#include <engine/scene_forward_pipeline.h>
+#include <engine/forward_pipeline.h>
+
+// PID controller driving the render scale from the measured frame time (positional form). The scale is the maximum scale
+// corrected by the terms, the integral holds the steady state offset and is clamped to the range it can act upon.
+struct DynamicResolutionController {
+	float target_ms = 16.f; // leave some headroom below the 16.6 ms vsync interval
+	float kp = 0.3f, ki = 0.05f, kd = 0.05f; // gains on the relative frame time error
+	float min_scale = 0.5f, max_scale = 1.f;
+
+	float scale = 1.f;
+
+	float Update(float frame_ms) {
+		const float error = (target_ms - frame_ms) / target_ms;
+
+		integral = hg::Clamp(integral + error, (min_scale - max_scale) / ki, 0.f); // anti-windup
+		const float derivative = error - prev_error;
+		prev_error = error;
+
+		scale = hg::Clamp(max_scale + kp * error + ki * integral + kd * derivative, min_scale, max_scale);
+		return scale;
+	}
+
+private:
+	float integral = 0.f, prev_error = 0.f;
+};
+
+// Frame time and scale history for telemetry.
+struct DynamicResolutionTelemetry {
+	static const int history_size = 256;
+
+	float frame_ms[history_size] = {}, scale[history_size] = {};
+	int head = 0;
+
+	void Push(float ms, float s) {
+		frame_ms[head] = ms;
+		scale[head] = s;
+		head = (head + 1) % history_size;
+	}
+};
+
+// GPU frame time from the renderer statistics, CPU frame time when GPU timers are not available.
+static float GetFrameTimeMs(hg::time_ns cpu_dt) {
+	const bgfx::Stats *stats = bgfx::getStats();
+	if (stats->gpuTimerFreq > 0 && stats->gpuTimeEnd > stats->gpuTimeBegin)
+		return float(stats->gpuTimeEnd - stats->gpuTimeBegin) * 1000.f / float(stats->gpuTimerFreq);
+	return hg::time_to_sec_f(cpu_dt) * 1000.f;
+}
+
+int main() {
+	// create window.
+	hg::InputInit();
+	hg::WindowSystemInit();
+
+	int res_x = 1280, res_y = 720;
+
+	hg::Window *win = hg::RenderInit("AAA Scene - Dynamic Resolution", res_x, res_y, BGFX_RESET_NONE);
+	if (!win) {
+		hg::error("failed to create window.");
+		return EXIT_FAILURE;
+	}
+
+	// access compiled resources
+	hg::AddAssetsFolder("resources_compiled");
+
+	// create forward pipeline and resources.
+	hg::ForwardPipeline pipeline = hg::CreateForwardPipeline();
+	hg::PipelineResources res = hg::PipelineResources();
+
+	// load scene
+	hg::Scene scene;
+	hg::LoadSceneContext load_ctx;
+	hg::LoadSceneFromAssets("car_engine/engine.scn", scene, res, hg::GetForwardPipelineInfo(), load_ctx);
+
+	// AAA pipeline, it renders and resolves at the scaled resolution, the result is then stretched with a bilinear quad
+	hg::ForwardPipelineAAAConfig pipeline_aaa_config;
+	hg::ForwardPipelineAAA pipeline_aaa = hg::CreateForwardPipelineAAAFromAssets("core", pipeline_aaa_config, bgfx::BackbufferRatio::Equal, bgfx::BackbufferRatio::Equal);
+	pipeline_aaa_config.sample_count = 1;
+
+	// full resolution frame buffer, only a sub-rectangle of it is rendered to
+	hg::FrameBuffer frame_buffer = hg::CreateFrameBuffer(res_x, res_y, bgfx::TextureFormat::RGBA8, bgfx::TextureFormat::D24, 1, "dynamic_resolution");
+	hg::Texture color = hg::GetColorTexture(frame_buffer);
+
+	// upscale quad
+	bgfx::VertexLayout quad_layout;
+	quad_layout.begin().add(bgfx::Attrib::Position, 3, bgfx::AttribType::Float).add(bgfx::Attrib::TexCoord0, 2, bgfx::AttribType::Float).end();
+
+	hg::Vertices quad_vtx(quad_layout, 4);
+	hg::Indices quad_idx;
+	quad_idx.insert(quad_idx.end(), {0, 1, 2, 0, 2, 3});
+
+	bgfx::ProgramHandle quad_prg = hg::LoadProgramFromAssets("shaders/texture");
+	hg::RenderState quad_render_state = hg::ComputeRenderState(hg::BM_Opaque, hg::DT_Disabled, hg::FC_Disabled);
+
+	std::vector<hg::UniformSetValue> quad_values = {hg::MakeUniformSetValue("color", hg::Vec4::One)};
+	std::vector<hg::UniformSetTexture> quad_textures = {hg::MakeUniformSetTexture("s_tex", color, 0)};
+
+	const bool origin_bottom_left = bgfx::getCaps()->originBottomLeft;
+
+	// initialize ImGui to display the controller telemetry
+	bgfx::ProgramHandle imgui_prg = hg::LoadProgramFromAssets("core/shader/imgui");
+	bgfx::ProgramHandle imgui_img_prg = hg::LoadProgramFromAssets("core/shader/imgui_image");
+
+	hg::ImGuiInit(10.f, imgui_prg, imgui_img_prg);
+
+	DynamicResolutionController controller;
+	DynamicResolutionTelemetry telemetry;
+	bool dynamic_resolution = true;
+
+	// main loop
+	int frame = 0;
+	hg::Node engine_master = scene.GetNode("engine_master");
+
+	hg::Keyboard keyboard;
+	while (!keyboard.Pressed(hg::K_Escape) && hg::IsWindowOpen(win)) {
+		hg::time_ns dt = hg::tick_clock();  // tick clock, retrieve elapsed clock since last call
+
+		// update keyboard devices
+		keyboard.Update();
+
+		// update the render scale from the last frame time, the rectangle is aligned on 8 pixels
+		const float frame_ms = GetFrameTimeMs(dt);
+		const float scale = dynamic_resolution ? controller.Update(frame_ms) : 1.f;
+		telemetry.Push(frame_ms, scale);
+
+		const int rect_x = std::max((int(res_x * scale) + 7) & ~7, 8), rect_y = std::max((int(res_y * scale) + 7) & ~7, 8);
+
+		hg::Transform trs = engine_master.GetTransform();
+		trs.SetRot(trs.GetRot() + hg::Vec3(0, hg::Deg(15.f) * hg::time_to_sec_f(dt), 0));
+
+		bgfx::ViewId view_id = 0;
+		hg::SceneForwardPipelinePassViewId views;
+
+		scene.Update(dt);
+		hg::SubmitSceneToPipeline(view_id, scene, hg::iRect(0, 0, rect_x, rect_y), true, pipeline, res, views, pipeline_aaa, pipeline_aaa_config, frame, frame_buffer.handle);
+
+		// bilinear upscale of the rendered rectangle to the back buffer
+		const float u = float(rect_x) / float(res_x), v = float(rect_y) / float(res_y);
+		const float v_top = origin_bottom_left ? 1.f : 0.f, v_bottom = origin_bottom_left ? 1.f - v : v;
+
+		quad_vtx.Begin(0).SetPos(hg::Vec3(0.f, 0.f, 0.f)).SetTexCoord0(hg::Vec2(0.f, v_top)).End();
+		quad_vtx.Begin(1).SetPos(hg::Vec3(float(res_x), 0.f, 0.f)).SetTexCoord0(hg::Vec2(u, v_top)).End();
+		quad_vtx.Begin(2).SetPos(hg::Vec3(float(res_x), float(res_y), 0.f)).SetTexCoord0(hg::Vec2(u, v_bottom)).End();
+		quad_vtx.Begin(3).SetPos(hg::Vec3(0.f, float(res_y), 0.f)).SetTexCoord0(hg::Vec2(0.f, v_bottom)).End();
+
+		hg::SetView2D(view_id, 0, 0, res_x, res_y, -1, 1, BGFX_CLEAR_COLOR | BGFX_CLEAR_DEPTH, hg::Color::Black, 1, 0);
+		hg::DrawTriangles(view_id, quad_idx, quad_vtx, quad_prg, quad_values, quad_textures, quad_render_state);
+
+		// telemetry
+		hg::ImGuiBeginFrame(res_x, res_y, dt, hg::ReadMouse(), keyboard.GetState());
+
+		if (ImGui::Begin("Dynamic Resolution")) {
+			ImGui::Checkbox("Enabled", &dynamic_resolution);
+			ImGui::SliderFloat("Target (ms)", &controller.target_ms, 4.f, 33.f);
+			ImGui::SliderFloat("Min scale", &controller.min_scale, 0.25f, 1.f);
+			ImGui::Text("Scale %.2f (%dx%d), frame %.2f ms", scale, rect_x, rect_y, frame_ms);
+			ImGui::PlotLines("Frame (ms)", telemetry.frame_ms, DynamicResolutionTelemetry::history_size, telemetry.head, nullptr, 0.f, 33.f, 0.f, 60.f);
+			ImGui::PlotLines("Scale", telemetry.scale, DynamicResolutionTelemetry::history_size, telemetry.head, nullptr, 0.f, 1.f, 0.f, 60.f);
+		}
+		ImGui::End();
+
+		hg::ImGuiEndFrame(view_id);
+
+		frame = bgfx::frame();
+		hg::UpdateWindow(win);
+	}
+
+	hg::RenderShutdown();
+	hg::DestroyWindow(win);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,510 @@
+// HARFANG(R) Copyright (C) 2022 NWNC HARFANG. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+// Assign hundreds of point and spot lights to a 3D grid of view space clusters (froxels) on the CPU, then give each
+// object only the lights overlapping its clusters. The stock forward shaders light every draw with the same lights, so
+// the clustered objects are drawn after the pipeline with a shader taking the light set of each draw as uniforms.
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define USE_SSE 1
+#endif
+
+#include <foundation/clock.h>
+#include <foundation/format.h>
+#include <foundation/log.h>
+#include <foundation/math.h>
+#include <foundation/projection.h>
+#include <foundation/rand.h>
+
+#include <platform/input_system.h>
+#include <platform/window_system.h>
+
+#include <engine/assets.h>
+#include <engine/create_geometry.h>
+#include <engine/font.h>
+#include <engine/forward_pipeline.h>
+#include <engine/render_pipeline.h>
+#include <engine/scene.h>
+#include <engine/scene_forward_pipeline.h>
+
+// Number of point/spot lights bound to a single draw, must match MAX_LIGHTS in shaders/clustered_fs.sc.
+static const size_t max_draw_lights = 8;
+
+struct ClusterLight {
+	hg::Vec3 view_pos; // view space bounding sphere
+	float radius;
+};
+
+class ClusterGrid {
+public:
+	static const int size_x = 16, size_y = 9, size_z = 24;
+	static const int count = size_x * size_y * size_z;
+
+	// Compute the view space bounds of each cluster, depth slices are distributed exponentially between znear and zfar.
+	void Setup(float tan_half_fov_x, float aspect_y_over_x, float znear, float zfar) {
+		tan_x = tan_half_fov_x, tan_y = tan_half_fov_x * aspect_y_over_x, zn = znear, zf = zfar;
+		log_ratio = logf(zf / zn);
+
+		for (int k = 0; k < size_z; ++k) {
+			const float z0 = SliceDepth(k), z1 = SliceDepth(k + 1);
+
+			for (int j = 0; j < size_y; ++j) {
+				const float y0 = (2.f * j / size_y - 1.f) * tan_y, y1 = (2.f * (j + 1) / size_y - 1.f) * tan_y;
+
+				for (int i = 0; i < size_x; ++i) {
+					const float x0 = (2.f * i / size_x - 1.f) * tan_x, x1 = (2.f * (i + 1) / size_x - 1.f) * tan_x;
+					const int c = Index(i, j, k);
+
+					mn_x[c] = std::min(x0 * z0, x0 * z1), mx_x[c] = std::max(x1 * z0, x1 * z1);
+					mn_y[c] = std::min(y0 * z0, y0 * z1), mx_y[c] = std::max(y1 * z0, y1 * z1);
+					mn_z[c] = z0, mx_z[c] = z1;
+				}
+			}
+		}
+	}
+
+	// Build the per-cluster light lists, stored as offset/count pairs into a single index array.
+	void Build(const std::vector<ClusterLight> &lights) {
+		pairs.clear();
+
+		for (uint32_t l = 0; l < lights.size(); ++l) {
+			int i0, i1, j0, j1, k0, k1;
+			if (!ComputeRange(lights[l].view_pos, lights[l].radius, i0, i1, j0, j1, k0, k1))
+				continue;
+
+			for (int k = k0; k <= k1; ++k)
+				for (int j = j0; j <= j1; ++j)
+					TestSphereRow(lights[l].view_pos, lights[l].radius, Index(i0, j, k), i1 - i0 + 1, l);
+		}
+
+		// counting sort of the (cluster, light) pairs
+		std::fill(cluster_count, cluster_count + count, 0);
+		for (const auto &p : pairs)
+			++cluster_count[p.cluster];
+
+		cluster_offset[0] = 0;
+		for (int c = 1; c < count; ++c)
+			cluster_offset[c] = cluster_offset[c - 1] + cluster_count[c - 1];
+
+		light_indices.resize(pairs.size());
+		std::copy(cluster_offset, cluster_offset + count, cluster_fill);
+		for (const auto &p : pairs)
+			light_indices[cluster_fill[p.cluster]++] = p.light;
+	}
+
+	// Call 'fn' for each light index of each cluster overlapped by a view space sphere.
+	template <typename Fn> void ForEachLight(const hg::Vec3 &view_pos, float radius, Fn fn) const {
+		int i0, i1, j0, j1, k0, k1;
+		if (!ComputeRange(view_pos, radius, i0, i1, j0, j1, k0, k1))
+			return;
+
+		for (int k = k0; k <= k1; ++k)
+			for (int j = j0; j <= j1; ++j)
+				for (int i = i0; i <= i1; ++i) {
+					const int c = Index(i, j, k);
+					for (uint32_t n = 0; n < cluster_count[c]; ++n)
+						fn(light_indices[cluster_offset[c] + n]);
+				}
+	}
+
+	size_t GetLightIndexCount() const { return light_indices.size(); }
+
+private:
+	static int Index(int i, int j, int k) { return (k * size_y + j) * size_x + i; }
+
+	float SliceDepth(int k) const { return zn * expf(log_ratio * float(k) / float(size_z)); }
+	int DepthToSlice(float z) const { return int(floorf(logf(std::max(z, zn) / zn) / log_ratio * size_z)); }
+
+	// Conservative cluster range covered by a view space sphere.
+	bool ComputeRange(const hg::Vec3 &p, float r, int &i0, int &i1, int &j0, int &j1, int &k0, int &k1) const {
+		const float z_lo = std::max(p.z - r, zn), z_hi = std::min(p.z + r, zf);
+		if (z_lo > z_hi)
+			return false;
+
+		const float tx0 = std::min((p.x - r) / z_lo, (p.x - r) / z_hi), tx1 = std::max((p.x + r) / z_lo, (p.x + r) / z_hi);
+		const float ty0 = std::min((p.y - r) / z_lo, (p.y - r) / z_hi), ty1 = std::max((p.y + r) / z_lo, (p.y + r) / z_hi);
+
+		if (tx1 < -tan_x || tx0 > tan_x || ty1 < -tan_y || ty0 > tan_y)
+			return false;
+
+		i0 = std::max(int((tx0 / tan_x + 1.f) * 0.5f * size_x), 0), i1 = std::min(int((tx1 / tan_x + 1.f) * 0.5f * size_x), size_x - 1);
+		j0 = std::max(int((ty0 / tan_y + 1.f) * 0.5f * size_y), 0), j1 = std::min(int((ty1 / tan_y + 1.f) * 0.5f * size_y), size_y - 1);
+		k0 = std::max(DepthToSlice(z_lo), 0), k1 = std::min(DepthToSlice(z_hi), size_z - 1);
+		return true;
+	}
+
+	// Sphere against a row of consecutive cluster bounds, 4 clusters at a time when SSE is available.
+	void TestSphereRow(const hg::Vec3 &p, float r, int first, int n, uint32_t light) {
+		int i = 0;
+#if USE_SSE
+		const __m128 px = _mm_set1_ps(p.x), py = _mm_set1_ps(p.y), pz = _mm_set1_ps(p.z), r2 = _mm_set1_ps(r * r);
+
+		for (; i + 4 <= n; i += 4) {
+			const int c = first + i;
+			const __m128 dx = _mm_sub_ps(px, _mm_min_ps(_mm_max_ps(px, _mm_loadu_ps(mn_x + c)), _mm_loadu_ps(mx_x + c)));
+			const __m128 dy = _mm_sub_ps(py, _mm_min_ps(_mm_max_ps(py, _mm_loadu_ps(mn_y + c)), _mm_loadu_ps(mx_y + c)));
+			const __m128 dz = _mm_sub_ps(pz, _mm_min_ps(_mm_max_ps(pz, _mm_loadu_ps(mn_z + c)), _mm_loadu_ps(mx_z + c)));
+			const __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+			const int mask = _mm_movemask_ps(_mm_cmple_ps(d2, r2));
+			for (int b = 0; b < 4; ++b)
+				if (mask & (1 << b))
+					pairs.push_back({uint32_t(c + b), light});
+		}
+#endif
+		for (; i < n; ++i) {
+			const int c = first + i;
+			const float dx = p.x - std::min(std::max(p.x, mn_x[c]), mx_x[c]);
+			const float dy = p.y - std::min(std::max(p.y, mn_y[c]), mx_y[c]);
+			const float dz = p.z - std::min(std::max(p.z, mn_z[c]), mx_z[c]);
+			if (dx * dx + dy * dy + dz * dz <= r * r)
+				pairs.push_back({uint32_t(c), light});
+		}
+	}
+
+	float tan_x{1.f}, tan_y{1.f}, zn{0.1f}, zf{100.f}, log_ratio{1.f};
+
+	float mn_x[count], mn_y[count], mn_z[count], mx_x[count], mx_y[count], mx_z[count];
+	uint32_t cluster_offset[count], cluster_count[count], cluster_fill[count];
+
+	struct Pair {
+		uint32_t cluster, light;
+	};
+
+	std::vector<Pair> pairs; // capacity is kept from one build to the next
+	std::vector<uint32_t> light_indices;
+};
+
+// Measure the grid build time for an increasing number of lights spread in the view frustum.
+static void BenchmarkClusterGrid(ClusterGrid &grid, float zfar) {
+	std::vector<ClusterLight> lights;
+
+	for (size_t light_count = 8; light_count <= 1024; light_count *= 2) {
+		lights.resize(light_count);
+		for (auto &l : lights) {
+			const float z = hg::FRRand(1.f, zfar);
+			l = {hg::Vec3(hg::FRRand(-z, z) * 0.6f, hg::FRRand(-z, z) * 0.4f, z), hg::FRRand(1.f, 4.f)};
+		}
+
+		const int iteration_count = 100;
+		const hg::time_ns t_start = hg::time_now();
+		for (int i = 0; i < iteration_count; ++i)
+			grid.Build(lights);
+		const hg::time_ns t_build = (hg::time_now() - t_start) / iteration_count;
+
+		hg::log(hg::format("%1 lights: %2 us per build, %3 light references").arg(light_count).arg(int(hg::time_to_us(t_build))).arg(grid.GetLightIndexCount()));
+	}
+}
+
+int main() {
+	// create window.
+	hg::InputInit();
+	hg::WindowSystemInit();
+
+	int res_x = 1280, res_y = 720;
+
+	hg::Window *win = hg::RenderInit("Harfang - Clustered Lights", res_x, res_y, BGFX_RESET_VSYNC | BGFX_RESET_MSAA_X4);
+	if (!win) {
+		hg::error("failed to create window.");
+		return EXIT_FAILURE;
+	}
+
+	// access compiled resources
+	hg::AddAssetsFolder("resources_compiled");
+
+	// create both forward pipelines, the light assignment does not depend on the pipeline
+	hg::ForwardPipeline pipeline = hg::CreateForwardPipeline();
+	hg::PipelineResources res = hg::PipelineResources();
+
+	hg::ForwardPipelineAAAConfig pipeline_aaa_config;
+	hg::ForwardPipelineAAA pipeline_aaa = hg::CreateForwardPipelineAAAFromAssets("core", pipeline_aaa_config, bgfx::BackbufferRatio::Equal, bgfx::BackbufferRatio::Equal);
+	pipeline_aaa_config.sample_count = 1;
+
+	// create models and materials, the ground is split in tiles so that each tile only receives the lights around it
+	bgfx::VertexLayout vtx_layout = hg::VertexLayoutPosFloatNormUInt8();
+
+	hg::ModelRef cube_ref = res.models.Add("cube", hg::CreateCubeModel(vtx_layout, 0.8f, 0.8f, 0.8f));
+	hg::ModelRef tile_ref = res.models.Add("ground_tile", hg::CreateCubeModel(vtx_layout, 4.f, 0.01f, 4.f));
+
+	hg::PipelineProgramRef prg = hg::LoadPipelineProgramRefFromAssets("core/shader/default.hps", res, hg::GetForwardPipelineInfo());
+
+	const hg::Vec4 cube_color(0.8f, 0.8f, 0.8f), ground_color(0.5f, 0.5f, 0.5f);
+
+	hg::Material cube_mat = hg::CreateMaterial(prg, "uDiffuseColor", cube_color, "uSpecularColor", hg::Vec4(0.5f, 0.5f, 0.5f));
+	hg::Material ground_mat = hg::CreateMaterial(prg, "uDiffuseColor", ground_color, "uSpecularColor", hg::Vec4(0.1f, 0.1f, 0.1f));
+
+	// program drawing an object with its own light set
+	bgfx::ProgramHandle clustered_program = hg::LoadProgramFromAssets("shaders/clustered");
+
+	bgfx::UniformHandle u_color = bgfx::createUniform("u_color", bgfx::UniformType::Vec4);
+	bgfx::UniformHandle u_ambient = bgfx::createUniform("u_ambient", bgfx::UniformType::Vec4);
+	bgfx::UniformHandle u_light_pos = bgfx::createUniform("u_light_pos", bgfx::UniformType::Vec4, uint16_t(max_draw_lights));
+	bgfx::UniformHandle u_light_dir = bgfx::createUniform("u_light_dir", bgfx::UniformType::Vec4, uint16_t(max_draw_lights));
+	bgfx::UniformHandle u_light_color = bgfx::createUniform("u_light_color", bgfx::UniformType::Vec4, uint16_t(max_draw_lights));
+
+	// setup scene
+	hg::Scene scene;
+	scene.canvas.color = hg::Color(0.02f, 0.02f, 0.03f);
+	scene.environment.ambient = hg::Color(0.02f, 0.02f, 0.02f);
+
+	const float znear = 0.1f, zfar = 200.f;
+	hg::Node camera = hg::CreateCamera(scene, hg::Mat4LookAt(hg::Vec3(0.f, 12.f, -40.f), hg::Vec3(0.f, 0.f, 0.f)), znear, zfar);
+	scene.SetCurrentCamera(camera);
+
+	// static objects, their world bounding sphere is computed once
+	struct ClusteredObject {
+		hg::Node node;
+		hg::ModelRef model;
+		hg::Vec4 color;
+		hg::Mat4 world;
+		hg::Vec3 center;
+		float radius;
+	};
+
+	std::vector<ClusteredObject> objects;
+
+	auto add_object = [&](const hg::Mat4 &world, hg::ModelRef model, const hg::Material &mat, const hg::Vec4 &color) {
+		hg::Node node = hg::CreateObject(scene, world, model, {mat});
+
+		hg::MinMax minmax;
+		node.GetObject().GetMinMax(res, minmax);
+		const hg::MinMax world_minmax = world * minmax;
+
+		objects.push_back({node, model, color, world, hg::GetCenter(world_minmax), hg::Len(world_minmax.mx - world_minmax.mn) * 0.5f});
+	};
+
+	for (int j = 0; j < 25; ++j)
+		for (int i = 0; i < 25; ++i)
+			add_object(hg::TranslationMat4(hg::Vec3(-48.f + i * 4.f, 0.f, -48.f + j * 4.f)), tile_ref, ground_mat, ground_color);
+
+	for (int j = 0; j < 30; ++j)
+		for (int i = 0; i < 30; ++i)
+			add_object(hg::TranslationMat4(hg::Vec3(-29.f + i * 2.f, 0.4f, -29.f + j * 2.f)), cube_ref, cube_mat, cube_color);
+
+	// hundreds of small colored lights moving over the ground
+	struct MovingLight {
+		hg::Node node;
+		hg::Vec3 center, pos;
+		float phase, speed;
+	};
+
+	std::vector<MovingLight> lights;
+
+	auto spawn_lights = [&](size_t light_count) {
+		while (lights.size() > light_count) {
+			scene.DestroyNode(lights.back().node);
+			lights.pop_back();
+		}
+
+		while (lights.size() < light_count) {
+			const hg::Color color(hg::FRand(), hg::FRand(), hg::FRand());
+			const hg::Vec3 center = hg::RandomVec3(hg::Vec3(-30.f, 0.5f, -30.f), hg::Vec3(30.f, 2.f, 30.f));
+			const hg::Mat4 mtx = hg::TranslationMat4(center);
+
+			hg::Node node = hg::Rand(4) ? hg::CreatePointLight(scene, mtx, 4.f, color, color) : hg::CreateSpotLight(scene, hg::TransformationMat4(center + hg::Vec3(0.f, 3.f, 0.f), hg::Deg3(90.f, 0.f, 0.f)), 6.f, hg::Deg(15.f), hg::Deg(30.f), color, color);
+			lights.push_back({node, center, center, hg::FRand(hg::TwoPi), hg::FRRand(0.5f, 2.f)});
+		}
+
+		scene.GarbageCollect();
+	};
+
+	spawn_lights(256);
+
+	// cluster grid covering the camera frustum, the camera fov is horizontal
+	auto grid = std::make_unique<ClusterGrid>(); // too large for the stack
+	grid->Setup(tanf(camera.GetCamera().GetFov() * 0.5f), float(res_y) / float(res_x), znear, zfar);
+
+	BenchmarkClusterGrid(*grid, zfar);
+
+	// shader parameters of a light, unused slots of a light set are black point lights
+	struct DrawLight {
+		hg::Vec4 pos, dir, color;
+	};
+
+	const DrawLight unused_light = {hg::Vec4(0.f, 0.f, 0.f, 0.f), hg::Vec4(0.f, 0.f, 0.f, -2.f), hg::Vec4(0.f, 0.f, 0.f, -1.f)};
+
+	std::vector<ClusterLight> cluster_lights;
+	std::vector<DrawLight> draw_lights;
+	std::vector<uint32_t> light_stamps, candidates;
+	std::vector<uint32_t> object_lights(objects.size() * max_draw_lights); // light set of each object
+	std::vector<uint8_t> object_light_counts(objects.size());
+
+	hg::Vec4 set_pos[max_draw_lights], set_dir[max_draw_lights], set_color[max_draw_lights];
+
+	// text overlay
+	hg::Font font = hg::LoadFontFromAssets("font/default.ttf", 16);
+	bgfx::ProgramHandle font_program = hg::LoadProgramFromAssets("core/shader/font");
+
+	hg::RenderState text_render_state = hg::ComputeRenderState(hg::BM_Alpha, hg::DT_Always, hg::FC_Disabled);
+	std::vector<hg::UniformSetValue> text_uniform_values = {hg::MakeUniformSetValue("u_color", hg::Vec4(1.f, 1.f, .5f, 1.f))};
+
+	// main loop
+	bool use_aaa = false, use_clusters = true;
+	float t = 0.f;
+	int frame = 0;
+
+	// clustered objects are drawn by the sample, otherwise the pipeline draws them with its own light selection
+	auto set_use_clusters = [&](bool enable) {
+		use_clusters = enable;
+		for (auto &o : objects)
+			if (use_clusters)
+				o.node.Disable();
+			else
+				o.node.Enable();
+	};
+
+	set_use_clusters(true);
+
+	hg::Keyboard keyboard;
+	while (!keyboard.Pressed(hg::K_Escape) && hg::IsWindowOpen(win)) {
+		hg::time_ns dt = hg::tick_clock();  // tick clock, retrieve elapsed clock since last call
+
+		keyboard.Update();
+
+		if (keyboard.Pressed(hg::K_P))
+			use_aaa = !use_aaa;
+		if (keyboard.Pressed(hg::K_Space))
+			set_use_clusters(!use_clusters);
+		if (keyboard.Pressed(hg::K_Add))
+			spawn_lights(std::min<size_t>(lights.size() * 2, 1024));
+		if (keyboard.Pressed(hg::K_Sub))
+			spawn_lights(std::max<size_t>(lights.size() / 2, 8));
+
+		// move lights in circles
+		t += hg::time_to_sec_f(dt);
+		for (auto &l : lights) {
+			const float a = l.phase + t * l.speed;
+			l.pos = l.center + hg::Vec3(cosf(a) * 2.f, l.node.GetLight().GetType() == hg::LT_Spot ? 3.f : 0.f, sinf(a) * 2.f);
+			l.node.GetTransform().SetPos(l.pos);
+		}
+
+		scene.Update(dt);
+
+		const hg::time_ns t_cluster = hg::time_now();
+		size_t object_light_count = 0, overflow_count = 0;
+
+		if (use_clusters) {
+			// assign lights to clusters and prepare their shader parameters
+			const hg::Mat4 view = hg::InverseFast(camera.GetTransform().GetWorld());
+
+			cluster_lights.resize(lights.size());
+			draw_lights.resize(lights.size());
+
+			for (size_t i = 0; i < lights.size(); ++i) {
+				const hg::Light light = lights[i].node.GetLight();
+				const hg::Color diffuse = light.GetDiffuseColor();
+				const float radius = light.GetRadius();
+
+				cluster_lights[i] = {view * lights[i].pos, radius};
+
+				if (light.GetType() == hg::LT_Spot)
+					draw_lights[i] = {hg::Vec4(lights[i].pos.x, lights[i].pos.y, lights[i].pos.z, 1.f / radius),
+						hg::Vec4(hg::Normalize(hg::GetZ(lights[i].node.GetTransform().GetWorld())), cosf(light.GetOuterAngle())),
+						hg::Vec4(diffuse.r, diffuse.g, diffuse.b, cosf(light.GetInnerAngle()))};
+				else
+					draw_lights[i] = {hg::Vec4(lights[i].pos.x, lights[i].pos.y, lights[i].pos.z, 1.f / radius), unused_light.dir, hg::Vec4(diffuse.r, diffuse.g, diffuse.b, -1.f)};
+			}
+
+			grid->Build(cluster_lights);
+
+			// gather the light set of each object from the clusters it overlaps
+			light_stamps.assign(lights.size(), ~0u);
+
+			for (uint32_t o = 0; o < objects.size(); ++o) {
+				const hg::Vec3 center = view * objects[o].center;
+
+				candidates.clear();
+				grid->ForEachLight(center, objects[o].radius, [&](uint32_t l) {
+					if (light_stamps[l] != o) { // a light may be found in several clusters of the same object
+						light_stamps[l] = o;
+						candidates.push_back(l);
+					}
+				});
+
+				object_light_count += candidates.size();
+
+				// too many lights for a single draw, keep the closest ones relative to their range
+				if (candidates.size() > max_draw_lights) {
+					std::partial_sort(candidates.begin(), candidates.begin() + max_draw_lights, candidates.end(), [&](uint32_t a, uint32_t b) {
+						return hg::Len(cluster_lights[a].view_pos - center) / cluster_lights[a].radius < hg::Len(cluster_lights[b].view_pos - center) / cluster_lights[b].radius;
+					});
+					candidates.resize(max_draw_lights);
+					++overflow_count;
+				}
+
+				std::copy(candidates.begin(), candidates.end(), object_lights.begin() + o * max_draw_lights);
+				object_light_counts[o] = uint8_t(candidates.size());
+			}
+		}
+
+		const hg::time_ns t_cluster_elapsed = hg::time_now() - t_cluster;
+
+		bgfx::ViewId view_id = 0;
+		hg::SceneForwardPipelinePassViewId views;
+
+		if (use_aaa)
+			hg::SubmitSceneToPipeline(view_id, scene, hg::iRect(0, 0, res_x, res_y), true, pipeline, res, views, pipeline_aaa, pipeline_aaa_config, frame);
+		else
+			hg::SubmitSceneToPipeline(view_id, scene, hg::iRect(0, 0, res_x, res_y), true, pipeline, res, views);
+
+		if (use_clusters) {
+			// draw each object with its own light set
+			hg::SetViewPerspective(view_id, 0, 0, res_x, res_y, camera.GetTransform().GetWorld(), znear, zfar, hg::FovToZoomFactor(camera.GetCamera().GetFov()), 0);
+
+			const hg::Vec4 ambient(scene.environment.ambient.r, scene.environment.ambient.g, scene.environment.ambient.b, 1.f);
+
+			for (size_t o = 0; o < objects.size(); ++o) {
+				for (size_t i = 0; i < max_draw_lights; ++i) {
+					const DrawLight &l = i < object_light_counts[o] ? draw_lights[object_lights[o * max_draw_lights + i]] : unused_light;
+					set_pos[i] = l.pos, set_dir[i] = l.dir, set_color[i] = l.color;
+				}
+
+				bgfx::setUniform(u_color, &objects[o].color.x);
+				bgfx::setUniform(u_ambient, &ambient.x);
+				bgfx::setUniform(u_light_pos, &set_pos[0].x, uint16_t(max_draw_lights));
+				bgfx::setUniform(u_light_dir, &set_dir[0].x, uint16_t(max_draw_lights));
+				bgfx::setUniform(u_light_color, &set_color[0].x, uint16_t(max_draw_lights));
+
+				hg::DrawModel(view_id, res.models.Get(objects[o].model), clustered_program, {}, {}, &objects[o].world, 1);
+			}
+
+			++view_id;
+		}
+
+		hg::SetView2D(view_id, 0, 0, res_x, res_y, -1, 1, BGFX_CLEAR_DEPTH, hg::Color::Black, 1, 0);
+		if (use_clusters)
+			hg::DrawText(view_id, font,
+				hg::format("%1 lights, %2 object/light pairs, %3 objects over %4 lights, clustering %5 us")
+					.arg(lights.size())
+					.arg(object_light_count)
+					.arg(overflow_count)
+					.arg(max_draw_lights)
+					.arg(int(hg::time_to_us(t_cluster_elapsed))),
+				font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20, res_y - 40, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+		else
+			hg::DrawText(view_id, font, hg::format("%1 lights, light selection by the pipeline").arg(lights.size()), font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20, res_y - 40, 0),
+				hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+		hg::DrawText(view_id, font, hg::format("Space: clustering %1 - P: %2 pipeline - +/-: light count").arg(use_clusters ? "on" : "off").arg(use_aaa ? "AAA" : "forward"), font_program, "u_tex", 0,
+			hg::Mat4::Identity, hg::Vec3(20, res_y - 64, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+
+		frame = bgfx::frame();
+		hg::UpdateWindow(win);
+	}
+
+	bgfx::destroy(u_light_color);
+	bgfx::destroy(u_light_dir);
+	bgfx::destroy(u_light_pos);
+	bgfx::destroy(u_ambient);
+	bgfx::destroy(u_color);
+	bgfx::destroy(clustered_program);
+
+	hg::RenderShutdown();
+	hg::DestroyWindow(win);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,292 @@
+// HARFANG(R) Copyright (C) 2022 NWNC HARFANG. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+// Component views: the nodes matching a component mask (eg. Transform+Object) are queried once into a dense view whose
+// transform state is stored in contiguous arrays split in fixed size chunks. Systems iterate the chunks, optionally on
+// worker threads, and the result is written back to the scene in a single pass.
+// M cycles between per node handle updates (as in scene_many_nodes), a single threaded view and a multithreaded view.
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <foundation/clock.h>
+#include <foundation/format.h>
+#include <foundation/log.h>
+
+#include <platform/input_system.h>
+#include <platform/window_system.h>
+
+#include <engine/assets.h>
+#include <engine/create_geometry.h>
+#include <engine/font.h>
+#include <engine/forward_pipeline.h>
+#include <engine/render_pipeline.h>
+#include <engine/scene.h>
+#include <engine/scene_forward_pipeline.h>
+
+#include "worker_pool.h"
+
+// Components a query can filter on.
+enum ComponentMask : uint32_t { CM_Transform = 1, CM_Object = 2, CM_Light = 4, CM_Camera = 8, CM_RigidBody = 16 };
+
+static uint32_t GetComponentMask(const hg::Node &node) {
+	return (node.HasTransform() ? CM_Transform : 0) | (node.HasObject() ? CM_Object : 0) | (node.HasLight() ? CM_Light : 0) | (node.HasCamera() ? CM_Camera : 0) |
+		   (node.HasRigidBody() ? CM_RigidBody : 0);
+}
+
+// Dense view over the nodes matching a component mask. Transform state is stored structure of arrays and split in
+// fixed size chunks, chunks do not share any data and can be processed concurrently.
+struct ComponentView {
+	uint32_t mask = 0;
+	size_t chunk_size = 1024;
+	size_t scene_node_count = 0; // node count when queried, used to detect nodes added to the scene
+
+	std::vector<hg::NodeRef> refs;
+	std::vector<hg::Transform> transforms;
+	std::vector<hg::Vec3> pos, rot, scale;
+};
+
+// Contiguous range of a view.
+struct ComponentViewChunk {
+	size_t begin, end;
+
+	const hg::NodeRef *refs;
+	hg::Vec3 *pos, *rot, *scale; // null when the view mask does not include CM_Transform
+
+	size_t size() const { return end - begin; }
+};
+
+static size_t GetChunkCount(const ComponentView &view) { return (view.refs.size() + view.chunk_size - 1) / view.chunk_size; }
+
+static ComponentViewChunk GetChunk(ComponentView &view, size_t chunk) {
+	const size_t begin = chunk * view.chunk_size, end = std::min(begin + view.chunk_size, view.refs.size());
+
+	if (!(view.mask & CM_Transform))
+		return {begin, end, view.refs.data() + begin, nullptr, nullptr, nullptr};
+	return {begin, end, view.refs.data() + begin, view.pos.data() + begin, view.rot.data() + begin, view.scale.data() + begin};
+}
+
+// A view is stale when nodes were added to the scene or when one of its nodes was destroyed, a node destroyed then
+// another created leaves the count unchanged but invalidates the generation of the destroyed node reference.
+static bool IsComponentViewStale(const ComponentView &view, const hg::Scene &scene) {
+	if (view.scene_node_count != scene.GetAllNodeCount())
+		return true;
+
+	for (const auto &ref : view.refs)
+		if (!scene.IsValidNodeRef(ref))
+			return true;
+
+	return false;
+}
+
+// Query the scene once and pull the current transform state of every matching node. The view keeps its capacity
+// across queries.
+static void QueryComponentView(const hg::Scene &scene, uint32_t mask, ComponentView &view) {
+	view.mask = mask;
+	view.refs.clear();
+	view.transforms.clear();
+
+	for (auto &node : scene.GetAllNodes())
+		if ((GetComponentMask(node) & mask) == mask) {
+			view.refs.push_back(node.ref);
+			if (mask & CM_Transform)
+				view.transforms.push_back(node.GetTransform());
+		}
+
+	view.pos.resize(view.transforms.size());
+	view.rot.resize(view.transforms.size());
+	view.scale.resize(view.transforms.size());
+
+	for (size_t i = 0; i < view.transforms.size(); ++i)
+		view.transforms[i].GetTRS(view.pos[i], view.rot[i], view.scale[i]);
+
+	view.scene_node_count = scene.GetAllNodeCount();
+}
+
+// Run a system over every chunk of a view, on the pool worker threads if a pool is given.
+template <typename System> static void ForEachChunk(ComponentView &view, WorkerPool *pool, System system) {
+	const size_t chunk_count = GetChunkCount(view);
+
+	if (pool)
+		pool->Run(chunk_count, 1, [&](size_t begin, size_t end) {
+			for (size_t c = begin; c < end; ++c)
+				system(GetChunk(view, c));
+		});
+	else
+		for (size_t c = 0; c < chunk_count; ++c)
+			system(GetChunk(view, c));
+}
+
+// Write the view position back to the scene. This is the only step going through the node handles and it runs on the
+// calling thread since the scene storage is not safe to modify concurrently.
+static void PushPositions(ComponentView &view) {
+	for (size_t i = 0; i < view.transforms.size(); ++i)
+		view.transforms[i].SetPos(view.pos[i]);
+}
+
+enum UpdateMode { UM_Handles, UM_View, UM_ViewThreaded, UM_Count };
+
+static const char *update_mode_names[UM_Count] = {"per node handles", "component view", "component view, threaded"};
+
+int main(int narg, const char **args) {
+	// create window.
+	hg::InputInit();
+	hg::WindowSystemInit();
+
+	int res_x = 1280, res_y = 720;
+
+	hg::Window *window = hg::RenderInit("Harfang - Component Views", res_x, res_y, BGFX_RESET_VSYNC | BGFX_RESET_MSAA_X4);
+	if (!window) {
+		hg::error("failed to create window.");
+		return EXIT_FAILURE;
+	}
+
+	hg::AddAssetsFolder("resources_compiled");
+
+	// create forward pipeline and resources.
+	hg::ForwardPipeline pipeline = hg::CreateForwardPipeline(4096);
+	hg::PipelineResources resources = hg::PipelineResources();
+
+	bgfx::VertexLayout vtx_layout = hg::VertexLayoutPosFloatNormUInt8();
+
+	hg::ModelRef sphere_ref = resources.models.Add("sphere", hg::CreateSphereModel(vtx_layout, 0.05f, 6, 12));
+	hg::ModelRef ground_ref = resources.models.Add("ground", hg::CreateCubeModel(vtx_layout, 60.f, 0.001f, 60.f));
+
+	hg::PipelineProgramRef prg = hg::LoadPipelineProgramRefFromAssets("core/shader/default.hps", resources, hg::GetForwardPipelineInfo());
+
+	hg::Material sphere_mat = hg::CreateMaterial(prg, "uDiffuseColor", hg::Vec4(1, 0, 0), "uSpecularColor", hg::Vec4(1, 0.8f, 0));
+	hg::Material ground_mat = hg::CreateMaterial(prg, "uDiffuseColor", hg::Vec4(1, 1, 1), "uSpecularColor", hg::Vec4(1, 1, 1));
+
+	// setup scene, camera and light.
+	hg::Scene scene;
+	scene.canvas.color = hg::Color(0.1f, 0.1f, 0.1f);
+	scene.environment.ambient = hg::Color(0.1f, 0.1f, 0.1f);
+
+	hg::Node camera = hg::CreateCamera(scene, hg::TransformationMat4(hg::Vec3(15.5f, 5, -6), hg::Vec3(0.4f, -1.2f, 0)), 0.01f, 100);
+	scene.SetCurrentCamera(camera);
+
+	hg::CreateSpotLight(scene, hg::TransformationMat4(hg::Vec3(-8.8f, 21.7f, -8.8f), hg::Deg3(60, 45, 0)), 0, hg::Deg(5.f), hg::Deg(30.f), hg::Color::White, hg::Color::White, 0, hg::LST_Map, 0.000005f);
+	hg::Node ground = hg::CreateObject(scene, hg::TranslationMat4(hg::Vec3(0, 0, 0)), ground_ref, {ground_mat});
+
+	// create 200 by 200 spheres.
+	const int count = 200;
+
+	std::vector<hg::Transform> rows;
+	rows.reserve(count * count);
+	for (int j = 0; j < count; j++)
+		for (int i = 0; i < count; i++) {
+			const hg::Vec3 position = hg::Vec3(((2.f * i) / count - 1.f) * 10.f, 0.1f, ((2.f * j) / count - 1.f) * 10.f);
+			rows.push_back(hg::CreateObject(scene, hg::TranslationMat4(position), sphere_ref, {sphere_mat}).GetTransform());
+		}
+
+	// query every node with a transform and an object, the ground is part of the view and is skipped by the system
+	ComponentView view;
+
+	hg::time_ns t = hg::time_now();
+	QueryComponentView(scene, CM_Transform | CM_Object, view);
+	float query_ms = hg::time_to_ms_f(hg::time_now() - t);
+
+	WorkerPool pool(std::max(int(std::thread::hardware_concurrency()), 1));
+
+	// text rendering
+	hg::Font font = hg::LoadFontFromAssets("font/default.ttf", 16);
+	bgfx::ProgramHandle font_program = hg::LoadProgramFromAssets("core/shader/font");
+
+	std::vector<hg::UniformSetValue> text_uniform_values = {hg::MakeUniformSetValue("u_color", hg::Vec4(1.f, 1.f, 0.5f))};
+	hg::RenderState text_render_state = hg::ComputeRenderState(hg::BM_Alpha, hg::DT_Always, hg::FC_Disabled);
+
+	// main loop.
+	int mode = UM_ViewThreaded;
+	float angle = 0.f, update_ms = 0.f, push_ms = 0.f;
+
+	hg::iRect viewport = hg::MakeRectFromWidthHeight(0, 0, res_x, res_y);
+	hg::SceneForwardPipelinePassViewId views;
+
+	hg::Keyboard keyboard;
+	while (!keyboard.Pressed(hg::K_Escape) && hg::IsWindowOpen(window)) {
+		keyboard.Update();
+
+		if (keyboard.Pressed(hg::K_M))
+			mode = (mode + 1) % UM_Count;
+
+		if (keyboard.Pressed(hg::K_Q) || IsComponentViewStale(view, scene)) {
+			t = hg::time_now();
+			QueryComponentView(scene, CM_Transform | CM_Object, view);
+			query_ms = hg::time_to_ms_f(hg::time_now() - t);
+		}
+
+		hg::time_ns dt = hg::tick_clock();
+		angle += hg::time_to_sec_f(dt);
+
+		// move the spheres vertically in a wave pattern.
+		t = hg::time_now();
+
+		if (mode == UM_Handles) {
+			for (int j = 0; j < count; j++) {
+				const float row_y = cos(angle + j * 0.1f);
+				for (int i = 0; i < count; i++) {
+					hg::Transform &trs = rows[i + j * count];
+					hg::Vec3 pos = trs.GetPos();
+					pos.y = 0.1f * (row_y * sin(angle + i * 0.1f) * 6.f + 6.5f);
+					trs.SetPos(pos);
+				}
+			}
+
+			update_ms = hg::time_to_ms_f(hg::time_now() - t);
+			push_ms = 0.f;
+		} else {
+			const hg::NodeRef ground_node_ref = ground.ref;
+			const float grid_to_row = count / 20.f * 0.1f; // world position to the row/column phase used by the handle update
+
+			ForEachChunk(view, mode == UM_ViewThreaded ? &pool : nullptr, [&](const ComponentViewChunk &chunk) {
+				for (size_t i = 0; i < chunk.size(); ++i) {
+					if (chunk.refs[i] == ground_node_ref)
+						continue;
+					hg::Vec3 &pos = chunk.pos[i];
+					const float row_y = cos(angle + (pos.z + 10.f) * grid_to_row);
+					pos.y = 0.1f * (row_y * sin(angle + (pos.x + 10.f) * grid_to_row) * 6.f + 6.5f);
+				}
+			});
+
+			update_ms = hg::time_to_ms_f(hg::time_now() - t);
+
+			t = hg::time_now();
+			PushPositions(view);
+			push_ms = hg::time_to_ms_f(hg::time_now() - t);
+		}
+
+		// update scene and send it to the forward rendering pipeline.
+		scene.Update(dt);
+
+		bgfx::ViewId view_id = 0;
+		hg::SubmitSceneToPipeline(view_id, scene, viewport, 1.f, pipeline, resources, views);
+
+		// report
+		hg::SetView2D(view_id, 0, 0, res_x, res_y, -1, 1, BGFX_CLEAR_DEPTH, hg::Color::Black, 1, 0);
+
+		const std::string report = hg::format("%1 - %2 nodes in %3 chunks of %4 - update %5 ms, write back %6 ms, query %7 ms")
+									   .arg(update_mode_names[mode])
+									   .arg(int(view.refs.size()))
+									   .arg(int(GetChunkCount(view)))
+									   .arg(int(view.chunk_size))
+									   .arg(update_ms, 3)
+									   .arg(push_ms, 3)
+									   .arg(query_ms, 3);
+		hg::DrawText(view_id, font, report, font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20, res_y - 40, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+		hg::DrawText(view_id, font, hg::format("M: update mode, Q: query the view again (%1 threads)").arg(pool.GetThreadCount()), font_program, "u_tex", 0, hg::Mat4::Identity,
+			hg::Vec3(20, res_y - 64, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+
+		bgfx::frame();
+		hg::UpdateWindow(window);
+	}
+
+	hg::RenderShutdown();
+	hg::DestroyWindow(window);
+
+	hg::WindowSystemShutdown();
+	hg::InputShutdown();
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,644 @@
+// HARFANG(R) Copyright (C) 2022 NWNC HARFANG. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+// Cosmetic debris as a lightweight alternative to rigid bodies. The pieces are not scene nodes, their state is kept in
+// structure of arrays integrated 4 at a time with SSE2 or NEON, they collide against static boxes and planes and every
+// pool of debris is rendered as a single instanced draw. The same board can be filled with Bullet rigid bodies to
+// compare the per object cost of both approaches.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <string>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define DEBRIS_SSE2 1
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define DEBRIS_NEON 1
+#endif
+
+#include <foundation/clock.h>
+#include <foundation/format.h>
+#include <foundation/log.h>
+#include <foundation/math.h>
+#include <foundation/projection.h>
+#include <foundation/rand.h>
+
+#include <platform/input_system.h>
+#include <platform/window_system.h>
+
+#include <engine/assets.h>
+#include <engine/create_geometry.h>
+#include <engine/font.h>
+#include <engine/forward_pipeline.h>
+#include <engine/scene.h>
+#include <engine/scene_bullet3_physics.h>
+#include <engine/scene_forward_pipeline.h>
+#include <engine/scene_systems.h>
+
+// 4 wide primitives, masks are all bits set or cleared lanes.
+#if DEBRIS_SSE2
+using F4 = __m128;
+
+static inline F4 F4Set1(float v) { return _mm_set1_ps(v); }
+static inline F4 F4Load(const float *p) { return _mm_loadu_ps(p); }
+static inline void F4Store(float *p, F4 v) { _mm_storeu_ps(p, v); }
+static inline F4 F4Add(F4 a, F4 b) { return _mm_add_ps(a, b); }
+static inline F4 F4Sub(F4 a, F4 b) { return _mm_sub_ps(a, b); }
+static inline F4 F4Mul(F4 a, F4 b) { return _mm_mul_ps(a, b); }
+static inline F4 F4MulAdd(F4 a, F4 b, F4 c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+static inline F4 F4Min(F4 a, F4 b) { return _mm_min_ps(a, b); }
+static inline F4 F4Max(F4 a, F4 b) { return _mm_max_ps(a, b); }
+static inline F4 F4Lt(F4 a, F4 b) { return _mm_cmplt_ps(a, b); }
+static inline F4 F4And(F4 a, F4 b) { return _mm_and_ps(a, b); }
+static inline F4 F4Or(F4 a, F4 b) { return _mm_or_ps(a, b); }
+static inline F4 F4Select(F4 m, F4 a, F4 b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+
+// estimate refined by one Newton-Raphson step
+static inline F4 F4RSqrt(F4 v) {
+	const F4 r = _mm_rsqrt_ps(v);
+	return _mm_mul_ps(r, _mm_sub_ps(_mm_set1_ps(1.5f), _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), v), _mm_mul_ps(r, r))));
+}
+
+static inline void F4Transpose(F4 &a, F4 &b, F4 &c, F4 &d) { _MM_TRANSPOSE4_PS(a, b, c, d); }
+#elif DEBRIS_NEON
+using F4 = float32x4_t;
+
+static inline F4 F4Set1(float v) { return vdupq_n_f32(v); }
+static inline F4 F4Load(const float *p) { return vld1q_f32(p); }
+static inline void F4Store(float *p, F4 v) { vst1q_f32(p, v); }
+static inline F4 F4Add(F4 a, F4 b) { return vaddq_f32(a, b); }
+static inline F4 F4Sub(F4 a, F4 b) { return vsubq_f32(a, b); }
+static inline F4 F4Mul(F4 a, F4 b) { return vmulq_f32(a, b); }
+static inline F4 F4MulAdd(F4 a, F4 b, F4 c) { return vmlaq_f32(c, a, b); }
+static inline F4 F4Min(F4 a, F4 b) { return vminq_f32(a, b); }
+static inline F4 F4Max(F4 a, F4 b) { return vmaxq_f32(a, b); }
+static inline F4 F4Lt(F4 a, F4 b) { return vreinterpretq_f32_u32(vcltq_f32(a, b)); }
+static inline F4 F4And(F4 a, F4 b) { return vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b))); }
+static inline F4 F4Or(F4 a, F4 b) { return vreinterpretq_f32_u32(vorrq_u32(vreinterpretq_u32_f32(a), vreinterpretq_u32_f32(b))); }
+static inline F4 F4Select(F4 m, F4 a, F4 b) { return vbslq_f32(vreinterpretq_u32_f32(m), a, b); }
+
+static inline F4 F4RSqrt(F4 v) {
+	const F4 r = vrsqrteq_f32(v);
+	return vmulq_f32(r, vrsqrtsq_f32(vmulq_f32(v, r), r));
+}
+
+static inline void F4Transpose(F4 &a, F4 &b, F4 &c, F4 &d) {
+	const float32x4x2_t ab = vtrnq_f32(a, b), cd = vtrnq_f32(c, d);
+	a = vcombine_f32(vget_low_f32(ab.val[0]), vget_low_f32(cd.val[0]));
+	b = vcombine_f32(vget_low_f32(ab.val[1]), vget_low_f32(cd.val[1]));
+	c = vcombine_f32(vget_high_f32(ab.val[0]), vget_high_f32(cd.val[0]));
+	d = vcombine_f32(vget_high_f32(ab.val[1]), vget_high_f32(cd.val[1]));
+}
+#else
+// scalar fallback, the compiler is left to vectorize the lane loops
+struct F4 {
+	float v[4];
+};
+
+template <typename OP> static inline F4 F4Map(F4 a, F4 b, OP op) {
+	F4 r;
+	for (int i = 0; i < 4; ++i)
+		r.v[i] = op(a.v[i], b.v[i]);
+	return r;
+}
+
+static inline float MaskToFloat(bool m) {
+	const uint32_t bits = m ? 0xffffffff : 0;
+	float f;
+	memcpy(&f, &bits, sizeof(f));
+	return f;
+}
+
+static inline uint32_t FloatBits(float f) {
+	uint32_t bits;
+	memcpy(&bits, &f, sizeof(bits));
+	return bits;
+}
+
+static inline F4 F4Set1(float v) { return {{v, v, v, v}}; }
+static inline F4 F4Load(const float *p) { return {{p[0], p[1], p[2], p[3]}}; }
+static inline void F4Store(float *p, F4 v) { memcpy(p, v.v, sizeof(v.v)); }
+static inline F4 F4Add(F4 a, F4 b) { return F4Map(a, b, [](float x, float y) { return x + y; }); }
+static inline F4 F4Sub(F4 a, F4 b) { return F4Map(a, b, [](float x, float y) { return x - y; }); }
+static inline F4 F4Mul(F4 a, F4 b) { return F4Map(a, b, [](float x, float y) { return x * y; }); }
+static inline F4 F4MulAdd(F4 a, F4 b, F4 c) { return F4Add(F4Mul(a, b), c); }
+static inline F4 F4Min(F4 a, F4 b) { return F4Map(a, b, [](float x, float y) { return x < y ? x : y; }); }
+static inline F4 F4Max(F4 a, F4 b) { return F4Map(a, b, [](float x, float y) { return x > y ? x : y; }); }
+static inline F4 F4Lt(F4 a, F4 b) { return F4Map(a, b, [](float x, float y) { return MaskToFloat(x < y); }); }
+static inline F4 F4And(F4 a, F4 b) { return F4Map(a, b, [](float x, float y) { return MaskToFloat(FloatBits(x) & FloatBits(y)); }); }
+static inline F4 F4Or(F4 a, F4 b) { return F4Map(a, b, [](float x, float y) { return MaskToFloat(FloatBits(x) | FloatBits(y)); }); }
+
+static inline F4 F4Select(F4 m, F4 a, F4 b) {
+	F4 r;
+	for (int i = 0; i < 4; ++i)
+		r.v[i] = FloatBits(m.v[i]) ? a.v[i] : b.v[i];
+	return r;
+}
+
+static inline F4 F4RSqrt(F4 v) {
+	F4 r;
+	for (int i = 0; i < 4; ++i)
+		r.v[i] = 1.f / std::sqrt(v.v[i]);
+	return r;
+}
+
+static inline void F4Transpose(F4 &a, F4 &b, F4 &c, F4 &d) {
+	const F4 r[4] = {a, b, c, d};
+	for (int i = 0; i < 4; ++i) {
+		a.v[i] = r[i].v[0];
+		b.v[i] = r[i].v[1];
+		c.v[i] = r[i].v[2];
+		d.v[i] = r[i].v[3];
+	}
+}
+#endif
+
+// Debris state streams.
+enum DebrisStream { DS_PX, DS_PY, DS_PZ, DS_VX, DS_VY, DS_VZ, DS_QX, DS_QY, DS_QZ, DS_QW, DS_WX, DS_WY, DS_WZ, DS_Size, DS_Life, DS_Count };
+
+// Debris sharing a model and a color. The streams are padded to a multiple of 4 so that the update always runs on full
+// lanes, the lanes past the debris count hold inert but finite values.
+struct DebrisPool {
+	hg::ModelRef model;
+	hg::Vec4 color;
+	float radius{}; // collision radius of a piece of unit size
+
+	size_t count{}, capacity{};
+	std::vector<float> streams[DS_Count];
+
+	void Init(hg::ModelRef model_, const hg::Vec4 &color_, float radius_, size_t capacity_) {
+		model = model_;
+		color = color_;
+		radius = radius_;
+		count = 0;
+		capacity = (capacity_ + 3) & ~size_t(3);
+
+		for (int s = 0; s < DS_Count; ++s)
+			streams[s].assign(capacity, s == DS_QW ? 1.f : 0.f);
+	}
+
+	float *operator[](DebrisStream s) { return streams[s].data(); }
+};
+
+// Static colliders the debris collide against.
+struct DebrisPlane {
+	hg::Vec3 n;
+	float d; // dot(n, p) + d = 0
+};
+
+struct DebrisBox {
+	hg::Vec3 mn, mx;
+};
+
+struct DebrisColliders {
+	std::vector<DebrisPlane> planes;
+	std::vector<DebrisBox> boxes;
+	float kill_y; // debris falling below this height are removed
+};
+
+// Response parameters.
+static const float debris_gravity = -9.81f;
+static const float debris_restitution = 0.3f;
+static const float debris_friction = 0.2f; // fraction of the tangential velocity removed per contact
+static const float debris_angular_damping = 0.85f; // fraction of the angular velocity kept per contact
+
+//
+static void SpawnDebris(DebrisPool &pool, const hg::Vec3 &origin, size_t n, float speed, float min_size, float max_size, float min_life, float max_life) {
+	n = std::min(n, pool.capacity - pool.count);
+
+	for (size_t i = pool.count; i < pool.count + n; ++i) {
+		pool[DS_PX][i] = origin.x + hg::FRRand(-0.5f, 0.5f);
+		pool[DS_PY][i] = origin.y + hg::FRRand(-0.5f, 0.5f);
+		pool[DS_PZ][i] = origin.z + hg::FRRand(-0.5f, 0.5f);
+
+		// random direction biased upward
+		hg::Vec3 dir(hg::FRRand(), hg::FRRand(), hg::FRRand());
+		dir = hg::Normalize(dir + hg::Vec3(0.f, 0.1f, 0.f)) * (hg::FRand() * speed);
+		pool[DS_VX][i] = dir.x;
+		pool[DS_VY][i] = dir.y + speed * 0.5f;
+		pool[DS_VZ][i] = dir.z;
+
+		const hg::Vec3 axis = hg::Normalize(hg::Vec3(hg::FRRand(), hg::FRRand(), hg::FRRand()) + hg::Vec3(0.f, 0.f, 0.001f));
+		const float half_angle = hg::FRand(hg::Pi);
+		pool[DS_QX][i] = axis.x * std::sin(half_angle);
+		pool[DS_QY][i] = axis.y * std::sin(half_angle);
+		pool[DS_QZ][i] = axis.z * std::sin(half_angle);
+		pool[DS_QW][i] = std::cos(half_angle);
+
+		pool[DS_WX][i] = hg::FRRand(-10.f, 10.f);
+		pool[DS_WY][i] = hg::FRRand(-10.f, 10.f);
+		pool[DS_WZ][i] = hg::FRRand(-10.f, 10.f);
+
+		pool[DS_Size][i] = hg::FRRand(min_size, max_size);
+		pool[DS_Life][i] = hg::FRRand(min_life, max_life);
+	}
+
+	pool.count += n;
+}
+
+// Push the pieces in contact out of the collider along the contact normal by the penetration depth (zero when not in
+// contact), remove their approaching normal velocity with restitution and damp their tangential and angular velocities.
+static inline void RespondToContact(F4 contact, F4 nx, F4 ny, F4 nz, F4 depth, F4 &px, F4 &py, F4 &pz, F4 &vx, F4 &vy, F4 &vz, F4 &wx, F4 &wy, F4 &wz) {
+	px = F4MulAdd(nx, depth, px);
+	py = F4MulAdd(ny, depth, py);
+	pz = F4MulAdd(nz, depth, pz);
+
+	const F4 zero = F4Set1(0.f);
+
+	const F4 vn = F4MulAdd(vx, nx, F4MulAdd(vy, ny, F4Mul(vz, nz)));
+	const F4 jn = F4Select(F4And(contact, F4Lt(vn, zero)), F4Mul(vn, F4Set1(1.f + debris_restitution)), zero);
+	vx = F4Sub(vx, F4Mul(nx, jn));
+	vy = F4Sub(vy, F4Mul(ny, jn));
+	vz = F4Sub(vz, F4Mul(nz, jn));
+
+	const F4 vn_after = F4MulAdd(vx, nx, F4MulAdd(vy, ny, F4Mul(vz, nz)));
+	const F4 friction = F4Select(contact, F4Set1(debris_friction), zero);
+	vx = F4Sub(vx, F4Mul(F4Sub(vx, F4Mul(nx, vn_after)), friction));
+	vy = F4Sub(vy, F4Mul(F4Sub(vy, F4Mul(ny, vn_after)), friction));
+	vz = F4Sub(vz, F4Mul(F4Sub(vz, F4Mul(nz, vn_after)), friction));
+
+	const F4 damping = F4Select(contact, F4Set1(debris_angular_damping), F4Set1(1.f));
+	wx = F4Mul(wx, damping);
+	wy = F4Mul(wy, damping);
+	wz = F4Mul(wz, damping);
+}
+
+// Integrate a pool of debris over dt and resolve its collisions. The pieces collide as spheres and do not collide with
+// each other.
+static void UpdateDebris(DebrisPool &pool, const DebrisColliders &colliders, float dt) {
+	const F4 zero = F4Set1(0.f), one = F4Set1(1.f), eps = F4Set1(1e-12f);
+	const F4 vdt = F4Set1(dt), half_dt = F4Set1(0.5f * dt), gravity_dt = F4Set1(debris_gravity * dt), radius = F4Set1(pool.radius);
+
+	float *PX = pool[DS_PX], *PY = pool[DS_PY], *PZ = pool[DS_PZ];
+	float *VX = pool[DS_VX], *VY = pool[DS_VY], *VZ = pool[DS_VZ];
+	float *QX = pool[DS_QX], *QY = pool[DS_QY], *QZ = pool[DS_QZ], *QW = pool[DS_QW];
+	float *WX = pool[DS_WX], *WY = pool[DS_WY], *WZ = pool[DS_WZ];
+	float *Size = pool[DS_Size], *Life = pool[DS_Life];
+
+	const size_t padded_count = (pool.count + 3) & ~size_t(3);
+
+	for (size_t i = 0; i < padded_count; i += 4) {
+		F4 vx = F4Load(VX + i), vy = F4Add(F4Load(VY + i), gravity_dt), vz = F4Load(VZ + i);
+		F4 px = F4MulAdd(vx, vdt, F4Load(PX + i)), py = F4MulAdd(vy, vdt, F4Load(PY + i)), pz = F4MulAdd(vz, vdt, F4Load(PZ + i));
+		F4 wx = F4Load(WX + i), wy = F4Load(WY + i), wz = F4Load(WZ + i);
+
+		// q += dt / 2 * (w, 0) * q, then normalize
+		const F4 qx = F4Load(QX + i), qy = F4Load(QY + i), qz = F4Load(QZ + i), qw = F4Load(QW + i);
+
+		F4 nqx = F4MulAdd(F4Sub(F4Add(F4Mul(qw, wx), F4Mul(wy, qz)), F4Mul(wz, qy)), half_dt, qx);
+		F4 nqy = F4MulAdd(F4Sub(F4Add(F4Mul(qw, wy), F4Mul(wz, qx)), F4Mul(wx, qz)), half_dt, qy);
+		F4 nqz = F4MulAdd(F4Sub(F4Add(F4Mul(qw, wz), F4Mul(wx, qy)), F4Mul(wy, qx)), half_dt, qz);
+		F4 nqw = F4Sub(qw, F4Mul(F4MulAdd(wx, qx, F4MulAdd(wy, qy, F4Mul(wz, qz))), half_dt));
+
+		const F4 inv_len = F4RSqrt(F4MulAdd(nqx, nqx, F4MulAdd(nqy, nqy, F4MulAdd(nqz, nqz, F4Mul(nqw, nqw)))));
+		F4Store(QX + i, F4Mul(nqx, inv_len));
+		F4Store(QY + i, F4Mul(nqy, inv_len));
+		F4Store(QZ + i, F4Mul(nqz, inv_len));
+		F4Store(QW + i, F4Mul(nqw, inv_len));
+
+		F4Store(Life + i, F4Sub(F4Load(Life + i), vdt));
+
+		// collisions
+		const F4 r = F4Mul(radius, F4Load(Size + i));
+
+		for (const auto &plane : colliders.planes) {
+			const F4 nx = F4Set1(plane.n.x), ny = F4Set1(plane.n.y), nz = F4Set1(plane.n.z);
+			const F4 dist = F4MulAdd(px, nx, F4MulAdd(py, ny, F4MulAdd(pz, nz, F4Set1(plane.d))));
+			const F4 depth = F4Max(F4Sub(r, dist), zero);
+			RespondToContact(F4Lt(zero, depth), nx, ny, nz, depth, px, py, pz, vx, vy, vz, wx, wy, wz);
+		}
+
+		for (const auto &box : colliders.boxes) {
+			const F4 mx_y = F4Set1(box.mx.y);
+			const F4 dx = F4Sub(px, F4Min(F4Max(px, F4Set1(box.mn.x)), F4Set1(box.mx.x)));
+			const F4 dy = F4Sub(py, F4Min(F4Max(py, F4Set1(box.mn.y)), mx_y));
+			const F4 dz = F4Sub(pz, F4Min(F4Max(pz, F4Set1(box.mn.z)), F4Set1(box.mx.z)));
+
+			const F4 d2 = F4MulAdd(dx, dx, F4MulAdd(dy, dy, F4Mul(dz, dz)));
+			const F4 inv_d = F4RSqrt(F4Max(d2, eps));
+			const F4 outside = F4And(F4Lt(eps, d2), F4Lt(d2, F4Mul(r, r)));
+
+			// a center that went through the surface is pushed out of the nearest face
+			const F4 inside = F4Lt(d2, eps);
+
+			const F4 pen_nx = F4Sub(px, F4Set1(box.mn.x)), pen_px = F4Sub(F4Set1(box.mx.x), px);
+			const F4 pen_ny = F4Sub(py, F4Set1(box.mn.y)), pen_py = F4Sub(mx_y, py);
+			const F4 pen_nz = F4Sub(pz, F4Set1(box.mn.z)), pen_pz = F4Sub(F4Set1(box.mx.z), pz);
+
+			const F4 pen_x = F4Min(pen_nx, pen_px), pen_y = F4Min(pen_ny, pen_py), pen_z = F4Min(pen_nz, pen_pz);
+			const F4 sign_x = F4Select(F4Lt(pen_px, pen_nx), one, F4Sub(zero, one));
+			const F4 sign_y = F4Select(F4Lt(pen_py, pen_ny), one, F4Sub(zero, one));
+			const F4 sign_z = F4Select(F4Lt(pen_pz, pen_nz), one, F4Sub(zero, one));
+
+			const F4 use_y = F4And(F4Lt(pen_y, pen_x), F4Lt(pen_y, pen_z));
+			const F4 use_x = F4Select(use_y, zero, F4Lt(pen_x, pen_z));
+			const F4 use_xy = F4Or(use_x, use_y);
+
+			const F4 in_nx = F4Select(use_x, sign_x, zero), in_ny = F4Select(use_y, sign_y, zero), in_nz = F4Select(use_xy, zero, sign_z);
+			const F4 in_depth = F4Add(F4Select(use_y, pen_y, F4Select(use_x, pen_x, pen_z)), r);
+
+			const F4 contact = F4Or(outside, inside);
+			const F4 nx = F4Select(inside, in_nx, F4Mul(dx, inv_d));
+			const F4 ny = F4Select(inside, in_ny, F4Mul(dy, inv_d));
+			const F4 nz = F4Select(inside, in_nz, F4Mul(dz, inv_d));
+			const F4 depth = F4Select(inside, in_depth, F4Select(outside, F4Sub(r, F4Mul(d2, inv_d)), zero));
+
+			RespondToContact(contact, nx, ny, nz, depth, px, py, pz, vx, vy, vz, wx, wy, wz);
+		}
+
+		F4Store(PX + i, px), F4Store(PY + i, py), F4Store(PZ + i, pz);
+		F4Store(VX + i, vx), F4Store(VY + i, vy), F4Store(VZ + i, vz);
+		F4Store(WX + i, wx), F4Store(WY + i, wy), F4Store(WZ + i, wz);
+	}
+
+	// remove expired debris by moving the last piece in their slot
+	for (size_t i = 0; i < pool.count;)
+		if (Life[i] <= 0.f || PY[i] < colliders.kill_y) {
+			--pool.count;
+			for (auto &stream : pool.streams)
+				stream[i] = stream[pool.count];
+		} else {
+			++i;
+		}
+}
+
+// Write the instance data of the first count pieces of a pool: position and size, then rotation.
+static const uint16_t debris_instance_stride = 8 * sizeof(float);
+
+static void WriteDebrisInstances(DebrisPool &pool, float *out, size_t count) {
+	const float *PX = pool[DS_PX], *PY = pool[DS_PY], *PZ = pool[DS_PZ], *Size = pool[DS_Size];
+	const float *QX = pool[DS_QX], *QY = pool[DS_QY], *QZ = pool[DS_QZ], *QW = pool[DS_QW];
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4, out += 32) {
+		F4 p0 = F4Load(PX + i), p1 = F4Load(PY + i), p2 = F4Load(PZ + i), p3 = F4Load(Size + i);
+		F4 q0 = F4Load(QX + i), q1 = F4Load(QY + i), q2 = F4Load(QZ + i), q3 = F4Load(QW + i);
+		F4Transpose(p0, p1, p2, p3);
+		F4Transpose(q0, q1, q2, q3);
+
+		F4Store(out, p0), F4Store(out + 4, q0);
+		F4Store(out + 8, p1), F4Store(out + 12, q1);
+		F4Store(out + 16, p2), F4Store(out + 20, q2);
+		F4Store(out + 24, p3), F4Store(out + 28, q3);
+	}
+
+	for (; i < count; ++i, out += 8) {
+		out[0] = PX[i], out[1] = PY[i], out[2] = PZ[i], out[3] = Size[i];
+		out[4] = QX[i], out[5] = QY[i], out[6] = QZ[i], out[7] = QW[i];
+	}
+}
+
+int main() {
+	// Create window
+	const int width = 1920, height = 1080;
+
+	hg::InputInit();
+	hg::WindowSystemInit();
+
+	hg::Window *window = hg::NewWindow(width, height);
+	if (!hg::RenderInit(window))
+		return EXIT_FAILURE;
+
+	bgfx::reset(width, height, BGFX_RESET_MSAA_X8);
+
+	if (!(bgfx::getCaps()->supported & BGFX_CAPS_INSTANCING)) {
+		hg::error("instancing is not supported by the renderer");
+		hg::RenderShutdown();
+		hg::DestroyWindow(window);
+		return EXIT_FAILURE;
+	}
+
+	// Create vertex layout for cubes and spheres (position and normal).
+	bgfx::VertexLayout vs_decl;
+	vs_decl.begin().add(bgfx::Attrib::Position, 3, bgfx::AttribType::Float).add(bgfx::Attrib::Normal, 3, bgfx::AttribType::Uint8, true, true).end();
+
+	hg::PipelineResources resources;
+
+	hg::ModelRef sphere_ref = resources.models.Add("sphere", hg::CreateSphereModel(vs_decl, 0.5f, 12, 24));
+	hg::ModelRef cube_ref = resources.models.Add("cube", hg::CreateCubeModel(vs_decl, 1.f, 1.f, 1.f));
+	hg::ModelRef debris_sphere_ref = resources.models.Add("debris_sphere", hg::CreateSphereModel(vs_decl, 0.5f, 4, 6));
+
+	// Load default pipeline shader and create and simple material.
+	hg::AddAssetsFolder("resources_compiled");
+
+	hg::PipelineProgramRef prg = hg::LoadPipelineProgramRefFromAssets("core/shader/default.hps", resources, hg::GetForwardPipelineInfo());
+
+	auto create_material = [prg](const hg::Vec4 &diffuse, const hg::Vec4 &specular, const hg::Vec4 &self) -> hg::Material {
+		hg::Material mat = hg::CreateMaterial(prg, "uDiffuseColor", diffuse, "uSpecularColor", specular);
+		hg::SetMaterialValue(mat, "uSelfColor", self);
+		return mat;
+	};
+
+	hg::Material ground_mat = create_material(hg::Vec4(0.5f, 0.5f, 0.5f), hg::Vec4(0.1f, 0.1f, 0.1f), hg::Vec4::Zero);
+	hg::Material floor_mat = create_material(hg::Vec4(0.3f, 0.3f, 0.35f), hg::Vec4(0.1f, 0.1f, 0.1f), hg::Vec4::Zero);
+	hg::Material objects_mat = create_material(hg::Vec4(0.8f, 0.5f, 0.2f), hg::Vec4::One, hg::Vec4::Zero);
+
+	// Debris program, one instanced draw per pool.
+	bgfx::ProgramHandle debris_program = hg::LoadProgramFromAssets("shaders/debris");
+	bgfx::UniformHandle u_color = bgfx::createUniform("u_color", bgfx::UniformType::Vec4);
+
+	// Setup scene.
+	hg::Scene scene;
+	scene.canvas.color = hg::ColorI(22, 56, 76);
+	scene.environment.fog_color = scene.canvas.color;
+	scene.environment.fog_near = 20;
+	scene.environment.fog_far = 80;
+
+	hg::Node camera = hg::CreateCamera(scene, hg::TransformationMat4(hg::Vec3(0, 20.f, -30.f), hg::Deg3(30.f, 0.f, 0.f)), 0.01f, 5000.f);
+	scene.SetCurrentCamera(camera);
+
+	hg::CreateLinearLight(scene, hg::TransformationMat4(hg::Vec3::Zero, hg::Deg3(30, 59, 0)), hg::Color(1, 0.8f, 0.7f), hg::Color(1, 0.8f, 0.7f), 10, hg::LST_Map, 0.002f,
+		hg::Vec4(50, 100, 200, 400));
+	hg::CreatePointLight(scene, hg::TranslationMat4(hg::Vec3(0.f, 10.f, 10.f)), 100.f, hg::ColorI(94, 155, 228), hg::ColorI(94, 255, 228));
+
+	// Create a board, every static box is also registered as a debris collider.
+	DebrisColliders colliders;
+
+	auto add_static_box = [&](const char *name, const hg::Vec3 &size, const hg::Vec3 &pos, const hg::Material &mat) {
+		hg::ModelRef mdl_ref = resources.models.Add(name, hg::CreateCubeModel(vs_decl, size.x, size.y, size.z));
+		hg::Node node = hg::CreatePhysicCube(scene, size, hg::TranslationMat4(pos), mdl_ref, {mat}, 0.f);
+		node.GetRigidBody().SetType(hg::RBT_Static);
+		colliders.boxes.push_back({pos - size * 0.5f, pos + size * 0.5f});
+	};
+
+	add_static_box("ground", hg::Vec3(30.f, 1.f, 30.f), hg::Vec3(0.f, -.5f, 0.f), ground_mat);
+	add_static_box("wall_l", hg::Vec3(1.f, 11.f, 32.f), hg::Vec3(-15.5f, -.5f, 0.f), ground_mat);
+	add_static_box("wall_r", hg::Vec3(1.f, 11.f, 32.f), hg::Vec3(15.5f, -.5f, 0.f), ground_mat);
+	add_static_box("wall_b", hg::Vec3(32.f, 11.f, 1.f), hg::Vec3(0.f, -.5f, -15.5f), ground_mat);
+	add_static_box("wall_t", hg::Vec3(32.f, 11.f, 1.f), hg::Vec3(0.f, -.5f, 15.5f), ground_mat);
+
+	// Debris thrown over the walls land on a floor plane, no rigid body is created for it.
+	hg::ModelRef floor_ref = resources.models.Add("floor", hg::CreateCubeModel(vs_decl, 200.f, 1.f, 200.f));
+	hg::CreateObject(scene, hg::TranslationMat4(hg::Vec3(0.f, -10.5f, 0.f)), floor_ref, {floor_mat});
+
+	colliders.planes.push_back({hg::Vec3(0.f, 1.f, 0.f), 10.f});
+	colliders.kill_y = -20.f;
+
+	// Create physic system.
+	hg::SceneClocks clocks;
+	hg::SceneBullet3Physics physics;
+	physics.SceneCreatePhysicsFromFile(scene);
+
+	// Debris pools.
+	const size_t debris_pool_capacity = 100000;
+
+	std::vector<DebrisPool> pools(3);
+	pools[0].Init(cube_ref, hg::Vec4(0.8f, 0.5f, 0.2f, 1.f), 0.5f, debris_pool_capacity);
+	pools[1].Init(cube_ref, hg::Vec4(0.6f, 0.6f, 0.65f, 1.f), 0.5f, debris_pool_capacity);
+	pools[2].Init(debris_sphere_ref, hg::Vec4(0.3f, 0.6f, 0.9f, 1.f), 0.5f, debris_pool_capacity);
+
+	// Load and create all the resources needed to display text.
+	hg::Font font = hg::LoadFontFromAssets("font/default.ttf", 24);
+	bgfx::ProgramHandle font_program = hg::LoadProgramFromAssets("core/shader/font");
+
+	hg::RenderState text_render_state = hg::ComputeRenderState(hg::BM_Alpha, hg::DT_Always, hg::FC_Disabled);
+	std::vector<hg::UniformSetValue> text_uniform_values = {hg::MakeUniformSetValue("u_color", hg::Vec4(1.f, 1.f, .5f, 1.f))};
+
+	// Create scene rendering pipeline.
+	hg::ForwardPipeline pipeline = hg::CreateForwardPipeline();
+	hg::iRect viewport = hg::MakeRectFromWidthHeight(0, 0, width, height);
+
+	std::list<hg::NodeRef> node_refs;
+
+	bool emit = false;
+	hg::time_ns debris_time = 0, physics_time = 0;
+
+	// Overlay texts, the statistics change every frame so they are only formatted four times per second.
+	std::string debris_text, rigid_text, help_text;
+	hg::time_ns text_time = -hg::time_from_ms(250); // format on the first frame
+	bool help_emit = !emit;
+
+	hg::reset_clock();
+
+	hg::Keyboard keyboard;
+
+	while (!keyboard.Down(hg::K_Escape) && hg::IsWindowOpen(window)) {
+		keyboard.Update();
+		const hg::time_ns dt = hg::tick_clock();
+
+		if (keyboard.Pressed(hg::K_S)) {
+			// Blow 10000 pieces of debris at a random point above the board.
+			const hg::Vec3 origin = hg::RandomVec3(hg::Vec3(-10.f, 4.f, -10.f), hg::Vec3(10.f, 8.f, 10.f));
+			for (auto &pool : pools)
+				SpawnDebris(pool, origin, 10000 / pools.size(), 12.f, 0.05f, 0.3f, 10.f, 20.f);
+		} else if (keyboard.Pressed(hg::K_D)) {
+			// Drop 500 rigid bodies.
+			for (int i = 0; i < 500; ++i) {
+				hg::Node node;
+				const hg::Mat4 mtx = hg::TranslationMat4(hg::RandomVec3(hg::Vec3(-10.f, 18.f, -10.f), hg::Vec3(10.f, 28.f, 10.f)));
+				if (hg::Rand() % 2)
+					node = hg::CreatePhysicCube(scene, hg::Vec3::One, mtx, cube_ref, {objects_mat});
+				else
+					node = hg::CreatePhysicSphere(scene, 0.5f, mtx, sphere_ref, {objects_mat});
+				physics.NodeCreatePhysicsFromFile(node);
+				node_refs.push_back(node.ref);
+			}
+		} else if (keyboard.Pressed(hg::K_E)) {
+			emit = !emit;
+		} else if (keyboard.Pressed(hg::K_C)) {
+			for (auto &pool : pools)
+				pool.count = 0;
+
+			for (const auto &ref : node_refs)
+				scene.DestroyNode(ref);
+			node_refs.clear();
+
+			scene.GarbageCollect();
+			physics.GarbageCollect(scene);
+		}
+
+		// A continuous fountain spawning 20000 pieces per second.
+		if (emit) {
+			const size_t n = size_t(20000.f * hg::time_to_sec_f(dt)) / pools.size() + 1;
+			for (auto &pool : pools)
+				SpawnDebris(pool, hg::Vec3(0.f, 1.f, 0.f), n, 14.f, 0.05f, 0.2f, 4.f, 6.f);
+		}
+
+		// Update debris, the step is clamped to keep the collisions stable through frame hitches.
+		const float debris_dt = std::min(hg::time_to_sec_f(dt), 1.f / 30.f);
+
+		hg::time_ns start = hg::time_now();
+		for (auto &pool : pools)
+			UpdateDebris(pool, colliders, debris_dt);
+		debris_time = hg::time_now() - start;
+
+		// Update rigid bodies.
+		start = hg::time_now();
+		hg::SceneUpdateSystems(scene, clocks, dt, physics, hg::time_from_ms(16), 3);
+		physics_time = hg::time_now() - start;
+
+		// Display scene.
+		bgfx::ViewId view_id = 0;
+		hg::SceneForwardPipelinePassViewId views;
+		hg::SubmitSceneToPipeline(view_id, scene, viewport, 1.f, pipeline, resources, views);
+
+		// Draw every pool of debris with a single instanced draw over the scene.
+		hg::SetViewPerspective(view_id, 0, 0, width, height, camera.GetTransform().GetWorld(), 0.01f, 5000.f, hg::FovToZoomFactor(camera.GetCamera().GetFov()), 0);
+
+		size_t debris_count = 0, drawn_count = 0;
+		for (auto &pool : pools) {
+			debris_count += pool.count;
+
+			const uint32_t count = bgfx::getAvailInstanceDataBuffer(uint32_t(pool.count), debris_instance_stride);
+			if (!count)
+				continue;
+
+			bgfx::InstanceDataBuffer idb;
+			bgfx::allocInstanceDataBuffer(&idb, count, debris_instance_stride);
+			WriteDebrisInstances(pool, reinterpret_cast<float *>(idb.data), count);
+			drawn_count += count;
+
+			const hg::Model &model = resources.models.Get(pool.model);
+			bgfx::setVertexBuffer(0, model.lists[0].vertex_buffer);
+			bgfx::setIndexBuffer(model.lists[0].index_buffer);
+			bgfx::setInstanceDataBuffer(&idb);
+			bgfx::setUniform(u_color, &pool.color.x);
+			bgfx::setState(BGFX_STATE_DEFAULT);
+			bgfx::submit(view_id, debris_program);
+		}
+		++view_id;
+
+		// Compare the cost per object of debris and rigid bodies.
+		hg::SetView2D(view_id, 0, 0, width, height, -1, 1, BGFX_CLEAR_DEPTH, hg::Color::Black, 1, 0);
+
+		if (hg::time_now() - text_time >= hg::time_from_ms(250)) {
+			debris_text = hg::format("Debris: %1 (%2 drawn) - update %3 ms, %4 ns per piece")
+							  .arg(int(debris_count))
+							  .arg(int(drawn_count))
+							  .arg(hg::time_to_ms_f(debris_time))
+							  .arg(debris_count ? float(debris_time) / float(debris_count) : 0.f);
+			rigid_text = hg::format("Rigid bodies: %1 - scene and physics update %2 ms, %3 ns per body")
+							 .arg(int(node_refs.size()))
+							 .arg(hg::time_to_ms_f(physics_time))
+							 .arg(node_refs.empty() ? 0.f : float(physics_time) / float(node_refs.size()));
+			text_time = hg::time_now();
+		}
+
+		if (help_emit != emit) {
+			help_text = hg::format("S: Debris burst - E: Debris fountain (%1) - D: Drop 500 rigid bodies - C: Clear").arg(emit ? "on" : "off");
+			help_emit = emit;
+		}
+
+		hg::DrawText(view_id, font, debris_text, font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20, height - 40, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {},
+			text_render_state);
+		hg::DrawText(view_id, font, rigid_text, font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20, height - 64, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {},
+			text_render_state);
+		hg::DrawText(view_id, font, help_text, font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20, height - 88, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+
+		bgfx::frame();
+		hg::UpdateWindow(window);
+	}
+
+	bgfx::destroy(u_color);
+	bgfx::destroy(debris_program);
+
+	hg::RenderShutdown();
+	hg::InputShutdown();
+	hg::DestroyWindow(window);
+	return EXIT_SUCCESS;
+}
@@ -42,6 +42,9 @@ int main() {
 	pipeline_aaa_config.dof_focus_point = 3.5f; // Distance to the focus point (in meters)
 	pipeline_aaa_config.dof_focus_length = 2.f; // Depth of field (in meters); smaller values result in a narrower focused area.
 
+	// resolve the animated node once, the transform stays valid for the lifetime of the node
+	hg::Transform trs = scene.GetNode("engine_master").GetTransform();
+
 	// main loop
 	int frame = 0;
 
@@ -52,7 +55,6 @@ int main() {
 		// update keyboard devices
 		keyboard.Update();
 		
-		hg::Transform trs = scene.GetNode("engine_master").GetTransform();
 		trs.SetRot(trs.GetRot() + hg::Vec3(0, hg::Deg(15.f) * hg::time_to_sec_f(dt), 0));
 
 		bgfx::ViewId view_id = 0;
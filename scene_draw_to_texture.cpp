@@ -57,6 +57,10 @@ int main() {
 	// prepare the cube shader program
 	bgfx::ProgramHandle cube_prg = hg::LoadProgramFromAssets("shaders/texture");
 
+	// the cube uniforms do not change, build them once instead of allocating them every frame
+	std::vector<hg::UniformSetValue> val_uniforms = { hg::MakeUniformSetValue("color", hg::Vec4::One) };
+	std::vector<hg::UniformSetTexture> tex_uniforms = { hg::MakeUniformSetTexture("s_tex", color, 0) };
+
 	// main loop
 	float angle = 0.f;
 
@@ -81,9 +85,6 @@ int main() {
 		// draw a rotating cube in immediate mode using the texture the scene was rendered to
 		hg::SetViewPerspective(view_id, 0, 0, res_x, res_y, hg::TranslationMat4(hg::Vec3(0.f, 0.f, -1.8f)));
 		
-		std::vector<hg::UniformSetValue> val_uniforms = { hg::MakeUniformSetValue("color", hg::Vec4::One) };  // note: these could be moved out of the main loop but are kept here for readability
-		std::vector<hg::UniformSetTexture> tex_uniforms = { hg::MakeUniformSetTexture("s_tex", color, 0) };
-		
 		hg::Mat4 trs = hg::TransformationMat4(hg::Vec3::Zero, hg::Vec3(angle * 0.1f, angle * 0.05f, angle * 0.2f));
 		hg::DrawModel(view_id, cube_mdl, cube_prg, val_uniforms, tex_uniforms, &trs, 1);
 
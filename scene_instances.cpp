@@ -32,9 +32,10 @@ public:
 	void Update(hg::time_ns dt);
 
 private:
-	void StartAnim(const std::string& name);
+	void StartAnim(State anim_state);
 
 	hg::Node node;
+	hg::SceneAnimRef anims[3] = {hg::InvalidSceneAnimRef, hg::InvalidSceneAnimRef, hg::InvalidSceneAnimRef}; // resolved once per instance, indexed by state
 	hg::time_ns delay = 0;
 	State state = Idle;
 	hg::ScenePlayAnimRef playing_anim_ref = hg::InvalidScenePlayAnimRef;
@@ -47,6 +48,13 @@ BipedActor::BipedActor(hg::Scene& scene, hg::PipelineResources& res, const hg::V
 	if (success) {
 		node.GetTransform().SetPosRot(pos, hg::Deg3(0.f, hg::FRand(360.f), 0.f));
 		playing_anim_ref = hg::InvalidScenePlayAnimRef;
+
+		static const char* state_names[] = {
+			"idle", "walk", "run"
+		};
+		for (int i = 0; i < 3; i++) {
+			anims[i] = node.GetInstanceSceneAnim(state_names[i]);
+		}
 	}
 	state = BipedActor::Idle;
 }
@@ -57,28 +65,23 @@ BipedActor::~BipedActor() {
 	}
 }
 
-void BipedActor::StartAnim(const std::string& name) {
+void BipedActor::StartAnim(State anim_state) {
 	if (!(node.scene_ref && node.scene_ref->scene)) {
 		return;
 	}
-	hg::SceneAnimRef anim = node.GetInstanceSceneAnim(name);
 	if (playing_anim_ref != hg::InvalidScenePlayAnimRef) {
 		node.scene_ref->scene->StopAnim(playing_anim_ref);
 	}
-	playing_anim_ref = node.scene_ref->scene->PlayAnim(anim, hg::ALM_Loop);
+	playing_anim_ref = node.scene_ref->scene->PlayAnim(anims[anim_state], hg::ALM_Loop);
 }
 
 void BipedActor::Update(hg::time_ns dt) {
-	static const char* state_names[] = {
-		"idle", "walk", "run"
-	};
-
 	// check for state change
 	delay = delay - dt;
 	if (delay <= 0) {
 		state = BipedActor::State(hg::Rand(2));
 		delay = delay + hg::time_from_sec_f(hg::FRRand(2.f, 6.f)); // 2 to 6 seconds before next state change
-		StartAnim(state_names[state]);
+		StartAnim(state);
 	}
 
 	// apply motion
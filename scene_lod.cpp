@@ -0,0 +1,648 @@
+// HARFANG(R) Copyright (C) 2022 NWNC HARFANG. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+// Toyota 2JZ - GTE Engine model by Serhii Denysenko(CGTrader: serhiidenysenko8256)
+// URL : https://www.cgtrader.com/3d-models/vehicle/part/toyota-2jz-gte-engine-2932b715-2f42-4ecd-93ce-df9507c67ce8
+
+// Generate a LOD chain for each model of a scene using quadric error simplification then select the LOD to draw
+// from the object projected size on screen, usage: scene_lod [source resources folder] [-save]
+// -save writes the LOD geometries next to their source with the hash of the source, later runs load them instead of
+// simplifying the models again as long as the source is unchanged.
+// The source resources default to the resources folder of the source tree, they are not installed.
+
+#include <foundation/clock.h>
+#include <foundation/dir.h>
+#include <foundation/format.h>
+#include <foundation/log.h>
+#include <foundation/math.h>
+#include <foundation/minmax.h>
+#include <foundation/projection.h>
+
+#include <platform/input_system.h>
+#include <platform/window_system.h>
+
+#include <engine/assets.h>
+#include <engine/font.h>
+#include <engine/forward_pipeline.h>
+#include <engine/geometry.h>
+#include <engine/render_pipeline.h>
+#include <engine/scene.h>
+#include <engine/scene_forward_pipeline.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "source_resources.h"
+
+static const int lod_count = 4;
+static const float lod_ratios[lod_count] = {1.f, 0.5f, 0.25f, 0.1f}; // fraction of the source triangles kept at each level
+
+// Triangle soup sharing positions, each triangle corner carries its own attributes so that simplification only
+// operates on the position topology and never opens cracks along attribute seams.
+struct Corner {
+	hg::Vec3 normal;
+	hg::Vec2 uv;
+};
+
+struct SimplifyMesh {
+	std::vector<hg::Vec3> pos;
+	std::vector<std::array<uint32_t, 3>> tri;
+	std::vector<std::array<Corner, 3>> corner;
+};
+
+// Symmetric 4x4 error quadric.
+struct Quadric {
+	double a2{}, ab{}, ac{}, ad{}, b2{}, bc{}, bd{}, c2{}, cd{}, d2{};
+
+	Quadric &operator+=(const Quadric &q) {
+		a2 += q.a2, ab += q.ab, ac += q.ac, ad += q.ad, b2 += q.b2, bc += q.bc, bd += q.bd, c2 += q.c2, cd += q.cd, d2 += q.d2;
+		return *this;
+	}
+
+	double Error(const hg::Vec3 &p) const {
+		const double x = p.x, y = p.y, z = p.z;
+		return a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x + b2 * y * y + 2 * bc * y * z + 2 * bd * y + c2 * z * z + 2 * cd * z + d2;
+	}
+};
+
+static Quadric MakePlaneQuadric(const hg::Vec3 &p0, const hg::Vec3 &p1, const hg::Vec3 &p2) {
+	const hg::Vec3 n = hg::Cross(p1 - p0, p2 - p0);
+	const float area = hg::Len(n);
+
+	Quadric q;
+	if (area <= 0.f)
+		return q;
+
+	const double a = n.x / area, b = n.y / area, c = n.z / area, d = -(a * p0.x + b * p0.y + c * p0.z), w = area * 0.5;
+	q.a2 = w * a * a, q.ab = w * a * b, q.ac = w * a * c, q.ad = w * a * d;
+	q.b2 = w * b * b, q.bc = w * b * c, q.bd = w * b * d;
+	q.c2 = w * c * c, q.cd = w * c * d, q.d2 = w * d * d;
+	return q;
+}
+
+// Greedy half-edge collapse ordered by quadric error (Garland & Heckbert). Vertices on open borders are locked.
+static SimplifyMesh Simplify(const SimplifyMesh &in, size_t target_tri_count) {
+	SimplifyMesh mesh = in;
+	const size_t vtx_count = mesh.pos.size();
+
+	std::vector<std::vector<uint32_t>> vtx_tris(vtx_count);
+	std::vector<Quadric> quadrics(vtx_count);
+	std::vector<bool> tri_alive(mesh.tri.size(), true), locked(vtx_count, false);
+	std::vector<uint32_t> version(vtx_count, 0);
+
+	for (uint32_t t = 0; t < mesh.tri.size(); ++t) {
+		const auto &tri = mesh.tri[t];
+		const Quadric q = MakePlaneQuadric(mesh.pos[tri[0]], mesh.pos[tri[1]], mesh.pos[tri[2]]);
+		for (int k = 0; k < 3; ++k) {
+			vtx_tris[tri[k]].push_back(t);
+			quadrics[tri[k]] += q;
+		}
+	}
+
+	// an edge used by a single triangle is a border
+	std::map<std::pair<uint32_t, uint32_t>, int> edge_use;
+	for (const auto &tri : mesh.tri)
+		for (int k = 0; k < 3; ++k)
+			++edge_use[std::minmax(tri[k], tri[(k + 1) % 3])];
+
+	for (const auto &i : edge_use)
+		if (i.second == 1)
+			locked[i.first.first] = locked[i.first.second] = true;
+
+	struct Collapse {
+		double cost;
+		uint32_t from, to, from_version, to_version;
+		bool operator>(const Collapse &c) const { return cost > c.cost; }
+	};
+
+	std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue;
+
+	auto push_edge = [&](uint32_t a, uint32_t b) {
+		Quadric q = quadrics[a];
+		q += quadrics[b];
+
+		if (!locked[a])
+			queue.push({q.Error(mesh.pos[b]), a, b, version[a], version[b]});
+		if (!locked[b])
+			queue.push({q.Error(mesh.pos[a]), b, a, version[b], version[a]});
+	};
+
+	for (const auto &i : edge_use)
+		push_edge(i.first.first, i.first.second);
+
+	auto tri_normal = [&](const std::array<uint32_t, 3> &tri) { return hg::Cross(mesh.pos[tri[1]] - mesh.pos[tri[0]], mesh.pos[tri[2]] - mesh.pos[tri[0]]); };
+
+	size_t tri_count = mesh.tri.size();
+
+	while (tri_count > target_tri_count && !queue.empty()) {
+		const Collapse c = queue.top();
+		queue.pop();
+
+		if (c.from_version != version[c.from] || c.to_version != version[c.to])
+			continue; // stale candidate
+
+		// reject collapses flipping a triangle
+		bool flips = false;
+		for (uint32_t t : vtx_tris[c.from]) {
+			if (!tri_alive[t])
+				continue;
+
+			auto tri = mesh.tri[t];
+			if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to)
+				continue; // removed by the collapse
+
+			const hg::Vec3 n0 = tri_normal(tri);
+			std::replace(tri.begin(), tri.end(), c.from, c.to);
+			if (hg::Dot(n0, tri_normal(tri)) <= 0.f) {
+				flips = true;
+				break;
+			}
+		}
+
+		if (flips)
+			continue;
+
+		for (uint32_t t : vtx_tris[c.from]) {
+			if (!tri_alive[t])
+				continue;
+
+			auto &tri = mesh.tri[t];
+			if (tri[0] == c.to || tri[1] == c.to || tri[2] == c.to) {
+				tri_alive[t] = false;
+				--tri_count;
+			} else {
+				std::replace(tri.begin(), tri.end(), c.from, c.to);
+				vtx_tris[c.to].push_back(t);
+			}
+		}
+
+		vtx_tris[c.from].clear();
+		quadrics[c.to] += quadrics[c.from];
+		++version[c.from];
+		++version[c.to];
+
+		// queue collapses for the edges around the surviving vertex
+		for (uint32_t t : vtx_tris[c.to])
+			if (tri_alive[t])
+				for (uint32_t v : mesh.tri[t])
+					if (v != c.to)
+						push_edge(c.to, v);
+	}
+
+	SimplifyMesh out;
+	out.pos = mesh.pos;
+	for (size_t t = 0; t < mesh.tri.size(); ++t)
+		if (tri_alive[t]) {
+			out.tri.push_back(mesh.tri[t]);
+			out.corner.push_back(mesh.corner[t]);
+		}
+	return out;
+}
+
+// One simplification mesh per material of the geometry.
+static std::map<uint16_t, SimplifyMesh> SplitGeometryByMaterial(const hg::Geometry &geo) {
+	std::map<uint16_t, SimplifyMesh> meshes;
+
+	size_t corner_count = 0;
+	for (const auto &pol : geo.pol)
+		corner_count += pol.vtx_count;
+
+	std::vector<hg::Vec3> computed_normals;
+	const std::vector<hg::Vec3> &normals = GetCornerNormals(geo, computed_normals);
+
+	const bool has_uv = geo.uv[0].size() >= corner_count;
+
+	size_t corner = 0;
+	for (const auto &pol : geo.pol) {
+		auto &mesh = meshes[pol.material];
+		if (mesh.pos.empty())
+			mesh.pos = geo.vtx;
+
+		for (int i = 1; i + 1 < pol.vtx_count; ++i) { // fan triangulation
+			const size_t c[3] = {corner, corner + i, corner + i + 1};
+
+			std::array<uint32_t, 3> tri;
+			std::array<Corner, 3> attr;
+			for (int k = 0; k < 3; ++k) {
+				tri[k] = uint32_t(geo.binding[c[k]]);
+				attr[k] = {normals[c[k]], has_uv ? geo.uv[0][c[k]] : hg::Vec2::Zero};
+			}
+
+			mesh.tri.push_back(tri);
+			mesh.corner.push_back(attr);
+		}
+
+		corner += pol.vtx_count;
+	}
+
+	return meshes;
+}
+
+// Upload simplified meshes as a model with the tangent frame required by normal mapped materials.
+static hg::Model MakeModel(const std::map<uint16_t, SimplifyMesh> &meshes) {
+	bgfx::VertexLayout layout;
+	layout.begin()
+		.add(bgfx::Attrib::Position, 3, bgfx::AttribType::Float)
+		.add(bgfx::Attrib::Normal, 4, bgfx::AttribType::Uint8, true, true)
+		.add(bgfx::Attrib::Tangent, 4, bgfx::AttribType::Uint8, true, true)
+		.add(bgfx::Attrib::Bitangent, 4, bgfx::AttribType::Uint8, true, true)
+		.add(bgfx::Attrib::TexCoord0, 2, bgfx::AttribType::Float)
+		.end();
+
+	hg::Model mdl;
+
+	for (const auto &i : meshes) {
+		const SimplifyMesh &mesh = i.second;
+		if (mesh.tri.empty())
+			continue;
+
+		// weld corners sharing position and attributes
+		std::map<std::array<uint32_t, 6>, uint32_t> welded;
+		std::vector<uint32_t> idx;
+		std::vector<hg::Vec3> pos, normal, tangent, bitangent;
+		std::vector<hg::Vec2> uv;
+
+		for (size_t t = 0; t < mesh.tri.size(); ++t)
+			for (int k = 0; k < 3; ++k) {
+				const Corner &c = mesh.corner[t][k];
+
+				std::array<uint32_t, 6> key = {mesh.tri[t][k]};
+				memcpy(&key[1], &c.normal, sizeof(float) * 3);
+				memcpy(&key[4], &c.uv, sizeof(float) * 2);
+
+				auto w = welded.emplace(key, uint32_t(pos.size()));
+				if (w.second) {
+					pos.push_back(mesh.pos[mesh.tri[t][k]]);
+					normal.push_back(c.normal);
+					uv.push_back(c.uv);
+				}
+				idx.push_back(w.first->second);
+			}
+
+		// per-vertex tangent frame from texture coordinates
+		tangent.assign(pos.size(), hg::Vec3::Zero);
+		bitangent.assign(pos.size(), hg::Vec3::Zero);
+
+		for (size_t t = 0; t < idx.size(); t += 3) {
+			const uint32_t a = idx[t], b = idx[t + 1], c = idx[t + 2];
+			const hg::Vec3 e0 = pos[b] - pos[a], e1 = pos[c] - pos[a];
+			const hg::Vec2 d0 = uv[b] - uv[a], d1 = uv[c] - uv[a];
+
+			const float det = d0.x * d1.y - d1.x * d0.y;
+			if (fabsf(det) < 1e-12f)
+				continue;
+
+			const hg::Vec3 T = (e0 * d1.y - e1 * d0.y) / det, B = (e1 * d0.x - e0 * d1.x) / det;
+			for (uint32_t v : {a, b, c})
+				tangent[v] += T, bitangent[v] += B;
+		}
+
+		hg::MinMax minmax(pos[0], pos[0]);
+
+		const bgfx::Memory *vtx_mem = bgfx::alloc(uint32_t(pos.size() * layout.getStride()));
+		for (uint32_t v = 0; v < uint32_t(pos.size()); ++v) {
+			minmax.mn = hg::Min(minmax.mn, pos[v]), minmax.mx = hg::Max(minmax.mx, pos[v]);
+
+			const hg::Vec3 n = normal[v];
+			const hg::Vec3 T = hg::Len(tangent[v]) > 0.f ? hg::Normalize(tangent[v]) : hg::Vec3::Right;
+			const hg::Vec3 B = hg::Len(bitangent[v]) > 0.f ? hg::Normalize(bitangent[v]) : hg::Vec3::Front;
+
+			const float p_[4] = {pos[v].x, pos[v].y, pos[v].z, 1.f}, n_[4] = {n.x, n.y, n.z, 0.f}, t_[4] = {T.x, T.y, T.z, 0.f}, b_[4] = {B.x, B.y, B.z, 0.f};
+			const float uv_[4] = {uv[v].x, uv[v].y, 0.f, 0.f};
+
+			bgfx::vertexPack(p_, false, bgfx::Attrib::Position, layout, vtx_mem->data, v);
+			bgfx::vertexPack(n_, true, bgfx::Attrib::Normal, layout, vtx_mem->data, v);
+			bgfx::vertexPack(t_, true, bgfx::Attrib::Tangent, layout, vtx_mem->data, v);
+			bgfx::vertexPack(b_, true, bgfx::Attrib::Bitangent, layout, vtx_mem->data, v);
+			bgfx::vertexPack(uv_, false, bgfx::Attrib::TexCoord0, layout, vtx_mem->data, v);
+		}
+
+		hg::DisplayList list;
+		list.vertex_buffer = bgfx::createVertexBuffer(vtx_mem, layout);
+		list.index_buffer = bgfx::createIndexBuffer(bgfx::copy(idx.data(), uint32_t(idx.size() * sizeof(uint32_t))), BGFX_BUFFER_INDEX32);
+
+		mdl.lists.push_back(list);
+		mdl.bounds.push_back(minmax);
+		mdl.mats.push_back(i.first);
+	}
+
+	return mdl;
+}
+
+// Write a LOD next to its source geometry so that it is compiled with the other assets.
+static bool SaveLodGeometry(const std::string &path, const std::map<uint16_t, SimplifyMesh> &meshes) {
+	// geometry polygons store their material index on 8 bits
+	if (!meshes.empty() && meshes.rbegin()->first > 255) {
+		hg::warn(hg::format("cannot save LOD '%1', material index %2 does not fit a geometry polygon").arg(path).arg(int(meshes.rbegin()->first)));
+		return false;
+	}
+
+	hg::Geometry geo;
+	geo.vtx = meshes.begin()->second.pos;
+
+	for (const auto &i : meshes)
+		for (size_t t = 0; t < i.second.tri.size(); ++t) {
+			geo.pol.push_back({3, uint8_t(i.first)});
+			for (int k = 0; k < 3; ++k) {
+				geo.binding.push_back(i.second.tri[t][k]);
+				geo.normal.push_back(i.second.corner[t][k].normal);
+				geo.uv[0].push_back(i.second.corner[t][k].uv);
+			}
+		}
+
+	return hg::SaveGeometryToFile(path.c_str(), geo);
+}
+
+// FNV-1a hash of a file content, 0 if the file cannot be read. Saved LODs record the hash of their source geometry.
+static uint64_t HashFile(const std::string &path) {
+	FILE *file = fopen(path.c_str(), "rb");
+	if (!file)
+		return 0;
+
+	uint64_t hash = 14695981039346656037ull;
+	uint8_t buffer[65536];
+
+	size_t size;
+	while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		for (size_t i = 0; i < size; ++i)
+			hash = (hash ^ buffer[i]) * 1099511628211ull;
+
+	const bool ok = !ferror(file);
+	fclose(file);
+	return ok ? hash : 0;
+}
+
+static uint64_t ReadLodSourceHash(const std::string &path) {
+	FILE *file = fopen(path.c_str(), "rb");
+	if (!file)
+		return 0;
+
+	uint64_t hash = 0;
+	const bool ok = fread(&hash, sizeof(hash), 1, file) == 1;
+	fclose(file);
+	return ok ? hash : 0;
+}
+
+static bool WriteLodSourceHash(const std::string &path, uint64_t hash) {
+	FILE *file = fopen(path.c_str(), "wb");
+	if (!file)
+		return false;
+
+	const bool ok = fwrite(&hash, sizeof(hash), 1, file) == 1;
+	return fclose(file) == 0 && ok;
+}
+
+//
+struct LodChain {
+	std::array<hg::ModelRef, lod_count> models;
+	std::array<size_t, lod_count> tri_counts;
+};
+
+struct LodInstance {
+	hg::Node node;
+	size_t chain;
+	int level;
+};
+
+// Projected size thresholds in pixels below which the next coarser level is used. The hysteresis band keeps an object
+// from switching back and forth when its size hovers around a threshold.
+static const float lod_thresholds[lod_count - 1] = {300.f, 120.f, 40.f};
+static const float lod_hysteresis = 0.15f;
+
+static int SelectLod(float projected_size, int level) {
+	while (level < lod_count - 1 && projected_size < lod_thresholds[level] * (1.f - lod_hysteresis))
+		++level;
+	while (level > 0 && projected_size > lod_thresholds[level - 1] * (1.f + lod_hysteresis))
+		--level;
+	return level;
+}
+
+int main(int narg, const char **args) {
+	std::string source_folder = HG_RESOURCES_SOURCE_DIR;
+	bool save_lods = false;
+
+	for (int i = 1; i < narg; ++i)
+		if (std::string(args[i]) == "-save")
+			save_lods = true;
+		else
+			source_folder = args[i];
+
+	if (!hg::IsDir((source_folder + "/car_engine").c_str())) {
+		hg::error(hg::format("source resources folder '%1' not found, usage: scene_lod [source resources folder] [-save]").arg(source_folder));
+		return EXIT_FAILURE;
+	}
+
+	// create window.
+	hg::InputInit();
+	hg::WindowSystemInit();
+
+	int res_x = 1280, res_y = 720;
+
+	hg::Window *win = hg::RenderInit("Harfang - Scene LOD", res_x, res_y, BGFX_RESET_VSYNC | BGFX_RESET_MSAA_X4);
+	if (!win) {
+		hg::error("failed to create window.");
+		return EXIT_FAILURE;
+	}
+
+	// access compiled resources
+	hg::AddAssetsFolder("resources_compiled");
+
+	// create forward pipeline and resources.
+	hg::ForwardPipeline pipeline = hg::CreateForwardPipeline();
+	hg::PipelineResources res = hg::PipelineResources();
+
+	// load scene
+	hg::Scene scene;
+	hg::LoadSceneContext load_ctx;
+	hg::LoadSceneFromAssets("car_engine/engine.scn", scene, res, hg::GetForwardPipelineInfo(), load_ctx);
+
+	// generate a LOD chain per model, the scene model is kept as the first level
+	std::vector<LodChain> chains;
+	std::map<std::string, size_t> chain_by_model;
+	std::vector<LodInstance> instances;
+
+	hg::time_ns t_generate = hg::time_now();
+	int loaded_lod_count = 0;
+
+	for (auto &node : scene.GetAllNodes()) {
+		if (!node.HasObject())
+			continue;
+
+		const hg::ModelRef mdl_ref = node.GetObject().GetModelRef();
+		const std::string name = res.models.GetName(mdl_ref);
+
+		auto i = chain_by_model.find(name);
+		if (i == chain_by_model.end()) {
+			const std::string source_path = source_folder + "/" + name;
+
+			const hg::Geometry geo = hg::LoadGeometryFromFile(source_path.c_str());
+			if (geo.pol.empty())
+				continue;
+
+			// LODs saved by a previous run are reused only if they were simplified from the current source
+			const uint64_t source_hash = HashFile(source_path);
+			const std::string hash_path = source_folder + "/" + name.substr(0, name.size() - 4) + ".lod.hash";
+
+			bool reuse_saved_lods = false;
+			if (!save_lods) {
+				const uint64_t saved_hash = ReadLodSourceHash(hash_path);
+				reuse_saved_lods = saved_hash != 0 && saved_hash == source_hash;
+				if (saved_hash != 0 && !reuse_saved_lods)
+					hg::log(hg::format("saved LODs of '%1' are stale, simplifying it again (run with -save to update them)").arg(name));
+			}
+
+			bool lods_saved = save_lods;
+
+			const auto meshes = SplitGeometryByMaterial(geo);
+
+			size_t tri_count = 0;
+			for (const auto &j : meshes)
+				tri_count += j.second.tri.size();
+
+			LodChain chain;
+			chain.models[0] = mdl_ref;
+			chain.tri_counts[0] = tri_count;
+
+			for (int level = 1; level < lod_count; ++level) {
+				std::map<uint16_t, SimplifyMesh> lod_meshes;
+				size_t lod_tri_count = 0;
+
+				const std::string lod_name = hg::format("%1.lod%2.geo").arg(name.substr(0, name.size() - 4)).arg(level);
+				const std::string lod_path = source_folder + "/" + lod_name;
+
+				// a LOD saved by a previous run is loaded instead of simplified again, -save regenerates it
+				if (reuse_saved_lods) {
+					const hg::Geometry lod_geo = hg::LoadGeometryFromFile(lod_path.c_str());
+					if (!lod_geo.pol.empty())
+						lod_meshes = SplitGeometryByMaterial(lod_geo);
+				}
+
+				if (lod_meshes.empty()) {
+					for (const auto &j : meshes)
+						lod_meshes[j.first] = Simplify(j.second, size_t(j.second.tri.size() * lod_ratios[level]));
+
+					if (save_lods && !SaveLodGeometry(lod_path, lod_meshes)) {
+						hg::warn(hg::format("failed to save LOD '%1'").arg(lod_path));
+						lods_saved = false;
+					}
+				} else {
+					++loaded_lod_count;
+				}
+
+				for (const auto &j : lod_meshes)
+					lod_tri_count += j.second.tri.size();
+
+				chain.models[level] = res.models.Add(lod_name, MakeModel(lod_meshes));
+				chain.tri_counts[level] = lod_tri_count;
+			}
+
+			// the hash is only written once every level is saved, a partial save is never reused
+			if (save_lods) {
+				if (!lods_saved || !source_hash || !WriteLodSourceHash(hash_path, source_hash)) {
+					std::remove(hash_path.c_str());
+					hg::warn(hg::format("LODs of '%1' not saved, they will be simplified again on the next run").arg(name));
+				}
+			}
+
+			i = chain_by_model.emplace(name, chains.size()).first;
+			chains.push_back(chain);
+		}
+
+		instances.push_back({node, i->second, 0});
+	}
+
+	hg::log(hg::format("Generated %1 LOD chains for %2 objects in %3 ms, %4 LOD loaded from previous runs")
+				.arg(chains.size())
+				.arg(instances.size())
+				.arg(int(hg::time_to_ms(hg::time_now() - t_generate)))
+				.arg(loaded_lod_count));
+
+	// text overlay
+	hg::Font font = hg::LoadFontFromAssets("font/default.ttf", 16);
+	bgfx::ProgramHandle font_program = hg::LoadProgramFromAssets("core/shader/font");
+
+	hg::RenderState text_render_state = hg::ComputeRenderState(hg::BM_Alpha, hg::DT_Always, hg::FC_Disabled);
+	std::vector<hg::UniformSetValue> text_uniform_values = {hg::MakeUniformSetValue("u_color", hg::Vec4(1.f, 1.f, .5f, 1.f))};
+
+	// the camera dollies back and forth along its view axis
+	hg::Node camera = scene.GetCurrentCamera();
+	const hg::Vec3 camera_origin = camera.GetTransform().GetPos();
+	const hg::Vec3 camera_axis = hg::GetZ(camera.GetTransform().GetWorld());
+
+	float angle = 0.f;
+	bool use_lod = true;
+
+	// main loop
+	hg::Keyboard keyboard;
+	while (!keyboard.Pressed(hg::K_Escape) && hg::IsWindowOpen(win)) {
+		hg::time_ns dt = hg::tick_clock();  // tick clock, retrieve elapsed clock since last call
+
+		keyboard.Update();
+
+		if (keyboard.Pressed(hg::K_Space))
+			use_lod = !use_lod;
+
+		angle += hg::time_to_sec_f(dt) * 0.25f;
+		camera.GetTransform().SetPos(camera_origin - camera_axis * ((1.f - hg::Cos(angle)) * 20.f));
+
+		scene.Update(dt);
+
+		// select the LOD of each object from its bounding sphere projected size
+		const hg::ViewState view_state = scene.ComputeCurrentCameraViewState(hg::ComputeAspectRatioX(float(res_x), float(res_y)));
+		const hg::Vec3 eye = hg::GetT(camera.GetTransform().GetWorld());
+		const float screen_scale = float(res_x) / (2.f * tanf(camera.GetCamera().GetFov() * 0.5f)); // horizontal fov
+
+		std::array<size_t, lod_count> level_counts = {};
+		size_t tri_drawn = 0, tri_full = 0;
+
+		for (auto &instance : instances) {
+			const LodChain &chain = chains[instance.chain];
+
+			hg::MinMax minmax;
+			if (!instance.node.GetObject().GetMinMax(res, minmax))
+				continue;
+
+			const hg::Mat4 world = instance.node.GetTransform().GetWorld();
+			const hg::MinMax world_minmax = world * minmax;
+
+			const float radius = hg::Len(world_minmax.mx - world_minmax.mn) * 0.5f;
+			const float distance = std::max(hg::Dist(hg::GetCenter(world_minmax), eye), 0.001f);
+
+			const int level = use_lod ? SelectLod(2.f * radius / distance * screen_scale, instance.level) : 0;
+			if (level != instance.level) {
+				instance.node.GetObject().SetModelRef(chain.models[level]);
+				instance.level = level;
+			}
+
+			if (hg::TestVisibility(view_state.frustum, world_minmax) != hg::V_Outside) {
+				++level_counts[level];
+				tri_drawn += chain.tri_counts[level];
+				tri_full += chain.tri_counts[0];
+			}
+		}
+
+		bgfx::ViewId view_id = 0;
+		hg::SceneForwardPipelinePassViewId views;
+		hg::SubmitSceneToPipeline(view_id, scene, hg::iRect(0, 0, res_x, res_y), true, pipeline, res, views);
+
+		// per frame triangle statistics
+		hg::SetView2D(view_id, 0, 0, res_x, res_y, -1, 1, BGFX_CLEAR_DEPTH, hg::Color::Black, 1, 0);
+		hg::DrawText(view_id, font, hg::format("Triangles: %1 (%2 without LOD) - Space: toggle LOD %3").arg(tri_drawn).arg(tri_full).arg(use_lod ? "off" : "on"), font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20, res_y - 40, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+		hg::DrawText(view_id, font, hg::format("Objects per level: %1 / %2 / %3 / %4").arg(level_counts[0]).arg(level_counts[1]).arg(level_counts[2]).arg(level_counts[3]), font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20, res_y - 64, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+
+		bgfx::frame();
+		hg::UpdateWindow(win);
+	}
+
+	hg::RenderShutdown();
+	hg::DestroyWindow(win);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,344 @@
+// HARFANG(R) Copyright (C) 2022 NWNC HARFANG. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+// Several offscreen views (security camera, minimap, rear view) rendered with their own update policy and sharing a
+// single common render data preparation per frame.
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <foundation/clock.h>
+#include <foundation/format.h>
+#include <foundation/log.h>
+#include <foundation/math.h>
+#include <foundation/matrix3.h>
+#include <foundation/projection.h>
+
+#include <platform/input_system.h>
+#include <platform/window_system.h>
+
+#include <engine/assets.h>
+#include <engine/font.h>
+#include <engine/forward_pipeline.h>
+#include <engine/render_pipeline.h>
+#include <engine/scene.h>
+#include <engine/scene_forward_pipeline.h>
+
+enum ViewUpdatePolicy {
+	VUP_EveryNFrames, // refresh every N frames regardless of content
+	VUP_OnChange, // refresh when the scene content or the view itself moved
+	VUP_TimeBudget, // refresh when the frame offscreen budget allows it, stalest view first
+};
+
+static const char *GetViewUpdatePolicyName(ViewUpdatePolicy policy) {
+	if (policy == VUP_EveryNFrames)
+		return "every N frames";
+	if (policy == VUP_OnChange)
+		return "on change";
+	return "time budget";
+}
+
+// Offscreen view format, the cheap format is what views displayed as thumbnails actually need.
+struct OffscreenFormat {
+	const char *name;
+	bgfx::TextureFormat::Enum color;
+	int aa;
+};
+
+static const OffscreenFormat offscreen_formats[] = {
+	{"RGBA8", bgfx::TextureFormat::RGBA8, 1},
+	{"RGBA8 MSAA x4", bgfx::TextureFormat::RGBA8, 4},
+	{"RGBA32F MSAA x4", bgfx::TextureFormat::RGBA32F, 4},
+};
+
+struct OffscreenView {
+	std::string name;
+
+	int size = 256;
+	hg::FrameBuffer frame_buffer;
+	hg::Texture color;
+
+	ViewUpdatePolicy policy = VUP_EveryNFrames;
+	int every_n_frames = 4;
+
+	hg::Mat4 world;
+	bool orthographic = false;
+	float fov_or_size = hg::Deg(60.f);
+
+	hg::Mat4 last_world = hg::Mat4::Zero;
+	int last_update_frame = -1000000;
+	int update_count = 0;
+	bool valid = false;
+};
+
+static void CreateOffscreenViewFrameBuffer(OffscreenView &view, const OffscreenFormat &fmt) {
+	if (bgfx::isValid(view.frame_buffer.handle))
+		hg::DestroyFrameBuffer(view.frame_buffer);
+
+	view.frame_buffer = hg::CreateFrameBuffer(view.size, view.size, fmt.color, bgfx::TextureFormat::D24, fmt.aa, view.name.c_str());
+	view.color = hg::GetColorTexture(view.frame_buffer);
+	view.valid = false;
+}
+
+static hg::ViewState ComputeOffscreenViewState(const OffscreenView &view) {
+	if (view.orthographic)
+		return hg::ComputeOrthographicViewState(view.world, view.fov_or_size, 0.1f, 100.f, hg::Vec2::One);
+	return hg::ComputePerspectiveViewState(view.world, view.fov_or_size, 0.1f, 100.f, hg::Vec2::One);
+}
+
+// Watch the content nodes of a scene, cameras are left out so that a moving camera does not invalidate the views.
+// Update returns true if a watched node moved since the last call, the result is shared by all views in the frame.
+struct SceneChangeTracker {
+	std::vector<hg::Node> nodes;
+	std::vector<hg::Mat4> worlds;
+
+	void Watch(const hg::Scene &scene) {
+		nodes.clear();
+		for (const auto &node : scene.GetNodes())
+			if (!node.HasCamera())
+				nodes.push_back(node);
+		worlds.assign(nodes.size(), hg::Mat4::Zero);
+	}
+
+	bool Update() {
+		bool changed = false;
+		for (size_t i = 0; i < nodes.size(); ++i) {
+			const hg::Mat4 world = nodes[i].GetWorld();
+			if (world != worlds[i]) {
+				worlds[i] = world;
+				changed = true;
+			}
+		}
+		return changed;
+	}
+};
+
+// Decide which views must be refreshed this frame. Budgeted views are returned last, stalest first, so that they can
+// be dropped once the budget is spent.
+static std::vector<OffscreenView *> ScheduleOffscreenViews(std::vector<OffscreenView> &views, int frame, bool scene_changed) {
+	std::vector<OffscreenView *> scheduled, budgeted;
+
+	for (auto &view : views) {
+		if (!view.valid) {
+			scheduled.push_back(&view);
+		} else if (view.policy == VUP_EveryNFrames) {
+			if (frame - view.last_update_frame >= view.every_n_frames)
+				scheduled.push_back(&view);
+		} else if (view.policy == VUP_OnChange) {
+			if (scene_changed || view.world != view.last_world)
+				scheduled.push_back(&view);
+		} else {
+			budgeted.push_back(&view);
+		}
+	}
+
+	std::sort(budgeted.begin(), budgeted.end(), [](const OffscreenView *a, const OffscreenView *b) { return a->last_update_frame < b->last_update_frame; });
+	scheduled.insert(scheduled.end(), budgeted.begin(), budgeted.end());
+	return scheduled;
+}
+
+int main() {
+	hg::InputInit();
+	hg::WindowSystemInit();
+
+	int res_x = 1280, res_y = 720;
+
+	hg::Window *window = hg::RenderInit("Harfang - Multi Camera Views", res_x, res_y, BGFX_RESET_VSYNC | BGFX_RESET_MSAA_X4);
+	if (!window) {
+		hg::error("failed to create window.");
+		return EXIT_FAILURE;
+	}
+
+	// access compiled resources
+	hg::AddAssetsFolder("resources_compiled");
+
+	// create forward pipeline and resources.
+	hg::ForwardPipeline pipeline = hg::CreateForwardPipeline();
+	hg::PipelineResources res = hg::PipelineResources();
+
+	// load host scene
+	hg::Scene scene;
+	hg::LoadSceneContext load_ctx;
+
+	hg::LoadSceneFromAssets("materials/materials.scn", scene, res, hg::GetForwardPipelineInfo(), load_ctx);
+
+	hg::Node camera = scene.GetCurrentCamera();
+	hg::Node animated = scene.GetNode("shiny_red");
+	const hg::Vec3 animated_pos = animated.GetTransform().GetPos();
+
+	// offscreen views
+	int format_idx = 0;
+
+	std::vector<OffscreenView> offscreen_views(3);
+
+	offscreen_views[0].name = "security";
+	offscreen_views[0].policy = VUP_EveryNFrames;
+	offscreen_views[0].every_n_frames = 6;
+	offscreen_views[0].world = hg::Mat4LookAt(hg::Vec3(-6.f, 5.f, -6.f), hg::Vec3::Zero);
+
+	offscreen_views[1].name = "minimap";
+	offscreen_views[1].policy = VUP_OnChange;
+	offscreen_views[1].orthographic = true;
+	offscreen_views[1].fov_or_size = 12.f;
+	offscreen_views[1].world = hg::TransformationMat4(hg::Vec3(0.f, 20.f, 0.f), hg::Vec3(hg::Deg(90.f), 0.f, 0.f));
+
+	offscreen_views[2].name = "rear view";
+	offscreen_views[2].policy = VUP_TimeBudget;
+
+	for (auto &view : offscreen_views)
+		CreateOffscreenViewFrameBuffer(view, offscreen_formats[format_idx]);
+
+	hg::time_ns offscreen_budget = hg::time_from_us(500);
+
+	// thumbnail quad
+	bgfx::VertexLayout quad_layout;
+	quad_layout.begin().add(bgfx::Attrib::Position, 3, bgfx::AttribType::Float).add(bgfx::Attrib::TexCoord0, 2, bgfx::AttribType::Float).end();
+
+	hg::Vertices quad_vtx(quad_layout, 4);
+	hg::Indices quad_idx;
+	quad_idx.insert(quad_idx.end(), {0, 1, 2, 0, 2, 3});
+
+	bgfx::ProgramHandle quad_prg = hg::LoadProgramFromAssets("shaders/texture");
+	hg::RenderState quad_render_state = hg::ComputeRenderState(hg::BM_Opaque, hg::DT_Disabled, hg::FC_Disabled);
+	std::vector<hg::UniformSetValue> quad_values = {hg::MakeUniformSetValue("color", hg::Vec4::One)};
+
+	const float v_top = bgfx::getCaps()->originBottomLeft ? 1.f : 0.f, v_bottom = 1.f - v_top;
+
+	// text rendering
+	hg::Font font = hg::LoadFontFromAssets("font/default.ttf", 16);
+	bgfx::ProgramHandle font_program = hg::LoadProgramFromAssets("core/shader/font");
+
+	std::vector<hg::UniformSetValue> text_uniform_values = {hg::MakeUniformSetValue("u_color", hg::Vec4(1.f, 1.f, 0.5f))};
+	hg::RenderState text_render_state = hg::ComputeRenderState(hg::BM_Alpha, hg::DT_Always, hg::FC_Disabled);
+
+	// main loop
+	hg::SceneForwardPipelineRenderData render_data;
+	SceneChangeTracker change_tracker;
+	change_tracker.Watch(scene);
+
+	bool animate = true, share_common = true;
+	float angle = 0.f, anim_t = 0.f;
+	int frame = 0;
+
+	hg::Keyboard keyboard;
+
+	while (!keyboard.Down(hg::K_Escape) && hg::IsWindowOpen(window)) {
+		hg::time_ns dt = hg::tick_clock();
+
+		keyboard.Update();
+
+		if (keyboard.Pressed(hg::K_A))
+			animate = !animate;
+		if (keyboard.Pressed(hg::K_C))
+			share_common = !share_common;
+		if (keyboard.Pressed(hg::K_F)) {
+			format_idx = (format_idx + 1) % 3;
+			for (auto &view : offscreen_views)
+				CreateOffscreenViewFrameBuffer(view, offscreen_formats[format_idx]);
+		}
+		if (keyboard.Pressed(hg::K_Add))
+			offscreen_budget = offscreen_budget + hg::time_from_us(100);
+		if (keyboard.Pressed(hg::K_Sub))
+			offscreen_budget = std::max(offscreen_budget - hg::time_from_us(100), hg::time_ns(0));
+
+		// orbit the main camera, the rear view follows it
+		angle += hg::time_to_sec_f(dt) * 0.25f;
+		const hg::Vec3 cam_pos(hg::Sin(angle) * 8.f, 3.f, hg::Cos(angle) * 8.f);
+		camera.GetTransform().SetWorld(hg::Mat4LookAt(cam_pos, hg::Vec3::Zero));
+		offscreen_views[2].world = hg::Mat4LookAt(cam_pos, cam_pos * 2.f);
+
+		if (animate) {
+			anim_t += hg::time_to_sec_f(dt);
+			animated.GetTransform().SetPos(animated_pos + hg::Vec3(0.f, hg::Abs(hg::Sin(anim_t * 3.f)) * 1.5f, 0.f));
+		}
+
+		scene.Update(dt);
+
+		const bool scene_changed = change_tracker.Update();
+
+		bgfx::ViewId view_id = 0;
+		hg::SceneForwardPipelinePassViewId views;
+
+		// lights and shadow casters are prepared once and reused by every camera of the frame
+		hg::PrepareSceneForwardPipelineCommonRenderData(view_id, scene, render_data, pipeline, res, views);
+
+		// offscreen views
+		const hg::time_ns offscreen_start = hg::time_now();
+		int offscreen_submitted = 0, offscreen_skipped = 0;
+
+		for (auto view : ScheduleOffscreenViews(offscreen_views, frame, scene_changed)) {
+			if (view->valid && view->policy == VUP_TimeBudget && hg::time_now() - offscreen_start > offscreen_budget) {
+				++offscreen_skipped;
+				continue;
+			}
+
+			if (!share_common)
+				hg::PrepareSceneForwardPipelineCommonRenderData(view_id, scene, render_data, pipeline, res, views);
+
+			const hg::ViewState view_state = ComputeOffscreenViewState(*view);
+			hg::PrepareSceneForwardPipelineViewDependentRenderData(view_id, view_state, scene, render_data, pipeline, res, views);
+			hg::SubmitSceneToForwardPipeline(view_id, scene, hg::iRect(0, 0, view->size, view->size), view_state, pipeline, render_data, res, views, view->frame_buffer.handle, view->name.c_str());
+
+			view->last_world = view->world;
+			view->last_update_frame = frame;
+			view->valid = true;
+			++view->update_count;
+			++offscreen_submitted;
+		}
+
+		const hg::time_ns offscreen_time = hg::time_now() - offscreen_start;
+
+		// main view
+		const hg::ViewState main_view_state = scene.ComputeCurrentCameraViewState(hg::ComputeAspectRatioX(float(res_x), float(res_y)));
+		const hg::iRect main_rect(0, 0, res_x, res_y);
+
+		if (!share_common)
+			hg::PrepareSceneForwardPipelineCommonRenderData(view_id, scene, render_data, pipeline, res, views);
+		hg::PrepareSceneForwardPipelineViewDependentRenderData(view_id, main_view_state, scene, render_data, pipeline, res, views);
+		hg::SubmitSceneToForwardPipeline(view_id, scene, main_rect, main_view_state, pipeline, render_data, res, views);
+
+		// thumbnails and statistics
+		hg::SetView2D(view_id, 0, 0, res_x, res_y, -1, 1, BGFX_CLEAR_DEPTH, hg::Color::Black, 1, 0);
+
+		for (size_t i = 0; i < offscreen_views.size(); ++i) {
+			const OffscreenView &view = offscreen_views[i];
+
+			const float x = 20.f + float(i) * 276.f, y = 20.f, s = 256.f;
+
+			quad_vtx.Begin(0).SetPos(hg::Vec3(x, y, 0.f)).SetTexCoord0(hg::Vec2(0.f, v_top)).End();
+			quad_vtx.Begin(1).SetPos(hg::Vec3(x + s, y, 0.f)).SetTexCoord0(hg::Vec2(1.f, v_top)).End();
+			quad_vtx.Begin(2).SetPos(hg::Vec3(x + s, y + s, 0.f)).SetTexCoord0(hg::Vec2(1.f, v_bottom)).End();
+			quad_vtx.Begin(3).SetPos(hg::Vec3(x, y + s, 0.f)).SetTexCoord0(hg::Vec2(0.f, v_bottom)).End();
+
+			hg::DrawTriangles(view_id, quad_idx, quad_vtx, quad_prg, quad_values, {hg::MakeUniformSetTexture("s_tex", view.color, 0)}, quad_render_state);
+
+			const std::string label = hg::format("%1: %2, %3 updates, age %4").arg(view.name).arg(GetViewUpdatePolicyName(view.policy)).arg(view.update_count).arg(frame - view.last_update_frame);
+			hg::DrawText(view_id, font, label, font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(x, y + s + 8.f, 0), hg::DTHA_Left, hg::DTVA_Top, text_uniform_values, {}, text_render_state);
+		}
+
+		const std::string stats = hg::format("Offscreen: %1 submitted, %2 skipped, %3 ms (budget %4 ms) - Format: %5 - Common render data: %6")
+									  .arg(offscreen_submitted)
+									  .arg(offscreen_skipped)
+									  .arg(hg::time_to_ms_f(offscreen_time))
+									  .arg(hg::time_to_ms_f(offscreen_budget))
+									  .arg(offscreen_formats[format_idx].name)
+									  .arg(share_common ? "shared" : "per camera");
+		hg::DrawText(view_id, font, stats, font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20, res_y - 40, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+		hg::DrawText(view_id, font, "A: toggle animation - C: toggle shared common data - F: cycle offscreen format - +/-: time budget", font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20, res_y - 64, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+
+		// end of frame
+		frame = bgfx::frame();
+		hg::UpdateWindow(window);
+	}
+
+	for (auto &view : offscreen_views)
+		hg::DestroyFrameBuffer(view.frame_buffer);
+
+	hg::RenderShutdown();
+	hg::DestroyWindow(window);
+
+	hg::WindowSystemShutdown();
+	hg::InputShutdown();
+
+	return EXIT_SUCCESS;
+}
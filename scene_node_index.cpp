@@ -0,0 +1,298 @@
+// HARFANG(R) Copyright (C) 2022 NWNC HARFANG. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+// Node name index: a hashed path to node index, including instance-scoped paths such as "biped_3/Bip001 Spine1", kept
+// up to date as nodes are created and destroyed. Interned path handles resolve to a node in constant time so gameplay
+// code can look nodes up by name in hot loops.
+// Lookups through Scene::GetNode, the hashed index and handles are timed side by side.
+
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <foundation/clock.h>
+#include <foundation/format.h>
+#include <foundation/log.h>
+#include <foundation/math.h>
+#include <foundation/rand.h>
+
+#include <platform/input_system.h>
+#include <platform/window_system.h>
+
+#include <engine/assets.h>
+#include <engine/font.h>
+#include <engine/forward_pipeline.h>
+#include <engine/render_pipeline.h>
+#include <engine/scene.h>
+#include <engine/scene_forward_pipeline.h>
+
+// Interned path, resolves in O(1) through a NodeNameIndex.
+struct NodePathHandle {
+	uint32_t id = 0xffffffff;
+};
+
+// Path to node index. Paths are interned once and never removed so that handles stay valid when the node they point to
+// is destroyed and a node with the same path is created again. Paths are expected to be unique, on duplicates the
+// first node indexed wins as with Scene::GetNode.
+struct NodeNameIndex {
+	std::unordered_map<std::string, uint32_t> path_ids;
+	std::vector<hg::NodeRef> nodes; // by path id, InvalidNodeRef if no node currently has this path
+
+	// paths registered with a node as root, by node ref index. The full ref is kept so that a slot reused after its node
+	// was destroyed outside of the index does not release the paths of the new node.
+	struct OwnedPaths {
+		hg::NodeRef root = hg::InvalidNodeRef;
+		std::vector<uint32_t> ids;
+	};
+
+	std::vector<OwnedPaths> owned_paths;
+};
+
+static NodePathHandle InternNodePath(NodeNameIndex &index, const std::string &path) {
+	const auto i = index.path_ids.find(path);
+	if (i != index.path_ids.end())
+		return {i->second};
+
+	const uint32_t id = uint32_t(index.nodes.size());
+	index.path_ids.emplace(path, id);
+	index.nodes.push_back(hg::InvalidNodeRef);
+	return {id};
+}
+
+// Index a node and, if it is an instance, every node of its instance view under "<name>/". All paths are owned by the
+// root node and removed along with it.
+static void IndexNode(NodeNameIndex &index, const hg::Scene &scene, const hg::Node &node, const std::string &prefix, hg::NodeRef root) {
+	const std::string path = prefix + node.GetName();
+
+	const NodePathHandle handle = InternNodePath(index, path);
+	if (index.nodes[handle.id] != hg::InvalidNodeRef && scene.IsValidNodeRef(index.nodes[handle.id]))
+		return; // duplicate path
+
+	index.nodes[handle.id] = node.ref;
+
+	if (root.idx >= index.owned_paths.size())
+		index.owned_paths.resize(root.idx + 1);
+
+	auto &owned = index.owned_paths[root.idx];
+	if (owned.root != root) { // previous node in this slot was not destroyed through the index, its paths are stale
+		owned.root = root;
+		owned.ids.clear();
+	}
+	owned.ids.push_back(handle.id);
+
+	if (node.HasInstance())
+		for (auto ref : node.GetInstanceSceneView().nodes)
+			IndexNode(index, scene, scene.GetNode(ref), path + "/", root);
+}
+
+static void IndexNode(NodeNameIndex &index, const hg::Scene &scene, const hg::Node &node) { IndexNode(index, scene, node, {}, node.ref); }
+
+static void UnindexNode(NodeNameIndex &index, hg::NodeRef ref) {
+	if (ref.idx >= index.owned_paths.size() || index.owned_paths[ref.idx].root != ref)
+		return;
+
+	auto &owned = index.owned_paths[ref.idx];
+	for (auto id : owned.ids)
+		index.nodes[id] = hg::InvalidNodeRef;
+	owned.root = hg::InvalidNodeRef;
+	owned.ids.clear();
+}
+
+// Index the top-level nodes of a scene, instantiated nodes are reached through their instance root.
+static void BuildNodeNameIndex(NodeNameIndex &index, const hg::Scene &scene) {
+	for (auto &node : scene.GetNodes())
+		IndexNode(index, scene, node);
+}
+
+static hg::Node ResolveNode(const NodeNameIndex &index, const hg::Scene &scene, NodePathHandle handle) {
+	if (handle.id >= index.nodes.size())
+		return {};
+	const hg::NodeRef ref = index.nodes[handle.id];
+	return scene.IsValidNodeRef(ref) ? scene.GetNode(ref) : hg::Node{};
+}
+
+static hg::Node FindNode(const NodeNameIndex &index, const hg::Scene &scene, const std::string &path) {
+	const auto i = index.path_ids.find(path);
+	return i != index.path_ids.end() ? ResolveNode(index, scene, {i->second}) : hg::Node{};
+}
+
+// Instance creation and destruction going through the index, nodes must not be destroyed behind its back.
+static hg::Node CreateIndexedInstance(hg::Scene &scene, NodeNameIndex &index, const std::string &name, const hg::Mat4 &world, const std::string &path,
+	hg::PipelineResources &resources) {
+	bool success;
+	hg::Node node = hg::CreateInstanceFromAssets(scene, world, path, resources, hg::GetForwardPipelineInfo(), success);
+	node.SetName(name);
+	IndexNode(index, scene, node);
+	return node;
+}
+
+static void DestroyIndexedNode(hg::Scene &scene, NodeNameIndex &index, const hg::Node &node) {
+	UnindexNode(index, node.ref);
+	scene.DestroyNode(node);
+}
+
+int main(int narg, const char **args) {
+	// create window.
+	hg::InputInit();
+	hg::WindowSystemInit();
+
+	int res_x = 1280, res_y = 720;
+
+	hg::Window *window = hg::RenderInit("Harfang - Node Name Index", res_x, res_y, BGFX_RESET_VSYNC | BGFX_RESET_MSAA_X4);
+	if (!window) {
+		hg::error("failed to create window.");
+		return EXIT_FAILURE;
+	}
+
+	// access compiled resources
+	hg::AddAssetsFolder("resources_compiled");
+
+	// create forward pipeline and resources.
+	hg::ForwardPipeline pipeline = hg::CreateForwardPipeline();
+	hg::PipelineResources res = hg::PipelineResources();
+
+	// load host scene and index it
+	hg::Scene scene;
+	hg::LoadSceneContext load_ctx;
+	hg::LoadSceneFromAssets("playground/playground.scn", scene, res, hg::GetForwardPipelineInfo(), load_ctx);
+
+	NodeNameIndex index;
+	BuildNodeNameIndex(index, scene);
+
+	// spawn bipeds, each one is an instance of a few hundred nodes
+	std::vector<hg::Node> bipeds;
+	int biped_counter = 0;
+
+	const auto spawn_biped = [&]() {
+		const hg::Mat4 world = hg::TransformationMat4(hg::RandomVec3(hg::Vec3(-10.f, 0.f, -10.f), hg::Vec3(10.f, 0.f, 10.f)), hg::Deg3(0.f, hg::FRand(360.f), 0.f));
+		bipeds.push_back(CreateIndexedInstance(scene, index, hg::format("biped_%1").arg(biped_counter++), world, "biped/biped.scn", res));
+	};
+
+	for (int i = 0; i < 40; ++i)
+		spawn_biped();
+
+	// text rendering
+	hg::Font font = hg::LoadFontFromAssets("font/default.ttf", 16);
+	bgfx::ProgramHandle font_program = hg::LoadProgramFromAssets("core/shader/font");
+
+	std::vector<hg::UniformSetValue> text_uniform_values = {hg::MakeUniformSetValue("u_color", hg::Vec4(1.f, 1.f, 0.5f))};
+	hg::RenderState text_render_state = hg::ComputeRenderState(hg::BM_Alpha, hg::DT_Always, hg::FC_Disabled);
+
+	// benchmark lookup set: random biped heads, rebuilt every frame outside of the timed sections
+	const int lookup_count = 1000;
+
+	std::vector<std::string> lookup_instances, lookup_paths;
+	std::vector<NodePathHandle> lookup_handles;
+	std::vector<hg::NodeRef> expected;
+
+	float get_node_ms = 0.f, find_ms = 0.f, resolve_ms = 0.f;
+	int mismatches = 0;
+
+	float angle = 0.f;
+
+	hg::Keyboard keyboard;
+
+	// game loop
+	while (!keyboard.Pressed(hg::K_Escape) && hg::IsWindowOpen(window)) {
+		hg::time_ns dt = hg::tick_clock();
+
+		keyboard.Update();
+
+		if (keyboard.Pressed(hg::K_S))
+			for (int i = 0; i < 10; ++i)
+				spawn_biped();
+
+		if (keyboard.Pressed(hg::K_D) && !bipeds.empty()) {
+			const int n = std::min(int(bipeds.size()), 10);
+			for (int i = 0; i < n; ++i)
+				DestroyIndexedNode(scene, index, bipeds[i]);
+			bipeds.erase(bipeds.begin(), bipeds.begin() + n);
+			scene.GarbageCollect();
+		}
+
+		// random lookups over every biped ever spawned, destroyed ones must resolve to an invalid node
+		lookup_instances.resize(lookup_count);
+		lookup_paths.resize(lookup_count);
+		lookup_handles.resize(lookup_count);
+		expected.resize(lookup_count);
+
+		for (int i = 0; i < lookup_count; ++i) {
+			lookup_instances[i] = hg::format("biped_%1").arg(int(hg::Rand(uint32_t(std::max(biped_counter, 1)))));
+			lookup_paths[i] = lookup_instances[i] + "/Bip001 Head";
+			lookup_handles[i] = InternNodePath(index, lookup_paths[i]);
+		}
+
+		// Scene::GetNode on the instance name then on the instance view
+		hg::time_ns t = hg::time_now();
+		for (int i = 0; i < lookup_count; ++i) {
+			const hg::Node instance = scene.GetNode(lookup_instances[i]);
+			if (instance.IsValid())
+				expected[i] = instance.GetInstanceSceneView().GetNode(scene, "Bip001 Head").ref;
+			else
+				expected[i] = hg::InvalidNodeRef;
+		}
+		get_node_ms = hg::time_to_ms_f(hg::time_now() - t);
+
+		// hashed path lookup
+		t = hg::time_now();
+		mismatches = 0;
+		for (int i = 0; i < lookup_count; ++i) {
+			const hg::Node node = FindNode(index, scene, lookup_paths[i]);
+			if ((node.IsValid() ? node.ref : hg::InvalidNodeRef) != expected[i])
+				++mismatches;
+		}
+		find_ms = hg::time_to_ms_f(hg::time_now() - t);
+
+		// interned handles
+		t = hg::time_now();
+		for (int i = 0; i < lookup_count; ++i) {
+			const hg::Node node = ResolveNode(index, scene, lookup_handles[i]);
+			if ((node.IsValid() ? node.ref : hg::InvalidNodeRef) != expected[i])
+				++mismatches;
+		}
+		resolve_ms = hg::time_to_ms_f(hg::time_now() - t);
+
+		// hot loop use: nod the heads looked up this frame through their handle
+		angle += hg::time_to_sec_f(dt);
+		for (auto &handle : lookup_handles) {
+			hg::Node head = ResolveNode(index, scene, handle);
+			if (head.IsValid())
+				head.GetTransform().SetRot(hg::Vec3(hg::Sin(angle * 4.f) * 0.3f, 0.f, 0.f));
+		}
+
+		scene.Update(dt);
+
+		bgfx::ViewId view_id = 0;
+		hg::SceneForwardPipelinePassViewId views;
+
+		const hg::ViewState view_state = hg::ComputePerspectiveViewState(
+			hg::Mat4LookAt(hg::Vec3(0.f, 10.f, -14.f), hg::Vec3(0.f, 1.f, -4.f)), hg::Deg(45.f), 0.01f, 1000.f, hg::ComputeAspectRatioX(float(res_x), float(res_y)));
+		hg::SubmitSceneToPipeline(view_id, scene, hg::iRect(0, 0, res_x, res_y), view_state, pipeline, res, views);
+
+		// report
+		hg::SetView2D(view_id, 0, 0, res_x, res_y, -1, 1, BGFX_CLEAR_DEPTH, hg::Color::Black, 1, 0);
+
+		const std::string report = hg::format("%1 nodes, %2 indexed paths - %3 lookups: Scene::GetNode %4 ms, hashed path %5 ms, handle %6 ms, %7 mismatches")
+									   .arg(int(scene.GetAllNodeCount()))
+									   .arg(int(index.path_ids.size()))
+									   .arg(lookup_count)
+									   .arg(get_node_ms, 3)
+									   .arg(find_ms, 3)
+									   .arg(resolve_ms, 3)
+									   .arg(mismatches);
+		hg::DrawText(view_id, font, report, font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20, res_y - 40, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+		hg::DrawText(view_id, font, hg::format("S: spawn 10 bipeds, D: destroy 10 bipeds (%1 alive)").arg(int(bipeds.size())), font_program, "u_tex", 0, hg::Mat4::Identity,
+			hg::Vec3(20, res_y - 64, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+
+		bgfx::frame();
+		hg::UpdateWindow(window);
+	}
+
+	hg::RenderShutdown();
+	hg::DestroyWindow(window);
+
+	hg::WindowSystemShutdown();
+	hg::InputShutdown();
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,497 @@
+// HARFANG(R) Copyright (C) 2022 NWNC HARFANG. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+// CPU occlusion culling: the occluders (the city buildings) are rasterized into a low resolution depth buffer on worker
+// threads, the bounds of every object are then tested against it and the hidden objects are disabled before the scene is
+// submitted. Everything runs on the CPU, there is no GPU readback.
+// O toggles the culling, F freezes the culling camera and switches to a top view, V displays the occlusion buffer.
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define OCCLUSION_SSE2 1
+#endif
+
+#include <foundation/clock.h>
+#include <foundation/format.h>
+#include <foundation/log.h>
+#include <foundation/math.h>
+#include <foundation/matrix4.h>
+#include <foundation/matrix44.h>
+#include <foundation/projection.h>
+#include <foundation/rand.h>
+
+#include <platform/input_system.h>
+#include <platform/window_system.h>
+
+#include <engine/assets.h>
+#include <engine/create_geometry.h>
+#include <engine/font.h>
+#include <engine/forward_pipeline.h>
+#include <engine/render_pipeline.h>
+#include <engine/scene.h>
+#include <engine/scene_forward_pipeline.h>
+
+#include "worker_pool.h"
+
+// Low resolution depth buffer storing the 1/w of the nearest occluder, 0 being infinitely far away. 1/w is linear in
+// screen space so it can be interpolated directly across triangles. Each tile also stores the farthest value it
+// contains so that most occludee tests are decided without visiting individual pixels.
+struct OcclusionBuffer {
+	static const int width = 320, height = 176, tile_size = 8;
+	static const int tiles_x = width / tile_size, tiles_y = height / tile_size;
+
+	std::vector<float> depth = std::vector<float>(width * height);
+	std::vector<float> tile_min = std::vector<float>(tiles_x * tiles_y);
+};
+
+// Occluder triangle in buffer pixel coordinates.
+struct OccluderTriangle {
+	float x[3], y[3], inv_w[3];
+	float min_y, max_y;
+};
+
+// Unit cube corners and triangles, occluders and occludees are unit cubes transformed by their world matrix.
+static const hg::Vec3 cube_corners[8] = {{-0.5f, -0.5f, -0.5f}, {0.5f, -0.5f, -0.5f}, {0.5f, 0.5f, -0.5f}, {-0.5f, 0.5f, -0.5f}, {-0.5f, -0.5f, 0.5f},
+	{0.5f, -0.5f, 0.5f}, {0.5f, 0.5f, 0.5f}, {-0.5f, 0.5f, 0.5f}};
+static const uint8_t cube_triangles[12][3] = {
+	{0, 1, 2}, {0, 2, 3}, {5, 4, 7}, {5, 7, 6}, {4, 0, 3}, {4, 3, 7}, {1, 5, 6}, {1, 6, 2}, {3, 2, 6}, {3, 6, 7}, {4, 5, 1}, {4, 1, 0}};
+
+static hg::Vec4 ToClip(const hg::Mat44 &view_proj, const hg::Mat4 &world, const hg::Vec3 &p) { return view_proj * hg::Vec4(world * p, 1.f); }
+
+static void ClipToBuffer(const hg::Vec4 &c, float &x, float &y, float &inv_w) {
+	inv_w = 1.f / c.w;
+	x = (c.x * inv_w * 0.5f + 0.5f) * OcclusionBuffer::width;
+	y = (0.5f - c.y * inv_w * 0.5f) * OcclusionBuffer::height;
+}
+
+// Clip the occluder triangles against the near plane and project them to the buffer, back faces are kept so that the
+// winding of the occluder meshes does not matter.
+static void SetupOccluderTriangles(const hg::Mat44 &view_proj, const std::vector<hg::Mat4> &occluders, float z_near, std::vector<OccluderTriangle> &out) {
+	out.clear();
+
+	hg::Vec4 clip[8];
+	for (auto &world : occluders) {
+		for (int i = 0; i < 8; ++i)
+			clip[i] = ToClip(view_proj, world, cube_corners[i]);
+
+		for (auto &tri : cube_triangles) {
+			// Sutherland-Hodgman against w = z_near, produces up to 4 vertices
+			hg::Vec4 poly[4];
+			int n = 0;
+
+			for (int i = 0; i < 3; ++i) {
+				const hg::Vec4 &a = clip[tri[i]], &b = clip[tri[(i + 1) % 3]];
+				const float da = a.w - z_near, db = b.w - z_near;
+
+				if (da >= 0.f)
+					poly[n++] = a;
+				if ((da >= 0.f) != (db >= 0.f)) {
+					const float t = da / (da - db);
+					poly[n++] = hg::Vec4(a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, a.z + (b.z - a.z) * t, a.w + (b.w - a.w) * t);
+				}
+			}
+
+			for (int i = 2; i < n; ++i) {
+				OccluderTriangle t;
+				ClipToBuffer(poly[0], t.x[0], t.y[0], t.inv_w[0]);
+				ClipToBuffer(poly[i - 1], t.x[1], t.y[1], t.inv_w[1]);
+				ClipToBuffer(poly[i], t.x[2], t.y[2], t.inv_w[2]);
+
+				// make the winding counter-clockwise in buffer space
+				const float area = (t.x[1] - t.x[0]) * (t.y[2] - t.y[0]) - (t.x[2] - t.x[0]) * (t.y[1] - t.y[0]);
+				if (std::abs(area) < 1e-6f)
+					continue;
+				if (area < 0.f) {
+					std::swap(t.x[1], t.x[2]);
+					std::swap(t.y[1], t.y[2]);
+					std::swap(t.inv_w[1], t.inv_w[2]);
+				}
+
+				t.min_y = std::min(t.y[0], std::min(t.y[1], t.y[2]));
+				t.max_y = std::max(t.y[0], std::max(t.y[1], t.y[2]));
+
+				if (t.max_y >= 0.f && t.min_y < OcclusionBuffer::height)
+					out.push_back(t);
+			}
+		}
+	}
+}
+
+// Rasterize every triangle overlapping a row of tiles, rows do not share pixels and are rasterized concurrently.
+static void RasterizeTileRow(OcclusionBuffer &buffer, const std::vector<OccluderTriangle> &triangles, int tile_row) {
+	const int row_y0 = tile_row * OcclusionBuffer::tile_size, row_y1 = row_y0 + OcclusionBuffer::tile_size;
+
+	float *depth = buffer.depth.data();
+	std::fill(depth + row_y0 * OcclusionBuffer::width, depth + row_y1 * OcclusionBuffer::width, 0.f);
+
+	for (auto &t : triangles) {
+		if (t.max_y < row_y0 || t.min_y >= row_y1)
+			continue;
+
+		// bounds are clamped as floats first, vertices close to the near plane project very far away
+		const float w = float(OcclusionBuffer::width);
+		const int x0 = int(std::floor(hg::Clamp(std::min(t.x[0], std::min(t.x[1], t.x[2])), 0.f, w))) & ~3; // 4 pixels aligned
+		const int x1 = int(std::ceil(hg::Clamp(std::max(t.x[0], std::max(t.x[1], t.x[2])), 0.f, w)));
+		const int y0 = int(std::floor(hg::Clamp(t.min_y, float(row_y0), float(row_y1)))), y1 = int(std::ceil(hg::Clamp(t.max_y, float(row_y0), float(row_y1))));
+
+		// edge functions e_i(x, y) = a_i * x + b_i * y + c_i, positive inside
+		float a[3], b[3], c[3];
+		for (int i = 0; i < 3; ++i) {
+			const int j = (i + 1) % 3;
+			a[i] = t.y[i] - t.y[j];
+			b[i] = t.x[j] - t.x[i];
+			c[i] = t.x[i] * t.y[j] - t.x[j] * t.y[i];
+		}
+
+		const float inv_area = 1.f / (c[0] + c[1] + c[2]);
+
+		// 1/w plane: z(x, y) = zx * x + zy * y + z0
+		const float l0_x = a[1] * inv_area, l0_y = b[1] * inv_area, l0_c = c[1] * inv_area; // barycentric of vertex 0 (opposite edge 1)
+		const float l1_x = a[2] * inv_area, l1_y = b[2] * inv_area, l1_c = c[2] * inv_area; // barycentric of vertex 1 (opposite edge 2)
+		const float zx = t.inv_w[0] * l0_x + t.inv_w[1] * l1_x + t.inv_w[2] * (-l0_x - l1_x);
+		const float zy = t.inv_w[0] * l0_y + t.inv_w[1] * l1_y + t.inv_w[2] * (-l0_y - l1_y);
+		const float z0 = t.inv_w[0] * l0_c + t.inv_w[1] * l1_c + t.inv_w[2] * (1.f - l0_c - l1_c);
+
+		for (int y = y0; y < y1; ++y) {
+			const float py = float(y) + 0.5f;
+			float *row = depth + y * OcclusionBuffer::width;
+
+#if OCCLUSION_SSE2
+			const __m128 step = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+			for (int x = x0; x < x1; x += 4) {
+				const __m128 px = _mm_add_ps(_mm_set1_ps(float(x)), step);
+
+				const __m128 e0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[0]), px), _mm_set1_ps(b[0] * py + c[0]));
+				const __m128 e1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[1]), px), _mm_set1_ps(b[1] * py + c[1]));
+				const __m128 e2 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[2]), px), _mm_set1_ps(b[2] * py + c[2]));
+
+				const __m128 inside = _mm_cmpge_ps(_mm_min_ps(e0, _mm_min_ps(e1, e2)), _mm_setzero_ps());
+				if (!_mm_movemask_ps(inside))
+					continue;
+
+				const __m128 z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(zx), px), _mm_set1_ps(zy * py + z0));
+				const __m128 current = _mm_loadu_ps(row + x);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, _mm_max_ps(current, z)), _mm_andnot_ps(inside, current)));
+			}
+#else
+			for (int x = x0; x < x1; ++x) {
+				const float px = float(x) + 0.5f;
+				if (a[0] * px + b[0] * py + c[0] < 0.f || a[1] * px + b[1] * py + c[1] < 0.f || a[2] * px + b[2] * py + c[2] < 0.f)
+					continue;
+				row[x] = std::max(row[x], zx * px + zy * py + z0);
+			}
+#endif
+		}
+	}
+
+	// farthest value of each tile in the row
+	for (int tx = 0; tx < OcclusionBuffer::tiles_x; ++tx) {
+		float tile_min = std::numeric_limits<float>::max();
+		for (int y = row_y0; y < row_y1; ++y)
+			for (int x = tx * OcclusionBuffer::tile_size; x < (tx + 1) * OcclusionBuffer::tile_size; ++x)
+				tile_min = std::min(tile_min, depth[y * OcclusionBuffer::width + x]);
+		buffer.tile_min[tile_row * OcclusionBuffer::tiles_x + tx] = tile_min;
+	}
+}
+
+enum OcclusionResult : uint8_t { OR_Visible, OR_Occluded, OR_Outside };
+
+// Test the screen bounds of a transformed unit cube against the buffer. Bounds crossing the near plane are visible,
+// bounds entirely outside of the buffer are left to the frustum culling of the pipeline.
+static OcclusionResult TestOccludee(const OcclusionBuffer &buffer, const hg::Mat44 &view_proj, const hg::Mat4 &world, float z_near) {
+	float min_x = std::numeric_limits<float>::max(), min_y = min_x, max_x = -min_x, max_y = -min_x, max_inv_w = 0.f;
+
+	for (auto &corner : cube_corners) {
+		const hg::Vec4 c = ToClip(view_proj, world, corner);
+		if (c.w < z_near)
+			return OR_Visible;
+
+		float x, y, inv_w;
+		ClipToBuffer(c, x, y, inv_w);
+
+		min_x = std::min(min_x, x);
+		max_x = std::max(max_x, x);
+		min_y = std::min(min_y, y);
+		max_y = std::max(max_y, y);
+		max_inv_w = std::max(max_inv_w, inv_w);
+	}
+
+	const float w = float(OcclusionBuffer::width), h = float(OcclusionBuffer::height);
+	const int x0 = int(std::floor(hg::Clamp(min_x, 0.f, w))), x1 = int(std::ceil(hg::Clamp(max_x, 0.f, w)));
+	const int y0 = int(std::floor(hg::Clamp(min_y, 0.f, h))), y1 = int(std::ceil(hg::Clamp(max_y, 0.f, h)));
+
+	if (x0 >= x1 || y0 >= y1)
+		return OR_Outside;
+
+	const int ts = OcclusionBuffer::tile_size;
+	for (int ty = y0 / ts; ty <= (y1 - 1) / ts; ++ty)
+		for (int tx = x0 / ts; tx <= (x1 - 1) / ts; ++tx) {
+			if (buffer.tile_min[ty * OcclusionBuffer::tiles_x + tx] > max_inv_w)
+				continue; // every pixel of the tile is nearer than the occludee
+
+			for (int y = std::max(y0, ty * ts); y < std::min(y1, (ty + 1) * ts); ++y)
+				for (int x = std::max(x0, tx * ts); x < std::min(x1, (tx + 1) * ts); ++x)
+					if (buffer.depth[y * OcclusionBuffer::width + x] <= max_inv_w)
+						return OR_Visible;
+		}
+
+	return OR_Occluded;
+}
+
+int main(int narg, const char **args) {
+	// create window.
+	hg::InputInit();
+	hg::WindowSystemInit();
+
+	int res_x = 1280, res_y = 720;
+
+	hg::Window *window = hg::RenderInit("Harfang - Occlusion Culling", res_x, res_y, BGFX_RESET_VSYNC | BGFX_RESET_MSAA_X4);
+	if (!window) {
+		hg::error("failed to create window.");
+		return EXIT_FAILURE;
+	}
+
+	hg::AddAssetsFolder("resources_compiled");
+
+	// create forward pipeline and resources.
+	hg::ForwardPipeline pipeline = hg::CreateForwardPipeline();
+	hg::PipelineResources resources = hg::PipelineResources();
+
+	bgfx::VertexLayout vtx_layout = hg::VertexLayoutPosFloatNormUInt8();
+
+	hg::ModelRef cube_ref = resources.models.Add("cube", hg::CreateCubeModel(vtx_layout, 1.f, 1.f, 1.f));
+	hg::ModelRef sphere_ref = resources.models.Add("sphere", hg::CreateSphereModel(vtx_layout, 0.5f, 12, 24));
+	hg::ModelRef ground_ref = resources.models.Add("ground", hg::CreateCubeModel(vtx_layout, 200.f, 0.01f, 200.f));
+
+	hg::PipelineProgramRef prg = hg::LoadPipelineProgramRefFromAssets("core/shader/default.hps", resources, hg::GetForwardPipelineInfo());
+
+	hg::Material building_mat = hg::CreateMaterial(prg, "uDiffuseColor", hg::Vec4(0.6f, 0.6f, 0.65f), "uSpecularColor", hg::Vec4(0.1f, 0.1f, 0.1f));
+	hg::Material prop_mats[3] = {hg::CreateMaterial(prg, "uDiffuseColor", hg::Vec4(0.9f, 0.3f, 0.2f), "uSpecularColor", hg::Vec4::One),
+		hg::CreateMaterial(prg, "uDiffuseColor", hg::Vec4(0.2f, 0.7f, 0.3f), "uSpecularColor", hg::Vec4::One),
+		hg::CreateMaterial(prg, "uDiffuseColor", hg::Vec4(0.2f, 0.4f, 0.9f), "uSpecularColor", hg::Vec4::One)};
+	hg::Material ground_mat = hg::CreateMaterial(prg, "uDiffuseColor", hg::Vec4(0.3f, 0.3f, 0.3f), "uSpecularColor", hg::Vec4(0.1f, 0.1f, 0.1f));
+
+	// setup scene, camera and light.
+	hg::Scene scene;
+	scene.canvas.color = hg::Color(0.5f, 0.6f, 0.7f);
+	scene.environment.ambient = hg::Color(0.2f, 0.2f, 0.2f);
+
+	const float z_near = 0.1f, z_far = 500.f;
+
+	hg::Node camera = hg::CreateCamera(scene, hg::Mat4::Identity, z_near, z_far);
+	scene.SetCurrentCamera(camera);
+
+	hg::CreateLinearLight(scene, hg::TransformationMat4(hg::Vec3::Zero, hg::Deg3(50, 30, 0)), hg::Color::White, hg::Color::White);
+	hg::CreateObject(scene, hg::Mat4::Identity, ground_ref, {ground_mat});
+
+	// city blocks, each building is an occluder and an occludee
+	const int block_count = 10;
+	const float block_pitch = 14.f;
+
+	std::vector<hg::Node> nodes;
+	std::vector<hg::Mat4> occluders, occludees;
+
+	for (int j = 0; j < block_count; ++j)
+		for (int i = 0; i < block_count; ++i) {
+			const hg::Vec3 size(hg::FRRand(8.f, 11.f), hg::FRRand(4.f, 25.f), hg::FRRand(8.f, 11.f));
+			const hg::Vec3 pos((i - (block_count - 1) * 0.5f) * block_pitch, size.y * 0.5f, (j - (block_count - 1) * 0.5f) * block_pitch);
+			const hg::Mat4 world = hg::TransformationMat4(pos, hg::Vec3::Zero, size);
+
+			nodes.push_back(hg::CreateObject(scene, world, cube_ref, {building_mat}));
+			occluders.push_back(world);
+			occludees.push_back(world);
+		}
+
+	// props scattered in the streets
+	const float city_half_size = block_count * block_pitch * 0.5f;
+
+	while (occludees.size() < occluders.size() + 5000) {
+		const hg::Vec3 pos(hg::FRRand(-city_half_size, city_half_size), 0.f, hg::FRRand(-city_half_size, city_half_size));
+
+		bool inside_building = false;
+		for (auto &building : occluders) {
+			const hg::Vec3 d = pos - hg::GetT(building), half = hg::GetScale(building) * 0.5f + hg::Vec3(0.5f, 0.f, 0.5f);
+			if (std::abs(d.x) < half.x && std::abs(d.z) < half.z)
+				inside_building = true;
+		}
+		if (inside_building)
+			continue;
+
+		const float size = hg::FRRand(0.3f, 1.f);
+		const hg::Mat4 world = hg::TransformationMat4(hg::Vec3(pos.x, size * 0.5f, pos.z), hg::Vec3(0.f, hg::FRand(hg::Pi), 0.f), hg::Vec3(size, size, size));
+
+		nodes.push_back(hg::CreateObject(scene, world, hg::Rand(2) ? cube_ref : sphere_ref, {prop_mats[hg::Rand(3)]}));
+		occludees.push_back(world);
+	}
+
+	// occlusion state
+	OcclusionBuffer buffer;
+	std::vector<OccluderTriangle> triangles;
+	std::vector<uint8_t> results(occludees.size(), OR_Visible), enabled(occludees.size(), 1);
+
+	WorkerPool pool(std::max(int(std::thread::hardware_concurrency()), 1));
+
+	// occlusion buffer display
+	hg::Texture buffer_texture = hg::CreateTexture(OcclusionBuffer::width, OcclusionBuffer::height, "occlusion_buffer", BGFX_SAMPLER_POINT | BGFX_SAMPLER_U_CLAMP | BGFX_SAMPLER_V_CLAMP);
+	std::vector<uint32_t> buffer_pixels(OcclusionBuffer::width * OcclusionBuffer::height);
+
+	bgfx::VertexLayout quad_layout;
+	quad_layout.begin().add(bgfx::Attrib::Position, 3, bgfx::AttribType::Float).add(bgfx::Attrib::TexCoord0, 2, bgfx::AttribType::Float).end();
+
+	hg::Vertices quad_vtx(quad_layout, 4);
+	hg::Indices quad_idx;
+	quad_idx.insert(quad_idx.end(), {0, 1, 2, 0, 2, 3});
+
+	{
+		const float x0 = float(res_x - OcclusionBuffer::width * 2 - 20), y0 = 20.f, x1 = float(res_x - 20), y1 = y0 + OcclusionBuffer::height * 2;
+		quad_vtx.Begin(0).SetPos(hg::Vec3(x0, y0, 0.f)).SetTexCoord0(hg::Vec2(0.f, 0.f)).End();
+		quad_vtx.Begin(1).SetPos(hg::Vec3(x1, y0, 0.f)).SetTexCoord0(hg::Vec2(1.f, 0.f)).End();
+		quad_vtx.Begin(2).SetPos(hg::Vec3(x1, y1, 0.f)).SetTexCoord0(hg::Vec2(1.f, 1.f)).End();
+		quad_vtx.Begin(3).SetPos(hg::Vec3(x0, y1, 0.f)).SetTexCoord0(hg::Vec2(0.f, 1.f)).End();
+	}
+
+	bgfx::ProgramHandle quad_prg = hg::LoadProgramFromAssets("shaders/texture");
+	hg::RenderState quad_render_state = hg::ComputeRenderState(hg::BM_Opaque, hg::DT_Disabled, hg::FC_Disabled);
+
+	std::vector<hg::UniformSetValue> quad_values = {hg::MakeUniformSetValue("color", hg::Vec4::One)};
+	std::vector<hg::UniformSetTexture> quad_textures = {hg::MakeUniformSetTexture("s_tex", buffer_texture, 0)};
+
+	// text rendering
+	hg::Font font = hg::LoadFontFromAssets("font/default.ttf", 16);
+	bgfx::ProgramHandle font_program = hg::LoadProgramFromAssets("core/shader/font");
+
+	std::vector<hg::UniformSetValue> text_uniform_values = {hg::MakeUniformSetValue("u_color", hg::Vec4(1.f, 1.f, 0.5f))};
+	hg::RenderState text_render_state = hg::ComputeRenderState(hg::BM_Alpha, hg::DT_Always, hg::FC_Disabled);
+
+	// main loop.
+	bool culling = true, frozen = false, show_buffer = false;
+	float t = 0.f, setup_ms = 0.f, raster_ms = 0.f, test_ms = 0.f;
+	int occluded_count = 0, outside_count = 0;
+
+	const hg::Vec2 aspect_ratio = hg::ComputeAspectRatioX(float(res_x), float(res_y));
+	hg::ViewState cull_view_state;
+
+	hg::iRect viewport = hg::MakeRectFromWidthHeight(0, 0, res_x, res_y);
+	hg::SceneForwardPipelinePassViewId views;
+
+	hg::Keyboard keyboard;
+	while (!keyboard.Pressed(hg::K_Escape) && hg::IsWindowOpen(window)) {
+		keyboard.Update();
+
+		if (keyboard.Pressed(hg::K_O))
+			culling = !culling;
+		if (keyboard.Pressed(hg::K_F))
+			frozen = !frozen;
+		if (keyboard.Pressed(hg::K_V))
+			show_buffer = !show_buffer;
+
+		hg::time_ns dt = hg::tick_clock();
+
+		// street level camera walking up and down the central avenue, or a top view when the culling camera is frozen
+		if (!frozen) {
+			t += hg::time_to_sec_f(dt);
+			const hg::Vec3 pos(0.f, 1.8f, hg::Sin(t * 0.1f) * city_half_size * 0.9f);
+			const float yaw = (hg::Cos(t * 0.1f) > 0.f ? 0.f : hg::Pi) + hg::Sin(t * 0.5f) * hg::Deg(60.f);
+			camera.GetTransform().SetWorld(hg::TransformationMat4(pos, hg::Vec3(0.f, yaw, 0.f)));
+		} else {
+			camera.GetTransform().SetWorld(hg::Mat4LookAt(hg::Vec3(0.f, 180.f, -60.f), hg::Vec3::Zero));
+		}
+
+		scene.Update(dt);
+
+		const hg::ViewState view_state = scene.ComputeCurrentCameraViewState(aspect_ratio);
+		if (!frozen)
+			cull_view_state = view_state;
+
+		const hg::Mat44 view_proj = cull_view_state.proj * cull_view_state.view;
+
+		// occlusion culling
+		if (culling) {
+			hg::time_ns t_start = hg::time_now();
+			SetupOccluderTriangles(view_proj, occluders, z_near, triangles);
+			setup_ms = hg::time_to_ms_f(hg::time_now() - t_start);
+
+			t_start = hg::time_now();
+			pool.Run(OcclusionBuffer::tiles_y, 1, [&](size_t begin, size_t end) {
+				for (size_t row = begin; row < end; ++row)
+					RasterizeTileRow(buffer, triangles, int(row));
+			});
+			raster_ms = hg::time_to_ms_f(hg::time_now() - t_start);
+
+			t_start = hg::time_now();
+			pool.Run(occludees.size(), 128, [&](size_t begin, size_t end) {
+				for (size_t i = begin; i < end; ++i)
+					results[i] = TestOccludee(buffer, view_proj, occludees[i], z_near);
+			});
+			test_ms = hg::time_to_ms_f(hg::time_now() - t_start);
+		} else {
+			std::fill(results.begin(), results.end(), OR_Visible);
+		}
+
+		occluded_count = outside_count = 0;
+		for (size_t i = 0; i < occludees.size(); ++i) {
+			const uint8_t visible = results[i] != OR_Occluded;
+			if (visible != enabled[i]) {
+				if (visible)
+					nodes[i].Enable();
+				else
+					nodes[i].Disable();
+				enabled[i] = visible;
+			}
+			occluded_count += results[i] == OR_Occluded;
+			outside_count += results[i] == OR_Outside;
+		}
+
+		// send the scene to the forward rendering pipeline.
+		bgfx::ViewId view_id = 0;
+		hg::SubmitSceneToPipeline(view_id, scene, viewport, view_state, pipeline, resources, views);
+
+		// overlay
+		hg::SetView2D(view_id, 0, 0, res_x, res_y, -1, 1, BGFX_CLEAR_DEPTH, hg::Color::Black, 1, 0);
+
+		if (show_buffer && culling) {
+			for (size_t i = 0; i < buffer.depth.size(); ++i) {
+				const uint32_t v = uint32_t(std::min(buffer.depth[i] * 8.f, 1.f) * 255.f); // 1/w to a near = bright gray level
+				buffer_pixels[i] = 0xff000000 | (v << 16) | (v << 8) | v;
+			}
+			bgfx::updateTexture2D(buffer_texture.handle, 0, 0, 0, 0, OcclusionBuffer::width, OcclusionBuffer::height,
+				bgfx::copy(buffer_pixels.data(), uint32_t(buffer_pixels.size() * sizeof(uint32_t))));
+			hg::DrawTriangles(view_id, quad_idx, quad_vtx, quad_prg, quad_values, quad_textures, quad_render_state);
+		}
+
+		const std::string report = hg::format("%1 occluder triangles, %2 objects - %3 occluded, %4 outside the view - setup %5 ms, raster %6 ms, test %7 ms (%8 threads)")
+									   .arg(int(triangles.size()))
+									   .arg(int(occludees.size()))
+									   .arg(occluded_count)
+									   .arg(outside_count)
+									   .arg(setup_ms, 3)
+									   .arg(raster_ms, 3)
+									   .arg(test_ms, 3)
+									   .arg(pool.GetThreadCount());
+		hg::DrawText(view_id, font, report, font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20, res_y - 40, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+		hg::DrawText(view_id, font,
+			hg::format("O: occlusion culling (%1), F: freeze culling camera (%2), V: show occlusion buffer")
+				.arg(culling ? "on" : "off")
+				.arg(frozen ? "frozen" : "live"),
+			font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20, res_y - 64, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+
+		bgfx::frame();
+		hg::UpdateWindow(window);
+	}
+
+	bgfx::destroy(buffer_texture.handle);
+
+	hg::RenderShutdown();
+	hg::DestroyWindow(window);
+
+	hg::WindowSystemShutdown();
+	hg::InputShutdown();
+
+	return EXIT_SUCCESS;
+}
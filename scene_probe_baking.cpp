@@ -0,0 +1,705 @@
+// HARFANG(R) Copyright (C) 2022 NWNC HARFANG. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+// Runtime probe baking: an equirectangular HDR environment is projected to irradiance spherical harmonics and filtered
+// to a GGX prefiltered radiance cube map on the CPU, using worker threads and SIMD accumulation. Results are cached on
+// disk keyed by the hash of the source file and of the bake settings, a cached probe loads in a few milliseconds.
+// P switches the source environment, B toggles between the runtime baked probe and the probe compiled by assetc,
+// R forces a bake ignoring the cache.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define PROBE_SSE2 1
+#endif
+
+#include <foundation/clock.h>
+#include <foundation/dir.h>
+#include <foundation/format.h>
+#include <foundation/log.h>
+#include <foundation/math.h>
+#include <foundation/projection.h>
+
+#include <platform/input_system.h>
+#include <platform/window_system.h>
+
+#include <engine/assets.h>
+#include <engine/font.h>
+#include <engine/forward_pipeline.h>
+#include <engine/render_pipeline.h>
+#include <engine/scene.h>
+#include <engine/scene_forward_pipeline.h>
+
+#include "worker_pool.h"
+
+// 4 wide float accumulator, RGB plus a weight in the last lane.
+#if PROBE_SSE2
+struct Float4 {
+	__m128 v;
+
+	Float4() : v(_mm_setzero_ps()) {}
+	explicit Float4(__m128 v_) : v(v_) {}
+	Float4(float r, float g, float b, float w) : v(_mm_set_ps(w, b, g, r)) {}
+
+	Float4 operator+(const Float4 &o) const { return Float4(_mm_add_ps(v, o.v)); }
+	Float4 operator*(float k) const { return Float4(_mm_mul_ps(v, _mm_set1_ps(k))); }
+	Float4 &operator+=(const Float4 &o) { return v = _mm_add_ps(v, o.v), *this; }
+
+	void Store(float out[4]) const { _mm_storeu_ps(out, v); }
+};
+#else
+struct Float4 {
+	float v[4];
+
+	Float4() : v{0.f, 0.f, 0.f, 0.f} {}
+	Float4(float r, float g, float b, float w) : v{r, g, b, w} {}
+
+	Float4 operator+(const Float4 &o) const { return {v[0] + o.v[0], v[1] + o.v[1], v[2] + o.v[2], v[3] + o.v[3]}; }
+	Float4 operator*(float k) const { return {v[0] * k, v[1] * k, v[2] * k, v[3] * k}; }
+	Float4 &operator+=(const Float4 &o) { return *this = *this + o; }
+
+	void Store(float out[4]) const { memcpy(out, v, sizeof(v)); }
+};
+#endif
+
+//
+static bool ReadFile(const char *path, std::vector<uint8_t> &data) {
+	FILE *file = fopen(path, "rb");
+	if (!file)
+		return false;
+
+	long size = -1;
+	if (fseek(file, 0, SEEK_END) == 0)
+		size = ftell(file);
+
+	bool ok = size >= 0 && fseek(file, 0, SEEK_SET) == 0;
+	if (ok) {
+		data.resize(size_t(size));
+		ok = fread(data.data(), 1, data.size(), file) == data.size();
+	}
+	fclose(file);
+	return ok;
+}
+
+static uint64_t HashBytes(const void *data, size_t size, uint64_t hash = 0xcbf29ce484222325ull) {
+	const uint8_t *p = reinterpret_cast<const uint8_t *>(data);
+	for (size_t i = 0; i < size; ++i)
+		hash = (hash ^ p[i]) * 0x100000001b3ull; // FNV-1a
+	return hash;
+}
+
+// Equirectangular RGB float image with a box filtered mip chain used for filtered importance sampling.
+struct Equirect {
+	struct Level {
+		int width, height;
+		std::vector<float> rgb;
+	};
+	std::vector<Level> levels;
+};
+
+// Radiance RGBE (.hdr) decoder, supports flat and new style run length encoded scanlines.
+static bool DecodeRadianceHDR(const std::vector<uint8_t> &data, Equirect::Level &out) {
+	size_t p = 0;
+	const auto read_line = [&]() {
+		std::string line;
+		while (p < data.size() && data[p] != '\n')
+			line += char(data[p++]);
+		++p;
+		return line;
+	};
+
+	if (read_line().compare(0, 2, "#?") != 0)
+		return false;
+	while (p < data.size() && !read_line().empty())
+		;
+
+	if (sscanf(read_line().c_str(), "-Y %d +X %d", &out.height, &out.width) != 2 || out.width <= 0 || out.height <= 0)
+		return false;
+
+	out.rgb.resize(size_t(out.width) * out.height * 3);
+	std::vector<uint8_t> scanline(size_t(out.width) * 4);
+
+	for (int y = 0; y < out.height; ++y) {
+		if (p + 4 > data.size())
+			return false;
+
+		if (out.width >= 8 && out.width < 32768 && data[p] == 2 && data[p + 1] == 2 && ((data[p + 2] << 8) | data[p + 3]) == out.width) {
+			p += 4;
+			for (int c = 0; c < 4; ++c)
+				for (int x = 0; x < out.width && p < data.size();) {
+					int count = data[p++];
+					if (count > 128) {
+						count -= 128;
+						if (p >= data.size() || x + count > out.width)
+							return false;
+						for (int i = 0; i < count; ++i)
+							scanline[size_t(x + i) * 4 + c] = data[p];
+						++p;
+					} else {
+						if (count == 0 || p + count > data.size() || x + count > out.width)
+							return false;
+						for (int i = 0; i < count; ++i)
+							scanline[size_t(x + i) * 4 + c] = data[p++];
+					}
+					x += count;
+				}
+		} else {
+			if (p + scanline.size() > data.size())
+				return false;
+			memcpy(scanline.data(), &data[p], scanline.size());
+			p += scanline.size();
+		}
+
+		float *rgb = &out.rgb[size_t(y) * out.width * 3];
+		for (int x = 0; x < out.width; ++x) {
+			const uint8_t *rgbe = &scanline[size_t(x) * 4];
+			const float k = rgbe[3] ? std::ldexp(1.f, int(rgbe[3]) - 136) : 0.f;
+			rgb[x * 3 + 0] = rgbe[0] * k;
+			rgb[x * 3 + 1] = rgbe[1] * k;
+			rgb[x * 3 + 2] = rgbe[2] * k;
+		}
+	}
+	return true;
+}
+
+static void BuildEquirectMips(Equirect &env) {
+	while (env.levels.back().width > 8 && env.levels.back().height > 4) {
+		const Equirect::Level &src = env.levels.back();
+
+		Equirect::Level dst;
+		dst.width = src.width / 2;
+		dst.height = src.height / 2;
+		dst.rgb.resize(size_t(dst.width) * dst.height * 3);
+
+		for (int y = 0; y < dst.height; ++y)
+			for (int x = 0; x < dst.width; ++x)
+				for (int c = 0; c < 3; ++c) {
+					const size_t i = (size_t(y) * 2 * src.width + x * 2) * 3 + c, row = size_t(src.width) * 3;
+					dst.rgb[(size_t(y) * dst.width + x) * 3 + c] = (src.rgb[i] + src.rgb[i + 3] + src.rgb[i + row] + src.rgb[i + row + 3]) * 0.25f;
+				}
+
+		env.levels.push_back(std::move(dst));
+	}
+}
+
+// Direction to equirectangular coordinates, +Y up and the center of the image facing +Z.
+static Float4 SampleEquirect(const Equirect &env, int level, const hg::Vec3 &d) {
+	const Equirect::Level &l = env.levels[std::min(level, int(env.levels.size()) - 1)];
+
+	const float u = std::atan2(d.x, d.z) * (0.5f / hg::Pi) + 0.5f, v = std::acos(hg::Clamp(d.y, -1.f, 1.f)) / hg::Pi;
+	const int x = std::min(int(u * l.width), l.width - 1), y = std::min(int(v * l.height), l.height - 1);
+
+	const float *rgb = &l.rgb[(size_t(y) * l.width + x) * 3];
+	return Float4(rgb[0], rgb[1], rgb[2], 1.f);
+}
+
+// Cube map texel direction, bgfx face order (+X, -X, +Y, -Y, +Z, -Z).
+static hg::Vec3 CubeTexelDirection(int face, int x, int y, int size) {
+	const float u = (x + 0.5f) / size * 2.f - 1.f, v = (y + 0.5f) / size * 2.f - 1.f;
+
+	switch (face) {
+		case 0:
+			return hg::Normalize(hg::Vec3(1.f, -v, -u));
+		case 1:
+			return hg::Normalize(hg::Vec3(-1.f, -v, u));
+		case 2:
+			return hg::Normalize(hg::Vec3(u, 1.f, v));
+		case 3:
+			return hg::Normalize(hg::Vec3(u, -1.f, -v));
+		case 4:
+			return hg::Normalize(hg::Vec3(u, -v, 1.f));
+		default:
+			return hg::Normalize(hg::Vec3(-u, -v, -1.f));
+	}
+}
+
+static uint16_t FloatToHalf(float f) {
+	uint32_t x;
+	memcpy(&x, &f, 4);
+
+	const uint32_t sign = (x >> 16) & 0x8000;
+	const int exponent = int((x >> 23) & 0xff) - 127 + 15;
+	uint32_t mantissa = x & 0x7fffff;
+
+	if (exponent <= 0)
+		return uint16_t(sign); // flush denormals to zero
+	if (exponent >= 31)
+		return uint16_t(sign | 0x7c00); // overflow to infinity
+
+	mantissa += 0x1000; // round to nearest
+	if (mantissa & 0x800000)
+		return uint16_t(sign | ((exponent + 1) << 10));
+	return uint16_t(sign | (exponent << 10) | (mantissa >> 13));
+}
+
+// Bake settings, part of the cache key.
+struct ProbeBakeSettings {
+	uint32_t version = 2;
+	uint32_t irradiance_size = 32;
+	uint32_t radiance_size = 256;
+	uint32_t radiance_roughness_mips = 6; // roughness 0 to 1 over 256 to 8, the smaller mips repeat roughness 1
+	uint32_t sample_count = 96;
+};
+
+// The radiance cube map is uploaded with its full mip chain, down to 1x1.
+static uint32_t GetRadianceMipCount(const ProbeBakeSettings &settings) {
+	uint32_t count = 1;
+	while ((settings.radiance_size >> count) > 0)
+		++count;
+	return count;
+}
+
+// Baked probe, cube map texels are RGBA16F in the bgfx upload order (for each face, for each mip).
+struct BakedProbe {
+	float sh[9][3];
+	std::vector<uint16_t> irradiance, radiance;
+};
+
+struct ProbeBakeTimings {
+	float load_ms = 0.f, sh_ms = 0.f, irradiance_ms = 0.f, radiance_ms = 0.f, cache_ms = 0.f;
+	bool cache_hit = false;
+};
+
+// Real spherical harmonics basis up to l=2.
+static void EvaluateSH9(const hg::Vec3 &d, float y[9]) {
+	y[0] = 0.282095f;
+	y[1] = 0.488603f * d.y;
+	y[2] = 0.488603f * d.z;
+	y[3] = 0.488603f * d.x;
+	y[4] = 1.092548f * d.x * d.y;
+	y[5] = 1.092548f * d.y * d.z;
+	y[6] = 0.315392f * (3.f * d.z * d.z - 1.f);
+	y[7] = 1.092548f * d.x * d.z;
+	y[8] = 0.546274f * (d.x * d.x - d.y * d.y);
+}
+
+// Project the environment radiance to SH, rows are accumulated in parallel then reduced.
+static void ProjectSH9(const Equirect &env, WorkerPool &pool, float sh[9][3]) {
+	const Equirect::Level &l = env.levels[0];
+
+	std::vector<Float4> rows(size_t(l.height) * 9);
+
+	pool.Run(l.height, 8, [&](size_t begin, size_t end) {
+		for (size_t y = begin; y < end; ++y) {
+			const float theta = (y + 0.5f) / l.height * hg::Pi;
+			const float d_omega = (2.f * hg::Pi / l.width) * (hg::Pi / l.height) * std::sin(theta);
+
+			Float4 acc[9];
+			float basis[9];
+
+			for (int x = 0; x < l.width; ++x) {
+				const float phi = ((x + 0.5f) / l.width - 0.5f) * 2.f * hg::Pi;
+				const hg::Vec3 d(std::sin(theta) * std::sin(phi), std::cos(theta), std::sin(theta) * std::cos(phi));
+
+				EvaluateSH9(d, basis);
+
+				const float *rgb = &l.rgb[(y * l.width + x) * 3];
+				const Float4 radiance(rgb[0], rgb[1], rgb[2], 0.f);
+
+				for (int k = 0; k < 9; ++k)
+					acc[k] += radiance * (basis[k] * d_omega);
+			}
+
+			for (int k = 0; k < 9; ++k)
+				rows[y * 9 + k] = acc[k];
+		}
+	});
+
+	for (int k = 0; k < 9; ++k) {
+		Float4 sum;
+		for (int y = 0; y < l.height; ++y)
+			sum += rows[size_t(y) * 9 + k];
+
+		float v[4];
+		sum.Store(v);
+		sh[k][0] = v[0];
+		sh[k][1] = v[1];
+		sh[k][2] = v[2];
+	}
+}
+
+// Irradiance cube map from the SH, stores E(n) / pi so that it is directly multiplied by the diffuse albedo.
+static void BakeIrradiance(const float sh[9][3], uint32_t size, WorkerPool &pool, std::vector<uint16_t> &out) {
+	static const float band_scale[9] = {1.f, 2.f / 3.f, 2.f / 3.f, 2.f / 3.f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f}; // A_l / pi
+
+	out.resize(size_t(size) * size * 6 * 4);
+
+	pool.Run(6 * size, 4, [&](size_t begin, size_t end) {
+		for (size_t row = begin; row < end; ++row) {
+			const int face = int(row / size), y = int(row % size);
+			for (uint32_t x = 0; x < size; ++x) {
+				float basis[9];
+				EvaluateSH9(CubeTexelDirection(face, int(x), y, int(size)), basis);
+
+				float rgb[3] = {0.f, 0.f, 0.f};
+				for (int k = 0; k < 9; ++k)
+					for (int c = 0; c < 3; ++c)
+						rgb[c] += sh[k][c] * basis[k] * band_scale[k];
+
+				uint16_t *texel = &out[((size_t(face) * size + y) * size + x) * 4];
+				for (int c = 0; c < 3; ++c)
+					texel[c] = FloatToHalf(std::max(rgb[c], 0.f));
+				texel[3] = FloatToHalf(1.f);
+			}
+		}
+	});
+}
+
+static hg::Vec2 Hammersley(uint32_t i, uint32_t n) {
+	uint32_t bits = i;
+	bits = (bits << 16u) | (bits >> 16u);
+	bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xaaaaaaaau) >> 1u);
+	bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xccccccccu) >> 2u);
+	bits = ((bits & 0x0f0f0f0fu) << 4u) | ((bits & 0xf0f0f0f0u) >> 4u);
+	bits = ((bits & 0x00ff00ffu) << 8u) | ((bits & 0xff00ff00u) >> 8u);
+	return hg::Vec2(float(i) / float(n), float(bits) * 2.3283064365386963e-10f);
+}
+
+// GGX sample in tangent space (N = V = R assumption) with the source level to fetch it from.
+struct GGXSample {
+	hg::Vec3 l;
+	float n_dot_l;
+	int level;
+};
+
+// The sample set only depends on the roughness, it is computed once per mip and rotated to every texel.
+static std::vector<GGXSample> ComputeGGXSamples(float roughness, uint32_t count, const Equirect &env) {
+	const float a = roughness * roughness;
+	const float texel_solid_angle = 4.f * hg::Pi / (float(env.levels[0].width) * env.levels[0].height);
+
+	std::vector<GGXSample> samples;
+	for (uint32_t i = 0; i < count; ++i) {
+		const hg::Vec2 xi = Hammersley(i, count);
+
+		const float phi = 2.f * hg::Pi * xi.x;
+		const float cos_theta = std::sqrt((1.f - xi.y) / (1.f + (a * a - 1.f) * xi.y)), sin_theta = std::sqrt(1.f - cos_theta * cos_theta);
+		const hg::Vec3 h(sin_theta * std::cos(phi), sin_theta * std::sin(phi), cos_theta);
+
+		const hg::Vec3 l = h * (2.f * cos_theta) - hg::Vec3(0.f, 0.f, 1.f); // reflect V = N around H
+		if (l.z <= 0.f)
+			continue;
+
+		// filtered importance sampling, fetch from the level whose texel covers the sample solid angle
+		const float d = (a * a) / (hg::Pi * std::pow(cos_theta * cos_theta * (a * a - 1.f) + 1.f, 2.f));
+		const float pdf = d * 0.25f, sample_solid_angle = 1.f / (count * pdf + 1e-6f);
+		const float level = roughness > 0.f ? std::max(0.5f * std::log2(sample_solid_angle / texel_solid_angle) + 1.f, 0.f) : 0.f;
+
+		samples.push_back({l, l.z, int(level)});
+	}
+	return samples;
+}
+
+// GGX prefiltered radiance over the full mip chain, mip i holds roughness i / (N - 1) for the first N roughness mips and
+// roughness 1 below. Faces are processed row by row in parallel.
+static void BakeRadiance(const Equirect &env, const ProbeBakeSettings &settings, WorkerPool &pool, std::vector<uint16_t> &out) {
+	const uint32_t mip_count = GetRadianceMipCount(settings), roughness_mips = std::max(std::min(settings.radiance_roughness_mips, mip_count), 2u);
+
+	std::vector<size_t> mip_offsets;
+	size_t face_size = 0;
+	for (uint32_t mip = 0; mip < mip_count; ++mip) {
+		const size_t size = settings.radiance_size >> mip;
+		mip_offsets.push_back(face_size);
+		face_size += size * size * 4;
+	}
+	out.resize(face_size * 6);
+
+	std::vector<GGXSample> samples;
+	float samples_roughness = -1.f;
+
+	for (uint32_t mip = 0; mip < mip_count; ++mip) {
+		const uint32_t size = settings.radiance_size >> mip;
+		const float roughness = float(std::min(mip, roughness_mips - 1)) / float(roughness_mips - 1);
+
+		if (roughness != samples_roughness) { // the mips below the roughness range reuse the last sample set
+			samples = ComputeGGXSamples(roughness, settings.sample_count, env);
+			samples_roughness = roughness;
+		}
+
+		pool.Run(6 * size, 2, [&](size_t begin, size_t end) {
+			for (size_t row = begin; row < end; ++row) {
+				const int face = int(row / size), y = int(row % size);
+				uint16_t *texels = &out[face * face_size + mip_offsets[mip] + size_t(y) * size * 4];
+
+				for (uint32_t x = 0; x < size; ++x) {
+					const hg::Vec3 n = CubeTexelDirection(face, int(x), y, int(size));
+
+					Float4 acc;
+					if (mip == 0) {
+						acc = SampleEquirect(env, 0, n);
+					} else {
+						const hg::Vec3 up = std::abs(n.y) < 0.999f ? hg::Vec3(0.f, 1.f, 0.f) : hg::Vec3(1.f, 0.f, 0.f);
+						const hg::Vec3 t = hg::Normalize(hg::Cross(up, n)), b = hg::Cross(n, t);
+
+						for (auto &s : samples)
+							acc += SampleEquirect(env, s.level, t * s.l.x + b * s.l.y + n * s.l.z) * s.n_dot_l;
+					}
+
+					float v[4];
+					acc.Store(v);
+					const float k = v[3] > 0.f ? 1.f / v[3] : 0.f;
+
+					for (int c = 0; c < 3; ++c)
+						texels[x * 4 + c] = FloatToHalf(v[c] * k);
+					texels[x * 4 + 3] = FloatToHalf(1.f);
+				}
+			}
+		});
+	}
+}
+
+// Cache file: header, SH coefficients, irradiance texels then radiance texels.
+struct ProbeCacheHeader {
+	uint32_t magic = 0x42504748; // 'HGPB'
+	uint32_t version = 1;
+	uint64_t key = 0;
+	uint32_t irradiance_count = 0, radiance_count = 0;
+};
+
+static std::string GetProbeCachePath(uint64_t key) { return hg::format("probe_cache/%1.probe").arg(hg::format("%1_%2").arg(uint32_t(key >> 32)).arg(uint32_t(key))); }
+
+static bool LoadProbeFromCache(uint64_t key, BakedProbe &probe) {
+	std::vector<uint8_t> data;
+	if (!ReadFile(GetProbeCachePath(key).c_str(), data) || data.size() < sizeof(ProbeCacheHeader))
+		return false;
+
+	ProbeCacheHeader header;
+	memcpy(&header, data.data(), sizeof(header));
+	if (header.magic != ProbeCacheHeader().magic || header.version != ProbeCacheHeader().version || header.key != key)
+		return false;
+	if (data.size() != sizeof(header) + sizeof(probe.sh) + (size_t(header.irradiance_count) + header.radiance_count) * sizeof(uint16_t))
+		return false;
+
+	size_t offset = sizeof(header);
+	memcpy(probe.sh, &data[offset], sizeof(probe.sh));
+	offset += sizeof(probe.sh);
+
+	probe.irradiance.resize(header.irradiance_count);
+	memcpy(probe.irradiance.data(), &data[offset], probe.irradiance.size() * sizeof(uint16_t));
+	offset += probe.irradiance.size() * sizeof(uint16_t);
+
+	probe.radiance.resize(header.radiance_count);
+	memcpy(probe.radiance.data(), &data[offset], probe.radiance.size() * sizeof(uint16_t));
+	return true;
+}
+
+static void SaveProbeToCache(uint64_t key, const BakedProbe &probe) {
+	hg::MkDir("probe_cache");
+
+	const std::string path = GetProbeCachePath(key), tmp_path = path + ".tmp";
+
+	FILE *file = fopen(tmp_path.c_str(), "wb");
+	if (!file)
+		return;
+
+	ProbeCacheHeader header;
+	header.key = key;
+	header.irradiance_count = uint32_t(probe.irradiance.size());
+	header.radiance_count = uint32_t(probe.radiance.size());
+
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	ok = ok && fwrite(probe.sh, sizeof(probe.sh), 1, file) == 1;
+	ok = ok && fwrite(probe.irradiance.data(), sizeof(uint16_t), probe.irradiance.size(), file) == probe.irradiance.size();
+	ok = ok && fwrite(probe.radiance.data(), sizeof(uint16_t), probe.radiance.size(), file) == probe.radiance.size();
+	fclose(file);
+
+	// write then rename so that an interrupted write never leaves a truncated cache entry
+	remove(path.c_str());
+	if (!ok || rename(tmp_path.c_str(), path.c_str()) != 0)
+		remove(tmp_path.c_str());
+}
+
+// Bake a probe from an equirectangular .hdr file or fetch it from the cache.
+static bool BakeProbe(const char *path, const ProbeBakeSettings &settings, bool use_cache, WorkerPool &pool, BakedProbe &probe, ProbeBakeTimings &timings) {
+	timings = {};
+
+	hg::time_ns t = hg::time_now();
+
+	std::vector<uint8_t> data;
+	if (!ReadFile(path, data))
+		return false;
+
+	const uint64_t key = HashBytes(&settings, sizeof(settings), HashBytes(data.data(), data.size()));
+
+	if (use_cache && LoadProbeFromCache(key, probe)) {
+		timings.cache_ms = hg::time_to_ms_f(hg::time_now() - t);
+		timings.cache_hit = true;
+		return true;
+	}
+
+	Equirect env;
+	env.levels.resize(1);
+	if (!DecodeRadianceHDR(data, env.levels[0]))
+		return false;
+	BuildEquirectMips(env);
+	timings.load_ms = hg::time_to_ms_f(hg::time_now() - t);
+
+	t = hg::time_now();
+	ProjectSH9(env, pool, probe.sh);
+	timings.sh_ms = hg::time_to_ms_f(hg::time_now() - t);
+
+	t = hg::time_now();
+	BakeIrradiance(probe.sh, settings.irradiance_size, pool, probe.irradiance);
+	timings.irradiance_ms = hg::time_to_ms_f(hg::time_now() - t);
+
+	t = hg::time_now();
+	BakeRadiance(env, settings, pool, probe.radiance);
+	timings.radiance_ms = hg::time_to_ms_f(hg::time_now() - t);
+
+	t = hg::time_now();
+	SaveProbeToCache(key, probe);
+	timings.cache_ms = hg::time_to_ms_f(hg::time_now() - t);
+	return true;
+}
+
+// Upload the probe cube maps, replacing the textures previously held by the references.
+static void UploadProbe(const BakedProbe &probe, const ProbeBakeSettings &settings, hg::PipelineResources &resources, hg::TextureRef &irradiance_ref, hg::TextureRef &radiance_ref) {
+	const bgfx::TextureHandle irradiance = bgfx::createTextureCube(uint16_t(settings.irradiance_size), false, 1, bgfx::TextureFormat::RGBA16F, BGFX_SAMPLER_NONE,
+		bgfx::copy(probe.irradiance.data(), uint32_t(probe.irradiance.size() * sizeof(uint16_t))));
+	const bgfx::TextureHandle radiance = bgfx::createTextureCube(uint16_t(settings.radiance_size), true, 1, bgfx::TextureFormat::RGBA16F, BGFX_SAMPLER_NONE,
+		bgfx::copy(probe.radiance.data(), uint32_t(probe.radiance.size() * sizeof(uint16_t))));
+
+	const auto replace = [&](hg::TextureRef &ref, bgfx::TextureHandle handle, const char *name) {
+		if (resources.textures.IsValid(ref)) {
+			bgfx::destroy(resources.textures.Get(ref).handle);
+			resources.textures.Get(ref) = hg::MakeTexture(handle);
+		} else {
+			ref = resources.textures.Add(name, hg::MakeTexture(handle));
+		}
+	};
+
+	replace(irradiance_ref, irradiance, "baked_probe.irradiance");
+	replace(radiance_ref, radiance, "baked_probe.radiance");
+}
+
+int main(int narg, const char **args) {
+	// create window.
+	hg::InputInit();
+	hg::WindowSystemInit();
+
+	int res_x = 1280, res_y = 720;
+
+	hg::Window *window = hg::RenderInit("Harfang - Probe Baking", res_x, res_y, BGFX_RESET_VSYNC | BGFX_RESET_MSAA_X4);
+	if (!window) {
+		hg::error("failed to create window.");
+		return EXIT_FAILURE;
+	}
+
+	// access compiled resources
+	hg::AddAssetsFolder("resources_compiled");
+
+	// create forward pipeline and resources.
+	hg::ForwardPipeline pipeline = hg::CreateForwardPipeline();
+	hg::PipelineResources res = hg::PipelineResources();
+
+	// load scene
+	hg::Scene scene;
+	hg::LoadSceneContext load_ctx;
+	hg::LoadSceneFromAssets("materials/materials.scn", scene, res, hg::GetForwardPipelineInfo(), load_ctx);
+
+	hg::Node camera = scene.GetCurrentCamera();
+
+	// the probes compiled by assetc for comparison, and the source environments installed next to the executable
+	static const char *sources[2] = {"probe.hdr", "blue_sky.hdr"};
+
+	hg::TextureRef compiled_irradiance[2], compiled_radiance[2];
+	for (int i = 0; i < 2; ++i) {
+		compiled_irradiance[i] = hg::LoadTextureFromAssets(hg::format("core/pbr/%1.irradiance").arg(sources[i]).c_str(), 0, res);
+		compiled_radiance[i] = hg::LoadTextureFromAssets(hg::format("core/pbr/%1.radiance").arg(sources[i]).c_str(), 0, res);
+	}
+
+	ProbeBakeSettings settings;
+	WorkerPool pool(std::max(int(std::thread::hardware_concurrency()), 1));
+
+	BakedProbe probe;
+	ProbeBakeTimings timings;
+	hg::TextureRef baked_irradiance = hg::InvalidTextureRef, baked_radiance = hg::InvalidTextureRef;
+
+	int source = 0;
+	bool use_baked = true, bake_ok = false, bake = true, force_bake = false;
+
+	// text rendering
+	hg::Font font = hg::LoadFontFromAssets("font/default.ttf", 16);
+	bgfx::ProgramHandle font_program = hg::LoadProgramFromAssets("core/shader/font");
+
+	std::vector<hg::UniformSetValue> text_uniform_values = {hg::MakeUniformSetValue("u_color", hg::Vec4(1.f, 1.f, 0.5f))};
+	hg::RenderState text_render_state = hg::ComputeRenderState(hg::BM_Alpha, hg::DT_Always, hg::FC_Disabled);
+
+	float angle = 0.f;
+
+	hg::Keyboard keyboard;
+	while (!keyboard.Pressed(hg::K_Escape) && hg::IsWindowOpen(window)) {
+		keyboard.Update();
+
+		if (keyboard.Pressed(hg::K_P)) {
+			source = (source + 1) % 2;
+			bake = true;
+		}
+		if (keyboard.Pressed(hg::K_R))
+			bake = force_bake = true;
+		if (keyboard.Pressed(hg::K_B))
+			use_baked = !use_baked;
+
+		if (bake) {
+			bake_ok = BakeProbe(hg::format("probes/%1").arg(sources[source]).c_str(), settings, !force_bake, pool, probe, timings);
+			if (bake_ok)
+				UploadProbe(probe, settings, res, baked_irradiance, baked_radiance);
+			else
+				hg::error(hg::format("failed to bake probe from probes/%1").arg(sources[source]));
+			bake = force_bake = false;
+		}
+
+		scene.environment.probe.irradiance_map = use_baked && bake_ok ? baked_irradiance : compiled_irradiance[source];
+		scene.environment.probe.radiance_map = use_baked && bake_ok ? baked_radiance : compiled_radiance[source];
+
+		hg::time_ns dt = hg::tick_clock();
+
+		angle += hg::time_to_sec_f(dt) * 0.25f;
+		camera.GetTransform().SetWorld(hg::Mat4LookAt(hg::Vec3(hg::Sin(angle) * 8.f, 3.f, hg::Cos(angle) * 8.f), hg::Vec3::Zero));
+
+		scene.Update(dt);
+
+		bgfx::ViewId view_id = 0;
+		hg::SceneForwardPipelinePassViewId views;
+		hg::SubmitSceneToPipeline(view_id, scene, hg::iRect(0, 0, res_x, res_y), true, pipeline, res, views);
+
+		// report
+		hg::SetView2D(view_id, 0, 0, res_x, res_y, -1, 1, BGFX_CLEAR_DEPTH, hg::Color::Black, 1, 0);
+
+		std::string report;
+		if (!bake_ok)
+			report = hg::format("%1: bake failed").arg(sources[source]);
+		else if (timings.cache_hit)
+			report = hg::format("%1: loaded from cache in %2 ms").arg(sources[source]).arg(timings.cache_ms, 3);
+		else
+			report = hg::format("%1: baked on %2 threads - decode %3 ms, SH %4 ms, irradiance %5 ms, GGX radiance %6 ms, cache write %7 ms")
+						 .arg(sources[source])
+						 .arg(pool.GetThreadCount())
+						 .arg(timings.load_ms)
+						 .arg(timings.sh_ms)
+						 .arg(timings.irradiance_ms)
+						 .arg(timings.radiance_ms)
+						 .arg(timings.cache_ms);
+
+		hg::DrawText(view_id, font, report, font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20, res_y - 40, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+		hg::DrawText(view_id, font, hg::format("P: switch environment, B: probe (%1), R: bake ignoring the cache").arg(use_baked ? "runtime baked" : "compiled by assetc"), font_program,
+			"u_tex", 0, hg::Mat4::Identity, hg::Vec3(20, res_y - 64, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+
+		bgfx::frame();
+		hg::UpdateWindow(window);
+	}
+
+	hg::RenderShutdown();
+	hg::DestroyWindow(window);
+
+	hg::WindowSystemShutdown();
+	hg::InputShutdown();
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,312 @@
+// HARFANG(R) Copyright (C) 2022 NWNC HARFANG. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+// Cache shadow maps across frames using the low-level scene rendering API.
+// Spot shadow maps are rendered when preparing the view-independent render data and linear light cascades when
+// preparing the view-dependent render data. Skipping either preparation keeps the previous shadow maps.
+// Cascades are throttled individually: the near cascade is rendered every frame, the far ones every few frames. The
+// views of a skipped cascade are redirected to a throwaway target so that its slice of the shadow map and its shadow
+// matrix are kept from the frame it was last rendered.
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <vector>
+
+#include <foundation/clock.h>
+#include <foundation/format.h>
+#include <foundation/log.h>
+#include <foundation/projection.h>
+
+#include <platform/input_system.h>
+#include <platform/window_system.h>
+
+#include <engine/assets.h>
+#include <engine/create_geometry.h>
+#include <engine/font.h>
+#include <engine/forward_pipeline.h>
+#include <engine/render_pipeline.h>
+#include <engine/scene.h>
+#include <engine/scene_forward_pipeline.h>
+
+// Decide when the shadow maps need to be rendered again.
+// Lights and static casters moving invalidate the cache right away while dynamic casters only invalidate the spot
+// shadow map every 'dynamic_interval' frames and the linear light cascades at their own 'cascade_intervals' rate.
+class ShadowCache {
+public:
+	void SetStaticCasters(const std::vector<hg::NodeRef> &refs) { static_casters = refs; }
+	void SetLights(const std::vector<hg::NodeRef> &refs) { lights = refs; }
+
+	int dynamic_interval = 4;
+	int cascade_intervals[4] = {1, 2, 4, 8};
+	bool enabled = true;
+
+	// Returns true if the view-independent render data must be prepared this frame.
+	bool UpdateCommon(const hg::Scene &scene, bool dynamic_casters_moved) {
+		const bool static_changed = CaptureWorlds(scene, lights, light_worlds) | CaptureWorlds(scene, static_casters, static_worlds);
+		const size_t node_count = scene.GetNodeCount();
+
+		full_refresh = !enabled || !valid || static_changed || node_count != prev_node_count;
+
+		bool refresh = full_refresh;
+		if (!refresh && dynamic_casters_moved)
+			refresh = ++frames_since_refresh >= dynamic_interval;
+
+		if (refresh)
+			frames_since_refresh = 0;
+
+		prev_node_count = node_count;
+		valid = true;
+		return refresh;
+	}
+
+	// Returns true if the view-dependent render data must be prepared this frame.
+	bool UpdateView(const hg::ViewState &view_state, bool common_refreshed, bool dynamic_casters_moved) {
+		const bool view_changed = memcmp(&view_state.view, &prev_view.view, sizeof(hg::Mat4)) != 0 || memcmp(&view_state.proj, &prev_view.proj, sizeof(hg::Mat44)) != 0;
+		prev_view = view_state;
+		return !enabled || common_refreshed || view_changed || dynamic_casters_moved;
+	}
+
+	// Returns the mask of the cascades to render when the view-dependent render data is prepared. Every cascade is
+	// rendered after a full invalidation, otherwise the far cascades are staggered so that they do not all fall on the
+	// same frame.
+	uint32_t UpdateCascades() {
+		++cascade_frame;
+		if (full_refresh)
+			return 0xf;
+
+		uint32_t mask = 0;
+		for (int i = 0; i < 4; ++i)
+			if ((cascade_frame + i) % cascade_intervals[i] == 0)
+				mask |= 1 << i;
+		return mask;
+	}
+
+private:
+	static bool CaptureWorlds(const hg::Scene &scene, const std::vector<hg::NodeRef> &refs, std::vector<hg::Mat4> &worlds) {
+		bool changed = worlds.size() != refs.size();
+		worlds.resize(refs.size());
+
+		for (size_t i = 0; i < refs.size(); ++i) {
+			const hg::Mat4 world = scene.GetNodeWorldMatrix(refs[i]);
+			if (memcmp(&world, &worlds[i], sizeof(hg::Mat4)) != 0) {
+				worlds[i] = world;
+				changed = true;
+			}
+		}
+
+		return changed;
+	}
+
+	std::vector<hg::NodeRef> static_casters, lights;
+	std::vector<hg::Mat4> static_worlds, light_worlds;
+
+	hg::ViewState prev_view{};
+	size_t prev_node_count = 0;
+	int frames_since_refresh = 0, cascade_frame = 0;
+	bool valid = false, full_refresh = true;
+};
+
+int main() {
+	// create window.
+	hg::InputInit();
+	hg::WindowSystemInit();
+
+	int res_x = 1280, res_y = 720;
+
+	hg::Window *window = hg::RenderInit("Harfang - Shadow Cache", res_x, res_y, BGFX_RESET_VSYNC | BGFX_RESET_MSAA_X4);
+	if (!window) {
+		hg::error("failed to create window.");
+		return EXIT_FAILURE;
+	}
+
+	// access compiled resources
+	hg::AddAssetsFolder("resources_compiled");
+
+	// create forward pipeline and resources.
+	hg::ForwardPipeline pipeline = hg::CreateForwardPipeline(4096); // increase shadow map resolution to 4096x4096.
+	hg::PipelineResources res = hg::PipelineResources();
+
+	hg::SceneForwardPipelineRenderData render_data; // kept across frames, holds the cached shadow data
+
+	// the draws of skipped cascades land in this target, the shadow map keeps their previous content
+	hg::FrameBuffer discard_frame_buffer = hg::CreateFrameBuffer(1, 1, bgfx::TextureFormat::RGBA8, bgfx::TextureFormat::D24, 1, "shadow_cascade_discard");
+
+	hg::Mat44 cascade_mtx[4];
+	std::vector<bgfx::ViewId> discarded_views;
+
+	// create models.
+	bgfx::VertexLayout vtx_layout = hg::VertexLayoutPosFloatNormUInt8();
+
+	hg::ModelRef sphere_ref = res.models.Add("sphere", hg::CreateSphereModel(vtx_layout, 0.1f, 8, 16));
+	hg::ModelRef pillar_ref = res.models.Add("pillar", hg::CreateCubeModel(vtx_layout, 0.5f, 3.f, 0.5f));
+	hg::ModelRef ground_ref = res.models.Add("ground", hg::CreateCubeModel(vtx_layout, 60.f, 0.001f, 60.f));
+
+	// create materials.
+	hg::PipelineProgramRef prg = hg::LoadPipelineProgramRefFromAssets("core/shader/default.hps", res, hg::GetForwardPipelineInfo());
+
+	hg::Material sphere_mat = hg::CreateMaterial(prg, "uDiffuseColor", hg::Vec4(1, 0, 0), "uSpecularColor", hg::Vec4(1, 0.8f, 0));
+	hg::Material pillar_mat = hg::CreateMaterial(prg, "uDiffuseColor", hg::Vec4(0.6f, 0.6f, 0.7f), "uSpecularColor", hg::Vec4(0.2f, 0.2f, 0.2f));
+	hg::Material ground_mat = hg::CreateMaterial(prg, "uDiffuseColor", hg::Vec4(1, 1, 1), "uSpecularColor", hg::Vec4(1, 1, 1));
+
+	// setup scene, camera and lights.
+	hg::Scene scene;
+	scene.canvas.color = hg::Color(0.1f, 0.1f, 0.1f);
+	scene.environment.ambient = hg::Color(0.1f, 0.1f, 0.1f);
+
+	hg::Node camera = hg::CreateCamera(scene, hg::TransformationMat4(hg::Vec3(15.5f, 5, -6), hg::Vec3(0.4f, -1.2f, 0)), 0.01f, 100);
+	scene.SetCurrentCamera(camera);
+
+	hg::Node spot = hg::CreateSpotLight(scene, hg::TransformationMat4(hg::Vec3(-8.8f, 21.7f, -8.8f), hg::Deg3(60, 45, 0)), 0, hg::Deg(5.f), hg::Deg(30.f), hg::Color::White, hg::Color::White, 0, hg::LST_Map, 0.000005f);
+	hg::Node sun = hg::CreateLinearLight(scene, hg::TransformationMat4(hg::Vec3::Zero, hg::Deg3(30, 59, 0)), hg::Color(0.4f, 0.3f, 0.25f), hg::Color(0.4f, 0.3f, 0.25f), 10, hg::LST_Map, 0.002f, hg::Vec4(10, 20, 40, 80));
+
+	std::vector<hg::NodeRef> static_casters;
+	static_casters.push_back(hg::CreateObject(scene, hg::Mat4::Identity, ground_ref, {ground_mat}).ref);
+
+	for (int j = 0; j < 5; ++j)
+		for (int i = 0; i < 5; ++i)
+			static_casters.push_back(hg::CreateObject(scene, hg::TranslationMat4(hg::Vec3(-12.f + i * 6.f, 1.5f, -12.f + j * 6.f)), pillar_ref, {pillar_mat}).ref);
+
+	// dynamic casters: 100 by 100 spheres moving in a wave pattern.
+	std::vector<hg::Transform> rows;
+	int count = 100;
+	rows.reserve(count * count);
+	for (int j = 0; j < count; j++) {
+		for (int i = 0; i < count; i++) {
+			hg::Vec3 position = hg::Vec3(((2.f * i) / count - 1.f) * 10.f, 0.1f, ((2.f * j) / count - 1.f) * 10.f);
+			hg::Node node = hg::CreateObject(scene, hg::TranslationMat4(position), sphere_ref, {sphere_mat});
+			rows.push_back(node.GetTransform());
+		}
+	}
+
+	ShadowCache shadow_cache;
+	shadow_cache.SetStaticCasters(static_casters);
+	shadow_cache.SetLights({spot.ref, sun.ref});
+
+	// text overlay
+	hg::Font font = hg::LoadFontFromAssets("font/default.ttf", 16);
+	bgfx::ProgramHandle font_program = hg::LoadProgramFromAssets("core/shader/font");
+
+	hg::RenderState text_render_state = hg::ComputeRenderState(hg::BM_Alpha, hg::DT_Always, hg::FC_Disabled);
+	std::vector<hg::UniformSetValue> text_uniform_values = {hg::MakeUniformSetValue("u_color", hg::Vec4(1.f, 1.f, .5f, 1.f))};
+
+	// main loop.
+	float angle = 0.f;
+	bool animate_spheres = true;
+
+	size_t frame_count = 0, common_prepare_count = 0, cascade_prepare_counts[4] = {};
+	std::string stats = "";
+	hg::time_ns stats_delay = 0;
+
+	hg::iRect viewport = hg::MakeRectFromWidthHeight(0, 0, res_x, res_y);
+
+	hg::Keyboard keyboard;
+	while (!keyboard.Pressed(hg::K_Escape) && hg::IsWindowOpen(window)) {
+		keyboard.Update();
+
+		hg::time_ns dt = hg::tick_clock();
+
+		if (keyboard.Pressed(hg::K_Space))
+			shadow_cache.enabled = !shadow_cache.enabled;
+		if (keyboard.Pressed(hg::K_A))
+			animate_spheres = !animate_spheres;
+		if (keyboard.Pressed(hg::K_Add))
+			++shadow_cache.dynamic_interval;
+		if (keyboard.Pressed(hg::K_Sub) && shadow_cache.dynamic_interval > 1)
+			--shadow_cache.dynamic_interval;
+
+		// swing the spot light with the arrow keys, this invalidates the cache
+		if (keyboard.Down(hg::K_Left) || keyboard.Down(hg::K_Right)) {
+			hg::Transform trs = spot.GetTransform();
+			trs.SetRot(trs.GetRot() + hg::Vec3(0.f, (keyboard.Down(hg::K_Left) ? -1.f : 1.f) * hg::time_to_sec_f(dt), 0.f));
+		}
+
+		// move the spheres vertically in a wave pattern.
+		if (animate_spheres) {
+			angle += hg::time_to_sec_f(dt);
+
+			for (int j = 0; j < count; j++) {
+				float row_y = cos(angle + j * 0.1f);
+				for (int i = 0; i < count; i++) {
+					hg::Transform &trs = rows[i + (j * count)];
+					hg::Vec3 pos = trs.GetPos();
+					pos.y = 0.1f * (row_y * sin(angle + i * 0.1f) * 6.f + 6.5f);
+					trs.SetPos(pos);
+				}
+			}
+		}
+
+		scene.Update(dt);
+
+		// prepare render data only when the cache says so then submit the scene
+		const hg::ViewState view_state = scene.ComputeCurrentCameraViewState(hg::ComputeAspectRatioX(float(res_x), float(res_y)));
+
+		bgfx::ViewId view_id = 0;
+		hg::SceneForwardPipelinePassViewId views;
+
+		// views redirected last frame may be assigned to other passes this frame
+		for (auto id : discarded_views)
+			bgfx::setViewFrameBuffer(id, BGFX_INVALID_HANDLE);
+		discarded_views.clear();
+
+		const bool prepare_common = shadow_cache.UpdateCommon(scene, animate_spheres);
+		if (prepare_common) {
+			hg::PrepareSceneForwardPipelineCommonRenderData(view_id, scene, render_data, pipeline, res, views);
+			++common_prepare_count;
+		}
+
+		if (shadow_cache.UpdateView(view_state, prepare_common, animate_spheres)) {
+			hg::PrepareSceneForwardPipelineViewDependentRenderData(view_id, view_state, scene, render_data, pipeline, res, views);
+
+			// keep the shadow matrix and the shadow map slice of the cascades that are not due this frame
+			const uint32_t cascades = shadow_cache.UpdateCascades();
+
+			for (int i = 0; i < 4; ++i)
+				if (cascades & (1 << i)) {
+					cascade_mtx[i] = render_data.shadow_data.linear_shadow_mtx[i];
+					++cascade_prepare_counts[i];
+				} else {
+					render_data.shadow_data.linear_shadow_mtx[i] = cascade_mtx[i];
+
+					const bgfx::ViewId cascade_view = hg::GetSceneForwardPipelinePassViewId(views, hg::SceneForwardPipelinePass(hg::SFPP_Slot0LinearSplit0 + i));
+					bgfx::setViewFrameBuffer(cascade_view, discard_frame_buffer.handle);
+					bgfx::setViewRect(cascade_view, 0, 0, 1, 1);
+					discarded_views.push_back(cascade_view);
+				}
+		}
+
+		hg::SubmitSceneToForwardPipeline(view_id, scene, viewport, view_state, pipeline, render_data, res, views);
+
+		// shadow update rates, refreshed every second
+		++frame_count;
+		stats_delay -= dt;
+		if (stats_delay <= 0) {
+			stats = hg::format("Shadow cache %1 - spot maps rendered %2/%3 frames, cascades %4/%5/%6/%7 - dynamic casters every %8 frames")
+						.arg(shadow_cache.enabled ? "on" : "off")
+						.arg(common_prepare_count)
+						.arg(frame_count)
+						.arg(cascade_prepare_counts[0])
+						.arg(cascade_prepare_counts[1])
+						.arg(cascade_prepare_counts[2])
+						.arg(cascade_prepare_counts[3])
+						.arg(shadow_cache.dynamic_interval);
+			frame_count = common_prepare_count = 0;
+			std::fill(std::begin(cascade_prepare_counts), std::end(cascade_prepare_counts), 0);
+			stats_delay = hg::time_from_sec(1);
+		}
+
+		hg::SetView2D(view_id, 0, 0, res_x, res_y, -1, 1, BGFX_CLEAR_DEPTH, hg::Color::Black, 1, 0);
+		hg::DrawText(view_id, font, stats, font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20, res_y - 40, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+		hg::DrawText(view_id, font, "Space: toggle cache - A: toggle animation - +/-: dynamic caster interval - Left/Right: move light", font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20, res_y - 64, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+
+		bgfx::frame();
+		hg::UpdateWindow(window);
+	}
+
+	hg::DestroyFrameBuffer(discard_frame_buffer);
+	hg::DestroyForwardPipeline(pipeline);
+	hg::RenderShutdown();
+	hg::DestroyWindow(window);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,446 @@
+// HARFANG(R) Copyright (C) 2022 NWNC HARFANG. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+// Static batching: objects that never move and share a material are merged into combined world space vertex and index
+// buffers. Merged geometry is split over a grid of cells so that each batch keeps tight bounds and is still frustum
+// culled. The board from physics_pool_of_objects is surrounded by a field of static props and a few moving objects
+// which are left out of the merge.
+// B toggles between the batches and the source objects, C cycles the cell size, M merges the static objects again.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <foundation/clock.h>
+#include <foundation/format.h>
+#include <foundation/log.h>
+#include <foundation/math.h>
+#include <foundation/minmax.h>
+#include <foundation/projection.h>
+#include <foundation/rand.h>
+
+#include <platform/input_system.h>
+#include <platform/window_system.h>
+
+#include <engine/assets.h>
+#include <engine/create_geometry.h>
+#include <engine/font.h>
+#include <engine/forward_pipeline.h>
+#include <engine/render_pipeline.h>
+#include <engine/scene.h>
+#include <engine/scene_forward_pipeline.h>
+
+// CPU side triangle mesh, models do not keep their geometry once uploaded so the batcher works from these.
+struct Mesh {
+	std::vector<hg::Vec3> pos;
+	std::vector<hg::Vec3> normal;
+	std::vector<uint32_t> idx;
+};
+
+static void AddQuad(Mesh &mesh, const hg::Vec3 &a, const hg::Vec3 &b, const hg::Vec3 &c, const hg::Vec3 &d, const hg::Vec3 &n) {
+	const uint32_t base = uint32_t(mesh.pos.size());
+	mesh.pos.insert(mesh.pos.end(), {a, b, c, d});
+	mesh.normal.insert(mesh.normal.end(), {n, n, n, n});
+	mesh.idx.insert(mesh.idx.end(), {base, base + 2, base + 1, base, base + 3, base + 2});
+}
+
+static Mesh CreateCubeMesh(float x, float y, float z) {
+	const float hx = x * 0.5f, hy = y * 0.5f, hz = z * 0.5f;
+
+	Mesh mesh;
+	AddQuad(mesh, {-hx, -hy, -hz}, {-hx, hy, -hz}, {hx, hy, -hz}, {hx, -hy, -hz}, {0.f, 0.f, -1.f});
+	AddQuad(mesh, {hx, -hy, hz}, {hx, hy, hz}, {-hx, hy, hz}, {-hx, -hy, hz}, {0.f, 0.f, 1.f});
+	AddQuad(mesh, {-hx, -hy, hz}, {-hx, hy, hz}, {-hx, hy, -hz}, {-hx, -hy, -hz}, {-1.f, 0.f, 0.f});
+	AddQuad(mesh, {hx, -hy, -hz}, {hx, hy, -hz}, {hx, hy, hz}, {hx, -hy, hz}, {1.f, 0.f, 0.f});
+	AddQuad(mesh, {-hx, hy, -hz}, {-hx, hy, hz}, {hx, hy, hz}, {hx, hy, -hz}, {0.f, 1.f, 0.f});
+	AddQuad(mesh, {-hx, -hy, hz}, {-hx, -hy, -hz}, {hx, -hy, -hz}, {hx, -hy, hz}, {0.f, -1.f, 0.f});
+	return mesh;
+}
+
+static Mesh CreateCylinderMesh(float radius, float height, int subdiv) {
+	Mesh mesh;
+
+	const float hy = height * 0.5f;
+	for (int i = 0; i < subdiv; ++i) {
+		const float a0 = hg::TwoPi * float(i) / float(subdiv), a1 = hg::TwoPi * float(i + 1) / float(subdiv);
+		const hg::Vec3 d0(cosf(a0), 0.f, sinf(a0)), d1(cosf(a1), 0.f, sinf(a1));
+
+		// side, smooth normals
+		const uint32_t base = uint32_t(mesh.pos.size());
+		mesh.pos.insert(mesh.pos.end(), {d0 * radius + hg::Vec3(0.f, -hy, 0.f), d0 * radius + hg::Vec3(0.f, hy, 0.f), d1 * radius + hg::Vec3(0.f, hy, 0.f), d1 * radius + hg::Vec3(0.f, -hy, 0.f)});
+		mesh.normal.insert(mesh.normal.end(), {d0, d0, d1, d1});
+		mesh.idx.insert(mesh.idx.end(), {base, base + 2, base + 1, base, base + 3, base + 2});
+
+		// caps
+		for (float s : {1.f, -1.f}) {
+			const uint32_t cap = uint32_t(mesh.pos.size());
+			const hg::Vec3 n(0.f, s, 0.f);
+			mesh.pos.insert(mesh.pos.end(), {n * hy, d0 * radius + n * hy, d1 * radius + n * hy});
+			mesh.normal.insert(mesh.normal.end(), {n, n, n});
+			if (s > 0.f)
+				mesh.idx.insert(mesh.idx.end(), {cap, cap + 1, cap + 2});
+			else
+				mesh.idx.insert(mesh.idx.end(), {cap, cap + 2, cap + 1});
+		}
+	}
+	return mesh;
+}
+
+static hg::MinMax ComputeMinMax(const std::vector<hg::Vec3> &pos) {
+	hg::MinMax minmax(pos.empty() ? hg::Vec3::Zero : pos[0], pos.empty() ? hg::Vec3::Zero : pos[0]);
+	for (const auto &p : pos)
+		minmax.mn = hg::Min(minmax.mn, p), minmax.mx = hg::Max(minmax.mx, p);
+	return minmax;
+}
+
+// Upload a mesh with 16 bit indices, the mesh must hold at most 65536 vertices.
+static hg::Model MakeModel(const Mesh &mesh, const bgfx::VertexLayout &layout) {
+	const bgfx::Memory *vtx_mem = bgfx::alloc(uint32_t(mesh.pos.size() * layout.getStride()));
+	for (uint32_t i = 0; i < uint32_t(mesh.pos.size()); ++i) {
+		const float pos[4] = {mesh.pos[i].x, mesh.pos[i].y, mesh.pos[i].z, 1.f};
+		bgfx::vertexPack(pos, false, bgfx::Attrib::Position, layout, vtx_mem->data, i);
+		const float normal[4] = {mesh.normal[i].x, mesh.normal[i].y, mesh.normal[i].z, 0.f};
+		bgfx::vertexPack(normal, true, bgfx::Attrib::Normal, layout, vtx_mem->data, i);
+	}
+
+	const bgfx::Memory *idx_mem = bgfx::alloc(uint32_t(mesh.idx.size() * sizeof(uint16_t)));
+	for (size_t i = 0; i < mesh.idx.size(); ++i)
+		reinterpret_cast<uint16_t *>(idx_mem->data)[i] = uint16_t(mesh.idx[i]);
+
+	hg::DisplayList list;
+	list.vertex_buffer = bgfx::createVertexBuffer(vtx_mem, layout);
+	list.index_buffer = bgfx::createIndexBuffer(idx_mem);
+
+	hg::Model mdl;
+	mdl.lists.push_back(list);
+	mdl.bounds.push_back(ComputeMinMax(mesh.pos));
+	mdl.mats.push_back(0);
+	return mdl;
+}
+
+// An object registered for static batching. The source node keeps its transform and object, it is disabled while the
+// batches are active and enabled again when they are released.
+struct StaticObject {
+	hg::NodeRef node;
+	size_t mesh, material;
+};
+
+struct StaticBatch {
+	hg::NodeRef node;
+	hg::ModelRef model;
+	size_t object_count, vertex_count, triangle_count;
+};
+
+struct StaticBatchReport {
+	size_t object_count{}, skipped_count{}, batch_count{}, vertex_count{}, triangle_count{};
+	float merge_ms{};
+};
+
+// Merge the static objects per material and per cell of the XZ grid, an object goes to the cell holding the center of
+// its world bounds. A cell is split further when its vertices no longer fit 16 bit indices.
+static std::vector<StaticBatch> BuildStaticBatches(hg::Scene &scene, hg::PipelineResources &resources, const bgfx::VertexLayout &layout, const std::vector<Mesh> &meshes,
+	const std::vector<hg::Material> &materials, const std::vector<StaticObject> &objects, float cell_size, StaticBatchReport &report) {
+	const hg::time_ns t_start = hg::time_now();
+
+	report = {};
+
+	// bucket objects by (material, cell)
+	std::map<std::tuple<size_t, int, int>, std::vector<const StaticObject *>> buckets;
+
+	for (const auto &object : objects) {
+		hg::Node node = scene.GetNode(object.node);
+		if (!node.IsValid() || (node.HasRigidBody() && node.GetRigidBody().GetType() != hg::RBT_Static)) {
+			++report.skipped_count; // only objects that can never move are merged
+			continue;
+		}
+
+		const hg::Vec3 center = scene.GetNodeWorldMatrix(object.node) * hg::GetCenter(ComputeMinMax(meshes[object.mesh].pos));
+		const int cx = int(floorf(center.x / cell_size)), cz = int(floorf(center.z / cell_size));
+
+		buckets[std::make_tuple(object.material, cx, cz)].push_back(&object);
+	}
+
+	std::vector<StaticBatch> batches;
+
+	const auto flush = [&](Mesh &merged, size_t material, size_t object_count) {
+		if (merged.idx.empty())
+			return;
+
+		StaticBatch batch;
+		batch.model = resources.models.Add(hg::format("static_batch_%1").arg(int(batches.size())), MakeModel(merged, layout));
+		batch.node = hg::CreateObject(scene, hg::Mat4::Identity, batch.model, {materials[material]}).ref;
+		batch.object_count = object_count;
+		batch.vertex_count = merged.pos.size();
+		batch.triangle_count = merged.idx.size() / 3;
+		batches.push_back(batch);
+
+		report.vertex_count += batch.vertex_count;
+		report.triangle_count += batch.triangle_count;
+
+		merged = {};
+	};
+
+	for (const auto &bucket : buckets) {
+		Mesh merged;
+		size_t merged_count = 0;
+
+		for (const StaticObject *object : bucket.second) {
+			const Mesh &mesh = meshes[object->mesh];
+
+			if (merged.pos.size() + mesh.pos.size() > 65536) {
+				flush(merged, std::get<0>(bucket.first), merged_count);
+				merged_count = 0;
+			}
+
+			// normals are transformed by the inverse transpose so that non uniform scales keep them perpendicular
+			const hg::Mat4 world = scene.GetNodeWorldMatrix(object->node), inv_world = hg::Inverse(world);
+			const hg::Vec3 inv_x = hg::GetX(inv_world), inv_y = hg::GetY(inv_world), inv_z = hg::GetZ(inv_world);
+
+			const uint32_t base = uint32_t(merged.pos.size());
+			for (size_t i = 0; i < mesh.pos.size(); ++i) {
+				const hg::Vec3 &n = mesh.normal[i];
+				merged.pos.push_back(world * mesh.pos[i]);
+				merged.normal.push_back(hg::Normalize(hg::Vec3(hg::Dot(inv_x, n), hg::Dot(inv_y, n), hg::Dot(inv_z, n))));
+			}
+			for (uint32_t i : mesh.idx)
+				merged.idx.push_back(base + i);
+
+			scene.GetNode(object->node).Disable();
+			++merged_count;
+			++report.object_count;
+		}
+
+		flush(merged, std::get<0>(bucket.first), merged_count);
+	}
+
+	report.batch_count = batches.size();
+	report.merge_ms = hg::time_to_ms_f(hg::time_now() - t_start);
+	return batches;
+}
+
+// Destroy the batches and enable the source objects again.
+static void ReleaseStaticBatches(hg::Scene &scene, hg::PipelineResources &resources, const std::vector<StaticObject> &objects, std::vector<StaticBatch> &batches) {
+	for (const auto &batch : batches) {
+		scene.DestroyNode(batch.node);
+
+		hg::Model &mdl = resources.models.Get(batch.model);
+		for (auto &list : mdl.lists) {
+			bgfx::destroy(list.vertex_buffer);
+			bgfx::destroy(list.index_buffer);
+		}
+		resources.models.Destroy(batch.model);
+	}
+	batches.clear();
+	scene.GarbageCollect();
+
+	for (const auto &object : objects) {
+		hg::Node node = scene.GetNode(object.node);
+		if (node.IsValid())
+			node.Enable();
+	}
+}
+
+int main(int narg, const char **args) {
+	// create window.
+	hg::InputInit();
+	hg::WindowSystemInit();
+
+	int res_x = 1280, res_y = 720;
+
+	hg::Window *window = hg::RenderInit("Harfang - Static Batching", res_x, res_y, BGFX_RESET_VSYNC | BGFX_RESET_MSAA_X4);
+	if (!window) {
+		hg::error("failed to create window.");
+		return EXIT_FAILURE;
+	}
+
+	// access compiled resources
+	hg::AddAssetsFolder("resources_compiled");
+
+	// create forward pipeline and resources.
+	hg::ForwardPipeline pipeline = hg::CreateForwardPipeline();
+	hg::PipelineResources res = hg::PipelineResources();
+
+	bgfx::VertexLayout vs_decl;
+	vs_decl.begin().add(bgfx::Attrib::Position, 3, bgfx::AttribType::Float).add(bgfx::Attrib::Normal, 3, bgfx::AttribType::Uint8, true, true).end();
+
+	// source meshes, the individual objects are drawn from models built out of the same meshes
+	enum MeshIndex { MI_Ground, MI_WallLR, MI_WallTB, MI_Crate, MI_Pillar, MI_Count };
+
+	std::vector<Mesh> meshes(MI_Count);
+	meshes[MI_Ground] = CreateCubeMesh(30.f, 1.f, 30.f);
+	meshes[MI_WallLR] = CreateCubeMesh(1.f, 11.f, 32.f);
+	meshes[MI_WallTB] = CreateCubeMesh(32.f, 11.f, 1.f);
+	meshes[MI_Crate] = CreateCubeMesh(1.f, 1.f, 1.f);
+	meshes[MI_Pillar] = CreateCylinderMesh(0.5f, 1.f, 16);
+
+	std::vector<hg::ModelRef> models;
+	for (const auto &mesh : meshes)
+		models.push_back(res.models.Add(hg::format("mesh_%1").arg(int(models.size())), MakeModel(mesh, vs_decl)));
+
+	// materials
+	hg::PipelineProgramRef prg = hg::LoadPipelineProgramRefFromAssets("core/shader/default.hps", res, hg::GetForwardPipelineInfo());
+
+	const hg::Vec4 colors[] = {{0.5f, 0.5f, 0.5f}, {0.6f, 0.4f, 0.3f}, {0.3f, 0.5f, 0.7f}, {0.7f, 0.7f, 0.4f}, {0.4f, 0.6f, 0.4f}};
+
+	std::vector<hg::Material> materials;
+	for (const auto &color : colors)
+		materials.push_back(hg::CreateMaterial(prg, "uDiffuseColor", color, "uSpecularColor", hg::Vec4(0.1f, 0.1f, 0.1f)));
+
+	hg::Material moving_mat = hg::CreateMaterial(prg, "uDiffuseColor", hg::Vec4(1.f, 0.5f, 0.1f), "uSpecularColor", hg::Vec4::One);
+
+	// setup scene
+	hg::Scene scene;
+	scene.canvas.color = hg::ColorI(22, 56, 76);
+	scene.environment.ambient = hg::Color(0.1f, 0.1f, 0.1f);
+	scene.environment.fog_color = scene.canvas.color;
+	scene.environment.fog_near = 60.f;
+	scene.environment.fog_far = 160.f;
+
+	hg::Node camera = hg::CreateCamera(scene, hg::Mat4::Identity, 0.1f, 200.f);
+	scene.SetCurrentCamera(camera);
+
+	hg::CreateLinearLight(scene, hg::TransformationMat4(hg::Vec3::Zero, hg::Deg3(30.f, 59.f, 0.f)), hg::Color(1.f, 0.8f, 0.7f), hg::Color(1.f, 0.8f, 0.7f), 10.f, hg::LST_Map, 0.002f,
+		hg::Vec4(20.f, 50.f, 100.f, 200.f));
+
+	std::vector<StaticObject> static_objects;
+
+	const auto create_static = [&](size_t mesh, size_t material, const hg::Mat4 &world) {
+		hg::Node node = hg::CreateObject(scene, world, models[mesh], {materials[material]});
+		static_objects.push_back({node.ref, mesh, material});
+	};
+
+	// the board
+	create_static(MI_Ground, 0, hg::TranslationMat4(hg::Vec3(0.f, -.5f, 0.f)));
+	create_static(MI_WallLR, 0, hg::TranslationMat4(hg::Vec3(-15.5f, -.5f, 0.f)));
+	create_static(MI_WallLR, 0, hg::TranslationMat4(hg::Vec3(15.5f, -.5f, 0.f)));
+	create_static(MI_WallTB, 0, hg::TranslationMat4(hg::Vec3(0.f, -.5f, -15.5f)));
+	create_static(MI_WallTB, 0, hg::TranslationMat4(hg::Vec3(0.f, -.5f, 15.5f)));
+
+	// field of static props around it
+	hg::Seed(7);
+
+	for (int j = -60; j < 60; ++j)
+		for (int i = -60; i < 60; ++i) {
+			const hg::Vec3 pos(float(i) * 1.6f + hg::FRRand(-0.3f, 0.3f), 0.f, float(j) * 1.6f + hg::FRRand(-0.3f, 0.3f));
+			if (std::abs(pos.x) < 18.f && std::abs(pos.z) < 18.f)
+				continue;
+			if (hg::FRand() > 0.6f)
+				continue;
+
+			const bool pillar = hg::FRand() > 0.7f;
+			const hg::Vec3 scale = pillar ? hg::Vec3(0.6f, hg::FRRand(1.f, 4.f), 0.6f) : hg::Vec3(hg::FRRand(0.6f, 1.2f), hg::FRRand(0.6f, 1.4f), hg::FRRand(0.6f, 1.2f));
+
+			create_static(pillar ? MI_Pillar : MI_Crate, 1 + hg::Rand(4), hg::TransformationMat4(pos + hg::Vec3(0.f, scale.y * 0.5f, 0.f), hg::Vec3(0.f, hg::FRRand(0.f, hg::TwoPi), 0.f), scale));
+		}
+
+	// moving objects are never merged
+	std::vector<hg::Node> movers;
+	for (int i = 0; i < 16; ++i)
+		movers.push_back(hg::CreateObject(scene, hg::Mat4::Identity, models[MI_Crate], {moving_mat}));
+
+	scene.Update(0);
+
+	// merge at load
+	const float cell_sizes[] = {8.f, 16.f, 32.f, 64.f, 1000.f};
+	int cell_size_index = 1;
+
+	StaticBatchReport report;
+	std::vector<StaticBatch> batches = BuildStaticBatches(scene, res, vs_decl, meshes, materials, static_objects, cell_sizes[cell_size_index], report);
+	bool use_batches = true;
+
+	uint32_t draw_count_sources = 0, draw_count_batches = 0; // last draw count measured in each mode
+	bool previous_frame_batches = use_batches;
+
+	// text overlay
+	hg::Font font = hg::LoadFontFromAssets("font/default.ttf", 16);
+	bgfx::ProgramHandle font_program = hg::LoadProgramFromAssets("core/shader/font");
+
+	hg::RenderState text_render_state = hg::ComputeRenderState(hg::BM_Alpha, hg::DT_Always, hg::FC_Disabled);
+	std::vector<hg::UniformSetValue> text_uniform_values = {hg::MakeUniformSetValue("u_color", hg::Vec4(1.f, 1.f, .5f, 1.f))};
+
+	float t = 0.f;
+
+	// main loop
+	hg::Keyboard keyboard;
+	while (!keyboard.Pressed(hg::K_Escape) && hg::IsWindowOpen(window)) {
+		hg::time_ns dt = hg::tick_clock();
+
+		keyboard.Update();
+
+		bool rebuild = false;
+		if (keyboard.Pressed(hg::K_C)) {
+			cell_size_index = (cell_size_index + 1) % 5;
+			rebuild = use_batches;
+		}
+		if (keyboard.Pressed(hg::K_M))
+			rebuild = use_batches;
+
+		if (keyboard.Pressed(hg::K_B)) {
+			if (use_batches)
+				ReleaseStaticBatches(scene, res, static_objects, batches);
+			else
+				batches = BuildStaticBatches(scene, res, vs_decl, meshes, materials, static_objects, cell_sizes[cell_size_index], report);
+			use_batches = !use_batches;
+		} else if (rebuild) {
+			ReleaseStaticBatches(scene, res, static_objects, batches);
+			batches = BuildStaticBatches(scene, res, vs_decl, meshes, materials, static_objects, cell_sizes[cell_size_index], report);
+		}
+
+		// animate the moving objects and circle the camera over the field
+		t += hg::time_to_sec_f(dt);
+
+		for (size_t i = 0; i < movers.size(); ++i) {
+			const float a = t * 0.5f + float(i) * hg::TwoPi / float(movers.size());
+			movers[i].GetTransform().SetWorld(hg::TransformationMat4(hg::Vec3(cosf(a) * 8.f, 1.f + sinf(t * 2.f + float(i)), sinf(a) * 8.f), hg::Vec3(a, a * 2.f, 0.f)));
+		}
+
+		const float cam_angle = t * 0.1f;
+		camera.GetTransform().SetWorld(hg::Mat4LookAt(hg::Vec3(sinf(cam_angle) * 60.f, 22.f, cosf(cam_angle) * 60.f), hg::Vec3(sinf(cam_angle + 0.6f) * 20.f, 0.f, cosf(cam_angle + 0.6f) * 20.f)));
+
+		scene.Update(dt);
+
+		bgfx::ViewId view_id = 0;
+		hg::SceneForwardPipelinePassViewId views;
+		hg::SubmitSceneToPipeline(view_id, scene, hg::iRect(0, 0, res_x, res_y), true, pipeline, res, views);
+
+		// bgfx reports the statistics of the previous frame, overlay included
+		const bgfx::Stats *stats = bgfx::getStats();
+		(previous_frame_batches ? draw_count_batches : draw_count_sources) = stats->numDraw;
+		previous_frame_batches = use_batches;
+
+		hg::SetView2D(view_id, 0, 0, res_x, res_y, -1, 1, BGFX_CLEAR_DEPTH, hg::Color::Black, 1, 0);
+
+		const std::string info = hg::format("%1 - %2 draw calls (sources: %3, batches: %4)")
+									 .arg(use_batches ? "Static batches" : "Source objects")
+									 .arg(use_batches ? int(draw_count_batches) : int(draw_count_sources))
+									 .arg(int(draw_count_sources))
+									 .arg(int(draw_count_batches));
+		const std::string merge_info = hg::format("%1 static objects merged into %2 batches (cell size %3 m), %4 vertices, %5 triangles in %6 ms, %7 skipped")
+										   .arg(int(report.object_count))
+										   .arg(int(report.batch_count))
+										   .arg(cell_sizes[cell_size_index], 0)
+										   .arg(int(report.vertex_count))
+										   .arg(int(report.triangle_count))
+										   .arg(report.merge_ms)
+										   .arg(int(report.skipped_count));
+
+		hg::DrawText(view_id, font, info, font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20, res_y - 40, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+		hg::DrawText(view_id, font, merge_info, font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20, res_y - 64, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+		hg::DrawText(view_id, font, "B: toggle batches, C: cycle cell size, M: merge again", font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20, res_y - 88, 0), hg::DTHA_Left,
+			hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+
+		bgfx::frame();
+		hg::UpdateWindow(window);
+	}
+
+	hg::RenderShutdown();
+	hg::DestroyWindow(window);
+
+	hg::WindowSystemShutdown();
+	hg::InputShutdown();
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,690 @@
+// HARFANG(R) Copyright (C) 2022 NWNC HARFANG. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+// Transform stream: each frame the transforms that changed are quantized, delta encoded against the last published
+// state and pushed to a lock-free single producer/single consumer ring buffer in shared memory. A local observer process
+// reconstructs the scene state from the stream.
+// Run without argument to start the publisher (100k moving nodes), run a second instance with -reader to attach the
+// reference reader.
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <foundation/clock.h>
+#include <foundation/format.h>
+#include <foundation/log.h>
+#include <foundation/matrix4.h>
+
+#include <platform/input_system.h>
+#include <platform/window_system.h>
+
+#include <engine/assets.h>
+#include <engine/create_geometry.h>
+#include <engine/font.h>
+#include <engine/forward_pipeline.h>
+#include <engine/render_pipeline.h>
+#include <engine/scene.h>
+#include <engine/scene_forward_pipeline.h>
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2, "shared memory atomics must be lock-free");
+
+static const char *stream_name = "hg_transform_stream";
+static const uint32_t stream_magic = 0x53544748; // 'HGTS'
+static const uint32_t stream_capacity = 32 * 1024 * 1024; // must be a power of two
+
+// A stream whose publisher heartbeat does not move for this long was left behind by a publisher that crashed.
+static const hg::time_ns heartbeat_timeout = hg::time_from_sec(2);
+
+// Quantization steps: 1/1024 m for position, 1/8192 rad for rotation and 1/4096 for scale.
+static const float quantize_scale[3] = {1024.f, 8192.f, 4096.f};
+
+// Header at the start of the shared memory block, the ring buffer data follows it. The publisher stores the magic last
+// with release semantics, a reader must acquire it before reading the other fields. The write position is only
+// modified by the publisher and the read position only by the reader, both live on their own cache line.
+struct StreamHeader {
+	std::atomic<uint32_t> magic{0};
+	uint32_t version = 2;
+	uint32_t capacity = stream_capacity;
+	uint32_t node_count = 0;
+
+	alignas(64) std::atomic<uint64_t> write_pos{0};
+	alignas(64) std::atomic<uint64_t> read_pos{0};
+
+	std::atomic<uint32_t> reader_attached{0}, keyframe_request{0}, publisher_closed{0};
+	std::atomic<uint32_t> heartbeat{0}; // incremented by the publisher every frame
+};
+
+enum FrameFlags : uint32_t { FF_Keyframe = 1, FF_Checksum = 2 };
+
+// Each record in the ring is a frame header followed by the encoded node entries:
+// varint index gap, varint component mask, then one zigzag varint delta per component set in the mask.
+struct FrameRecordHeader {
+	uint32_t size; // including this header
+	uint32_t frame;
+	uint32_t change_count;
+	uint32_t flags;
+	uint64_t checksum;
+};
+
+static const int component_count = 9; // position, rotation, scale
+static const size_t max_entry_size = 5 + 2 + component_count * 5;
+
+// Named shared memory block.
+struct SharedMemory {
+	void *data = nullptr;
+	size_t size = 0;
+	bool owner = false;
+#if _WIN32
+	HANDLE mapping = nullptr;
+#else
+	int fd = -1;
+#endif
+};
+
+static bool OpenSharedMemory(SharedMemory &shm, const char *name, size_t size, bool create) {
+#if _WIN32
+	const std::string path = std::string("Local\\") + name;
+	shm.mapping = create ? CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, DWORD(uint64_t(size) >> 32), DWORD(size & 0xffffffff), path.c_str())
+						 : OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, path.c_str());
+	if (!shm.mapping)
+		return false;
+
+	shm.data = MapViewOfFile(shm.mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+	if (!shm.data) {
+		CloseHandle(shm.mapping);
+		shm.mapping = nullptr;
+		return false;
+	}
+#else
+	const std::string path = std::string("/") + name;
+	if (create)
+		shm_unlink(path.c_str()); // a crashed publisher leaves its segment behind, readers still mapping it see it stall
+
+	shm.fd = create ? shm_open(path.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600) : shm_open(path.c_str(), O_RDWR, 0);
+	if (shm.fd < 0)
+		return false;
+
+	// the segment is empty until the publisher sized it, mapping it earlier would fault on access
+	struct stat st;
+	if (!create && (fstat(shm.fd, &st) != 0 || size_t(st.st_size) < size)) {
+		close(shm.fd);
+		shm.fd = -1;
+		return false;
+	}
+
+	if (create && ftruncate(shm.fd, off_t(size)) != 0) {
+		close(shm.fd);
+		shm_unlink(path.c_str());
+		shm.fd = -1;
+		return false;
+	}
+
+	shm.data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, shm.fd, 0);
+	if (shm.data == MAP_FAILED) {
+		shm.data = nullptr;
+		close(shm.fd);
+		shm.fd = -1;
+		return false;
+	}
+#endif
+	shm.size = size;
+	shm.owner = create;
+	return true;
+}
+
+static void CloseSharedMemory(SharedMemory &shm, const char *name) {
+#if _WIN32
+	if (shm.data)
+		UnmapViewOfFile(shm.data);
+	if (shm.mapping)
+		CloseHandle(shm.mapping);
+	shm.mapping = nullptr;
+#else
+	if (shm.data)
+		munmap(shm.data, shm.size);
+	if (shm.fd >= 0)
+		close(shm.fd);
+	if (shm.owner)
+		shm_unlink((std::string("/") + name).c_str());
+	shm.fd = -1;
+#endif
+	shm.data = nullptr;
+}
+
+static size_t GetSharedMemorySize() { return sizeof(StreamHeader) + stream_capacity; }
+static uint8_t *GetRingData(StreamHeader *header) { return reinterpret_cast<uint8_t *>(header) + sizeof(StreamHeader); }
+
+// Ring buffer copies, a record may wrap around the end of the buffer.
+static void RingWrite(uint8_t *ring, uint64_t pos, const uint8_t *src, size_t size) {
+	const size_t at = size_t(pos & (stream_capacity - 1)), first = std::min<size_t>(size, stream_capacity - at);
+	memcpy(ring + at, src, first);
+	memcpy(ring, src + first, size - first);
+}
+
+static void RingRead(const uint8_t *ring, uint64_t pos, uint8_t *dst, size_t size) {
+	const size_t at = size_t(pos & (stream_capacity - 1)), first = std::min<size_t>(size, stream_capacity - at);
+	memcpy(dst, ring + at, first);
+	memcpy(dst + first, ring, size - first);
+}
+
+// LEB128 varint and zigzag encoding of the quantized deltas.
+static inline uint8_t *WriteVarint(uint8_t *p, uint32_t v) {
+	while (v >= 0x80) {
+		*p++ = uint8_t(v | 0x80);
+		v >>= 7;
+	}
+	*p++ = uint8_t(v);
+	return p;
+}
+
+static inline const uint8_t *ReadVarint(const uint8_t *p, uint32_t &v) {
+	v = 0;
+	for (int shift = 0;; shift += 7) {
+		const uint8_t b = *p++;
+		v |= uint32_t(b & 0x7f) << shift;
+		if (!(b & 0x80))
+			return p;
+	}
+}
+
+static inline uint32_t ZigZag(int32_t v) { return (uint32_t(v) << 1) ^ uint32_t(v >> 31); }
+static inline int32_t UnZigZag(uint32_t v) { return int32_t(v >> 1) ^ -int32_t(v & 1); }
+
+static void Quantize(const hg::Vec3 &pos, const hg::Vec3 &rot, const hg::Vec3 &scale, int32_t q[component_count]) {
+	const hg::Vec3 *trs[3] = {&pos, &rot, &scale};
+	for (int k = 0; k < 3; ++k) {
+		q[k * 3 + 0] = int32_t(std::lround(trs[k]->x * quantize_scale[k]));
+		q[k * 3 + 1] = int32_t(std::lround(trs[k]->y * quantize_scale[k]));
+		q[k * 3 + 2] = int32_t(std::lround(trs[k]->z * quantize_scale[k]));
+	}
+}
+
+// Order dependent checksum of a quantized state, computed by both sides to validate the reconstruction.
+static uint64_t ComputeChecksum(const std::vector<int32_t> &state) {
+	uint64_t sum = 0;
+	for (size_t i = 0; i < state.size(); ++i)
+		sum += uint64_t(uint32_t(state[i])) * (i + 1);
+	return sum;
+}
+
+// Publisher side, keeps the last published quantized state of every node.
+struct TransformStreamWriter {
+	std::vector<int32_t> sent;
+	std::vector<uint8_t> record;
+
+	uint32_t frame = 0;
+	bool keyframe_pending = true;
+
+	// last frame statistics
+	uint32_t change_count = 0, record_size = 0, dropped_frames = 0;
+	float encode_ms = 0.f;
+};
+
+static void InitTransformStreamWriter(TransformStreamWriter &writer, size_t node_count) {
+	writer.sent.assign(node_count * component_count, 0);
+	writer.record.resize(sizeof(FrameRecordHeader) + node_count * max_entry_size); // worst case, allocated once
+}
+
+// Encode the transforms that changed since the last published frame and push the record to the ring. If the reader
+// fell behind and the record does not fit, the frame is dropped and the next one is sent as a keyframe.
+static void PublishTransforms(StreamHeader &header, const std::vector<hg::Transform> &transforms, TransformStreamWriter &writer) {
+	const hg::time_ns t_start = hg::time_now();
+
+	++writer.frame;
+	writer.change_count = 0;
+	writer.record_size = 0;
+
+	if (!header.reader_attached.load(std::memory_order_acquire)) {
+		writer.keyframe_pending = true; // nobody listening, resync when a reader attaches
+		writer.encode_ms = 0.f;
+		return;
+	}
+
+	const bool keyframe = header.keyframe_request.exchange(0, std::memory_order_acq_rel) != 0 || writer.keyframe_pending;
+	if (keyframe)
+		std::fill(writer.sent.begin(), writer.sent.end(), 0); // a keyframe is a delta against the zero state
+
+	uint8_t *p = writer.record.data() + sizeof(FrameRecordHeader);
+
+	int32_t q[component_count];
+	uint32_t next_index = 0, change_count = 0;
+
+	for (uint32_t i = 0; i < uint32_t(transforms.size()); ++i) {
+		hg::Vec3 pos, rot, scale;
+		transforms[i].GetTRS(pos, rot, scale);
+		Quantize(pos, rot, scale, q);
+
+		int32_t *s = &writer.sent[size_t(i) * component_count];
+
+		uint32_t mask = 0;
+		for (int c = 0; c < component_count; ++c)
+			if (q[c] != s[c])
+				mask |= 1 << c;
+
+		if (!mask)
+			continue;
+
+		p = WriteVarint(p, i - next_index);
+		p = WriteVarint(p, mask);
+		for (int c = 0; c < component_count; ++c)
+			if (mask & (1 << c)) {
+				p = WriteVarint(p, ZigZag(q[c] - s[c]));
+				s[c] = q[c];
+			}
+
+		next_index = i + 1;
+		++change_count;
+	}
+
+	FrameRecordHeader record_header;
+	record_header.size = uint32_t(p - writer.record.data());
+	record_header.frame = writer.frame;
+	record_header.change_count = change_count;
+	record_header.flags = keyframe ? FF_Keyframe : 0;
+	record_header.checksum = 0;
+
+	if (keyframe || writer.frame % 60 == 0) {
+		record_header.flags |= FF_Checksum;
+		record_header.checksum = ComputeChecksum(writer.sent);
+	}
+
+	memcpy(writer.record.data(), &record_header, sizeof(FrameRecordHeader));
+
+	const uint64_t write_pos = header.write_pos.load(std::memory_order_relaxed);
+	const uint64_t read_pos = header.read_pos.load(std::memory_order_acquire);
+
+	if (write_pos - read_pos + record_header.size > stream_capacity) {
+		++writer.dropped_frames;
+		writer.keyframe_pending = true; // the sent state is now ahead of the reader
+	} else {
+		RingWrite(GetRingData(&header), write_pos, writer.record.data(), record_header.size);
+		header.write_pos.store(write_pos + record_header.size, std::memory_order_release);
+		writer.keyframe_pending = false;
+	}
+
+	writer.change_count = change_count;
+	writer.record_size = record_header.size;
+	writer.encode_ms = hg::time_to_ms_f(hg::time_now() - t_start);
+}
+
+// Reference reader, reconstructs the quantized state of every node from the stream.
+struct TransformStreamReader {
+	std::vector<int32_t> state;
+	std::vector<uint8_t> record;
+
+	bool synced = false;
+	uint32_t last_frame = 0;
+
+	// statistics since the last report
+	uint32_t frames = 0, changes = 0, missed_frames = 0, checksum_mismatches = 0;
+	uint64_t bytes = 0;
+	hg::time_ns decode_time = 0;
+};
+
+static hg::Mat4 GetNodeWorld(const TransformStreamReader &reader, size_t index) {
+	const int32_t *q = &reader.state[index * component_count];
+	const hg::Vec3 pos(q[0] / quantize_scale[0], q[1] / quantize_scale[0], q[2] / quantize_scale[0]);
+	const hg::Vec3 rot(q[3] / quantize_scale[1], q[4] / quantize_scale[1], q[5] / quantize_scale[1]);
+	const hg::Vec3 scale(q[6] / quantize_scale[2], q[7] / quantize_scale[2], q[8] / quantize_scale[2]);
+	return hg::TransformationMat4(pos, rot, scale);
+}
+
+// Consume every record available in the ring, returns the number of records read.
+static int ConsumeTransforms(StreamHeader &header, TransformStreamReader &reader) {
+	const uint8_t *ring = GetRingData(&header);
+
+	uint64_t read_pos = header.read_pos.load(std::memory_order_relaxed);
+	const uint64_t write_pos = header.write_pos.load(std::memory_order_acquire);
+
+	int count = 0;
+
+	while (read_pos < write_pos) {
+		const hg::time_ns t_start = hg::time_now();
+
+		FrameRecordHeader record_header;
+		RingRead(ring, read_pos, reinterpret_cast<uint8_t *>(&record_header), sizeof(FrameRecordHeader));
+
+		reader.record.resize(std::max<size_t>(reader.record.size(), record_header.size));
+		RingRead(ring, read_pos, reader.record.data(), record_header.size);
+		read_pos += record_header.size;
+
+		if (reader.synced && record_header.frame != reader.last_frame + 1)
+			reader.missed_frames += record_header.frame - reader.last_frame - 1; // dropped by the publisher, always followed by a keyframe
+
+		if (record_header.flags & FF_Keyframe) {
+			std::fill(reader.state.begin(), reader.state.end(), 0);
+			reader.synced = true;
+		}
+
+		if (reader.synced) {
+			const uint8_t *p = reader.record.data() + sizeof(FrameRecordHeader);
+			uint32_t index = 0;
+
+			for (uint32_t n = 0; n < record_header.change_count; ++n) {
+				uint32_t gap, mask;
+				p = ReadVarint(p, gap);
+				p = ReadVarint(p, mask);
+				index += gap;
+
+				int32_t *s = &reader.state[size_t(index) * component_count];
+				for (int c = 0; c < component_count; ++c)
+					if (mask & (1 << c)) {
+						uint32_t v;
+						p = ReadVarint(p, v);
+						s[c] += UnZigZag(v);
+					}
+
+				++index;
+			}
+
+			if ((record_header.flags & FF_Checksum) && ComputeChecksum(reader.state) != record_header.checksum)
+				++reader.checksum_mismatches;
+
+			reader.last_frame = record_header.frame;
+			++reader.frames;
+			reader.changes += record_header.change_count;
+			reader.bytes += record_header.size;
+		}
+
+		reader.decode_time += hg::time_now() - t_start;
+		++count;
+	}
+
+	header.read_pos.store(read_pos, std::memory_order_release);
+	return count;
+}
+
+// Wait for the publisher heartbeat to move, false if it stays still for the heartbeat timeout.
+static bool WaitPublisherHeartbeat(const StreamHeader &header) {
+	const uint32_t heartbeat = header.heartbeat.load(std::memory_order_acquire);
+	const hg::time_ns t_start = hg::time_now();
+
+	while (header.heartbeat.load(std::memory_order_acquire) == heartbeat) {
+		if (hg::time_now() - t_start > heartbeat_timeout)
+			return false;
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	return true;
+}
+
+// Attach to a live publisher: the header is only read once its magic is published and stale segments are skipped.
+// Returns nullptr if the stream is incompatible.
+static StreamHeader *AttachStream(SharedMemory &shm) {
+	bool stale_reported = false;
+
+	for (;; std::this_thread::sleep_for(std::chrono::milliseconds(500))) {
+		if (!OpenSharedMemory(shm, stream_name, GetSharedMemorySize(), false))
+			continue;
+
+		StreamHeader &header = *reinterpret_cast<StreamHeader *>(shm.data);
+
+		const hg::time_ns t_start = hg::time_now();
+		while (header.magic.load(std::memory_order_acquire) != stream_magic && hg::time_now() - t_start < heartbeat_timeout)
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+		if (header.magic.load(std::memory_order_acquire) == stream_magic) {
+			if (header.version != StreamHeader().version || header.capacity != stream_capacity) {
+				CloseSharedMemory(shm, stream_name);
+				return nullptr;
+			}
+
+			if (WaitPublisherHeartbeat(header))
+				return &header;
+		}
+
+		if (!stale_reported) {
+			hg::warn("Stale transform stream, waiting for a new publisher...");
+			stale_reported = true;
+		}
+		CloseSharedMemory(shm, stream_name);
+	}
+}
+
+// Headless observer process.
+static int RunReader() {
+	SharedMemory shm;
+
+	hg::log("Waiting for the publisher...");
+	StreamHeader *attached = AttachStream(shm);
+	if (!attached) {
+		hg::error("Incompatible transform stream.");
+		return EXIT_FAILURE;
+	}
+
+	StreamHeader &header = *attached;
+
+	TransformStreamReader reader;
+	reader.state.assign(size_t(header.node_count) * component_count, 0);
+
+	// skip the stale records and ask for a keyframe
+	header.read_pos.store(header.write_pos.load(std::memory_order_acquire), std::memory_order_release);
+	header.keyframe_request.store(1, std::memory_order_release);
+	header.reader_attached.store(1, std::memory_order_release);
+
+	hg::log(hg::format("Attached to transform stream, %1 nodes").arg(header.node_count));
+
+	hg::time_ns report_time = hg::time_now(), heartbeat_time = report_time;
+	uint32_t heartbeat = header.heartbeat.load(std::memory_order_acquire);
+	bool publisher_lost = false;
+
+	while (!header.publisher_closed.load(std::memory_order_acquire)) {
+		if (!ConsumeTransforms(header, reader))
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+		const hg::time_ns now = hg::time_now();
+
+		const uint32_t new_heartbeat = header.heartbeat.load(std::memory_order_acquire);
+		if (new_heartbeat != heartbeat) {
+			heartbeat = new_heartbeat;
+			heartbeat_time = now;
+		} else if (now - heartbeat_time > heartbeat_timeout) {
+			publisher_lost = true;
+			break;
+		}
+		if (now - report_time >= hg::time_from_sec(1)) {
+			const float elapsed = hg::time_to_sec_f(now - report_time);
+			const hg::Vec3 node_0 = header.node_count ? hg::GetT(GetNodeWorld(reader, 0)) : hg::Vec3::Zero;
+
+			hg::log(hg::format("%1 frames/s, %2 MB/s, %3 changes/frame, decode %4 ms/frame, %5 missed frames, %6 checksum mismatches - node #0 at %7 %8 %9")
+						.arg(reader.frames / elapsed)
+						.arg(reader.bytes / elapsed / (1024.f * 1024.f))
+						.arg(reader.frames ? reader.changes / reader.frames : 0)
+						.arg(reader.frames ? hg::time_to_ms_f(reader.decode_time) / reader.frames : 0.f)
+						.arg(reader.missed_frames)
+						.arg(reader.checksum_mismatches)
+						.arg(node_0.x)
+						.arg(node_0.y)
+						.arg(node_0.z));
+
+			reader.frames = reader.changes = reader.missed_frames = reader.checksum_mismatches = 0;
+			reader.bytes = 0;
+			reader.decode_time = 0;
+			report_time = now;
+		}
+	}
+
+	header.reader_attached.store(0, std::memory_order_release);
+	CloseSharedMemory(shm, stream_name);
+
+	if (publisher_lost) {
+		hg::error("Publisher stopped responding.");
+		return EXIT_FAILURE;
+	}
+
+	hg::log("Publisher closed the stream.");
+	return EXIT_SUCCESS;
+}
+
+int main(int narg, const char **args) {
+	if (narg > 1 && strcmp(args[1], "-reader") == 0)
+		return RunReader();
+
+	// create window.
+	hg::InputInit();
+	hg::WindowSystemInit();
+
+	int res_x = 1280, res_y = 720;
+
+	hg::Window *window = hg::RenderInit("Harfang - Transform Stream", res_x, res_y, BGFX_RESET_VSYNC | BGFX_RESET_MSAA_X4);
+	if (!window) {
+		hg::error("failed to create window.");
+		return EXIT_FAILURE;
+	}
+
+	hg::AddAssetsFolder("resources_compiled");
+
+	// create forward pipeline and resources.
+	hg::ForwardPipeline pipeline = hg::CreateForwardPipeline();
+	hg::PipelineResources resources = hg::PipelineResources();
+
+	bgfx::VertexLayout vtx_layout = hg::VertexLayoutPosFloatNormUInt8();
+
+	hg::ModelRef sphere_ref = resources.models.Add("sphere", hg::CreateSphereModel(vtx_layout, 0.03f, 4, 8));
+	hg::ModelRef ground_ref = resources.models.Add("ground", hg::CreateCubeModel(vtx_layout, 60.f, 0.001f, 60.f));
+
+	hg::PipelineProgramRef prg = hg::LoadPipelineProgramRefFromAssets("core/shader/default.hps", resources, hg::GetForwardPipelineInfo());
+
+	hg::Material sphere_mat = hg::CreateMaterial(prg, "uDiffuseColor", hg::Vec4(1, 0, 0), "uSpecularColor", hg::Vec4(1, 0.8f, 0));
+	hg::Material ground_mat = hg::CreateMaterial(prg, "uDiffuseColor", hg::Vec4(1, 1, 1), "uSpecularColor", hg::Vec4(1, 1, 1));
+
+	// setup scene, camera and light.
+	hg::Scene scene;
+	scene.canvas.color = hg::Color(0.1f, 0.1f, 0.1f);
+	scene.environment.ambient = hg::Color(0.1f, 0.1f, 0.1f);
+
+	hg::Node camera = hg::CreateCamera(scene, hg::TransformationMat4(hg::Vec3(15.5f, 5, -6), hg::Vec3(0.4f, -1.2f, 0)), 0.01f, 100);
+	scene.SetCurrentCamera(camera);
+
+	hg::CreateSpotLight(scene, hg::TransformationMat4(hg::Vec3(-8.8f, 21.7f, -8.8f), hg::Deg3(60, 45, 0)), 0, hg::Deg(5.f), hg::Deg(30.f), hg::Color::White, hg::Color::White, 0, hg::LST_Map, 0.000005f);
+	hg::CreateObject(scene, hg::TranslationMat4(hg::Vec3(0, 0, 0)), ground_ref, {ground_mat});
+
+	// create 317 by 317 spheres (100489 nodes).
+	const int count = 317;
+
+	std::vector<hg::Transform> transforms;
+	transforms.reserve(count * count);
+	for (int j = 0; j < count; j++)
+		for (int i = 0; i < count; i++) {
+			const hg::Vec3 position = hg::Vec3(((2.f * i) / count - 1.f) * 10.f, 0.1f, ((2.f * j) / count - 1.f) * 10.f);
+			transforms.push_back(hg::CreateObject(scene, hg::TranslationMat4(position), sphere_ref, {sphere_mat}).GetTransform());
+		}
+
+	// create the shared memory stream.
+	SharedMemory shm;
+	if (!OpenSharedMemory(shm, stream_name, GetSharedMemorySize(), true)) {
+		hg::error("failed to create the shared memory transform stream.");
+		return EXIT_FAILURE;
+	}
+
+	// readers ignore the header until its magic is published
+	StreamHeader &header = *new (shm.data) StreamHeader;
+	header.node_count = uint32_t(transforms.size());
+	header.magic.store(stream_magic, std::memory_order_release);
+
+	TransformStreamWriter writer;
+	InitTransformStreamWriter(writer, transforms.size());
+
+	// text rendering
+	hg::Font font = hg::LoadFontFromAssets("font/default.ttf", 16);
+	bgfx::ProgramHandle font_program = hg::LoadProgramFromAssets("core/shader/font");
+
+	std::vector<hg::UniformSetValue> text_uniform_values = {hg::MakeUniformSetValue("u_color", hg::Vec4(1.f, 1.f, 0.5f))};
+	hg::RenderState text_render_state = hg::ComputeRenderState(hg::BM_Alpha, hg::DT_Always, hg::FC_Disabled);
+
+	// main loop.
+	float angle = 0.f, moving_rows = 1.f;
+	bool draw_scene = true;
+
+	hg::iRect viewport = hg::MakeRectFromWidthHeight(0, 0, res_x, res_y);
+	hg::SceneForwardPipelinePassViewId views;
+
+	hg::Keyboard keyboard;
+	while (!keyboard.Pressed(hg::K_Escape) && hg::IsWindowOpen(window)) {
+		keyboard.Update();
+
+		if (keyboard.Pressed(hg::K_V))
+			draw_scene = !draw_scene;
+		if (keyboard.Pressed(hg::K_M))
+			moving_rows = moving_rows == 1.f ? 0.1f : 1.f;
+
+		hg::time_ns dt = hg::tick_clock();
+
+		// move the spheres vertically in a wave pattern, optionally on a fraction of the rows only.
+		angle += hg::time_to_sec_f(dt);
+
+		const int row_count = int(count * moving_rows);
+		for (int j = 0; j < row_count; j++) {
+			const float row_y = cos(angle + j * 0.1f);
+			for (int i = 0; i < count; i++) {
+				hg::Transform &trs = transforms[i + j * count];
+				hg::Vec3 pos = trs.GetPos();
+				pos.y = 0.1f * (row_y * sin(angle + i * 0.1f) * 6.f + 6.5f);
+				trs.SetPos(pos);
+			}
+		}
+
+		PublishTransforms(header, transforms, writer);
+		header.heartbeat.fetch_add(1, std::memory_order_release);
+
+		// update scene and send it to the forward rendering pipeline.
+		scene.Update(dt);
+
+		bgfx::ViewId view_id = 0;
+		if (draw_scene)
+			hg::SubmitSceneToPipeline(view_id, scene, viewport, 1.f, pipeline, resources, views);
+
+		// stream report
+		hg::SetView2D(view_id, 0, 0, res_x, res_y, -1, 1, draw_scene ? BGFX_CLEAR_DEPTH : BGFX_CLEAR_COLOR | BGFX_CLEAR_DEPTH, scene.canvas.color, 1, 0);
+
+		const float bytes_per_node = writer.change_count ? float(writer.record_size - sizeof(FrameRecordHeader)) / writer.change_count : 0.f;
+		const float throughput = writer.encode_ms > 0.f ? transforms.size() / writer.encode_ms / 1000.f : 0.f;
+
+		std::string report;
+		if (header.reader_attached)
+			report = hg::format("%1 nodes, %2 changed - %3 KB/frame (%4 bytes/node), encode %5 ms (%6 M nodes/s scanned), %7 dropped frames")
+						 .arg(int(transforms.size()))
+						 .arg(writer.change_count)
+						 .arg(writer.record_size / 1024.f)
+						 .arg(bytes_per_node)
+						 .arg(writer.encode_ms)
+						 .arg(throughput)
+						 .arg(writer.dropped_frames);
+		else
+			report = hg::format("%1 nodes - waiting for a reader (run with -reader)").arg(int(transforms.size()));
+
+		hg::DrawText(view_id, font, report, font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20, res_y - 40, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+		hg::DrawText(view_id, font, hg::format("V: draw scene (%1), M: moving rows (%2)").arg(draw_scene ? "on" : "off").arg(moving_rows == 1.f ? "all" : "10 percent"), font_program, "u_tex", 0,
+			hg::Mat4::Identity, hg::Vec3(20, res_y - 64, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+
+		bgfx::frame();
+		hg::UpdateWindow(window);
+	}
+
+	header.publisher_closed.store(1, std::memory_order_release);
+	CloseSharedMemory(shm, stream_name);
+
+	hg::RenderShutdown();
+	hg::DestroyWindow(window);
+
+	hg::WindowSystemShutdown();
+	hg::InputShutdown();
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,29 @@
+// HARFANG(R) Copyright (C) 2022 NWNC HARFANG. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+#pragma once
+
+#include <vector>
+
+#include <foundation/math.h>
+
+#include <engine/geometry.h>
+
+// Source resources folder, set by the build to the resources folder of the source tree. Only the compiled resources
+// are installed, samples working on source geometries read them from there.
+#ifndef HG_RESOURCES_SOURCE_DIR
+#define HG_RESOURCES_SOURCE_DIR "resources"
+#endif
+
+// Per polygon corner normals of a geometry, geometries exported without normals get smooth normals computed from their
+// faces. The returned vector is either the geometry normals or the computed storage.
+inline const std::vector<hg::Vec3> &GetCornerNormals(const hg::Geometry &geo, std::vector<hg::Vec3> &computed) {
+	size_t corner_count = 0;
+	for (const auto &pol : geo.pol)
+		corner_count += pol.vtx_count;
+
+	if (geo.normal.size() >= corner_count)
+		return geo.normal;
+
+	computed = hg::ComputeVertexNormal(geo, hg::ComputeFaceNormal(geo), hg::Deg(45.f));
+	return computed;
+}
@@ -0,0 +1,363 @@
+// HARFANG(R) Copyright (C) 2022 NWNC HARFANG. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+// Cached text labels: each distinct string is laid out and rendered once to a label atlas, all visible labels are then
+// drawn from the atlas with a single batched draw call per view.
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <foundation/clock.h>
+#include <foundation/format.h>
+#include <foundation/log.h>
+#include <foundation/math.h>
+#include <foundation/rand.h>
+
+#include <platform/input_system.h>
+#include <platform/window_system.h>
+
+#include <engine/assets.h>
+#include <engine/font.h>
+#include <engine/render_pipeline.h>
+
+// Shelf packer: rectangles are placed left to right on horizontal shelves as tall as the tallest rectangle they hold.
+class ShelfPacker {
+public:
+	explicit ShelfPacker(int size) : size(size) {}
+
+	bool Pack(int w, int h, int &x, int &y) {
+		if (w > size)
+			return false;
+
+		if (shelf_x + w > size) { // open a new shelf
+			shelf_y += shelf_h;
+			shelf_x = shelf_h = 0;
+		}
+
+		if (shelf_y + h > size)
+			return false;
+
+		x = shelf_x;
+		y = shelf_y;
+
+		shelf_x += w;
+		shelf_h = std::max(shelf_h, h);
+		return true;
+	}
+
+	void Reset() { shelf_x = shelf_y = shelf_h = 0; }
+
+private:
+	int size, shelf_x = 0, shelf_y = 0, shelf_h = 0;
+};
+
+// Label cache for a font, keyed by text. New labels are queued and rendered to the atlas in a dedicated view before the
+// views that draw them, the atlas is flushed and refilled with the labels in use when it runs out of space. Labels that
+// still do not fit are drawn directly with DrawText until a later flush makes room for them.
+class TextLabelCache {
+public:
+	TextLabelCache(const hg::Font &font, bgfx::ProgramHandle font_program, int atlas_size = 2048)
+		: font(&font), font_program(font_program), atlas_size(atlas_size), packer(atlas_size), batch_vtx(MakeBatchLayout(), 4096) {
+		atlas = hg::CreateFrameBuffer(atlas_size, atlas_size, bgfx::TextureFormat::RGBA8, bgfx::TextureFormat::D24, 1, "text_label_atlas");
+		atlas_texture = hg::GetColorTexture(atlas);
+
+		// glyphs are written as is to the cleared atlas, blending happens when the labels are drawn
+		atlas_render_state = hg::ComputeRenderState(hg::BM_Opaque, hg::DT_Always, hg::FC_Disabled);
+		atlas_values = {hg::MakeUniformSetValue("u_color", hg::Vec4::One)};
+		uncached_values = {hg::MakeUniformSetValue("u_color", hg::Vec4::One)};
+
+		batch_program = hg::LoadProgramFromAssets("shaders/texture");
+		batch_render_state = hg::ComputeRenderState(hg::BM_Alpha, hg::DT_Always, hg::FC_Disabled);
+		batch_values = {hg::MakeUniformSetValue("color", hg::Vec4::One)};
+		batch_textures = {hg::MakeUniformSetTexture("s_tex", atlas_texture, 0)};
+
+		origin_bottom_left = bgfx::getCaps()->originBottomLeft;
+	}
+
+	~TextLabelCache() { hg::DestroyFrameBuffer(atlas); }
+
+	// the cache owns its atlas frame buffer
+	TextLabelCache(const TextLabelCache &) = delete;
+	TextLabelCache &operator=(const TextLabelCache &) = delete;
+
+	// Queue a label for the current batch, its layout and atlas slot are reused as long as the text does not change.
+	void Add(const std::string &text, const hg::Vec3 &pos, hg::DrawTextHAlign halign = hg::DTHA_Left, hg::DrawTextVAlign valign = hg::DTVA_Top) {
+		if (instances.size() >= max_instances)
+			return; // 16 bit indices
+
+		Label *label = GetLabel(text);
+		if (!label)
+			return;
+
+		label->last_used_frame = frame;
+
+		hg::Vec3 p = pos;
+		if (halign == hg::DTHA_Center)
+			p.x -= float(label->w) * 0.5f;
+		else if (halign == hg::DTHA_Right)
+			p.x -= float(label->w);
+		if (valign == hg::DTVA_Center)
+			p.y -= float(label->h) * 0.5f;
+		else if (valign == hg::DTVA_Bottom)
+			p.y -= float(label->h);
+
+		instances.push_back({label, p});
+	}
+
+	// Render the labels added since the last call to the atlas view then draw the whole batch in a single call.
+	void Submit(bgfx::ViewId atlas_view_id, bgfx::ViewId view_id, const hg::Color &color) {
+		if (!pending.empty()) {
+			hg::SetView2D(atlas_view_id, 0, 0, atlas_size, atlas_size, -1, 1, clear_atlas ? BGFX_CLEAR_COLOR : 0, hg::Color::Zero, 1, 0);
+			bgfx::setViewFrameBuffer(atlas_view_id, atlas.handle);
+
+			for (auto label : pending)
+				hg::DrawText(atlas_view_id, *font, label->text, font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(float(label->x) - label->rect_sx, float(label->y) - label->rect_sy, 0.f),
+					hg::DTHA_Left, hg::DTVA_Top, atlas_values, {}, atlas_render_state);
+
+			laid_out_count += pending.size();
+			pending.clear();
+			clear_atlas = false;
+		}
+
+		// quads are built once all labels are known since an atlas flush moves the labels already added
+		batch_vtx.Clear();
+		batch_idx.clear();
+
+		uncached_values[0].value = {color.r, color.g, color.b, color.a};
+		uncached_count = 0;
+
+		for (const auto &instance : instances) {
+			const Label &label = *instance.label;
+			const hg::Vec3 &p = instance.pos;
+
+			if (!label.in_atlas) { // no room left in the atlas
+				hg::DrawText(view_id, *font, label.text, font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(p.x - label.rect_sx, p.y - label.rect_sy, p.z), hg::DTHA_Left, hg::DTVA_Top,
+					uncached_values, {}, batch_render_state);
+				++uncached_count;
+				continue;
+			}
+
+			const float u0 = float(label.x) / atlas_size, u1 = float(label.x + label.w) / atlas_size;
+			float v0 = float(label.y) / atlas_size, v1 = float(label.y + label.h) / atlas_size;
+			if (origin_bottom_left) {
+				v0 = 1.f - v0;
+				v1 = 1.f - v1;
+			}
+
+			const size_t i = batch_idx.size() / 6 * 4;
+			batch_vtx.Begin(i + 0).SetPos(p).SetTexCoord0(hg::Vec2(u0, v0)).End();
+			batch_vtx.Begin(i + 1).SetPos(hg::Vec3(p.x + label.w, p.y, p.z)).SetTexCoord0(hg::Vec2(u1, v0)).End();
+			batch_vtx.Begin(i + 2).SetPos(hg::Vec3(p.x + label.w, p.y + label.h, p.z)).SetTexCoord0(hg::Vec2(u1, v1)).End();
+			batch_vtx.Begin(i + 3).SetPos(hg::Vec3(p.x, p.y + label.h, p.z)).SetTexCoord0(hg::Vec2(u0, v1)).End();
+
+			const uint16_t b = uint16_t(i);
+			batch_idx.insert(batch_idx.end(), {b, uint16_t(b + 1), uint16_t(b + 2), b, uint16_t(b + 2), uint16_t(b + 3)});
+		}
+
+		if (!batch_idx.empty()) {
+			batch_values[0].value = {color.r, color.g, color.b, color.a};
+			hg::DrawTriangles(view_id, batch_idx, batch_vtx, batch_program, batch_values, batch_textures, batch_render_state);
+		}
+
+		instances.clear();
+		++frame;
+	}
+
+	size_t GetLabelCount() const { return labels.size(); }
+	size_t GetLaidOutCount() const { return laid_out_count; }
+	size_t GetFlushCount() const { return flush_count; }
+	size_t GetUncachedCount() const { return uncached_count; }
+
+private:
+	struct Label {
+		std::string text;
+		int x, y, w, h;
+		float rect_sx, rect_sy;
+		int last_used_frame;
+		bool in_atlas;
+	};
+
+	struct Instance {
+		Label *label;
+		hg::Vec3 pos;
+	};
+
+	static const size_t max_instances = 65536 / 4;
+
+	static bgfx::VertexLayout MakeBatchLayout() {
+		bgfx::VertexLayout layout;
+		layout.begin().add(bgfx::Attrib::Position, 3, bgfx::AttribType::Float).add(bgfx::Attrib::TexCoord0, 2, bgfx::AttribType::Float).end();
+		return layout;
+	}
+
+	Label *GetLabel(const std::string &text) {
+		auto i = labels.find(text);
+		if (i != labels.end())
+			return &i->second;
+
+		const hg::fRect rect = hg::ComputeTextRect(*font, text);
+		const int w = int(std::ceil(rect.ex - rect.sx)) + 2, h = int(std::ceil(rect.ey - rect.sy)) + 2; // 1 pixel border to avoid bleeding
+
+		int x = 0, y = 0;
+		bool in_atlas = packer.Pack(w, h, x, y);
+		if (!in_atlas) {
+			Flush();
+			in_atlas = packer.Pack(w, h, x, y);
+			if (!in_atlas)
+				hg::warn(hg::format("Label '%1' does not fit the text label atlas, drawing it uncached").arg(text));
+		}
+
+		Label &label = labels[text];
+		label = {text, x, y, w, h, rect.sx - 1.f, rect.sy - 1.f, frame, in_atlas};
+		if (in_atlas)
+			pending.push_back(&label);
+		return &label;
+	}
+
+	// Drop the labels not used this frame and repack the others, they are all rendered again on the next submit. Labels
+	// that do not fit anymore stay in the cache and are drawn uncached.
+	void Flush() {
+		for (auto i = labels.begin(); i != labels.end();)
+			if (i->second.last_used_frame != frame)
+				i = labels.erase(i);
+			else
+				++i;
+
+		packer.Reset();
+		pending.clear();
+
+		for (auto &i : labels) {
+			Label &label = i.second;
+			label.in_atlas = packer.Pack(label.w, label.h, label.x, label.y);
+			if (label.in_atlas)
+				pending.push_back(&label);
+		}
+
+		clear_atlas = true;
+		++flush_count;
+	}
+
+	const hg::Font *font;
+	bgfx::ProgramHandle font_program;
+
+	int atlas_size;
+	ShelfPacker packer;
+	hg::FrameBuffer atlas;
+	hg::Texture atlas_texture;
+	hg::RenderState atlas_render_state;
+	std::vector<hg::UniformSetValue> atlas_values, uncached_values;
+	bool clear_atlas = true, origin_bottom_left = false;
+
+	std::unordered_map<std::string, Label> labels;
+	std::vector<Label *> pending;
+
+	std::vector<Instance> instances;
+
+	hg::Vertices batch_vtx;
+	hg::Indices batch_idx;
+	bgfx::ProgramHandle batch_program;
+	hg::RenderState batch_render_state;
+	std::vector<hg::UniformSetValue> batch_values;
+	std::vector<hg::UniformSetTexture> batch_textures;
+
+	int frame = 0;
+	size_t laid_out_count = 0, flush_count = 0, uncached_count = 0;
+};
+
+int main() {
+	hg::InputInit();
+	hg::WindowSystemInit();
+
+	int res_x = 1280, res_y = 720;
+
+	hg::Window *window = hg::RenderInit("Harfang - Text Label Cache", res_x, res_y, BGFX_RESET_VSYNC);
+	if (!window) {
+		hg::error("failed to create window.");
+		return EXIT_FAILURE;
+	}
+
+	// access compiled resources
+	hg::AddAssetsFolder("resources_compiled");
+
+	// text rendering
+	hg::Font font = hg::LoadFontFromAssets("font/default.ttf", 16);
+	bgfx::ProgramHandle font_program = hg::LoadProgramFromAssets("core/shader/font");
+
+	std::vector<hg::UniformSetValue> text_uniform_values = {hg::MakeUniformSetValue("u_color", hg::Vec4(1.f, 1.f, 0.5f))};
+	hg::RenderState text_render_state = hg::ComputeRenderState(hg::BM_Alpha, hg::DT_Always, hg::FC_Disabled);
+
+	TextLabelCache label_cache(font, font_program);
+
+	// a HUD of 20x24 labels, a few of them change every frame
+	const int label_cols = 20, label_rows = 24;
+
+	std::vector<int> values(label_cols * label_rows);
+	for (auto &v : values)
+		v = hg::Rand(1000);
+
+	bool use_cache = true;
+	hg::time_ns hud_time = 0;
+
+	hg::Keyboard keyboard;
+
+	while (!keyboard.Down(hg::K_Escape) && hg::IsWindowOpen(window)) {
+		hg::tick_clock();
+
+		keyboard.Update();
+
+		if (keyboard.Pressed(hg::K_Space))
+			use_cache = !use_cache;
+
+		for (int i = 0; i < 8; ++i)
+			values[hg::Rand(uint32_t(values.size()))] = hg::Rand(1000);
+
+		// the label atlas view must come before the HUD view
+		const bgfx::ViewId atlas_view_id = 0, hud_view_id = 1;
+		hg::SetView2D(hud_view_id, 0, 0, res_x, res_y, -1, 1, BGFX_CLEAR_COLOR | BGFX_CLEAR_DEPTH, hg::Color(0.1f, 0.1f, 0.1f), 1, 0);
+
+		const hg::time_ns hud_start = hg::time_now();
+
+		for (int j = 0; j < label_rows; ++j)
+			for (int i = 0; i < label_cols; ++i) {
+				const std::string text = hg::format("#%1: %2").arg(j * label_cols + i).arg(values[j * label_cols + i]);
+				const hg::Vec3 pos(20.f + float(i) * 62.f, 20.f + float(j) * 24.f, 0.f);
+
+				if (use_cache)
+					label_cache.Add(text, pos);
+				else
+					hg::DrawText(hud_view_id, font, text, font_program, "u_tex", 0, hg::Mat4::Identity, pos, hg::DTHA_Left, hg::DTVA_Top, text_uniform_values, {}, text_render_state);
+			}
+
+		if (use_cache)
+			label_cache.Submit(atlas_view_id, hud_view_id, hg::Color(1.f, 1.f, 0.5f));
+
+		hud_time = hg::time_now() - hud_start;
+
+		const bgfx::Stats *stats = bgfx::getStats();
+		const std::string info = hg::format("%1 - HUD submit %2 ms, %3 draw calls - %4 cached labels, %5 laid out, %6 atlas flushes, %7 uncached")
+									 .arg(use_cache ? "Cached labels" : "DrawText per label")
+									 .arg(hg::time_to_ms_f(hud_time))
+									 .arg(stats->numDraw)
+									 .arg(label_cache.GetLabelCount())
+									 .arg(label_cache.GetLaidOutCount())
+									 .arg(label_cache.GetFlushCount())
+									 .arg(label_cache.GetUncachedCount());
+
+		hg::DrawText(hud_view_id, font, info, font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20, res_y - 40, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {}, text_render_state);
+		hg::DrawText(hud_view_id, font, "Space: toggle label cache", font_program, "u_tex", 0, hg::Mat4::Identity, hg::Vec3(20, res_y - 64, 0), hg::DTHA_Left, hg::DTVA_Bottom, text_uniform_values, {},
+			text_render_state);
+
+		bgfx::frame();
+		hg::UpdateWindow(window);
+	}
+
+	hg::RenderShutdown();
+	hg::DestroyWindow(window);
+
+	hg::WindowSystemShutdown();
+	hg::InputShutdown();
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,98 @@
+// HARFANG(R) Copyright (C) 2022 NWNC HARFANG. Released under GPL/LGPL/Commercial Licence, see licence.txt for details.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Fixed pool of worker threads, the calling thread takes part in the work.
+class WorkerPool {
+public:
+	using Job = std::function<void(size_t begin, size_t end)>;
+
+	explicit WorkerPool(int thread_count) {
+		for (int i = 1; i < thread_count; ++i)
+			workers.emplace_back([this]() { WorkerMain(); });
+	}
+
+	~WorkerPool() {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		wake.notify_all();
+		for (auto &worker : workers)
+			worker.join();
+	}
+
+	int GetThreadCount() const { return int(workers.size()) + 1; }
+
+	// Run the job over [0, count) in chunks, returns once every chunk was processed.
+	void Run(size_t count, size_t chunk, const Job &fn) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			job = &fn;
+			job_count = count;
+			job_chunk = std::max<size_t>(chunk, 1);
+			next = 0;
+			busy = workers.size();
+			++generation;
+		}
+		wake.notify_all();
+
+		Work();
+
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [this]() { return busy == 0; });
+		job = nullptr;
+	}
+
+private:
+	void WorkerMain() {
+		uint64_t seen = 0;
+		for (;;) {
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&]() { return quit || generation != seen; });
+				if (quit)
+					return;
+				seen = generation;
+			}
+
+			Work();
+
+			std::lock_guard<std::mutex> lock(mutex);
+			if (--busy == 0)
+				done.notify_one();
+		}
+	}
+
+	void Work() {
+		for (;;) {
+			const size_t begin = next.fetch_add(job_chunk);
+			if (begin >= job_count)
+				break;
+			(*job)(begin, std::min(begin + job_chunk, job_count));
+		}
+	}
+
+	std::vector<std::thread> workers;
+
+	std::mutex mutex;
+	std::condition_variable wake, done;
+	bool quit = false;
+	uint64_t generation = 0;
+	size_t busy = 0;
+
+	const Job *job = nullptr;
+	size_t job_count = 0, job_chunk = 1;
+	std::atomic<size_t> next{0};
+};
+